@@ -5,6 +5,7 @@
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <shellapi.h>   // NOTIFYICONDATAW
 
 #if defined(__cplusplus)
 extern "C" {
@@ -42,6 +43,12 @@ extern "C" {
 // User defined timer ids
 #define MNI_USER_TIMER_ID       (1000)
 
+// Icons attached to a host share its window, internal timer ids must be below this value.
+#define MNI_HOSTED_TIMER_ID_LIMIT (0x00FFFFFF)
+
+// Notify icon callback message id (for custom backends)
+#define MNI_NOTIFYICON_MESSAGE_ID (WM_USER + 0)
+
 // Null guid
 #define MNI_GUID_NULL ((GUID){0x00000000L, 0x0000, 0x0000, {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}})
 
@@ -50,6 +57,16 @@ typedef int MniBool;
 
 // Forward declaration.
 struct ModernNotifyIcon;
+struct MniShellWorker;
+struct MniCommandQueue;
+struct MniTrayThread;
+struct MniTimerWheel;
+struct MniAnimation;
+struct MniIconCache;
+struct MniIconLoader;
+struct MniNotificationQueue;
+struct MniOverlay;
+struct MniGraph;
 
 // MniError
 typedef enum MniError {
@@ -59,6 +76,10 @@ typedef enum MniError {
     MNI_ICON_ALREADY_CREATED                = 2,
     MNI_ICON_ALREADY_SHOWN                  = 3,
     MNI_ICON_ALREADY_HIDDEN                 = 4,
+    MNI_SHELL_WORKER_ALREADY_RUNNING        = 5,
+    MNI_SHELL_WORKER_NOT_RUNNING            = 6,
+    MNI_NOTIFICATION_DEDUPLICATED           = 7,
+    MNI_COMMANDS_DROPPED                    = 8,
 
     // Error codes:
     MNI_ERROR_MNI_PTR_IS_NULL               = -1,
@@ -91,6 +112,36 @@ typedef enum MniError {
     MNI_ERROR_FAILED_TO_CONVERT_TEXT        = -28,
     MNI_ERROR_FAILED_TO_SEND_MESSAGE        = -29,
     MNI_ERROR_FAILED_TO_POST_MESSAGE        = -30,
+    MNI_ERROR_FAILED_TO_UPDATE_ICON         = -31,
+    MNI_ERROR_UPDATE_NOT_STARTED            = -32,
+    MNI_ERROR_FAILED_TO_START_THREAD        = -33,
+    MNI_ERROR_OUT_OF_MEMORY                 = -34,
+    MNI_ERROR_QUEUE_FULL                    = -35,
+    MNI_ERROR_QUEUE_NOT_CREATED             = -36,
+    MNI_ERROR_THREAD_NOT_RUNNING            = -37,
+    MNI_ERROR_INVALID_HOST                  = -38,
+    MNI_ERROR_INVALID_MESSAGE_RANGE         = -39,
+    MNI_ERROR_INVALID_ANIMATION             = -40,
+    MNI_ERROR_INVALID_ICON_SOURCE           = -41,
+    MNI_ERROR_FAILED_TO_LOAD_ICON           = -42,
+    MNI_ERROR_INVALID_PIXELS                = -43,
+    MNI_ERROR_INVALID_ICON_POOL_BUDGET      = -44,
+    MNI_ERROR_INVALID_ICON_POOL_STATS       = -45,
+    MNI_ERROR_INVALID_ICON_UPDATE_STATS     = -46,
+    MNI_ERROR_INVALID_BADGE                 = -47,
+    MNI_ERROR_INVALID_PROGRESS              = -48,
+    MNI_ERROR_FAILED_TO_RENDER_OVERLAY      = -49,
+    MNI_ERROR_INVALID_GRAPH                 = -50,
+    MNI_ERROR_FAILED_TO_RENDER_GRAPH        = -51,
+    MNI_ERROR_GRAPH_NOT_STARTED             = -52,
+    MNI_ERROR_INVALID_TEXT                  = -53,
+    MNI_ERROR_FAILED_TO_RENDER_TEXT         = -54,
+    MNI_ERROR_FAILED_TO_OPEN_ICON_PACK      = -55,
+    MNI_ERROR_INVALID_ICON_PACK             = -56,
+    MNI_ERROR_ICON_NOT_IN_PACK              = -57,
+    MNI_ERROR_FAILED_TO_DECODE_ICON         = -58,
+    MNI_ERROR_NOTIFICATION_QUEUE_NOT_CREATED = -59,
+    MNI_ERROR_FAILED_TO_OPEN_JOURNAL        = -60,
 } MniError;
 
 // MniBalloonFlags
@@ -110,12 +161,114 @@ typedef enum MniBalloonIconType {
     MNI_BALLOON_ICON_TYPE_CUSTOM            = 4,
 } MniBalloonIconType;
 
+// MniNotificationPriority
+// Higher priority is shown first, urgent notifications are never coalesced.
+typedef enum MniNotificationPriority {
+    MNI_NOTIFICATION_PRIORITY_LOW           = 0,
+    MNI_NOTIFICATION_PRIORITY_NORMAL        = 1,
+    MNI_NOTIFICATION_PRIORITY_HIGH          = 2,
+    MNI_NOTIFICATION_PRIORITY_URGENT        = 3,
+} MniNotificationPriority;
+
+// MniNotificationQueueInfo
+// Zero rate, dedup_window or coalesce_threshold turns that feature off.
+typedef struct MniNotificationQueueInfo {
+    int                         capacity;           // pending notifications, 0 means default
+    UINT                        rate;               // balloons per minute
+    UINT                        burst;              // balloons shown at once before rate applies
+    UINT                        dedup_window;       // ms, same title and text within it is dropped
+    UINT                        coalesce_threshold; // pending count shown as one summary balloon
+    const wchar_t               *summary_title;     // NULL keeps title of most important one
+    const wchar_t               *summary_text;      // %d is replaced by count
+    const wchar_t               *journal_file;      // NULL keeps notifications in memory only
+} MniNotificationQueueInfo;
+
+// MniNotificationQueueStats
+typedef struct MniNotificationQueueStats {
+    UINT64                      posted;
+    UINT64                      shown;              // balloons, summary counts once
+    UINT64                      deduplicated;
+    UINT64                      coalesced;          // notifications folded into summaries
+    UINT64                      dropped;            // queued ones pushed out by more important
+    UINT64                      rejected;           // posts refused with MNI_ERROR_QUEUE_FULL
+    UINT64                      replayed;           // undelivered ones loaded from journal
+    int                         pending;
+} MniNotificationQueueStats;
+
 // MniTipType
 typedef enum MniTipType {
     MNI_TIP_TYPE_STANDARD                   = 0,
     MNI_TIP_TYPE_RICH_POPUP                 = 1,
 } MniTipType;
 
+// MniTimerMode
+typedef enum MniTimerMode {
+    MNI_TIMER_MODE_DEFAULT                  = 0,    // WM_TIMER, 10ms ticks
+    MNI_TIMER_MODE_HIGH_RESOLUTION          = 1,    // waitable timer, 1ms ticks
+} MniTimerMode;
+
+// MniTimerStats
+// Lateness of the OS timer driving user timers, in microseconds.
+typedef struct MniTimerStats {
+    UINT64      samples;
+    LONGLONG    last;
+    LONGLONG    min;
+    LONGLONG    max;
+    LONGLONG    mean;
+    LONGLONG    stddev;
+} MniTimerStats;
+
+// MniIconSource
+// Where icon variants for each dpi come from. First set member of load, resource_name
+// and file_name is used. size is small icon size at given dpi.
+typedef HICON (*MniIconSourceLoadFn)(void *context, int size, int dpi);
+
+typedef struct MniIconSource {
+    MniIconSourceLoadFn         load;               // called from thread pool too
+    void                        *context;
+    HINSTANCE                   module_handle;
+    const wchar_t               *resource_name;     // name or MAKEINTRESOURCEW
+    const wchar_t               *file_name;         // .ico file
+} MniIconSource;
+
+// MniPixelFormat
+// Byte order of 32-bit pixels with straight (not premultiplied) alpha.
+typedef enum MniPixelFormat {
+    MNI_PIXEL_FORMAT_RGBA = 0,
+    MNI_PIXEL_FORMAT_BGRA = 1,
+} MniPixelFormat;
+
+// MniIconUpdateStats
+// Icon updates sent to the shell and those skipped because content didn't change.
+typedef struct MniIconUpdateStats {
+    UINT64                      pushed;
+    UINT64                      suppressed;
+} MniIconUpdateStats;
+
+// MniIconPoolStats
+// Pool is shared by the whole process. icons includes icons in use, which are never
+// evicted, so it may be above budget.
+#define MNI_ICON_POOL_DEFAULT_BUDGET    (128)
+
+typedef struct MniIconPoolStats {
+    int                         budget;
+    int                         icons;
+    int                         idle_icons;
+    UINT64                      hits;
+    UINT64                      misses;
+    UINT64                      evictions;
+} MniIconPoolStats;
+
+// MniAnimationStats
+// Frame counters and shell latency of icon update per frame, in microseconds.
+typedef struct MniAnimationStats {
+    UINT64      frames_shown;
+    UINT64      frames_dropped;
+    LONGLONG    latency_last;
+    LONGLONG    latency_max;
+    LONGLONG    latency_mean;
+} MniAnimationStats;
+
 // MniMenuPosition
 typedef enum MniMenuPosition {
     MNI_MENU_POSITION_DEFAULT               = 0,
@@ -140,6 +293,89 @@ typedef struct MniThemeInfo {
     DWORD           BackgroundColor;    // BGR
 } MniThemeInfo;
 
+// MniRecordType
+typedef enum MniRecordType {
+    MNI_RECORD_NOTIFY_ICON                  = 0,
+    MNI_RECORD_CREATE_WINDOW                = 1,
+    MNI_RECORD_DESTROY_WINDOW               = 2,
+    MNI_RECORD_SEND_MESSAGE                 = 3,
+    MNI_RECORD_SET_TIMER                    = 4,
+    MNI_RECORD_KILL_TIMER                   = 5,
+    MNI_RECORD_POST_MESSAGE                 = 6,
+} MniRecordType;
+
+// Backend typedefs.
+typedef BOOL     (*MniBackendNotifyIconFn)  (void *context, DWORD message, NOTIFYICONDATAW *nid);
+typedef MniError (*MniBackendCreateWindowFn)(void *context, HINSTANCE module_handle, const wchar_t *class_name,
+                                             const wchar_t *title, DWORD style, HWND parent, LPVOID param, HWND *window);
+typedef BOOL     (*MniBackendDestroyWindowFn)(void *context, HWND window, HINSTANCE module_handle, const wchar_t *class_name);
+typedef LRESULT  (*MniBackendSendMessageFn) (void *context, HWND window, UINT msg, WPARAM wParam, LPARAM lParam);
+typedef BOOL     (*MniBackendPostMessageFn) (void *context, HWND window, UINT msg, WPARAM wParam, LPARAM lParam);
+typedef UINT_PTR (*MniBackendSetTimerFn)    (void *context, HWND window, UINT_PTR id, UINT interval);
+typedef BOOL     (*MniBackendKillTimerFn)   (void *context, HWND window, UINT_PTR id);
+
+// MniBackend
+// Every shell, window and timer call made by the library goes through this table.
+// Zero initialized backend (or any NULL entry) means Win32 / explorer.exe.
+// create_window registers the class and creates the window, failure of either is reported
+// with MNI_ERROR_FAILED_TO_REGISTER_WNDCLASS or MNI_ERROR_FAILED_TO_CREATE_WINDOW.
+typedef struct MniBackend {
+    void                        *context;
+    MniBackendNotifyIconFn      notify_icon;
+    MniBackendCreateWindowFn    create_window;
+    MniBackendDestroyWindowFn   destroy_window;
+    MniBackendSendMessageFn     send_message;
+    MniBackendPostMessageFn     post_message;
+    MniBackendSetTimerFn        set_timer;
+    MniBackendKillTimerFn       kill_timer;
+} MniBackend;
+
+// MniRecord
+typedef struct MniRecord {
+    MniRecordType   type;
+    HWND            window;
+    DWORD           message;            // NIM_* or WM_*
+    WPARAM          wParam;             // message wParam / timer id
+    LPARAM          lParam;             // message lParam / timer interval
+    NOTIFYICONDATAW nid;                // valid for MNI_RECORD_NOTIFY_ICON
+} MniRecord;
+
+// MniRecorder
+// State of the recording backend. Records are stored in user provided buffer,
+// when it is full, only total_count keeps growing.
+// Posted messages are dispatched immediately on the posting thread.
+typedef struct MniRecorder {
+    MniRecord                   *records;
+    LONG                        capacity;
+    volatile LONG               count;
+    volatile LONG               total_count;
+    MniBool                     fail_notify_icon;
+    struct ModernNotifyIcon     *mni;
+} MniRecorder;
+
+// MniIconPack
+// Memory mapped icon pack made by the mni_pack tool. Pack holds premultiplied frames of
+// named icons at several sizes, frames are turned into icons only when first requested.
+typedef struct MniIconPack {
+    HANDLE                      file;
+    HANDLE                      mapping;
+    const void                  *data;
+    SIZE_T                      size;
+} MniIconPack;
+
+// MniMessageRange
+// Inclusive range of window messages forwarded to on_system_message.
+typedef struct MniMessageRange {
+    UINT    first;
+    UINT    last;
+} MniMessageRange;
+
+#define MNI_MESSAGE(_msg)                   { (_msg), (_msg) }
+#define MNI_MESSAGE_RANGE(_first, _last)    { (_first), (_last) }
+
+// Messages below this value are kept in bitmap, others in sorted range list.
+#define MNI_SYSTEM_MESSAGE_BITMAP_SIZE (WM_USER)
+
 // Callbacks typedefs.
 typedef void (*MniOnWindowCreateFn)         (struct ModernNotifyIcon *mni);
 typedef void (*MniOnWindowDestroyFn)        (struct ModernNotifyIcon *mni);
@@ -169,6 +405,9 @@ typedef void (*MniOnSystemThemeChangeFn)    (struct ModernNotifyIcon *mni, MniTh
 typedef void (*MniOnAppsThemeChangeFn)      (struct ModernNotifyIcon *mni, MniThemeInfo mti);
 typedef void (*MniOnTaskbarCreatedFn)       (struct ModernNotifyIcon *mni);
 typedef void (*MniOnTimerFn)                (struct ModernNotifyIcon *mni, UINT id);
+typedef void (*MniOnTimersFn)               (struct ModernNotifyIcon *mni, const UINT *ids, int count);
+typedef void (*MniOnShellCompleteFn)        (struct ModernNotifyIcon *mni, MniError result, UINT flags);
+typedef void (*MniOnIconLoadFn)             (struct ModernNotifyIcon *mni, MniError result);
 
 typedef void (*MniOnCustomMessageFn)(struct ModernNotifyIcon *mni, UINT msg, WPARAM wParam, LPARAM lParam);
 typedef BOOL (*MniOnSystemMessageFn)(struct ModernNotifyIcon *mni, UINT msg, WPARAM wParam, LPARAM lParam);
@@ -191,6 +430,9 @@ typedef struct MniInfo {
     HWND                        parent_window;
     void                        *user_data1;
     void                        *user_data2;
+    MniBackend                  backend;
+    struct ModernNotifyIcon     *host;              // share window of this icon
+    MniTimerMode                timer_mode;
 
     MniOnWindowCreateFn         on_window_create;
     MniOnWindowDestroyFn        on_window_destroy;
@@ -220,8 +462,11 @@ typedef struct MniInfo {
     MniOnAppsThemeChangeFn      on_apps_theme_change;
     MniOnTaskbarCreatedFn       on_taskbar_created;
     MniOnTimerFn                on_timer;
+    MniOnTimersFn               on_timers;          // all timers expired at once, replaces on_timer
     MniOnCustomMessageFn        on_custom_message;
     MniOnSystemMessageFn        on_system_message;
+    MniOnShellCompleteFn        on_shell_complete;
+    MniOnIconLoadFn             on_icon_load;       // result of MniSetIconFrom*Async
 } MniInfo;
 
 // ModernNotifyIcon
@@ -246,12 +491,42 @@ typedef struct ModernNotifyIcon {
     MniBool                     is_dpi_event;
     MniBool                     prevent_double_key_select;
     int                         taskbar_created_message_id;
+    int                         update_depth;
+    UINT                        update_flags;
+    DWORD                       update_state;
     const wchar_t               *class_name;
     HMONITOR                    primary_monitor;
     void                        *user_data1;
     void                        *user_data2;
     void                        *reserved1;
     void                        *reserved2;
+    MniBackend                  backend;
+    struct MniShellWorker       *shell_worker;
+    struct MniCommandQueue      *command_queue;
+    volatile LONG               command_queue_users;    // producers inside MniQueue*, closed bit
+    struct MniTrayThread        *tray_thread;
+    struct MniTimerWheel        *timer_wheel;
+    MniTimerMode                timer_mode;
+    struct MniAnimation         *animation;
+    struct MniIconCache         *icon_cache;
+    struct MniIconLoader        *icon_loader;
+    struct MniNotificationQueue *notification_queue;
+    struct MniOverlay           *overlay;
+    struct MniGraph             *graph;
+    UINT64                      icon_fingerprint;   // content of icon shown by shell
+    MniBool                     icon_fingerprint_valid;
+    UINT64                      icon_updates_pushed;
+    UINT64                      icon_updates_suppressed;
+    struct ModernNotifyIcon     *host;
+    UINT                        uid;
+    struct ModernNotifyIcon     **hosted_icons;     // indexed by uid
+    int                         hosted_capacity;
+    int                         hosted_count;
+    UINT64                      subscriptions;      // on_* callbacks that are set
+    MniBool                     system_message_filtered;
+    DWORD                       system_message_bits[MNI_SYSTEM_MESSAGE_BITMAP_SIZE / 32];
+    MniMessageRange             *system_message_ranges;
+    int                         system_message_range_count;
 
     MniOnWindowCreateFn         on_window_create;
     MniOnWindowDestroyFn        on_window_destroy;
@@ -281,14 +556,32 @@ typedef struct ModernNotifyIcon {
     MniOnAppsThemeChangeFn      on_apps_theme_change;
     MniOnTaskbarCreatedFn       on_taskbar_created;
     MniOnTimerFn                on_timer;
+    MniOnTimersFn               on_timers;          // all timers expired at once, replaces on_timer
     MniOnCustomMessageFn        on_custom_message;
     MniOnSystemMessageFn        on_system_message;
+    MniOnShellCompleteFn        on_shell_complete;
+    MniOnIconLoadFn             on_icon_load;       // result of MniSetIconFrom*Async
 } ModernNotifyIcon;
 
+// When info.host is set, icon is attached to window of the host and gets its own uID.
+// Host receives custom and system messages, hosted icons receive their own notify icon
+// messages and timers. Releasing the host removes all attached icons from the tray.
+// Host takes up to 65535 icons, 255 in 32-bit build, more fail with MNI_ERROR_INVALID_HOST.
+// MniRelease drops commands still in command queue and returns MNI_COMMANDS_DROPPED then.
 MNI_API MniError MniInit(ModernNotifyIcon *mni, MniInfo info);
 MNI_API MniError MniRelease(ModernNotifyIcon *mni, MniBool destroy_icon, MniBool destroy_menu);
 MNI_API MniError MniShow(ModernNotifyIcon *mni, MniBool recreate);
 MNI_API MniError MniHide(ModernNotifyIcon *mni);
+// Events are dispatched by mask of on_* callbacks set at MniInit. Must be called after any
+// on_* callback of initialized icon is assigned or cleared, until then new callback isn't
+// called and event of cleared one still costs the dispatch.
+MNI_API MniError MniRefreshSubscriptions(ModernNotifyIcon *mni);
+// Only messages in given ranges are forwarded to on_system_message, others go straight
+// to DefWindowProcW. Pass NULL ranges to forward all messages again.
+// Must be called from thread that owns the window.
+MNI_API MniError MniSetSystemMessageFilter(ModernNotifyIcon *mni, const MniMessageRange *ranges, int count);
+MNI_API MniError MniBeginUpdate(ModernNotifyIcon *mni);
+MNI_API MniError MniEndUpdate(ModernNotifyIcon *mni);
 
 MNI_API MniError MniSetIcon(ModernNotifyIcon *mni, HICON icon, MniBool destroy_current);
 MNI_API MniError MniSetMenu(ModernNotifyIcon *mni, HMENU menu, MniBool destroy_current);
@@ -326,15 +619,159 @@ MNI_API MniError MniSendBalloonNotification(
     MniBalloonFlags         flags
 );
 MNI_API MniError MniRemoveBalloonNotification(ModernNotifyIcon *mni);
+// Notifications posted to the queue are shown one balloon at a time, next one goes out
+// when the shell reports the balloon hidden or timed out. Rate is limited by token bucket,
+// repeated notifications are dropped and bursts above coalesce_threshold are shown as one
+// summary. NULL info uses defaults. Must be called from thread that owns the window.
+// With journal_file every notification and its outcome is appended to memory mapped file,
+// notifications not delivered before exit or crash are queued again by the next
+// MniCreateNotificationQueue with the same file. Custom balloon icon isn't persisted, replayed
+// notification shows icon of the notify icon instead.
+MNI_API MniError MniCreateNotificationQueue(ModernNotifyIcon *mni, const MniNotificationQueueInfo *info);
+MNI_API MniError MniDestroyNotificationQueue(ModernNotifyIcon *mni);
+MNI_API MniError MniPostNotification(
+    ModernNotifyIcon        *mni,
+    MniNotificationPriority priority,
+    const wchar_t           *title,
+    const wchar_t           *text,
+    MniBalloonIconType      icon_type,
+    HICON                   icon,
+    MniBalloonFlags         flags
+);
+MNI_API MniError MniGetNotificationQueueStats(ModernNotifyIcon *mni, MniNotificationQueueStats *stats);
+
+// Tray thread mode: library owned thread creates the window, runs the message loop
+// and executes all callbacks. Control it from other threads with MniQueue* functions.
+MNI_API MniError MniStartThread(ModernNotifyIcon *mni, MniInfo info);
+MNI_API MniError MniStopThread(ModernNotifyIcon *mni, MniBool destroy_icon, MniBool destroy_menu);
+
+// Shell worker pushes icon, tip and state from its own thread, setters don't wait for the shell.
+// Worker keeps its own copy of the icon, caller may destroy the icon as soon as setter returns.
+// Recreating or deleting the icon drops an update the worker hasn't pushed yet.
+MNI_API MniError MniStartShellWorker(ModernNotifyIcon *mni);
+MNI_API MniError MniStopShellWorker(ModernNotifyIcon *mni);
+
+// MniQueue* may be called from any thread, commands run on the window thread in order.
+// MniDestroyCommandQueue, called from the window thread, waits for producers still pushing
+// and runs commands they queued. MniQueue* fails with MNI_ERROR_QUEUE_NOT_CREATED after that.
+// MniQueue* fails only if the command wasn't queued. Once it returns MNI_OK the command will
+// run, even if waking the window thread failed, so handles passed to it must stay valid.
+MNI_API MniError MniCreateCommandQueue(ModernNotifyIcon *mni, int capacity);
+MNI_API MniError MniDestroyCommandQueue(ModernNotifyIcon *mni);
+MNI_API MniError MniQueueSetIcon(ModernNotifyIcon *mni, HICON icon, MniBool destroy_current);
+MNI_API MniError MniQueueSetTip(ModernNotifyIcon *mni, const wchar_t *tip);
+MNI_API MniError MniQueueSetTipType(ModernNotifyIcon *mni, MniTipType mtt);
+MNI_API MniError MniQueueShow(ModernNotifyIcon *mni, MniBool recreate);
+MNI_API MniError MniQueueHide(ModernNotifyIcon *mni);
+MNI_API MniError MniQueueBalloonNotification(
+    ModernNotifyIcon        *mni,
+    const wchar_t           *title,
+    const wchar_t           *text,
+    MniBalloonIconType      icon_type,
+    HICON                   icon,
+    MniBalloonFlags         flags
+);
 
+// User timers are multiplexed on a single OS timer through a timer wheel with 10ms resolution,
+// or 1ms with MNI_TIMER_MODE_HIGH_RESOLUTION. Must be called from thread that owns the window.
+// High resolution timers fire only while the thread waits in MniRunMessageLoop.
 MNI_API MniError MniStartTimer(ModernNotifyIcon *mni, UINT timer_id, UINT interval);
 MNI_API MniError MniStopTimer(ModernNotifyIcon *mni, UINT timer_id);
+// Icon is loaded from source for every dpi the icon is shown at, variants are cached and
+// owned by the library. Missing variants are built on the thread pool after dpi change.
+// MniSetIcon or NULL source stops using the source.
+// Like MniSetIcon, it ends animation, graph and overlay, which restore their previous icon.
+MNI_API MniError MniSetIconSource(ModernNotifyIcon *mni, const MniIconSource *source);
+// Builds icon from raw pixels, up to 256x256. stride is in bytes, 0 means tightly packed.
+// Pixels are copied, the icon is resampled for current dpi and rebuilt after dpi change.
+MNI_API MniError MniSetIconFromPixels(
+    ModernNotifyIcon *mni,
+    const void *pixels,
+    int width,
+    int height,
+    int stride,
+    MniPixelFormat format
+);
+// Uses alpha of mask icon as shape and colors it with taskbar text color, so light, dark
+// and high contrast variants are generated and switched on theme change automatically.
+// Icons without alpha use their AND mask. mask is copied and stays owned by the caller.
+MNI_API MniError MniSetIconMask(ModernNotifyIcon *mni, HICON mask);
+// Pack stays mapped until closed. Icons loaded from it are pooled copies and may outlive
+// the pack, icon set by MniSetIconFromPack loads other sizes on dpi change, so the pack
+// has to stay open while it is shown. MniSetIconFromPack copies the MniIconPack struct,
+// only the mapping has to stay, the struct itself may be a local or a copy.
+MNI_API MniError MniOpenIconPack(MniIconPack *pack, const wchar_t *file_name);
+MNI_API MniError MniCloseIconPack(MniIconPack *pack);
+MNI_API MniError MniLoadIconFromPack(const MniIconPack *pack, const char *name, int dpi, HICON *icon);
+MNI_API MniError MniSetIconFromPack(ModernNotifyIcon *mni, const MniIconPack *pack, const char *name);
+// Decode .ico, .bmp or .png on the thread pool and set the result like MniSetIconFromPixels
+// once done, .ico image closest to icon size at current dpi is used. Newer request or any
+// other way of setting icon cancels pending one. Requests that weren't cancelled report
+// their result to on_icon_load. data is copied.
+MNI_API MniError MniSetIconFromFileAsync(ModernNotifyIcon *mni, const wchar_t *file_name);
+MNI_API MniError MniSetIconFromMemoryAsync(ModernNotifyIcon *mni, const void *data, SIZE_T size);
+// Counts icon updates sent to the shell and those skipped since the shell already shows that content.
+// Icons set inside MniBeginUpdate/MniEndUpdate scope are pushed and counted once on flush.
+MNI_API MniError MniGetIconUpdateStats(ModernNotifyIcon *mni, MniIconUpdateStats *stats);
+// Pools icon by its content and returns pooled handle, which may differ from icon when the
+// same content is already pooled; icon is then destroyed. Pooled icon passed to MniSetIcon
+// with destroy_current, MniRelease with destroy_icon or MniReleaseIcon only drops reference.
+// Unused pooled icons are kept in LRU order up to budget.
+MNI_API HICON MniAcquireIcon(HICON icon);
+MNI_API void MniReleaseIcon(HICON icon);
+MNI_API MniError MniSetIconPoolBudget(int budget);
+MNI_API MniError MniGetIconPoolStats(MniIconPoolStats *stats);
+MNI_API void MniTrimIconPool(void);
+// Draws number badge or progress ring over current icon at current dpi, colors follow
+// the taskbar theme. Rendered icons are pooled, repeated values are not drawn again.
+// Badge 0 and progress -1 remove the overlay, any other way of setting icon ends it too.
+MNI_API MniError MniSetBadge(ModernNotifyIcon *mni, int value);
+MNI_API MniError MniSetProgress(ModernNotifyIcon *mni, int percent);
+// Turns icon into scrolling graph of samples in range min_value..max_value, colored by
+// taskbar theme. Each sample adds one column, the shell gets at most max_fps updates per
+// second (0 means 10), samples in between are coalesced. Samples outside the range are clamped,
+// NaN is drawn at the bottom. Stopping restores previous icon.
+MNI_API MniError MniStartGraph(ModernNotifyIcon *mni, float min_value, float max_value, UINT max_fps);
+MNI_API MniError MniAddGraphSample(ModernNotifyIcon *mni, float value);
+MNI_API MniError MniStopGraph(ModernNotifyIcon *mni);
+// Creates pooled icon with up to 4 characters of text on transparent background, sized
+// for dpi (0 means 96) in BGR color, drawn with built-in font which has digits, uppercase
+// letters and punctuation. Same text, dpi and color give the same icon. Pass it to MniSetIcon
+// with destroy_current or release it with MniReleaseIcon.
+MNI_API MniError MniCreateTextIcon(const wchar_t *text, int dpi, DWORD color, HICON *icon);
+// Frames are shown at given rate from the timer wheel, frames are owned by caller and must
+// outlive animation. Frames are dropped when the shell can't keep up, animation pauses while
+// the icon is hidden. MniSetIcon or MniStopAnimation ends it and restores the previous icon.
+MNI_API MniError MniAnimateIcon(ModernNotifyIcon *mni, const HICON *frames, int frame_count, UINT fps, MniBool loop);
+// Animates frame_count images of width x height pixels packed one after another, up to
+// 256x256. Frames are stored compressed against the previous one and decoded only when
+// shown, at the size of current dpi. Pixels aren't needed after the call returns.
+MNI_API MniError MniAnimatePixels(
+    ModernNotifyIcon *mni,
+    const void *pixels,
+    int width,
+    int height,
+    int frame_count,
+    MniPixelFormat format,
+    UINT fps,
+    MniBool loop
+);
+MNI_API MniError MniStopAnimation(ModernNotifyIcon *mni);
+MNI_API MniError MniGetAnimationStats(ModernNotifyIcon *mni, MniAnimationStats *stats);
+MNI_API MniError MniGetTimerStats(ModernNotifyIcon *mni, MniTimerStats *stats);
+MNI_API MniError MniResetTimerStats(ModernNotifyIcon *mni);
 
 MNI_API MniError MniSendCustomMessage(ModernNotifyIcon *mni, UINT msg, WPARAM wParam, LPARAM lParam);
 MNI_API MniError MniPostCustomMessage(ModernNotifyIcon *mni, UINT msg, WPARAM wParam, LPARAM lParam);
 
 MNI_API const wchar_t *MniErrorToString(MniError error);
 
+MNI_API MniError MniGetDefaultBackend(MniBackend *backend);
+MNI_API MniError MniInitRecorder(MniRecorder *recorder, MniRecord *records, int capacity);
+MNI_API MniError MniResetRecorder(MniRecorder *recorder);
+MNI_API MniError MniGetRecordingBackend(MniRecorder *recorder, MniBackend *backend);
+MNI_API LRESULT MniDispatchMessage(ModernNotifyIcon *mni, UINT msg, WPARAM wParam, LPARAM lParam);
+
 MNI_API int MniRunMessageLoop(void);
 MNI_API void MniQuit(void);
 
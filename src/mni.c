@@ -1,13 +1,20 @@
 #include "../include/mni/mni.h"
+#include "mni_pixels.h"
+#include "mni_pack.h"
+#include "mni_decode.h"
+#include "mni_journal.h"
+#include "mni_utf8.h"
 
 #include <shellapi.h>   // Shell_NotifyIconW
+#include <stdlib.h>     // qsort
+#include <math.h>       // sqrt
 
 #define GET_X_LPARAM(lp) ((int)(short)LOWORD(lp))
 #define GET_Y_LPARAM(lp) ((int)(short)HIWORD(lp))
 
 // ========================================================================== //
 
-#define WM_NOTIFYICON                           (WM_USER + 0)
+#define WM_NOTIFYICON                           MNI_NOTIFYICON_MESSAGE_ID
 #define WM_DPICHANGED_DELAYED                   (WM_USER + 1)
 #define WM_MNI_INIT                             (WM_USER + 2)
 #define WM_MNI_RELEASE                          (WM_USER + 3)
@@ -17,17 +24,71 @@
 #define WM_MNI_MENU_CHANGE                      (WM_USER + 7)
 #define WM_MNI_TIP_CHANGE                       (WM_USER + 8)
 #define WM_MNI_TIP_TYPE_CHANGE                  (WM_USER + 9)
+#define WM_MNI_SHELL_COMPLETE                   (WM_USER + 10)
+#define WM_MNI_COMMANDS                         (WM_USER + 11)
+#define WM_MNI_ICON_VARIANT                     (WM_USER + 12)
+#define WM_MNI_LAST                             WM_MNI_ICON_VARIANT
 
 #define WM_APP_LAST                             (0xBFFF)
 
 #define TIMER_LMB_DOUBLE_CLICK_CHECK            (1)
 #define TIMER_PREVENT_DOUBLE_KEYSELECT          (2)
+#define TIMER_WHEEL                             (3)
+
+// Internal timers driven by timer wheel, below MNI_USER_TIMER_ID.
+#define WHEEL_TIMER_ANIMATION                   (1)
+#define WHEEL_TIMER_GRAPH                       (2)
+#define WHEEL_TIMER_NOTIFICATION                (3)
+
+#define MNI_GRAPH_DEFAULT_FPS                   (10)
 
 #define TIMER_LMB_DOUBLE_CLICK_CHECK_INTERVAL   (100)
 #define TIMER_PREVENT_DOUBLE_KEYSELECT_INTERVAL (100)
 
 #define MNI_TASKBAR_CREATED_WINDOW_MESSAGE      TEXT("TaskbarCreated")
 
+#define MNI_COMMAND_QUEUE_DEFAULT_CAPACITY      (256)
+#define MNI_COMMAND_QUEUE_CLOSED                (0x40000000)    // bit of command_queue_users
+
+#define MNI_NOTIFICATION_QUEUE_DEFAULT_CAPACITY (64)
+#define MNI_NOTIFICATION_QUEUE_MAX_CAPACITY     (4096)
+#define MNI_NOTIFICATION_DEFAULT_RATE           (6)     // per minute
+#define MNI_NOTIFICATION_DEFAULT_BURST          (3)
+#define MNI_NOTIFICATION_DEFAULT_DEDUP_WINDOW   (60000) // ms
+#define MNI_NOTIFICATION_DEFAULT_COALESCE       (5)
+#define MNI_NOTIFICATION_DEFAULT_SUMMARY        L"%d new notifications"
+#define MNI_NOTIFICATION_RECENT_COUNT           (64)
+#define MNI_NOTIFICATION_TOKEN                  (1000)
+#define MNI_NOTIFICATION_BALLOON_TIMEOUT        (30000) // ms, balloon shell never reported back
+#define MNI_NOTIFICATION_RETRY_INTERVAL         (1000)  // ms
+#define MNI_NOTIFICATION_JOURNAL_SIZE           (1024 * 1024)   // initial, rewrite grows it
+#define MNI_NOTIFICATION_JOURNAL_GRANULARITY    (64 * 1024)
+#define MNI_NOTIFICATION_JOURNAL_RECORD_SIZE    (1024)  // posted and shown records of one notification at most
+
+// Outcomes recorded in notification journal.
+#define MNI_NOTIFICATION_OUTCOME_CLICKED        (1)
+#define MNI_NOTIFICATION_OUTCOME_TIMEOUT        (2)
+#define MNI_NOTIFICATION_OUTCOME_HIDDEN         (3)
+#define MNI_NOTIFICATION_OUTCOME_EXPIRED        (4)     // shell never reported the balloon back
+#define MNI_NOTIFICATION_OUTCOME_DROPPED        (5)     // queue was full
+
+// Hosted timer id is uid above MNI_HOSTED_TIMER_ID_LIMIT, 32-bit UINT_PTR leaves 8 bits for it.
+#define MNI_HOSTED_TIMER_SHIFT                  (24)
+#if defined(_WIN64)
+    #define MNI_HOSTED_ICONS_MAX                (0xFFFF)
+#else
+    #define MNI_HOSTED_ICONS_MAX                (0xFF)
+#endif
+
+#define MNI_TIMER_WHEEL_TICK                    (10000) // us
+#define MNI_TIMER_WHEEL_TICK_HIGH_RESOLUTION    (1000)  // us
+#define MNI_TIMER_WHEEL_TOLERANCE               (10)    // ms, OS may coalesce wheel timer
+#define MNI_TIMER_WHEEL_BITS                    (6)
+#define MNI_TIMER_WHEEL_SLOTS                   (1 << MNI_TIMER_WHEEL_BITS)
+#define MNI_TIMER_WHEEL_LEVELS                  (4)
+#define MNI_TIMER_WHEEL_BUCKET_BITS             (8)
+#define MNI_TIMER_WHEEL_BUCKETS                 (1 << MNI_TIMER_WHEEL_BUCKET_BITS)
+
 // ========================================================================== //
 
 #pragma region Macros
@@ -283,11 +344,35 @@ static int _GetDpi(HWND hWnd) {
         }
     }
 
+    // Window handles that don't belong to Win32 (custom backends) report 0.
+    if (dpi <= 0) {
+        dpi = 96;
+    }
+
     return dpi;
 }
 
 // ========================================================================== //
 
+static int _GetSmallIconSize(int dpi) {
+    typedef int (WINAPI *pfnGetSystemMetricsForDpi)(int, UINT);
+
+    // This is available since Windows 10 1607
+    pfnGetSystemMetricsForDpi GetSystemMetricsForDpiFn =
+        (pfnGetSystemMetricsForDpi)GetProcAddress(GetModuleHandleW(L"User32"), "GetSystemMetricsForDpi");
+
+    if (GetSystemMetricsForDpiFn) {
+        int size = GetSystemMetricsForDpiFn(SM_CXSMICON, (UINT)dpi);
+        if (size > 0) {
+            return size;
+        }
+    }
+
+    return MulDiv(16, dpi, 96);
+}
+
+// ========================================================================== //
+
 // dest must be valid memory location!
 // This functions make sure that dest will be null terminated (if cch > 0).
 static int _StringCopyW(wchar_t *dest, int cch, const wchar_t *src) {
@@ -338,22 +423,6 @@ static int _StringLengthMaxW(const wchar_t *str, int max) {
 
 // ========================================================================== //
 
-static int _StringLengthMaxA(const char *str, int max) {
-    int i = 0;
-
-    if (str) {
-        for (i = 0; i < max; i += 1) {
-            if (str[i] == '\0') {
-                break;
-            }
-        }
-    }
-
-    return i;
-}
-
-// ========================================================================== //
-
 static int _StringCompareW(const wchar_t *lhs, const wchar_t *rhs, int cch) {
     if (lhs == NULL && rhs != NULL) {
         return -1;
@@ -383,6 +452,20 @@ static int _StringCompareW(const wchar_t *lhs, const wchar_t *rhs, int cch) {
 
 // ========================================================================== //
 
+static void *_MniAlloc(SIZE_T size) {
+    return HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size);
+}
+
+// ========================================================================== //
+
+static void _MniFree(void *ptr) {
+    if (ptr) {
+        HeapFree(GetProcessHeap(), 0, ptr);
+    }
+}
+
+// ========================================================================== //
+
 static MniBool _IsGuidEq(GUID guid1, GUID guid2) {
     return guid1.Data1 == guid2.Data1
         && guid1.Data2 == guid2.Data2
@@ -410,6 +493,8 @@ static MniBool _IsThemeInfoChanged(MniThemeInfo lhs, MniThemeInfo rhs) {
 // ========================================================================== //
 
 // NOTE: if utf16 buffer is not big enough, the result will be truncated.
+// Invalid sequences are replaced with U+FFFD like MultiByteToWideChar does. NULL converts
+// to empty string, non empty utf8 that didn't fit at all fails.
 static MniBool _UTF8ToUTF16(const char *utf8, wchar_t *utf16, int cch) {
     MNI_ASSERT(cch > 0 && "cch is <= 0");
 
@@ -417,18 +502,9 @@ static MniBool _UTF8ToUTF16(const char *utf8, wchar_t *utf16, int cch) {
         return MNI_FALSE;
     }
 
-    int len = _StringLengthMaxA(utf8, cch * 4);
-    int ret = MultiByteToWideChar(CP_UTF8, 0, utf8, len, utf16, cch - 1);
-
-    if (ret == 0) {
-        DWORD err = GetLastError();
-        if (err != ERROR_INSUFFICIENT_BUFFER) {
-            return MNI_FALSE;
-        }
-
-        utf16[cch - 1] = L'\0';
-    } else {
-        utf16[ret] = L'\0';
+    int ret = _MniUtf8ToUtf16(utf8, (uint16_t *)utf16, cch);
+    if (ret == 0 && utf8 && utf8[0] != '\0') {
+        return MNI_FALSE;
     }
 
     return MNI_TRUE;
@@ -438,781 +514,954 @@ static MniBool _UTF8ToUTF16(const char *utf8, wchar_t *utf16, int cch) {
 
 // ========================================================================== //
 
-#pragma region Window Messages
+#pragma region Backend
 
-static MniBool _MniWmWindowCreate(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmWindowCreate()");
+static LRESULT CALLBACK _MniWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
-    if (mni->on_window_create) {
-        mni->on_window_create(mni);
-    }
+// ========================================================================== //
 
-    return MNI_TRUE;
+static BOOL _MniWin32NotifyIcon(void *context, DWORD message, NOTIFYICONDATAW *nid) {
+    UNREFERENCED_PARAMETER(context);
+
+    return Shell_NotifyIconW(message, nid);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmWindowDestroy(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmWindowDestroy()");
+static MniError _MniWin32CreateWindow(
+    void            *context,
+    HINSTANCE       module_handle,
+    const wchar_t   *class_name,
+    const wchar_t   *title,
+    DWORD           style,
+    HWND            parent,
+    LPVOID          param,
+    HWND            *window
+) {
+    UNREFERENCED_PARAMETER(context);
 
-    if (mni->on_window_destroy) {
-        mni->on_window_destroy(mni);
+    ATOM atom = 0;
+    {
+        WNDCLASSEX wcex = {
+            .cbSize         = sizeof(wcex),
+            .style          = CS_HREDRAW | CS_VREDRAW,
+            .lpfnWndProc    = _MniWndProc,
+            .cbClsExtra     = 0,
+            .cbWndExtra     = 0,
+            .hInstance      = module_handle,
+            .hIcon          = NULL,
+            .hCursor        = NULL,
+            .hbrBackground  = (HBRUSH)COLOR_WINDOW,
+            .lpszMenuName   = NULL,
+            .lpszClassName  = class_name,
+            .hIconSm        = NULL
+        };
+
+        atom = RegisterClassExW(&wcex);
+        if (atom == 0) {
+            return MNI_ERROR_FAILED_TO_REGISTER_WNDCLASS;
+        }
     }
 
-    return MNI_TRUE;
-}
+    HWND hWnd = CreateWindowExW(
+        0,
+        class_name,
+        title,
+        style,
+        0,                  // we want to put window on main monitor
+        0,                  // we want to put window on main monitor
+        100,
+        40,
+        parent,
+        NULL,
+        module_handle,
+        param
+    );
 
-// ========================================================================== //
+    if (hWnd == NULL) {
+        UnregisterClassW(class_name, module_handle);
+        return MNI_ERROR_FAILED_TO_CREATE_WINDOW;
+    }
 
-static MniBool _MniWmInit(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmInit()");
+    UpdateWindow(hWnd);
 
-    if (mni->on_init) {
-        mni->on_init(mni);
-    }
+    *window = hWnd;
 
-    return MNI_TRUE;
+    return MNI_OK;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmRelease(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmRelease()");
+static BOOL _MniWin32DestroyWindow(void *context, HWND window, HINSTANCE module_handle, const wchar_t *class_name) {
+    UNREFERENCED_PARAMETER(context);
 
-    if (mni->on_release) {
-        mni->on_release(mni);
-    }
+    BOOL ret = DestroyWindow(window);
+    UnregisterClassW(class_name, module_handle);
 
-    return MNI_TRUE;
+    return ret;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmIconShow(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmIconShow()");
-
-    if (mni->on_show) {
-        mni->on_show(mni);
-    }
+static LRESULT _MniWin32SendMessage(void *context, HWND window, UINT msg, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(context);
 
-    return MNI_TRUE;
+    return SendMessageW(window, msg, wParam, lParam);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmIconHide(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmIconHide()");
-
-    if (mni->on_hide) {
-        mni->on_hide(mni);
-    }
+static BOOL _MniWin32PostMessage(void *context, HWND window, UINT msg, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(context);
 
-    return MNI_TRUE;
+    return PostMessageW(window, msg, wParam, lParam);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmIconChange(ModernNotifyIcon *mni, HICON icon) {
-    MNI_TRACE(L"_MniWmIconChange()");
+static UINT_PTR _MniWin32SetTimer(void *context, HWND window, UINT_PTR id, UINT interval) {
+    UNREFERENCED_PARAMETER(context);
 
-    if (mni->on_icon_change) {
-        mni->on_icon_change(mni, icon);
+    // Timer wheel tolerates late ticks, let the system batch it with other wake ups.
+    if ((id & MNI_HOSTED_TIMER_ID_LIMIT) == TIMER_WHEEL) {
+        return SetCoalescableTimer(window, id, interval, NULL, MNI_TIMER_WHEEL_TOLERANCE);
     }
 
-    return MNI_TRUE;
+    return SetTimer(window, id, interval, NULL);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmMenuChange(ModernNotifyIcon *mni, HMENU menu) {
-    MNI_TRACE(L"_MniWmMenuChange()");
+static BOOL _MniWin32KillTimer(void *context, HWND window, UINT_PTR id) {
+    UNREFERENCED_PARAMETER(context);
 
-    if (mni->on_menu_change) {
-        mni->on_menu_change(mni, menu);
+    return KillTimer(window, id);
+}
+
+// ========================================================================== //
+
+// NOTE: NULL backend entries fall back to Win32, so zeroed mni is still safe to use.
+static BOOL _MniBackendNotifyIcon(ModernNotifyIcon *mni, DWORD message, NOTIFYICONDATAW *nid) {
+    if (mni->backend.notify_icon) {
+        return mni->backend.notify_icon(mni->backend.context, message, nid);
     }
 
-    return MNI_TRUE;
+    return _MniWin32NotifyIcon(NULL, message, nid);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmTipChange(ModernNotifyIcon *mni, const wchar_t *tip) {
-    MNI_TRACE(L"_MniWmTipChange()");
-
-    if (mni->on_tip_change) {
-        mni->on_tip_change(mni, tip);
+static MniError _MniBackendCreateWindow(
+    ModernNotifyIcon    *mni,
+    HINSTANCE           module_handle,
+    const wchar_t       *class_name,
+    const wchar_t       *title,
+    DWORD               style,
+    HWND                parent,
+    HWND                *window
+) {
+    if (mni->backend.create_window) {
+        return mni->backend.create_window(
+            mni->backend.context,
+            module_handle,
+            class_name,
+            title,
+            style,
+            parent,
+            (LPVOID)mni,
+            window
+        );
     }
 
-    return MNI_TRUE;
+    return _MniWin32CreateWindow(NULL, module_handle, class_name, title, style, parent, (LPVOID)mni, window);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmTipTypeChange(ModernNotifyIcon *mni, MniTipType mtt) {
-    MNI_TRACE(L"_MniWmTipTypeChange()");
-
-    if (mni->on_tip_type_change) {
-        mni->on_tip_type_change(mni, mtt);
+static BOOL _MniBackendDestroyWindow(ModernNotifyIcon *mni) {
+    if (mni->backend.destroy_window) {
+        return mni->backend.destroy_window(
+            mni->backend.context,
+            mni->window_handle,
+            mni->module_handle,
+            mni->class_name
+        );
     }
 
-    return MNI_TRUE;
+    return _MniWin32DestroyWindow(NULL, mni->window_handle, mni->module_handle, mni->class_name);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmKeySelect(ModernNotifyIcon *mni, int x, int y) {
-    MNI_TRACE(
-        L"_MniWmKeySelect(x=%d, y=%d), prevent_double_key_select=%d",
-        x,
-        y,
-        mni->prevent_double_key_select
-    );
+// Internal messages carry uid of the sender in HIWORD(lParam), same as WM_NOTIFYICON,
+// so a host window can route them to the right icon.
+static LPARAM _MniInternalLParam(ModernNotifyIcon *mni, LPARAM lParam) {
+    return (LPARAM)(((UINT)mni->uid << 16) | ((UINT)lParam & 0xFFFF));
+}
 
-    if (!mni->prevent_double_key_select) {
-        mni->prevent_double_key_select = MNI_TRUE;
+// ========================================================================== //
 
-        SetTimer(
-            mni->window_handle,
-            TIMER_PREVENT_DOUBLE_KEYSELECT,
-            TIMER_PREVENT_DOUBLE_KEYSELECT_INTERVAL,
-            NULL
-        );
+static LRESULT _MniBackendSendMessage(ModernNotifyIcon *mni, UINT msg, WPARAM wParam, LPARAM lParam) {
+    lParam = _MniInternalLParam(mni, lParam);
 
-        if (mni->on_key_select) {
-            mni->on_key_select(mni, x, y);
-        }
+    if (mni->backend.send_message) {
+        return mni->backend.send_message(mni->backend.context, mni->window_handle, msg, wParam, lParam);
     }
 
-    return MNI_TRUE;
+    return _MniWin32SendMessage(NULL, mni->window_handle, msg, wParam, lParam);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmLmbClick(ModernNotifyIcon *mni, int x, int y) {
-    MNI_TRACE(L"_MniWmLmbClick(x=%d, y=%d)", x, y);
+static BOOL _MniBackendPostMessage(ModernNotifyIcon *mni, UINT msg, WPARAM wParam, LPARAM lParam) {
+    lParam = _MniInternalLParam(mni, lParam);
 
-    if (mni->on_lmb_click) {
-        mni->on_lmb_click(mni, x, y);
+    if (mni->backend.post_message) {
+        return mni->backend.post_message(mni->backend.context, mni->window_handle, msg, wParam, lParam);
     }
 
-    return MNI_TRUE;
+    return _MniWin32PostMessage(NULL, mni->window_handle, msg, wParam, lParam);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmLmbDoubleClick(ModernNotifyIcon *mni, int x, int y) {
-    MNI_TRACE(L"_MniWmLmbDoubleClick(x=%d, y=%d)", x, y);
-    
-    if (mni->on_lmb_double_click) {
-        mni->on_lmb_double_click(mni, x, y);
+static UINT_PTR _MniHostedTimerId(ModernNotifyIcon *mni, UINT_PTR id) {
+    if (!mni->host) {
+        return id;
     }
 
-    return MNI_TRUE;
+    return ((UINT_PTR)mni->uid << MNI_HOSTED_TIMER_SHIFT) | (id & MNI_HOSTED_TIMER_ID_LIMIT);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmMmbClick(ModernNotifyIcon *mni, int x, int y) {
-    MNI_TRACE(L"_MniWmMmbClick(x=%d, y=%d)", x, y);
+static UINT_PTR _MniBackendSetTimer(ModernNotifyIcon *mni, UINT_PTR id, UINT interval) {
+    id = _MniHostedTimerId(mni, id);
 
-    if (mni->on_mmb_click) {
-        mni->on_mmb_click(mni, x, y);
+    if (mni->backend.set_timer) {
+        return mni->backend.set_timer(mni->backend.context, mni->window_handle, id, interval);
     }
 
-    return MNI_TRUE;
+    return _MniWin32SetTimer(NULL, mni->window_handle, id, interval);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmContextMenu(ModernNotifyIcon *mni, int x, int y) {
-    MNI_TRACE(L"_MniWmContextMenu(x=%d, y=%d)", x, y);
-    if (mni->on_context_menu_open) {
-        mni->on_context_menu_open(mni);
+static BOOL _MniBackendKillTimer(ModernNotifyIcon *mni, UINT_PTR id) {
+    id = _MniHostedTimerId(mni, id);
+
+    if (mni->backend.kill_timer) {
+        return mni->backend.kill_timer(mni->backend.context, mni->window_handle, id);
     }
 
-    BOOL selected_item = 0;
+    return _MniWin32KillTimer(NULL, mni->window_handle, id);
+}
 
-    if (mni->menu) {
-        HMENU hSubMenu = GetSubMenu(mni->menu, 0);
-        if (hSubMenu) {
-            // Our window must be foreground before calling TrackPopupMenu
-            // or the menu will not disappear when the user clicks away.
-            SetForegroundWindow(mni->window_handle);
+#pragma endregion
 
-            UINT uFlags = TPM_RETURNCMD | TPM_NONOTIFY | TPM_RIGHTBUTTON | TPM_TOPALIGN;
+// ========================================================================== //
 
-            int alignment = GetSystemMetrics(SM_MENUDROPALIGNMENT);
+#pragma region Command Queue
+
+typedef enum MniCommandType {
+    MNI_COMMAND_SET_ICON,
+    MNI_COMMAND_SET_TIP,
+    MNI_COMMAND_SET_TIP_TYPE,
+    MNI_COMMAND_SHOW,
+    MNI_COMMAND_HIDE,
+    MNI_COMMAND_BALLOON,
+} MniCommandType;
+
+typedef struct MniCommand {
+    MniCommandType              type;
+    union {
+        struct {
+            HICON               icon;
+            MniBool             destroy_current;
+        } set_icon;
+        struct {
+            wchar_t             tip[128];
+        } set_tip;
+        struct {
+            MniTipType          tip_type;
+        } set_tip_type;
+        struct {
+            MniBool             recreate;
+        } show;
+        struct {
+            wchar_t             title[64];
+            wchar_t             text[256];
+            MniBalloonIconType  icon_type;
+            HICON               icon;
+            MniBalloonFlags     flags;
+        } balloon;
+    } data;
+} MniCommand;
+
+typedef struct MniCommandCell {
+    volatile LONG               sequence;
+    MniCommand                  command;
+} MniCommandCell;
+
+// Bounded multi-producer / single-consumer queue (D. Vyukov's array queue).
+// Each cell carries a sequence number, producers claim a position with one CAS
+// and publish by bumping the sequence, so nobody ever blocks.
+// Window thread is the only consumer, it's woken up by a single posted message
+// per batch, not per command.
+typedef struct MniCommandQueue {
+    LONG                        mask;
+    volatile LONG               enqueue_pos;
+    volatile LONG               dequeue_pos;
+    volatile LONG               signaled;
+    MniCommandCell              *cells;
+} MniCommandQueue;
 
-            // Respect menu drop alignment.
-            if (alignment != 0) {
-                uFlags |= TPM_RIGHTALIGN;
-            } else {
-                uFlags |= TPM_LEFTALIGN;
-            }
+// ========================================================================== //
 
-            if (_IsLayoutRTL()) {
-                uFlags = uFlags | TPM_LAYOUTRTL;                
-            }
+// Returns cell reserved for writing or NULL if queue is full.
+static MniCommandCell *_MniCommandQueueReserve(MniCommandQueue *queue, LONG *out_pos) {
+    LONG pos = ReadNoFence(&queue->enqueue_pos);
 
-            {
-                selected_item = ImmersiveTrackPopupMenu(
-                    hSubMenu,
-                    uFlags,
-                    x,
-                    y,
-                    mni->window_handle,
-                    NULL,
-                    mni->icm_style,
-                    mni->icm_theme
-                );
+    while (1) {
+        MniCommandCell *cell = &queue->cells[pos & queue->mask];
+        LONG seq = ReadAcquire(&cell->sequence);
+        LONG dif = (LONG)((ULONG)seq - (ULONG)pos);
+
+        if (dif == 0) {
+            LONG prev = InterlockedCompareExchange(&queue->enqueue_pos, (LONG)((ULONG)pos + 1), pos);
+            if (prev == pos) {
+                *out_pos = pos;
+                return cell;
             }
-
-            // ??
-            PostMessageW(mni->window_handle, WM_NULL, 0, 0);
+            pos = prev;
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = ReadNoFence(&queue->enqueue_pos);
         }
     }
+}
+
+// ========================================================================== //
+
+static MniError _MniCommandQueueWrite(ModernNotifyIcon *mni, MniCommandQueue *queue, const MniCommand *command) {
+    if (!queue) {
+        return MNI_ERROR_QUEUE_NOT_CREATED;
+    }
 
-    MNI_TRACE(L"\tTrackPopupMenu(): Selected Item: %d", selected_item);
-    if (mni->on_context_menu_item_click && selected_item != 0) {
-        mni->on_context_menu_item_click(mni, (int)selected_item);
+    LONG pos = 0;
+    MniCommandCell *cell = _MniCommandQueueReserve(queue, &pos);
+    if (!cell) {
+        return MNI_ERROR_QUEUE_FULL;
     }
-    
-    if (mni->on_context_menu_close) {
-        mni->on_context_menu_close(mni, (MniBool)(selected_item != 0));
+
+    cell->command = *command;
+    WriteRelease(&cell->sequence, (LONG)((ULONG)pos + 1));
+
+    // Only the first producer after a drain wakes the window thread. Command is queued
+    // already, so failed post isn't an error, next producer posts again or next drain runs it.
+    if (InterlockedExchange(&queue->signaled, 1) == 0) {
+        if (!_MniBackendPostMessage(mni, WM_MNI_COMMANDS, 0, 0)) {
+            MNI_TRACE(L"_MniCommandQueueWrite(), failed to post WM_MNI_COMMANDS");
+            InterlockedExchange(&queue->signaled, 0);
+        }
     }
 
-    return MNI_TRUE;
+    return MNI_OK;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmBalloonShow(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmBalloonShow()");
-    
-    if (mni->on_balloon_show) {
-        mni->on_balloon_show(mni);
+static MniError _MniCommandQueuePush(ModernNotifyIcon *mni, const MniCommand *command) {
+    // Producers are counted, so the queue isn't freed under one that's still writing.
+    if (InterlockedIncrement(&mni->command_queue_users) & MNI_COMMAND_QUEUE_CLOSED) {
+        InterlockedDecrement(&mni->command_queue_users);
+        return MNI_ERROR_QUEUE_NOT_CREATED;
     }
 
-    return MNI_TRUE;
+    MniError result = _MniCommandQueueWrite(mni, mni->command_queue, command);
+
+    InterlockedDecrement(&mni->command_queue_users);
+
+    return result;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmBalloonHide(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmBalloonHide()");
+static MniBool _MniCommandQueuePop(MniCommandQueue *queue, MniCommand *command) {
+    LONG pos = queue->dequeue_pos;
+    MniCommandCell *cell = &queue->cells[pos & queue->mask];
+    LONG seq = ReadAcquire(&cell->sequence);
 
-    if (mni->on_balloon_hide) {
-        mni->on_balloon_hide(mni);
+    if ((LONG)((ULONG)seq - ((ULONG)pos + 1)) < 0) {
+        return MNI_FALSE;
     }
 
+    *command = cell->command;
+    WriteRelease(&cell->sequence, (LONG)((ULONG)pos + (ULONG)queue->mask + 1));
+    queue->dequeue_pos = (LONG)((ULONG)pos + 1);
+
     return MNI_TRUE;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmBalloonTimeout(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmBalloonTimeout()");
+static void _MniCommandExecute(ModernNotifyIcon *mni, const MniCommand *command) {
+    switch (command->type) {
+        case MNI_COMMAND_SET_ICON:
+            MniSetIcon(mni, command->data.set_icon.icon, command->data.set_icon.destroy_current);
+            break;
 
-    if (mni->on_balloon_timeout) {
-        mni->on_balloon_timeout(mni);
-    }
+        case MNI_COMMAND_SET_TIP:
+            MniSetTip(mni, command->data.set_tip.tip);
+            break;
 
-    return MNI_TRUE;
+        case MNI_COMMAND_SET_TIP_TYPE:
+            MniSetTipType(mni, command->data.set_tip_type.tip_type);
+            break;
+
+        case MNI_COMMAND_SHOW:
+            MniShow(mni, command->data.show.recreate);
+            break;
+
+        case MNI_COMMAND_HIDE:
+            MniHide(mni);
+            break;
+
+        case MNI_COMMAND_BALLOON:
+            MniSendBalloonNotification(
+                mni,
+                command->data.balloon.title,
+                command->data.balloon.text,
+                command->data.balloon.icon_type,
+                command->data.balloon.icon,
+                command->data.balloon.flags
+            );
+            break;
+    }
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmBalloonUserClick(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmBalloonUserClick()");
+// Balloon and recreated icon go to the shell right away instead of joining the batch.
+static MniBool _MniCommandIsBatched(const MniCommand *command) {
+    switch (command->type) {
+        case MNI_COMMAND_BALLOON:
+            return MNI_FALSE;
 
-    if (mni->on_balloon_click) {
-        mni->on_balloon_click(mni);
+        case MNI_COMMAND_SHOW:
+            return !command->data.show.recreate;
+
+        default:
+            return MNI_TRUE;
     }
+}
 
-    return MNI_TRUE;
+// ========================================================================== //
+
+static void _MniCommandQueueRun(ModernNotifyIcon *mni, MniCommandQueue *queue) {
+    // Batched commands go to the shell as one NIM_MODIFY.
+    MniBeginUpdate(mni);
+    {
+        MniCommand command;
+        while (_MniCommandQueuePop(queue, &command)) {
+            // Batch queued so far is flushed first, so the shell sees commands in order.
+            if (!_MniCommandIsBatched(&command)) {
+                MniEndUpdate(mni);
+                _MniCommandExecute(mni, &command);
+                MniBeginUpdate(mni);
+                continue;
+            }
+
+            _MniCommandExecute(mni, &command);
+        }
+    }
+    MniEndUpdate(mni);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmRichPopupOpen(ModernNotifyIcon *mni, int x, int y) {
-    MNI_TRACE(L"_MniWmRichPopupOpen(x=%d, y=%d)", x, y);
-    
-    if (mni->on_rich_popup_open) {
-        mni->on_rich_popup_open(mni, x, y);
+static void _MniCommandQueueDrain(ModernNotifyIcon *mni) {
+    MniCommandQueue *queue = mni->command_queue;
+    if (!queue) {
+        return;
     }
 
-    return MNI_TRUE;
+    // Clear the flag first, anything pushed from now on posts a new wake-up.
+    InterlockedExchange(&queue->signaled, 0);
+
+    _MniCommandQueueRun(mni, queue);
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmRichPopupClose(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniWmRichPopupClose()");
-    
-    if (mni->on_rich_popup_close) {
-        mni->on_rich_popup_close(mni);
+// Stops producers and detaches the queue once none of them is still writing into it.
+static MniCommandQueue *_MniCommandQueueClose(ModernNotifyIcon *mni) {
+    MniCommandQueue *queue = mni->command_queue;
+    if (!queue) {
+        return NULL;
     }
 
-    return MNI_TRUE;
+    InterlockedOr(&mni->command_queue_users, MNI_COMMAND_QUEUE_CLOSED);
+    while ((ReadAcquire(&mni->command_queue_users) & ~MNI_COMMAND_QUEUE_CLOSED) != 0) {
+        SwitchToThread();
+    }
+
+    mni->command_queue = NULL;
+    InterlockedAnd(&mni->command_queue_users, ~MNI_COMMAND_QUEUE_CLOSED);
+
+    return queue;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmDpiChange(ModernNotifyIcon *mni, int dpi) {
-    MNI_TRACE(L"_MniWmDpiChange(dpi=%d)", dpi);
-    
-    if (mni->dpi != dpi) {
-        if (mni->on_dpi_change) {
-            mni->on_dpi_change(mni, dpi);
-        }
+// Frees the queue without running what's left in it, returns number of dropped commands.
+static int _MniCommandQueueDiscard(ModernNotifyIcon *mni) {
+    MniCommandQueue *queue = _MniCommandQueueClose(mni);
+    if (!queue) {
+        return 0;
+    }
 
-        mni->dpi = dpi;
+    int dropped = 0;
+    MniCommand command;
+    while (_MniCommandQueuePop(queue, &command)) {
+        dropped += 1;
     }
 
-    return MNI_TRUE;
+    _MniFree(queue);
+
+    return dropped;
 }
 
+#pragma endregion
+
 // ========================================================================== //
 
-static MniBool _MniWmThemeChange(ModernNotifyIcon *mni, MniBool is_hc) {
-    MNI_TRACE(L"_MniWmThemeChange()");
+#pragma region Timer Wheel
+
+// Hierarchical timer wheel, all user timers of icon are driven by one OS timer (TIMER_WHEEL).
+// Level 0 holds timers expiring within MNI_TIMER_WHEEL_SLOTS ticks, each next level covers
+// MNI_TIMER_WHEEL_SLOTS times more. Timers of higher level cascade down when wheel rotates.
+
+typedef struct MniTimer {
+    UINT                        id;
+    UINT                        interval;           // ticks
+    ULONGLONG                   expires;            // tick
+    int                         level;              // -1 when not in wheel
+    int                         slot;
+    int                         prev;               // slot list, -1 if none
+    int                         next;
+    int                         hash_next;          // id bucket chain / free list
+} MniTimer;
+
+typedef struct MniTimerWheel {
+    LONGLONG                    start_counter;      // QueryPerformanceCounter() of tick 0
+    LONGLONG                    frequency;
+    ULONGLONG                   tick;               // us
+    HANDLE                      waitable_timer;     // MNI_TIMER_MODE_HIGH_RESOLUTION only
+    ULONGLONG                   current;            // last processed tick
+    ULONGLONG                   armed;              // tick OS timer fires at, 0 if disarmed
+    MniBool                     expiring;
+
+    // Lateness of OS timer against the tick it was armed for.
+    UINT64                      jitter_samples;
+    LONGLONG                    jitter_last;
+    LONGLONG                    jitter_min;
+    LONGLONG                    jitter_max;
+    double                      jitter_sum;
+    double                      jitter_sum_sq;
+
+    int                         slots[MNI_TIMER_WHEEL_LEVELS][MNI_TIMER_WHEEL_SLOTS];
+    UINT64                      occupied[MNI_TIMER_WHEEL_LEVELS];
+    int                         buckets[MNI_TIMER_WHEEL_BUCKETS];
+    MniTimer                    *timers;
+    int                         capacity;
+    int                         count;
+    int                         free_list;
+    UINT                        *expired;           // ids fired in one batch
+} MniTimerWheel;
+
+static int _MniLowestBit64(UINT64 value) {
+    unsigned long index;
+
+    if (_BitScanForward(&index, (unsigned long)value)) {
+        return (int)index;
+    }
+
+    _BitScanForward(&index, (unsigned long)(value >> 32));
+    return (int)index + 32;
+}
 
-    // When theme change this is invoked multiple times, using is_hc is unstable.
-    UNREFERENCED_PARAMETER(is_hc);
+// ========================================================================== //
 
-    if (_IsHighContrastThemeEnabled()) {
-        MniThemeInfo hcti = _GetHighContrastThemeInfo();
+// Microseconds since wheel was created, split to not overflow with high counter frequency.
+static ULONGLONG _MniTimerWheelElapsed(MniTimerWheel *wheel) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
 
-        // Check if high contrast theme changed.
-        if (_IsThemeInfoChanged(mni->system_theme, hcti)) {
-            if (mni->on_system_theme_change) {
-                mni->on_system_theme_change(mni, hcti);
-            }
+    ULONGLONG elapsed = (ULONGLONG)(counter.QuadPart - wheel->start_counter);
+    ULONGLONG frequency = (ULONGLONG)wheel->frequency;
 
-            mni->system_theme = hcti;
-        }
+    return (elapsed / frequency) * 1000000 + (elapsed % frequency) * 1000000 / frequency;
+}
 
-        // Check if high contrast theme changed.
-        if (_IsThemeInfoChanged(mni->apps_theme, hcti)) {
-            if (mni->on_apps_theme_change) {
-                mni->on_apps_theme_change(mni, hcti);
-            }
+// ========================================================================== //
 
-            mni->apps_theme = hcti;
-        }
-    } else {
-        // Check if system theme changed.
-        MniThemeInfo sti = _GetSystemThemeInfo();
-        if (mni->system_theme.Theme != sti.Theme) {
-            if (mni->on_system_theme_change) {
-                mni->on_system_theme_change(mni, sti);
-            }
+static ULONGLONG _MniTimerWheelNow(MniTimerWheel *wheel) {
+    return _MniTimerWheelElapsed(wheel) / wheel->tick;
+}
 
-            mni->system_theme = sti;
-        }
+// ========================================================================== //
 
-        // Check if apps theme changed.
-        MniThemeInfo ati = _GetAppsThemeInfo();
-        if (mni->apps_theme.Theme != ati.Theme) {
-            if (mni->on_apps_theme_change) {
-                mni->on_apps_theme_change(mni, ati);
-            }
+static int *_MniTimerWheelBucket(MniTimerWheel *wheel, UINT id) {
+    return &wheel->buckets[(id * 2654435761u) >> (32 - MNI_TIMER_WHEEL_BUCKET_BITS)];
+}
 
-            mni->apps_theme = ati;
+// ========================================================================== //
+
+static int _MniTimerWheelFind(MniTimerWheel *wheel, UINT id) {
+    for (int i = *_MniTimerWheelBucket(wheel, id); i != -1; i = wheel->timers[i].hash_next) {
+        if (wheel->timers[i].id == id) {
+            return i;
         }
     }
 
-    return MNI_TRUE;
+    return -1;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmTaskbarCreated(ModernNotifyIcon *mni) {
-    MNI_TRACE(
-        L"_MniWmTaskbarCreated(), is_dpi_event=%d, primary_monitor=%p",
-        mni->is_dpi_event,
-        mni->primary_monitor
-    );
+static void _MniTimerWheelLink(MniTimerWheel *wheel, int index) {
+    MniTimer *timer = &wheel->timers[index];
 
-    if (mni->is_dpi_event) {
-        mni->is_dpi_event = MNI_FALSE;
-    } else {
-        // NOTE: Setting these two here can lead to undesirable effects
-        //       if this was called from something else than explorer restart.
-        //       It's better to force recreating icon when re-showing.
-        // Icon no longer exists.
-        //mni->icon_visible = MNI_FALSE;
-        //mni->icon_created = MNI_FALSE;
-        MNI_TRACE(L"\tEXPLORER RESTART");
-        if (mni->on_taskbar_created) {
-            mni->on_taskbar_created(mni);
-        }
+    ULONGLONG delta = timer->expires - wheel->current;
+    int level = 0;
+    while (level < MNI_TIMER_WHEEL_LEVELS - 1 && delta >= ((ULONGLONG)1 << (MNI_TIMER_WHEEL_BITS * (level + 1)))) {
+        level += 1;
     }
 
-    // We check for dpi change here.
-    int dpi = _GetDpi(mni->window_handle);
-    MNI_TRACE(L"\t_GetDpi(): %d", dpi);
-    if (mni->dpi != dpi) {
-        SendMessageW(mni->window_handle, WM_DPICHANGED_DELAYED, (WPARAM)dpi, 0);
+    // Timers beyond the last level are parked in its farthest slot and cascade again.
+    ULONGLONG expires = timer->expires;
+    if (delta >= ((ULONGLONG)1 << (MNI_TIMER_WHEEL_BITS * MNI_TIMER_WHEEL_LEVELS))) {
+        expires = wheel->current + ((ULONGLONG)1 << (MNI_TIMER_WHEEL_BITS * MNI_TIMER_WHEEL_LEVELS)) - 1;
     }
 
-    return MNI_TRUE;
+    int slot = (int)((expires >> (MNI_TIMER_WHEEL_BITS * level)) & (MNI_TIMER_WHEEL_SLOTS - 1));
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = -1;
+    timer->next = wheel->slots[level][slot];
+    if (timer->next != -1) {
+        wheel->timers[timer->next].prev = index;
+    }
+
+    wheel->slots[level][slot] = index;
+    wheel->occupied[level] |= (UINT64)1 << slot;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmUserTimerTimeout(ModernNotifyIcon *mni, UINT id) {
-    MNI_TRACE(L"_MniWmUserTimerTimeout(id=%d)", id);
+static void _MniTimerWheelUnlink(MniTimerWheel *wheel, int index) {
+    MniTimer *timer = &wheel->timers[index];
 
-    if (id >= MNI_USER_TIMER_ID) {
-        if (mni->on_timer) {
-            mni->on_timer(mni, id);
+    if (timer->level < 0) {
+        return;
+    }
+
+    if (timer->prev != -1) {
+        wheel->timers[timer->prev].next = timer->next;
+    } else {
+        wheel->slots[timer->level][timer->slot] = timer->next;
+        if (timer->next == -1) {
+            wheel->occupied[timer->level] &= ~((UINT64)1 << timer->slot);
         }
     }
 
-    return MNI_TRUE;
+    if (timer->next != -1) {
+        wheel->timers[timer->next].prev = timer->prev;
+    }
+
+    timer->level = -1;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmInternalTimerTimeout(ModernNotifyIcon *mni, UINT id) {
-    MNI_TRACE(L"_MniWmInternalTimerTimeout(id=%d)", id);
-
-    if (id >= MNI_USER_TIMER_ID) {
-        return MNI_FALSE;
+static MniTimerWheel *_MniTimerWheelCreate(MniTimerMode mode) {
+    MniTimerWheel *wheel = (MniTimerWheel *)_MniAlloc(sizeof(*wheel));
+    if (!wheel) {
+        return NULL;
     }
 
-    if (id == TIMER_PREVENT_DOUBLE_KEYSELECT) {
-        KillTimer(mni->window_handle, TIMER_PREVENT_DOUBLE_KEYSELECT);
-        mni->prevent_double_key_select = MNI_FALSE;
-    }
+    memset(wheel->slots, 0xFF, sizeof(wheel->slots));
+    memset(wheel->buckets, 0xFF, sizeof(wheel->buckets));
+    wheel->free_list = -1;
+    wheel->tick = MNI_TIMER_WHEEL_TICK;
 
-    return MNI_TRUE;
-}
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    wheel->frequency = frequency.QuadPart;
+    wheel->start_counter = counter.QuadPart;
 
-// ========================================================================== //
+    if (mode == MNI_TIMER_MODE_HIGH_RESOLUTION) {
+        // High resolution flag is supported since Windows 10 1803, older systems get
+        // ordinary waitable timer which still beats WM_TIMER latency.
+        wheel->waitable_timer = CreateWaitableTimerExW(
+            NULL,
+            NULL,
+            CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+            TIMER_ALL_ACCESS
+        );
 
-static MniBool _MniWmCustomMessage(ModernNotifyIcon *mni, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    MNI_TRACE(L"_MniWmCustomMessage(uMsg=%d, wParam=%lld, lParam=%lld)", uMsg, wParam, lParam);
+        if (!wheel->waitable_timer) {
+            wheel->waitable_timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+        }
 
-    if (mni->on_custom_message) {
-        mni->on_custom_message(mni, uMsg, wParam, lParam);
+        if (!wheel->waitable_timer) {
+            _MniFree(wheel);
+            return NULL;
+        }
+
+        wheel->tick = MNI_TIMER_WHEEL_TICK_HIGH_RESOLUTION;
     }
 
-    return MNI_TRUE;
+    return wheel;
 }
 
 // ========================================================================== //
 
-static MniBool _MniWmSystemMessage(ModernNotifyIcon *mni, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    if (mni->on_system_message) {
-        return mni->on_system_message(mni, uMsg, wParam, lParam);
-    }
+static void _MniTimerWheelDestroy(MniTimerWheel *wheel) {
+    if (wheel) {
+        if (wheel->waitable_timer) {
+            // Also cancels completion routine that is already queued.
+            CancelWaitableTimer(wheel->waitable_timer);
+            CloseHandle(wheel->waitable_timer);
+        }
 
-    return MNI_FALSE; // we don't want to handle this message
+        _MniFree(wheel->timers);
+        _MniFree(wheel->expired);
+        _MniFree(wheel);
+    }
 }
 
-#pragma endregion
-
 // ========================================================================== //
 
-#pragma region Window Procedure
+static MniBool _MniTimerWheelGrow(MniTimerWheel *wheel) {
+    int capacity = wheel->capacity > 0 ? wheel->capacity * 2 : 32;
 
-static LRESULT _MniDispatch(
-    ModernNotifyIcon    *mni,
-    HWND                hWnd,
-    UINT                uMsg,
-    WPARAM              wParam,
-    LPARAM              lParam
-) {
-    MNI_TRACE2(L"_MniDispatch(uMsg=0x%04x, wParam=%lld, lParam=%lld)", uMsg, wParam, lParam);
+    MniTimer *timers = (MniTimer *)_MniAlloc(sizeof(*timers) * (SIZE_T)capacity);
+    UINT *expired = (UINT *)_MniAlloc(sizeof(*expired) * (SIZE_T)capacity);
+    if (!timers || !expired) {
+        _MniFree(timers);
+        _MniFree(expired);
+        return MNI_FALSE;
+    }
 
-    // Register message when taskbar is created to get notified when explorer.exe gets restarted.
-    if (mni->taskbar_created_message_id == 0) {
-        mni->taskbar_created_message_id = RegisterWindowMessageW(MNI_TASKBAR_CREATED_WINDOW_MESSAGE);
+    if (wheel->timers) {
+        memcpy(timers, wheel->timers, sizeof(*timers) * (SIZE_T)wheel->capacity);
     }
 
-    // Handle notify icon messages.
-    switch (uMsg) {
-        case WM_CREATE:
-            if (_MniWmWindowCreate(mni)) {
-                return 0;
-            }
-            break;
+    // Batch being expired is detached from the wheel, see _MniTimerWheelExpire.
+    if (wheel->expired) {
+        memcpy(expired, wheel->expired, sizeof(*expired) * (SIZE_T)wheel->capacity);
+    }
 
-        case WM_DESTROY:
-            if (_MniWmWindowDestroy(mni)) {
-                return 0;
-            }
-            break;
+    // New entries go to free list.
+    for (int i = capacity - 1; i >= wheel->capacity; i -= 1) {
+        timers[i].level = -1;
+        timers[i].hash_next = wheel->free_list;
+        wheel->free_list = i;
+    }
 
-        case WM_NOTIFYICON:
-            switch (LOWORD(lParam)) {
-            // Left Click.
-            //case NIN_SELECT:
-            //    if (KeySelect(GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam)))
-            //    {
-            //        return 0;
-            //    }
-            //    break;
-
-            // When you select icon with keyboard and press Space or Enter.
-            // Pressing Enter triggers this twice.
-            case NIN_KEYSELECT:
-                if (_MniWmKeySelect(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam)))
-                {
-                    return 0;
-                }
-                break;
+    _MniFree(wheel->timers);
+    _MniFree(wheel->expired);
+    wheel->timers = timers;
+    wheel->expired = expired;
+    wheel->capacity = capacity;
 
-            // When you Right Click on icon or Shift+F10 when it's selected with keyboard.
-            case WM_CONTEXTMENU:
-                if (_MniWmContextMenu(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam))) {
-                    return 0;
-                }
-                break;
+    return MNI_TRUE;
+}
 
-            case WM_LBUTTONUP:
-                if (_MniWmLmbClick(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam))) {
-                    return 0;
-                }
-                break;
+// ========================================================================== //
 
-            case WM_LBUTTONDBLCLK:
-                if (_MniWmLmbDoubleClick(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam))) {
-                    return 0;
-                }
-                break;
+// Tick at which the earliest non empty slot is reached (level 0) or cascades (higher levels).
+static ULONGLONG _MniTimerWheelNextTick(MniTimerWheel *wheel) {
+    ULONGLONG next = 0;
 
-            case WM_MBUTTONUP:
-                if (_MniWmMmbClick(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam))) {
-                    return 0;
-                }
-                break;
+    for (int level = 0; level < MNI_TIMER_WHEEL_LEVELS; level += 1) {
+        UINT64 occupied = wheel->occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
 
-            case NIN_BALLOONSHOW:
-                if (_MniWmBalloonShow(mni)) {                
-                    return 0;
-                }
-                break;
-        
-            case NIN_BALLOONHIDE:
-                if (_MniWmBalloonHide(mni)) {
-                    return 0;
-                }
-                break;
+        int shift = MNI_TIMER_WHEEL_BITS * level;
+        ULONGLONG base = wheel->current >> shift;
+        int rotate = (int)((base + 1) & (MNI_TIMER_WHEEL_SLOTS - 1));
+        UINT64 rotated = (occupied >> rotate) | (occupied << ((MNI_TIMER_WHEEL_SLOTS - rotate) & (MNI_TIMER_WHEEL_SLOTS - 1)));
 
-            case NIN_BALLOONTIMEOUT:
-                if (_MniWmBalloonTimeout(mni)) {
-                    return 0;
-                }
-                break;
+        ULONGLONG tick = (base + (ULONGLONG)_MniLowestBit64(rotated) + 1) << shift;
+        if (next == 0 || tick < next) {
+            next = tick;
+        }
+    }
 
-            case NIN_BALLOONUSERCLICK:
-                if (_MniWmBalloonUserClick(mni)) {
-                    return 0;
-                }
-                break;
+    return next;
+}
 
-            case NIN_POPUPOPEN:
-                if (_MniWmRichPopupOpen(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam))) {
-                    return 0;
-                }
-                break;
+// ========================================================================== //
 
-            case NIN_POPUPCLOSE:
-                if (_MniWmRichPopupClose(mni)) {
-                    return 0;
-                }
-                break;
-            }
-            break; // WM_NOTIFYICON
-
-        case WM_DPICHANGED:
-            // NOTE: Not calling message handler immediately, because
-            //       changing dpi in system also trigger TaskbarCreated message.
-            //       And if we call handler before TaskbarCreated, changing icons etc.
-            //       doesn't work.
-            mni->is_dpi_event = MNI_TRUE;
-            MNI_TRACE(L"DPI CHANGED");
-            return 0;
-            //return _MniWmDpiChange(mni, LOWORD(wParam));
+static void _MniTimerWheelExpire(ModernNotifyIcon *mni);
+static void _MniAnimationTick(ModernNotifyIcon *mni);
+static void _MniGraphTick(ModernNotifyIcon *mni);
+static void _MniNotificationDrain(ModernNotifyIcon *mni);
 
-        case WM_DISPLAYCHANGE:
-            {
-                HMONITOR monitor = _GetPrimaryMonitor();
-                if (mni->primary_monitor != monitor) {
-                    MNI_TRACE(L"PRIMARY MONITOR CHANGE");
-                    mni->primary_monitor = monitor;
+static VOID CALLBACK _MniTimerWheelCompletion(LPVOID arg, DWORD low, DWORD high) {
+    UNREFERENCED_PARAMETER(low);
+    UNREFERENCED_PARAMETER(high);
 
-                    // Move invisible window to primary monitor for accurate dpi value.
-                    SetWindowPos(mni->window_handle, HWND_BOTTOM, 0, 0, 0, 0, SWP_NOACTIVATE | SWP_NOSIZE);
-                }
-                return 0;
-            }
-            break;
+    _MniTimerWheelExpire((ModernNotifyIcon *)arg);
+}
 
-        case WM_SETTINGCHANGE:
-            {
-                if (wParam == SPI_SETHIGHCONTRAST) {
-                    if (_MniWmThemeChange(mni, MNI_TRUE)) {
-                        return 0;
-                    }
-                } else {
-                    if ((const wchar_t *)lParam != NULL) {
-                        const wchar_t name[] = L"ImmersiveColorSet";
-                        const int len = ARRAYSIZE(name) - 1; // ARRAYSIZE includes '\0'
-                        if (_StringCompareW((const wchar_t *)lParam, name, len) == 0) {
-                            if (_MniWmThemeChange(mni, MNI_FALSE)) {
-                                return 0;
-                            }
-                        }
-                    }
-                }
-            }
-            break;
+// ========================================================================== //
 
-        case WM_TIMER:
-            if ((UINT)wParam >= MNI_USER_TIMER_ID) {
-                if (_MniWmUserTimerTimeout(mni, (UINT)wParam)) {
-                    return 0;
-                }
+static void _MniTimerWheelArm(ModernNotifyIcon *mni, MniTimerWheel *wheel, ULONGLONG tick) {
+    if (tick == 0) {
+        if (wheel->armed != 0) {
+            if (wheel->waitable_timer) {
+                CancelWaitableTimer(wheel->waitable_timer);
             } else {
-                if (_MniWmInternalTimerTimeout(mni, (UINT)wParam)) {
-                    return 0;
-                }
+                _MniBackendKillTimer(mni, TIMER_WHEEL);
             }
-            break;
+            wheel->armed = 0;
+        }
+        return;
+    }
 
-        case WM_DPICHANGED_DELAYED:
-            if (_MniWmDpiChange(mni, (int)wParam)) {
-                return 0;
-            }
-            break;
+    ULONGLONG now = _MniTimerWheelElapsed(wheel);
+    ULONGLONG deadline = tick * wheel->tick;
+    ULONGLONG delay = deadline > now ? deadline - now : 0;
 
-        case WM_MNI_INIT:
-            if (_MniWmInit(mni)) {
-                return 0;
-            }
-            break;
+    wheel->armed = tick;
 
-        case WM_MNI_RELEASE:
-            if (_MniWmRelease(mni)) {
-                return 0;
-            }
-            break;
+    if (wheel->waitable_timer) {
+        // Completion routine runs on this thread when it waits alertably, see MniRunMessageLoop.
+        LARGE_INTEGER due = { .QuadPart = -(LONGLONG)(delay * 10) };
+        SetWaitableTimer(wheel->waitable_timer, &due, 0, _MniTimerWheelCompletion, mni, FALSE);
+    } else {
+        UINT ms = (UINT)min((delay + 999) / 1000, (ULONGLONG)0x7FFFFFFF);
+        _MniBackendSetTimer(mni, TIMER_WHEEL, max(ms, USER_TIMER_MINIMUM));
+    }
+}
 
-        case WM_MNI_SHOW:
-            if (_MniWmIconShow(mni)) {
-                return 0;
-            }
-            break;
+// ========================================================================== //
 
-        case WM_MNI_HIDE:
-            if (_MniWmIconHide(mni)) {
-                return 0;
-            }
-            break;
+static void _MniTimerWheelSampleJitter(MniTimerWheel *wheel) {
+    LONGLONG jitter = (LONGLONG)_MniTimerWheelElapsed(wheel) - (LONGLONG)(wheel->armed * wheel->tick);
 
-        case WM_MNI_ICON_CHANGE:
-            if (_MniWmIconChange(mni, (HICON)wParam)) {
-                return 0;
-            }
-            break;
+    if (wheel->jitter_samples == 0) {
+        wheel->jitter_min = jitter;
+        wheel->jitter_max = jitter;
+    } else {
+        wheel->jitter_min = min(wheel->jitter_min, jitter);
+        wheel->jitter_max = max(wheel->jitter_max, jitter);
+    }
 
-        case WM_MNI_MENU_CHANGE:
-            if (_MniWmMenuChange(mni, (HMENU)wParam)) {
-                return 0;
-            }
-            break;
-
-        case WM_MNI_TIP_CHANGE:
-            if (_MniWmTipChange(mni, (const wchar_t *)wParam)) {
-                return 0;
-            }
-            break;
+    wheel->jitter_samples += 1;
+    wheel->jitter_last = jitter;
+    wheel->jitter_sum += (double)jitter;
+    wheel->jitter_sum_sq += (double)jitter * (double)jitter;
+}
 
-        case WM_MNI_TIP_TYPE_CHANGE:
-            if (_MniWmTipTypeChange(mni, (MniTipType)wParam)) {
-                return 0;
-            }
-            break;
-    } // switch (uMsg)
+// ========================================================================== //
 
-    // explorer.exe restart / dpi changed.
-    if (uMsg == (UINT)mni->taskbar_created_message_id) {
-        if (_MniWmTaskbarCreated(mni)) {
-            return 0;
+static void _MniTimerWheelRelease(ModernNotifyIcon *mni) {
+    if (mni->timer_wheel) {
+        // Hosted icons share window that outlives them, OS timer must go away now.
+        if (mni->window_handle) {
+            _MniTimerWheelArm(mni, mni->timer_wheel, 0);
         }
-    }
 
-    // User and system messages.
-    if (WM_APP <= uMsg && uMsg <= WM_APP_LAST) {
-        if (_MniWmCustomMessage(mni, uMsg, wParam, lParam)) {
-            return 0;
-        }
-    } else {
-        if (_MniWmSystemMessage(mni, uMsg, wParam, lParam)) {
-            return 0;
-        }
+        _MniTimerWheelDestroy(mni->timer_wheel);
+        mni->timer_wheel = NULL;
     }
-
-    return DefWindowProcW(hWnd, uMsg, wParam, lParam);
 }
 
 // ========================================================================== //
 
-static LRESULT CALLBACK _MniWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    ModernNotifyIcon *mni = NULL;
+static MniError _MniTimerWheelStart(ModernNotifyIcon *mni, UINT id, UINT interval) {
+    if (!mni->timer_wheel) {
+        mni->timer_wheel = _MniTimerWheelCreate(mni->timer_mode);
+        if (!mni->timer_wheel) {
+            return MNI_ERROR_FAILED_TO_START_TIMER;
+        }
+    }
 
-    if (uMsg == WM_NCCREATE) {
-        LPCREATESTRUCT lpCreateStruct = (LPCREATESTRUCT)lParam;
+    MniTimerWheel *wheel = mni->timer_wheel;
 
-        mni = (ModernNotifyIcon *)lpCreateStruct->lpCreateParams;
-        SetWindowLongPtrW(hWnd, GWLP_USERDATA, (LONG_PTR)mni);
-        
-        mni->window_handle = hWnd;
+    // Starting timer with existing id restarts it, same as SetTimer.
+    int index = _MniTimerWheelFind(wheel, id);
+    if (index == -1) {
+        if (wheel->free_list == -1 && !_MniTimerWheelGrow(wheel)) {
+            return MNI_ERROR_OUT_OF_MEMORY;
+        }
+
+        index = wheel->free_list;
+        wheel->free_list = wheel->timers[index].hash_next;
+
+        int *bucket = _MniTimerWheelBucket(wheel, id);
+        wheel->timers[index].id = id;
+        wheel->timers[index].hash_next = *bucket;
+        *bucket = index;
+        wheel->count += 1;
     } else {
-        mni = (ModernNotifyIcon *)GetWindowLongPtrW(hWnd, GWLP_USERDATA);
+        _MniTimerWheelUnlink(wheel, index);
     }
 
-    if (mni) {
-        return _MniDispatch(mni, hWnd, uMsg, wParam, lParam);
+    // Catch up with time that passed while no timer was armed.
+    ULONGLONG now = _MniTimerWheelNow(wheel);
+    if (wheel->armed == 0 && wheel->count == 1) {
+        wheel->current = now;
     }
 
-    return DefWindowProcW(hWnd, uMsg, wParam, lParam);
-}
+    MniTimer *timer = &wheel->timers[index];
+    timer->interval = (UINT)max(((ULONGLONG)interval * 1000 + wheel->tick - 1) / wheel->tick, 1);
+    timer->expires = max(now, wheel->current) + timer->interval;
+    _MniTimerWheelLink(wheel, index);
 
-#pragma endregion
+    if (!wheel->expiring && (wheel->armed == 0 || timer->expires < wheel->armed)) {
+        _MniTimerWheelArm(mni, wheel, _MniTimerWheelNextTick(wheel));
+    }
+
+    return MNI_OK;
+}
 
 // ========================================================================== //
 
-#pragma region Internal Methods
+static MniError _MniTimerWheelStop(ModernNotifyIcon *mni, UINT id) {
+    MniTimerWheel *wheel = mni->timer_wheel;
 
-static MniError _MniUpdateIcon(ModernNotifyIcon *mni, HICON icon) {
-    MNI_TRACE(L"_MniUpdateIcon(icon=%p), icon_created=%d", icon, mni->icon_created);
+    int index = wheel ? _MniTimerWheelFind(wheel, id) : -1;
+    if (index == -1) {
+        return MNI_ERROR_FAILED_TO_STOP_TIMER;
+    }
 
-    if (mni->icon_created) {
-        NOTIFYICONDATAW nid = {
-            .cbSize = sizeof(nid),
-            .hWnd   = mni->window_handle,
-            .uID    = 0,
-            .uFlags = NIF_ICON,
-            .hIcon  = icon,
-        };
+    _MniTimerWheelUnlink(wheel, index);
 
-        if (mni->use_guid) {
-            nid.uFlags |= NIF_GUID;
-            nid.guidItem = mni->guid;
-        }
+    int *link = _MniTimerWheelBucket(wheel, id);
+    while (*link != index) {
+        link = &wheel->timers[*link].hash_next;
+    }
+    *link = wheel->timers[index].hash_next;
 
-        if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
-            nid.uFlags |= NIF_SHOWTIP;
-        }
+    wheel->timers[index].hash_next = wheel->free_list;
+    wheel->free_list = index;
+    wheel->count -= 1;
 
-        if (!Shell_NotifyIconW(NIM_MODIFY, &nid)) {
-            return MNI_ERROR_FAILED_TO_CHANGE_ICON;
-        }
+    // Early wake up is harmless, OS timer is only dropped when nothing is left.
+    if (wheel->count == 0 && !wheel->expiring) {
+        _MniTimerWheelArm(mni, wheel, 0);
     }
 
     return MNI_OK;
@@ -1220,1028 +1469,7632 @@ static MniError _MniUpdateIcon(ModernNotifyIcon *mni, HICON icon) {
 
 // ========================================================================== //
 
-static MniError _MniUpdateMenu(ModernNotifyIcon *mni, HMENU menu) {
-    MNI_TRACE(L"_MniUpdateMenu(menu=%p)", menu);
+static void _MniTimerWheelCascade(MniTimerWheel *wheel, int level) {
+    int slot = (int)((wheel->current >> (MNI_TIMER_WHEEL_BITS * level)) & (MNI_TIMER_WHEEL_SLOTS - 1));
 
-    UNREFERENCED_PARAMETER(menu);
-    UNREFERENCED_PARAMETER(mni);
+    int index = wheel->slots[level][slot];
+    wheel->slots[level][slot] = -1;
+    wheel->occupied[level] &= ~((UINT64)1 << slot);
 
-    return MNI_OK;
+    while (index != -1) {
+        int next = wheel->timers[index].next;
+        _MniTimerWheelLink(wheel, index);
+        index = next;
+    }
 }
 
 // ========================================================================== //
 
-static MniError _MniUpdateTip(ModernNotifyIcon *mni, const wchar_t *tip) {
-    MNI_TRACE(L"_MniUpdateTip(tip=%p)", &tip);
+// Advances wheel to current time, collects expired ids into wheel->expired.
+static int _MniTimerWheelAdvance(MniTimerWheel *wheel) {
+    ULONGLONG now = _MniTimerWheelNow(wheel);
+    int count = 0;
+
+    while (wheel->current < now) {
+        // Nothing can expire before level 0 wraps, skip to the next cascade.
+        if (wheel->occupied[0] == 0) {
+            ULONGLONG last = wheel->current | (MNI_TIMER_WHEEL_SLOTS - 1);
+            if (last >= now) {
+                wheel->current = now;
+                break;
+            }
+            wheel->current = last;
+        }
 
-    if (mni->icon_created) {
-        NOTIFYICONDATAW nid = {
-            .cbSize = sizeof(nid),
-            .hWnd   = mni->window_handle,
-            .uID    = 0,
-            .uFlags = NIF_TIP
-        };
+        wheel->current += 1;
 
-        if (mni->use_guid) {
-            nid.uFlags |= NIF_GUID;
-            nid.guidItem = mni->guid;
+        // Cascade higher levels whose slot was just reached.
+        for (int level = 1; level < MNI_TIMER_WHEEL_LEVELS; level += 1) {
+            if ((wheel->current & (((ULONGLONG)1 << (MNI_TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            _MniTimerWheelCascade(wheel, level);
         }
 
-        if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
-            nid.uFlags |= NIF_SHOWTIP;
-            _StringCopyW(nid.szTip, ARRAYSIZE(nid.szTip), tip);
-        }
+        int slot = (int)(wheel->current & (MNI_TIMER_WHEEL_SLOTS - 1));
+        int index = wheel->slots[0][slot];
+        wheel->slots[0][slot] = -1;
+        wheel->occupied[0] &= ~((UINT64)1 << slot);
 
-        if (!Shell_NotifyIconW(NIM_MODIFY, &nid)) {
-            return MNI_ERROR_FAILED_TO_CHANGE_TIP;
+        while (index != -1) {
+            MniTimer *timer = &wheel->timers[index];
+            int next = timer->next;
+
+            wheel->expired[count] = timer->id;
+            count += 1;
+
+            // Periods missed while the thread was busy are dropped, like WM_TIMER does.
+            ULONGLONG late = now - wheel->current;
+            timer->expires = wheel->current + timer->interval * (1 + late / timer->interval);
+            _MniTimerWheelLink(wheel, index);
+
+            index = next;
         }
     }
 
-    return MNI_OK;
+    return count;
 }
 
 // ========================================================================== //
 
-static MniError _MniInternalCreateWindow(ModernNotifyIcon *mni, MniInfo info) {
-    MNI_TRACE(L"_MniInternalCreateWindow()");
-
-    if (mni->window_handle != NULL) {
-        return MNI_WINDOW_ALREADY_CREATED;
+static void _MniTimerWheelInternalTimeout(ModernNotifyIcon *mni, UINT id) {
+    switch (id) {
+        case WHEEL_TIMER_ANIMATION:
+            _MniAnimationTick(mni);
+            break;
+        case WHEEL_TIMER_GRAPH:
+            _MniGraphTick(mni);
+            break;
+        case WHEEL_TIMER_NOTIFICATION:
+            _MniNotificationDrain(mni);
+            break;
     }
+}
 
-    // Get module handle.
-    HINSTANCE hInstance = info.module_handle;
-    if (hInstance == NULL) {
-        hInstance = GetModuleHandleW(NULL);
-        if (hInstance == NULL) {
-            return MNI_ERROR_INVALID_MODULE_HANDLE;
-        }
+// ========================================================================== //
+
+static void _MniTimerWheelExpire(ModernNotifyIcon *mni) {
+    MniTimerWheel *wheel = mni->timer_wheel;
+
+    // Callback pumping messages must not advance wheel under us.
+    if (!wheel || wheel->expiring) {
+        return;
     }
 
-    // Init window class.
-    const wchar_t *class_name = L"MniWndClass";
-    if (info.class_name != NULL && info.class_name[0] != L'\0') {
-        class_name = info.class_name;
+    wheel->expiring = MNI_TRUE;
+
+    if (wheel->armed != 0) {
+        _MniTimerWheelSampleJitter(wheel);
+        wheel->armed = 0;
     }
 
-    ATOM atom = 0;
-    {
-        WNDCLASSEX wcex = {
-            .cbSize         = sizeof(wcex),
-            .style          = CS_HREDRAW | CS_VREDRAW,
-            .lpfnWndProc    = _MniWndProc,
-            .cbClsExtra     = 0,
-            .cbWndExtra     = 0,
-            .hInstance      = hInstance,
-            .hIcon          = NULL,
-            .hCursor        = NULL,
-            .hbrBackground  = (HBRUSH)COLOR_WINDOW,
-            .lpszMenuName   = NULL,
-            .lpszClassName  = class_name,
-            .hIconSm        = NULL
-        };
+    int count = _MniTimerWheelAdvance(wheel);
+    MNI_TRACE2(L"_MniTimerWheelExpire(), current=%llu, expired=%d", wheel->current, count);
 
-        atom = RegisterClassExW(&wcex);
-        if (atom == 0) {
-            return MNI_ERROR_FAILED_TO_REGISTER_WNDCLASS;
+    // Callbacks may start timers and grow the wheel, batch is detached so growing allocates
+    // new buffer instead of freeing this one.
+    UINT *expired = wheel->expired;
+    wheel->expired = NULL;
+
+    // Internal timers are handled here, user timers are compacted for callbacks. Notification
+    // callbacks could release the icon, rest of the batch is dropped then.
+    int user_count = 0;
+    for (int i = 0; i < count && mni->timer_wheel == wheel; i += 1) {
+        UINT id = expired[i];
+        if (id < MNI_USER_TIMER_ID) {
+            _MniTimerWheelInternalTimeout(mni, id);
+        } else {
+            expired[user_count] = id;
+            user_count += 1;
         }
     }
 
-    // Create invisible window.
-    HWND hWnd = NULL;
-    {        
-        hWnd = CreateWindowExW(
-            0,
-            class_name,
-            info.window_title,
-            info.window_style,
-            0,                  // we want to put window on main monitor
-            0,                  // we want to put window on main monitor
-            100,
-            40,
-            info.parent_window,
-            NULL,
-            hInstance,
-            (LPVOID)mni
-        );
-
-        if (hWnd == NULL) {
-            UnregisterClassW(class_name, hInstance);
-            return MNI_ERROR_FAILED_TO_CREATE_WINDOW;
+    if (user_count > 0 && mni->timer_wheel == wheel) {
+        if (mni->on_timers) {
+            mni->on_timers(mni, expired, user_count);
+        } else if (mni->on_timer) {
+            // Callbacks could release the icon or stop timers of the same batch.
+            for (int i = 0; i < user_count && mni->timer_wheel == wheel; i += 1) {
+                UINT id = expired[i];
+                if (_MniTimerWheelFind(wheel, id) != -1) {
+                    mni->on_timer(mni, id);
+                }
+            }
         }
+    }
 
-        UpdateWindow(hWnd);
+    if (mni->timer_wheel != wheel) {
+        _MniFree(expired);
+        return;
     }
 
-    mni->window_handle = hWnd;
-    mni->module_handle = hInstance;
-    mni->class_name = class_name;
+    // Wheel that grew meanwhile has bigger buffer already.
+    if (wheel->expired) {
+        _MniFree(expired);
+    } else {
+        wheel->expired = expired;
+    }
 
-    return MNI_OK;
+    wheel->expiring = MNI_FALSE;
+    _MniTimerWheelArm(mni, wheel, wheel->count > 0 ? _MniTimerWheelNextTick(wheel) : 0);
 }
 
+#pragma endregion
+
 // ========================================================================== //
 
-static MniError _MniInternalDestroyWindow(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"_MniInternalDestroyWindow()");
+#pragma region Window Messages
 
-    if (mni->window_handle == NULL) {
-        return MNI_ERROR_INVALID_WINDOW_HANDLE;
-    }
+static MniBool _MniWmWindowCreate(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmWindowCreate()");
 
-    DestroyWindow(mni->window_handle);
-    mni->window_handle = NULL;
+    if (mni->on_window_create) {
+        mni->on_window_create(mni);
+    }
 
-    UnregisterClassW(mni->class_name, mni->module_handle);
-    
-    return MNI_OK;
+    return MNI_TRUE;
 }
 
 // ========================================================================== //
 
-static MniError _MniInternalCreateNotifyIcon(ModernNotifyIcon *mni) {
-    MNI_TRACE(
-        L"_MniInternalCreateNotifyIcon(), icon_created=%d, window_handle=%p",
-        mni->icon_created,
-        mni->window_handle
-    );
+static MniBool _MniWmWindowDestroy(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmWindowDestroy()");
 
-    if (mni->icon_created) {
-        return MNI_ICON_ALREADY_CREATED;
+    if (mni->on_window_destroy) {
+        mni->on_window_destroy(mni);
     }
 
-    if (mni->window_handle == NULL) {
-        return MNI_ERROR_INVALID_WINDOW_HANDLE;
-    }
+    return MNI_TRUE;
+}
 
-    NOTIFYICONDATAW nid = {
-        .cbSize           = sizeof(nid),
-        .hWnd             = mni->window_handle,
-        .uID              = 0,
-        .uFlags           = NIF_TIP | NIF_ICON | NIF_MESSAGE, // NIF_TIP is required for
-                                                              // standard tip and rich popup
-        .uCallbackMessage = WM_NOTIFYICON,
-        .hIcon            = mni->icon,
-        .szTip            = L"",
-        .dwState          = 0,
-        .dwStateMask      = 0,
-        .szInfo           = L"",
-        .uVersion         = NOTIFYICON_VERSION_4,
-        .szInfoTitle      = L"",
-        .dwInfoFlags      = 0,
-        .guidItem         = MNI_GUID_NULL,
-        .hBalloonIcon     = 0,
-    };
+// ========================================================================== //
 
-    if (mni->use_guid) {
-        nid.uFlags |= NIF_GUID;
-        nid.guidItem = mni->guid;
-    }
+static MniBool _MniWmInit(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmInit()");
 
-    if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
-        nid.uFlags |= NIF_SHOWTIP;
-        _StringCopyW(nid.szTip, ARRAYSIZE(nid.szTip), mni->tip);
-    }
-    
-    if (!Shell_NotifyIconW(NIM_ADD, &nid)) {
-        return MNI_ERROR_FAILED_TO_ADD_ICON;
+    if (mni->on_init) {
+        mni->on_init(mni);
     }
 
-    if (!Shell_NotifyIconW(NIM_SETVERSION, &nid)) {
-        if (!Shell_NotifyIconW(NIM_DELETE, &nid)) {
-            return MNI_ERROR_FAILED_TO_DELETE_ICON;
-        }
+    return MNI_TRUE;
+}
 
-        return MNI_ERROR_UNSUPPORTED_VERSION;
-    }
+// ========================================================================== //
 
-    mni->icon_created = MNI_TRUE;
-    mni->icon_visible = MNI_TRUE;
+static MniBool _MniWmRelease(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmRelease()");
 
-    return MNI_OK;
+    if (mni->on_release) {
+        mni->on_release(mni);
+    }
+
+    return MNI_TRUE;
 }
 
 // ========================================================================== //
 
-static MniError _MniInternalDestroyNotifyIcon(ModernNotifyIcon *mni) {
-    MNI_TRACE(
-        L"_MniInternalDestroyNotifyIcon(), icon_created=%d, window_handle=%p",
-        mni->icon_created,
-        mni->window_handle
-    );
+static MniBool _MniWmIconShow(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmIconShow()");
 
-    if (mni->icon_created == MNI_FALSE) {
-        return MNI_ERROR_ICON_NOT_CREATED;
+    if (mni->on_show) {
+        mni->on_show(mni);
     }
 
-    NOTIFYICONDATAW nid = {
-        .cbSize = sizeof(nid),
-        .hWnd   = mni->window_handle,
-        .uID    = 0
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmIconHide(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmIconHide()");
+
+    if (mni->on_hide) {
+        mni->on_hide(mni);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmIconChange(ModernNotifyIcon *mni, HICON icon) {
+    MNI_TRACE(L"_MniWmIconChange()");
+
+    if (mni->on_icon_change) {
+        mni->on_icon_change(mni, icon);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmMenuChange(ModernNotifyIcon *mni, HMENU menu) {
+    MNI_TRACE(L"_MniWmMenuChange()");
+
+    if (mni->on_menu_change) {
+        mni->on_menu_change(mni, menu);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmTipChange(ModernNotifyIcon *mni, const wchar_t *tip) {
+    MNI_TRACE(L"_MniWmTipChange()");
+
+    if (mni->on_tip_change) {
+        mni->on_tip_change(mni, tip);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmTipTypeChange(ModernNotifyIcon *mni, MniTipType mtt) {
+    MNI_TRACE(L"_MniWmTipTypeChange()");
+
+    if (mni->on_tip_type_change) {
+        mni->on_tip_type_change(mni, mtt);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmKeySelect(ModernNotifyIcon *mni, int x, int y) {
+    MNI_TRACE(
+        L"_MniWmKeySelect(x=%d, y=%d), prevent_double_key_select=%d",
+        x,
+        y,
+        mni->prevent_double_key_select
+    );
+
+    if (!mni->prevent_double_key_select) {
+        mni->prevent_double_key_select = MNI_TRUE;
+
+        _MniBackendSetTimer(
+            mni,
+            TIMER_PREVENT_DOUBLE_KEYSELECT,
+            TIMER_PREVENT_DOUBLE_KEYSELECT_INTERVAL
+        );
+
+        if (mni->on_key_select) {
+            mni->on_key_select(mni, x, y);
+        }
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmLmbClick(ModernNotifyIcon *mni, int x, int y) {
+    MNI_TRACE(L"_MniWmLmbClick(x=%d, y=%d)", x, y);
+
+    if (mni->on_lmb_click) {
+        mni->on_lmb_click(mni, x, y);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmLmbDoubleClick(ModernNotifyIcon *mni, int x, int y) {
+    MNI_TRACE(L"_MniWmLmbDoubleClick(x=%d, y=%d)", x, y);
+    
+    if (mni->on_lmb_double_click) {
+        mni->on_lmb_double_click(mni, x, y);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmMmbClick(ModernNotifyIcon *mni, int x, int y) {
+    MNI_TRACE(L"_MniWmMmbClick(x=%d, y=%d)", x, y);
+
+    if (mni->on_mmb_click) {
+        mni->on_mmb_click(mni, x, y);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmContextMenu(ModernNotifyIcon *mni, int x, int y) {
+    MNI_TRACE(L"_MniWmContextMenu(x=%d, y=%d)", x, y);
+    if (mni->on_context_menu_open) {
+        mni->on_context_menu_open(mni);
+    }
+
+    BOOL selected_item = 0;
+
+    if (mni->menu) {
+        HMENU hSubMenu = GetSubMenu(mni->menu, 0);
+        if (hSubMenu) {
+            // Our window must be foreground before calling TrackPopupMenu
+            // or the menu will not disappear when the user clicks away.
+            SetForegroundWindow(mni->window_handle);
+
+            UINT uFlags = TPM_RETURNCMD | TPM_NONOTIFY | TPM_RIGHTBUTTON | TPM_TOPALIGN;
+
+            int alignment = GetSystemMetrics(SM_MENUDROPALIGNMENT);
+
+            // Respect menu drop alignment.
+            if (alignment != 0) {
+                uFlags |= TPM_RIGHTALIGN;
+            } else {
+                uFlags |= TPM_LEFTALIGN;
+            }
+
+            if (_IsLayoutRTL()) {
+                uFlags = uFlags | TPM_LAYOUTRTL;                
+            }
+
+            {
+                selected_item = ImmersiveTrackPopupMenu(
+                    hSubMenu,
+                    uFlags,
+                    x,
+                    y,
+                    mni->window_handle,
+                    NULL,
+                    mni->icm_style,
+                    mni->icm_theme
+                );
+            }
+
+            // ??
+            PostMessageW(mni->window_handle, WM_NULL, 0, 0);
+        }
+    }
+
+    MNI_TRACE(L"\tTrackPopupMenu(): Selected Item: %d", selected_item);
+    if (mni->on_context_menu_item_click && selected_item != 0) {
+        mni->on_context_menu_item_click(mni, (int)selected_item);
+    }
+    
+    if (mni->on_context_menu_close) {
+        mni->on_context_menu_close(mni, (MniBool)(selected_item != 0));
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static void _MniNotificationBalloonDone(ModernNotifyIcon *mni, UINT outcome);
+
+static MniBool _MniWmBalloonShow(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmBalloonShow()");
+    
+    if (mni->on_balloon_show) {
+        mni->on_balloon_show(mni);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmBalloonHide(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmBalloonHide()");
+
+    _MniNotificationBalloonDone(mni, MNI_NOTIFICATION_OUTCOME_HIDDEN);
+
+    if (mni->on_balloon_hide) {
+        mni->on_balloon_hide(mni);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmBalloonTimeout(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmBalloonTimeout()");
+
+    _MniNotificationBalloonDone(mni, MNI_NOTIFICATION_OUTCOME_TIMEOUT);
+
+    if (mni->on_balloon_timeout) {
+        mni->on_balloon_timeout(mni);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmBalloonUserClick(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmBalloonUserClick()");
+
+    _MniNotificationBalloonDone(mni, MNI_NOTIFICATION_OUTCOME_CLICKED);
+
+    if (mni->on_balloon_click) {
+        mni->on_balloon_click(mni);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmRichPopupOpen(ModernNotifyIcon *mni, int x, int y) {
+    MNI_TRACE(L"_MniWmRichPopupOpen(x=%d, y=%d)", x, y);
+    
+    if (mni->on_rich_popup_open) {
+        mni->on_rich_popup_open(mni, x, y);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmRichPopupClose(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmRichPopupClose()");
+    
+    if (mni->on_rich_popup_close) {
+        mni->on_rich_popup_close(mni);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static void _MniIconCacheApply(ModernNotifyIcon *mni, int dpi);
+static void _MniIconCacheCollect(ModernNotifyIcon *mni);
+static void _MniIconLoaderCollect(ModernNotifyIcon *mni);
+static void _MniOverlaySetDpi(ModernNotifyIcon *mni, int dpi);
+static MniError _MniOverlayRender(ModernNotifyIcon *mni);
+static void _MniGraphRefresh(ModernNotifyIcon *mni, int dpi);
+
+static MniBool _MniWmDpiChange(ModernNotifyIcon *mni, int dpi) {
+    MNI_TRACE(L"_MniWmDpiChange(dpi=%d)", dpi);
+    
+    if (mni->dpi != dpi) {
+        // Cached variant and overlay are shown right away, before the application gets to react.
+        _MniOverlaySetDpi(mni, dpi);
+        _MniIconCacheApply(mni, dpi);
+        _MniOverlayRender(mni);
+        _MniGraphRefresh(mni, dpi);
+
+        if (mni->on_dpi_change) {
+            mni->on_dpi_change(mni, dpi);
+        }
+
+        mni->dpi = dpi;
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static void _MniIconMaskApplyTheme(ModernNotifyIcon *mni);
+
+static void _MniApplyThemeChange(ModernNotifyIcon *mni, MniBool hc, MniThemeInfo sti, MniThemeInfo ati) {
+    MniThemeInfo previous_system_theme = mni->system_theme;
+
+    if (hc) {
+        MniThemeInfo hcti = sti;
+
+        // Check if high contrast theme changed.
+        if (_IsThemeInfoChanged(mni->system_theme, hcti)) {
+            if (mni->on_system_theme_change) {
+                mni->on_system_theme_change(mni, hcti);
+            }
+
+            mni->system_theme = hcti;
+        }
+
+        // Check if high contrast theme changed.
+        if (_IsThemeInfoChanged(mni->apps_theme, hcti)) {
+            if (mni->on_apps_theme_change) {
+                mni->on_apps_theme_change(mni, hcti);
+            }
+
+            mni->apps_theme = hcti;
+        }
+    } else {
+        // Check if system theme changed.
+        if (mni->system_theme.Theme != sti.Theme) {
+            if (mni->on_system_theme_change) {
+                mni->on_system_theme_change(mni, sti);
+            }
+
+            mni->system_theme = sti;
+        }
+
+        // Check if apps theme changed.
+        if (mni->apps_theme.Theme != ati.Theme) {
+            if (mni->on_apps_theme_change) {
+                mni->on_apps_theme_change(mni, ati);
+            }
+
+            mni->apps_theme = ati;
+        }
+    }
+
+    // Mask, overlay and graph colors follow the taskbar.
+    if (_IsThemeInfoChanged(previous_system_theme, mni->system_theme)) {
+        _MniIconMaskApplyTheme(mni);
+        _MniOverlayRender(mni);
+        _MniGraphRefresh(mni, mni->dpi);
+    }
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmThemeChange(ModernNotifyIcon *mni, MniBool is_hc) {
+    MNI_TRACE(L"_MniWmThemeChange()");
+
+    // When theme change this is invoked multiple times, using is_hc is unstable.
+    UNREFERENCED_PARAMETER(is_hc);
+
+    // Theme is queried once per window, then applied to every icon on it.
+    MniBool hc = _IsHighContrastThemeEnabled();
+    MniThemeInfo sti;
+    MniThemeInfo ati;
+
+    if (hc) {
+        sti = _GetHighContrastThemeInfo();
+        ati = sti;
+    } else {
+        sti = _GetSystemThemeInfo();
+        ati = _GetAppsThemeInfo();
+    }
+
+    _MniApplyThemeChange(mni, hc, sti, ati);
+
+    for (int i = 1; i < mni->hosted_capacity; i += 1) {
+        if (mni->hosted_icons[i]) {
+            _MniApplyThemeChange(mni->hosted_icons[i], hc, sti, ati);
+        }
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static void _MniApplyTaskbarCreated(ModernNotifyIcon *mni, int dpi) {
+    if (mni->is_dpi_event) {
+        mni->is_dpi_event = MNI_FALSE;
+    } else {
+        // NOTE: Setting these two here can lead to undesirable effects
+        //       if this was called from something else than explorer restart.
+        //       It's better to force recreating icon when re-showing.
+        // Icon no longer exists.
+        //mni->icon_visible = MNI_FALSE;
+        //mni->icon_created = MNI_FALSE;
+        MNI_TRACE(L"\tEXPLORER RESTART");
+        if (mni->on_taskbar_created) {
+            mni->on_taskbar_created(mni);
+        }
+    }
+
+    if (mni->dpi != dpi) {
+        _MniBackendSendMessage(mni, WM_DPICHANGED_DELAYED, (WPARAM)dpi, 0);
+    }
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmTaskbarCreated(ModernNotifyIcon *mni) {
+    MNI_TRACE(
+        L"_MniWmTaskbarCreated(), is_dpi_event=%d, primary_monitor=%p",
+        mni->is_dpi_event,
+        mni->primary_monitor
+    );
+
+    // We check for dpi change here, once for the whole window.
+    int dpi = _GetDpi(mni->window_handle);
+    MNI_TRACE(L"\t_GetDpi(): %d", dpi);
+
+    _MniApplyTaskbarCreated(mni, dpi);
+
+    for (int i = 1; i < mni->hosted_capacity; i += 1) {
+        if (mni->hosted_icons[i]) {
+            _MniApplyTaskbarCreated(mni->hosted_icons[i], dpi);
+        }
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmUserTimerTimeout(ModernNotifyIcon *mni, UINT id) {
+    MNI_TRACE(L"_MniWmUserTimerTimeout(id=%d)", id);
+
+    if (id >= MNI_USER_TIMER_ID) {
+        if (mni->on_timer) {
+            mni->on_timer(mni, id);
+        }
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmInternalTimerTimeout(ModernNotifyIcon *mni, UINT id) {
+    MNI_TRACE(L"_MniWmInternalTimerTimeout(id=%d)", id);
+
+    if (id >= MNI_USER_TIMER_ID) {
+        return MNI_FALSE;
+    }
+
+    if (id == TIMER_PREVENT_DOUBLE_KEYSELECT) {
+        _MniBackendKillTimer(mni, TIMER_PREVENT_DOUBLE_KEYSELECT);
+        mni->prevent_double_key_select = MNI_FALSE;
+    }
+
+    if (id == TIMER_WHEEL) {
+        _MniTimerWheelExpire(mni);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmCustomMessage(ModernNotifyIcon *mni, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    MNI_TRACE(L"_MniWmCustomMessage(uMsg=%d, wParam=%lld, lParam=%lld)", uMsg, wParam, lParam);
+
+    if (mni->on_custom_message) {
+        mni->on_custom_message(mni, uMsg, wParam, lParam);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmShellComplete(ModernNotifyIcon *mni, MniError result, UINT flags) {
+    MNI_TRACE(L"_MniWmShellComplete(result=%d, flags=%x)", result, flags);
+
+    if (mni->on_shell_complete) {
+        mni->on_shell_complete(mni, result, flags);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmCommands(ModernNotifyIcon *mni) {
+    MNI_TRACE2(L"_MniWmCommands()");
+
+    _MniCommandQueueDrain(mni);
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniIsSystemMessageWanted(ModernNotifyIcon *mni, UINT uMsg) {
+    if (!mni->system_message_filtered) {
+        return MNI_TRUE;
+    }
+
+    if (uMsg < MNI_SYSTEM_MESSAGE_BITMAP_SIZE) {
+        return (mni->system_message_bits[uMsg / 32] >> (uMsg % 32)) & 1;
+    }
+
+    // Ranges are sorted and don't overlap.
+    int lo = 0;
+    int hi = mni->system_message_range_count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        const MniMessageRange *range = &mni->system_message_ranges[mid];
+
+        if (uMsg < range->first) {
+            hi = mid - 1;
+        } else if (uMsg > range->last) {
+            lo = mid + 1;
+        } else {
+            return MNI_TRUE;
+        }
+    }
+
+    return MNI_FALSE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmIconVariant(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniWmIconVariant()");
+
+    _MniIconCacheCollect(mni);
+    _MniIconLoaderCollect(mni);
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniWmSystemMessage(ModernNotifyIcon *mni, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    if (mni->on_system_message) {
+        return mni->on_system_message(mni, uMsg, wParam, lParam);
+    }
+
+    return MNI_FALSE; // we don't want to handle this message
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Window Procedure
+
+static ModernNotifyIcon *_MniHostFindIcon(ModernNotifyIcon *host, UINT uid) {
+    if (uid == host->uid) {
+        return host;
+    }
+
+    if (uid < (UINT)host->hosted_capacity) {
+        return host->hosted_icons[uid];
+    }
+
+    return NULL;
+}
+
+// ========================================================================== //
+
+typedef enum MniEvent {
+    MNI_EVENT_NONE = 0,
+
+    // Window messages.
+    MNI_EVENT_WINDOW_CREATE,
+    MNI_EVENT_WINDOW_DESTROY,
+    MNI_EVENT_DPI_CHANGED,
+    MNI_EVENT_DISPLAY_CHANGE,
+    MNI_EVENT_SETTING_CHANGE,
+    MNI_EVENT_TIMER,
+
+    // Internal messages.
+    MNI_EVENT_NOTIFY_ICON,
+    MNI_EVENT_DPI_CHANGED_DELAYED,
+    MNI_EVENT_INIT,
+    MNI_EVENT_RELEASE,
+    MNI_EVENT_SHOW,
+    MNI_EVENT_HIDE,
+    MNI_EVENT_ICON_CHANGE,
+    MNI_EVENT_MENU_CHANGE,
+    MNI_EVENT_TIP_CHANGE,
+    MNI_EVENT_TIP_TYPE_CHANGE,
+    MNI_EVENT_SHELL_COMPLETE,
+    MNI_EVENT_COMMANDS,
+    MNI_EVENT_ICON_VARIANT,
+
+    // Notify icon sub-codes, LOWORD(lParam) of WM_NOTIFYICON.
+    MNI_EVENT_KEY_SELECT,
+    MNI_EVENT_CONTEXT_MENU,
+    MNI_EVENT_LMB_CLICK,
+    MNI_EVENT_LMB_DOUBLE_CLICK,
+    MNI_EVENT_MMB_CLICK,
+    MNI_EVENT_BALLOON_SHOW,
+    MNI_EVENT_BALLOON_HIDE,
+    MNI_EVENT_BALLOON_TIMEOUT,
+    MNI_EVENT_BALLOON_CLICK,
+    MNI_EVENT_POPUP_OPEN,
+    MNI_EVENT_POPUP_CLOSE,
+
+    // Messages outside of the tables.
+    MNI_EVENT_CUSTOM_MESSAGE,
+    MNI_EVENT_SYSTEM_MESSAGE,
+
+    MNI_EVENT_COUNT
+} MniEvent;
+
+#define MNI_EVENT_BIT(_event) ((UINT64)1 << (_event))
+
+// Events that do work of their own, dispatched whether user subscribed or not.
+#define MNI_EVENT_INTERNAL (                        \
+    MNI_EVENT_BIT(MNI_EVENT_DPI_CHANGED)          | \
+    MNI_EVENT_BIT(MNI_EVENT_DISPLAY_CHANGE)       | \
+    MNI_EVENT_BIT(MNI_EVENT_SETTING_CHANGE)       | \
+    MNI_EVENT_BIT(MNI_EVENT_TIMER)                | \
+    MNI_EVENT_BIT(MNI_EVENT_NOTIFY_ICON)          | \
+    MNI_EVENT_BIT(MNI_EVENT_DPI_CHANGED_DELAYED)  | \
+    MNI_EVENT_BIT(MNI_EVENT_COMMANDS)             | \
+    MNI_EVENT_BIT(MNI_EVENT_ICON_VARIANT)         | \
+    MNI_EVENT_BIT(MNI_EVENT_KEY_SELECT)           | \
+    MNI_EVENT_BIT(MNI_EVENT_CONTEXT_MENU)           \
+)
+
+typedef MniBool (*MniMessageHandlerFn)(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam);
+
+static MniBool _MniMsgWindowCreate(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmWindowCreate(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgWindowDestroy(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmWindowDestroy(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgDpiChanged(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+
+    // NOTE: Not calling message handler immediately, because
+    //       changing dpi in system also trigger TaskbarCreated message.
+    //       And if we call handler before TaskbarCreated, changing icons etc.
+    //       doesn't work.
+    mni->is_dpi_event = MNI_TRUE;
+    for (int i = 1; i < mni->hosted_capacity; i += 1) {
+        if (mni->hosted_icons[i]) {
+            mni->hosted_icons[i]->is_dpi_event = MNI_TRUE;
+        }
+    }
+    MNI_TRACE(L"DPI CHANGED");
+    return MNI_TRUE;
+    //return _MniWmDpiChange(mni, LOWORD(wParam));
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgDisplayChange(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+
+    HMONITOR monitor = _GetPrimaryMonitor();
+    if (mni->primary_monitor != monitor) {
+        MNI_TRACE(L"PRIMARY MONITOR CHANGE");
+        mni->primary_monitor = monitor;
+
+        // Move invisible window to primary monitor for accurate dpi value.
+        SetWindowPos(mni->window_handle, HWND_BOTTOM, 0, 0, 0, 0, SWP_NOACTIVATE | SWP_NOSIZE);
+    }
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgSettingChange(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    if (wParam == SPI_SETHIGHCONTRAST) {
+        return _MniWmThemeChange(mni, MNI_TRUE);
+    }
+
+    if ((const wchar_t *)lParam != NULL) {
+        const wchar_t name[] = L"ImmersiveColorSet";
+        const int len = ARRAYSIZE(name) - 1; // ARRAYSIZE includes '\0'
+        if (_StringCompareW((const wchar_t *)lParam, name, len) == 0) {
+            return _MniWmThemeChange(mni, MNI_FALSE);
+        }
+    }
+
+    return MNI_FALSE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgTimer(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+
+    if ((UINT)wParam >= MNI_USER_TIMER_ID) {
+        return _MniWmUserTimerTimeout(mni, (UINT)wParam);
+    }
+
+    return _MniWmInternalTimerTimeout(mni, (UINT)wParam);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgDpiChangedDelayed(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmDpiChange(mni, (int)wParam);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgInit(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmInit(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgRelease(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmRelease(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgShow(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmIconShow(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgHide(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmIconHide(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgIconChange(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmIconChange(mni, (HICON)wParam);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgMenuChange(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmMenuChange(mni, (HMENU)wParam);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgTipChange(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmTipChange(mni, (const wchar_t *)wParam);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgTipTypeChange(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmTipTypeChange(mni, (MniTipType)wParam);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgShellComplete(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    return _MniWmShellComplete(mni, (MniError)(INT_PTR)wParam, (UINT)LOWORD(lParam));
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgCommands(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmCommands(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgIconVariant(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmIconVariant(mni);
+}
+
+// ========================================================================== //
+
+// When you select icon with keyboard and press Space or Enter.
+// Pressing Enter triggers this twice.
+static MniBool _MniMsgKeySelect(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmKeySelect(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam));
+}
+
+// ========================================================================== //
+
+// When you Right Click on icon or Shift+F10 when it's selected with keyboard.
+static MniBool _MniMsgContextMenu(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmContextMenu(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam));
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgLmbClick(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmLmbClick(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam));
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgLmbDoubleClick(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmLmbDoubleClick(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam));
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgMmbClick(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmMmbClick(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam));
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgBalloonShow(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmBalloonShow(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgBalloonHide(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmBalloonHide(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgBalloonTimeout(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmBalloonTimeout(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgBalloonClick(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmBalloonUserClick(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgPopupOpen(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmRichPopupOpen(mni, GET_X_LPARAM(wParam), GET_Y_LPARAM(wParam));
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgPopupClose(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UNREFERENCED_PARAMETER(wParam);
+    UNREFERENCED_PARAMETER(lParam);
+    return _MniWmRichPopupClose(mni);
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgNotifyIcon(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam);
+
+static const MniMessageHandlerFn _mni_event_handlers[MNI_EVENT_COUNT] = {
+    [MNI_EVENT_WINDOW_CREATE]       = _MniMsgWindowCreate,
+    [MNI_EVENT_WINDOW_DESTROY]      = _MniMsgWindowDestroy,
+    [MNI_EVENT_DPI_CHANGED]         = _MniMsgDpiChanged,
+    [MNI_EVENT_DISPLAY_CHANGE]      = _MniMsgDisplayChange,
+    [MNI_EVENT_SETTING_CHANGE]      = _MniMsgSettingChange,
+    [MNI_EVENT_TIMER]               = _MniMsgTimer,
+    [MNI_EVENT_NOTIFY_ICON]         = _MniMsgNotifyIcon,
+    [MNI_EVENT_DPI_CHANGED_DELAYED] = _MniMsgDpiChangedDelayed,
+    [MNI_EVENT_INIT]                = _MniMsgInit,
+    [MNI_EVENT_RELEASE]             = _MniMsgRelease,
+    [MNI_EVENT_SHOW]                = _MniMsgShow,
+    [MNI_EVENT_HIDE]                = _MniMsgHide,
+    [MNI_EVENT_ICON_CHANGE]         = _MniMsgIconChange,
+    [MNI_EVENT_MENU_CHANGE]         = _MniMsgMenuChange,
+    [MNI_EVENT_TIP_CHANGE]          = _MniMsgTipChange,
+    [MNI_EVENT_TIP_TYPE_CHANGE]     = _MniMsgTipTypeChange,
+    [MNI_EVENT_SHELL_COMPLETE]      = _MniMsgShellComplete,
+    [MNI_EVENT_COMMANDS]            = _MniMsgCommands,
+    [MNI_EVENT_ICON_VARIANT]        = _MniMsgIconVariant,
+    [MNI_EVENT_KEY_SELECT]          = _MniMsgKeySelect,
+    [MNI_EVENT_CONTEXT_MENU]        = _MniMsgContextMenu,
+    [MNI_EVENT_LMB_CLICK]           = _MniMsgLmbClick,
+    [MNI_EVENT_LMB_DOUBLE_CLICK]    = _MniMsgLmbDoubleClick,
+    [MNI_EVENT_MMB_CLICK]           = _MniMsgMmbClick,
+    [MNI_EVENT_BALLOON_SHOW]        = _MniMsgBalloonShow,
+    [MNI_EVENT_BALLOON_HIDE]        = _MniMsgBalloonHide,
+    [MNI_EVENT_BALLOON_TIMEOUT]     = _MniMsgBalloonTimeout,
+    [MNI_EVENT_BALLOON_CLICK]       = _MniMsgBalloonClick,
+    [MNI_EVENT_POPUP_OPEN]          = _MniMsgPopupOpen,
+    [MNI_EVENT_POPUP_CLOSE]         = _MniMsgPopupClose,
+};
+
+// Window messages below WM_USER we handle, everything else is MNI_EVENT_NONE.
+static const unsigned char _mni_window_events[WM_USER] = {
+    [WM_CREATE]        = MNI_EVENT_WINDOW_CREATE,
+    [WM_DESTROY]       = MNI_EVENT_WINDOW_DESTROY,
+    [WM_DPICHANGED]    = MNI_EVENT_DPI_CHANGED,
+    [WM_DISPLAYCHANGE] = MNI_EVENT_DISPLAY_CHANGE,
+    [WM_SETTINGCHANGE] = MNI_EVENT_SETTING_CHANGE,
+    [WM_TIMER]         = MNI_EVENT_TIMER,
+};
+
+// Internal messages indexed from WM_USER.
+static const unsigned char _mni_internal_events[WM_MNI_LAST - WM_USER + 1] = {
+    [WM_NOTIFYICON - WM_USER]           = MNI_EVENT_NOTIFY_ICON,
+    [WM_DPICHANGED_DELAYED - WM_USER]   = MNI_EVENT_DPI_CHANGED_DELAYED,
+    [WM_MNI_INIT - WM_USER]             = MNI_EVENT_INIT,
+    [WM_MNI_RELEASE - WM_USER]          = MNI_EVENT_RELEASE,
+    [WM_MNI_SHOW - WM_USER]             = MNI_EVENT_SHOW,
+    [WM_MNI_HIDE - WM_USER]             = MNI_EVENT_HIDE,
+    [WM_MNI_ICON_CHANGE - WM_USER]      = MNI_EVENT_ICON_CHANGE,
+    [WM_MNI_MENU_CHANGE - WM_USER]      = MNI_EVENT_MENU_CHANGE,
+    [WM_MNI_TIP_CHANGE - WM_USER]       = MNI_EVENT_TIP_CHANGE,
+    [WM_MNI_TIP_TYPE_CHANGE - WM_USER]  = MNI_EVENT_TIP_TYPE_CHANGE,
+    [WM_MNI_SHELL_COMPLETE - WM_USER]   = MNI_EVENT_SHELL_COMPLETE,
+    [WM_MNI_COMMANDS - WM_USER]         = MNI_EVENT_COMMANDS,
+    [WM_MNI_ICON_VARIANT - WM_USER]     = MNI_EVENT_ICON_VARIANT,
+};
+
+// Notify icon sub-codes, NIN_* codes are right above WM_USER.
+// NIN_SELECT (left click) is not handled.
+static const unsigned char _mni_notify_icon_events[NIN_POPUPCLOSE + 1] = {
+    [NIN_KEYSELECT]        = MNI_EVENT_KEY_SELECT,
+    [WM_CONTEXTMENU]       = MNI_EVENT_CONTEXT_MENU,
+    [WM_LBUTTONUP]         = MNI_EVENT_LMB_CLICK,
+    [WM_LBUTTONDBLCLK]     = MNI_EVENT_LMB_DOUBLE_CLICK,
+    [WM_MBUTTONUP]         = MNI_EVENT_MMB_CLICK,
+    [NIN_BALLOONSHOW]      = MNI_EVENT_BALLOON_SHOW,
+    [NIN_BALLOONHIDE]      = MNI_EVENT_BALLOON_HIDE,
+    [NIN_BALLOONTIMEOUT]   = MNI_EVENT_BALLOON_TIMEOUT,
+    [NIN_BALLOONUSERCLICK] = MNI_EVENT_BALLOON_CLICK,
+    [NIN_POPUPOPEN]        = MNI_EVENT_POPUP_OPEN,
+    [NIN_POPUPCLOSE]       = MNI_EVENT_POPUP_CLOSE,
+};
+
+// ========================================================================== //
+
+static MniBool _MniIsSubscribed(ModernNotifyIcon *mni, MniEvent event) {
+    return ((MNI_EVENT_INTERNAL | mni->subscriptions) & MNI_EVENT_BIT(event)) != 0;
+}
+
+// ========================================================================== //
+
+static MniBool _MniMsgNotifyIcon(ModernNotifyIcon *mni, WPARAM wParam, LPARAM lParam) {
+    UINT code = LOWORD(lParam);
+    if (code >= ARRAYSIZE(_mni_notify_icon_events)) {
+        return MNI_FALSE;
+    }
+
+    MniEvent event = (MniEvent)_mni_notify_icon_events[code];
+    if (!_MniIsSubscribed(mni, event)) {
+        return event != MNI_EVENT_NONE;
+    }
+
+    return _mni_event_handlers[event](mni, wParam, lParam);
+}
+
+// ========================================================================== //
+
+static UINT64 _MniComputeSubscriptions(const ModernNotifyIcon *mni) {
+    UINT64 mask = 0;
+
+    #define MNI_SUBSCRIBE(_callback, _event) \
+        if (mni->_callback) { mask |= MNI_EVENT_BIT(_event); }
+
+    MNI_SUBSCRIBE(on_window_create,     MNI_EVENT_WINDOW_CREATE);
+    MNI_SUBSCRIBE(on_window_destroy,    MNI_EVENT_WINDOW_DESTROY);
+    MNI_SUBSCRIBE(on_init,              MNI_EVENT_INIT);
+    MNI_SUBSCRIBE(on_release,           MNI_EVENT_RELEASE);
+    MNI_SUBSCRIBE(on_show,              MNI_EVENT_SHOW);
+    MNI_SUBSCRIBE(on_hide,              MNI_EVENT_HIDE);
+    MNI_SUBSCRIBE(on_icon_change,       MNI_EVENT_ICON_CHANGE);
+    MNI_SUBSCRIBE(on_menu_change,       MNI_EVENT_MENU_CHANGE);
+    MNI_SUBSCRIBE(on_tip_change,        MNI_EVENT_TIP_CHANGE);
+    MNI_SUBSCRIBE(on_tip_type_change,   MNI_EVENT_TIP_TYPE_CHANGE);
+    MNI_SUBSCRIBE(on_shell_complete,    MNI_EVENT_SHELL_COMPLETE);
+    MNI_SUBSCRIBE(on_lmb_click,         MNI_EVENT_LMB_CLICK);
+    MNI_SUBSCRIBE(on_lmb_double_click,  MNI_EVENT_LMB_DOUBLE_CLICK);
+    MNI_SUBSCRIBE(on_mmb_click,         MNI_EVENT_MMB_CLICK);
+    MNI_SUBSCRIBE(on_balloon_show,      MNI_EVENT_BALLOON_SHOW);
+    MNI_SUBSCRIBE(on_balloon_hide,      MNI_EVENT_BALLOON_HIDE);
+    MNI_SUBSCRIBE(on_balloon_timeout,   MNI_EVENT_BALLOON_TIMEOUT);
+    MNI_SUBSCRIBE(on_balloon_click,     MNI_EVENT_BALLOON_CLICK);
+    MNI_SUBSCRIBE(on_rich_popup_open,   MNI_EVENT_POPUP_OPEN);
+    MNI_SUBSCRIBE(on_rich_popup_close,  MNI_EVENT_POPUP_CLOSE);
+    MNI_SUBSCRIBE(on_custom_message,    MNI_EVENT_CUSTOM_MESSAGE);
+    MNI_SUBSCRIBE(on_system_message,    MNI_EVENT_SYSTEM_MESSAGE);
+
+    #undef MNI_SUBSCRIBE
+
+    // Queue needs to know when balloon is gone.
+    if (mni->notification_queue) {
+        mask |= MNI_EVENT_BIT(MNI_EVENT_BALLOON_HIDE) | MNI_EVENT_BIT(MNI_EVENT_BALLOON_TIMEOUT) | MNI_EVENT_BIT(MNI_EVENT_BALLOON_CLICK);
+    }
+
+    return mask;
+}
+
+// ========================================================================== //
+
+static LRESULT _MniDispatch(
+    ModernNotifyIcon    *mni,
+    HWND                hWnd,
+    UINT                uMsg,
+    WPARAM              wParam,
+    LPARAM              lParam
+) {
+    MNI_TRACE2(L"_MniDispatch(uMsg=0x%04x, wParam=%lld, lParam=%lld)", uMsg, wParam, lParam);
+
+    // Route messages meant for icons attached to this window.
+    if (mni->hosted_count > 0) {
+        ModernNotifyIcon *target = NULL;
+
+        if (WM_NOTIFYICON <= uMsg && uMsg <= WM_MNI_LAST) {
+            target = _MniHostFindIcon(mni, HIWORD(lParam));
+        } else if (uMsg == WM_TIMER) {
+            target = _MniHostFindIcon(mni, (UINT)(wParam >> MNI_HOSTED_TIMER_SHIFT));
+            if (target && target != mni) {
+                wParam &= MNI_HOSTED_TIMER_ID_LIMIT;
+            }
+        }
+
+        if (target && target != mni) {
+            return _MniDispatch(target, hWnd, uMsg, wParam, lParam);
+        }
+    }
+
+    MniEvent event = MNI_EVENT_NONE;
+    if (uMsg < WM_USER) {
+        event = (MniEvent)_mni_window_events[uMsg];
+    } else if (uMsg <= WM_MNI_LAST) {
+        event = (MniEvent)_mni_internal_events[uMsg - WM_USER];
+    }
+
+    if (event != MNI_EVENT_NONE) {
+        // Nobody listens, message is still ours.
+        if (!_MniIsSubscribed(mni, event)) {
+            return 0;
+        }
+
+        if (_mni_event_handlers[event](mni, wParam, lParam)) {
+            return 0;
+        }
+    }
+
+    // explorer.exe restart / dpi changed.
+    if (uMsg == (UINT)mni->taskbar_created_message_id) {
+        if (_MniWmTaskbarCreated(mni)) {
+            return 0;
+        }
+    }
+
+    // User and system messages.
+    if (WM_APP <= uMsg && uMsg <= WM_APP_LAST) {
+        if (!_MniIsSubscribed(mni, MNI_EVENT_CUSTOM_MESSAGE)) {
+            return 0;
+        }
+
+        if (_MniWmCustomMessage(mni, uMsg, wParam, lParam)) {
+            return 0;
+        }
+    } else if (_MniIsSubscribed(mni, MNI_EVENT_SYSTEM_MESSAGE) && _MniIsSystemMessageWanted(mni, uMsg)) {
+        if (_MniWmSystemMessage(mni, uMsg, wParam, lParam)) {
+            return 0;
+        }
+    }
+
+    return DefWindowProcW(hWnd, uMsg, wParam, lParam);
+}
+
+// ========================================================================== //
+
+static LRESULT CALLBACK _MniWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    ModernNotifyIcon *mni = NULL;
+
+    if (uMsg == WM_NCCREATE) {
+        LPCREATESTRUCT lpCreateStruct = (LPCREATESTRUCT)lParam;
+
+        mni = (ModernNotifyIcon *)lpCreateStruct->lpCreateParams;
+        SetWindowLongPtrW(hWnd, GWLP_USERDATA, (LONG_PTR)mni);
+        
+        mni->window_handle = hWnd;
+    } else {
+        mni = (ModernNotifyIcon *)GetWindowLongPtrW(hWnd, GWLP_USERDATA);
+    }
+
+    if (mni) {
+        return _MniDispatch(mni, hWnd, uMsg, wParam, lParam);
+    }
+
+    return DefWindowProcW(hWnd, uMsg, wParam, lParam);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Recording Backend
+
+static void _MniRecorderPush(
+    MniRecorder             *recorder,
+    MniRecordType           type,
+    HWND                    window,
+    DWORD                   message,
+    WPARAM                  wParam,
+    LPARAM                  lParam,
+    const NOTIFYICONDATAW   *nid
+) {
+    // Shell worker records from its own thread, slots are claimed atomically.
+    LONG slot = InterlockedIncrement(&recorder->total_count) - 1;
+
+    if (slot >= recorder->capacity) {
+        return;
+    }
+
+    MniRecord *record = &recorder->records[slot];
+
+    record->type    = type;
+    record->window  = window;
+    record->message = message;
+    record->wParam  = wParam;
+    record->lParam  = lParam;
+
+    if (nid) {
+        record->nid = *nid;
+    }
+
+    // Record is complete before count says it's there.
+    InterlockedIncrement(&recorder->count);
+}
+
+// ========================================================================== //
+
+static BOOL _MniRecorderNotifyIcon(void *context, DWORD message, NOTIFYICONDATAW *nid) {
+    MniRecorder *recorder = (MniRecorder *)context;
+
+    _MniRecorderPush(recorder, MNI_RECORD_NOTIFY_ICON, nid->hWnd, message, 0, 0, nid);
+
+    return recorder->fail_notify_icon ? FALSE : TRUE;
+}
+
+// ========================================================================== //
+
+static MniError _MniRecorderCreateWindow(
+    void            *context,
+    HINSTANCE       module_handle,
+    const wchar_t   *class_name,
+    const wchar_t   *title,
+    DWORD           style,
+    HWND            parent,
+    LPVOID          param,
+    HWND            *window
+) {
+    UNREFERENCED_PARAMETER(module_handle);
+    UNREFERENCED_PARAMETER(class_name);
+    UNREFERENCED_PARAMETER(title);
+    UNREFERENCED_PARAMETER(style);
+    UNREFERENCED_PARAMETER(parent);
+
+    MniRecorder *recorder = (MniRecorder *)context;
+
+    // Recorder address is used as a fake window handle, it's unique per recorder
+    // and it will never be a valid Win32 window.
+    HWND hWnd = (HWND)recorder;
+
+    _MniRecorderPush(recorder, MNI_RECORD_CREATE_WINDOW, hWnd, WM_CREATE, 0, (LPARAM)param, NULL);
+
+    recorder->mni = (ModernNotifyIcon *)param;
+    if (recorder->mni) {
+        recorder->mni->window_handle = hWnd;
+        _MniDispatch(recorder->mni, hWnd, WM_CREATE, 0, 0);
+    }
+
+    *window = hWnd;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static BOOL _MniRecorderDestroyWindow(void *context, HWND window, HINSTANCE module_handle, const wchar_t *class_name) {
+    UNREFERENCED_PARAMETER(module_handle);
+    UNREFERENCED_PARAMETER(class_name);
+
+    MniRecorder *recorder = (MniRecorder *)context;
+
+    _MniRecorderPush(recorder, MNI_RECORD_DESTROY_WINDOW, window, WM_DESTROY, 0, 0, NULL);
+
+    if (recorder->mni && recorder->mni->window_handle == window) {
+        _MniDispatch(recorder->mni, window, WM_DESTROY, 0, 0);
+    }
+
+    recorder->mni = NULL;
+
+    return TRUE;
+}
+
+// ========================================================================== //
+
+static LRESULT _MniRecorderSendMessage(void *context, HWND window, UINT msg, WPARAM wParam, LPARAM lParam) {
+    MniRecorder *recorder = (MniRecorder *)context;
+
+    _MniRecorderPush(recorder, MNI_RECORD_SEND_MESSAGE, window, msg, wParam, lParam, NULL);
+
+    if (recorder->mni && recorder->mni->window_handle == window) {
+        return _MniDispatch(recorder->mni, window, msg, wParam, lParam);
+    }
+
+    return 0;
+}
+
+// ========================================================================== //
+
+static BOOL _MniRecorderPostMessage(void *context, HWND window, UINT msg, WPARAM wParam, LPARAM lParam) {
+    MniRecorder *recorder = (MniRecorder *)context;
+
+    _MniRecorderPush(recorder, MNI_RECORD_POST_MESSAGE, window, msg, wParam, lParam, NULL);
+
+    // There is no queue, message is dispatched right away on the calling thread.
+    if (recorder->mni && recorder->mni->window_handle == window) {
+        _MniDispatch(recorder->mni, window, msg, wParam, lParam);
+    }
+
+    return TRUE;
+}
+
+// ========================================================================== //
+
+static UINT_PTR _MniRecorderSetTimer(void *context, HWND window, UINT_PTR id, UINT interval) {
+    MniRecorder *recorder = (MniRecorder *)context;
+
+    _MniRecorderPush(recorder, MNI_RECORD_SET_TIMER, window, WM_TIMER, (WPARAM)id, (LPARAM)interval, NULL);
+
+    return id;
+}
+
+// ========================================================================== //
+
+static BOOL _MniRecorderKillTimer(void *context, HWND window, UINT_PTR id) {
+    MniRecorder *recorder = (MniRecorder *)context;
+
+    _MniRecorderPush(recorder, MNI_RECORD_KILL_TIMER, window, WM_TIMER, (WPARAM)id, 0, NULL);
+
+    return TRUE;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Shell Worker
+
+// Shell worker owns a single mailbox with the newest requested state.
+// Setters overwrite it and return, worker applies whatever is there when it wakes up,
+// so intermediate values are dropped instead of queued behind a busy explorer.
+// Worker never touches the icon, everything it needs is copied into the mailbox. Icon
+// is copied too, so callers may destroy theirs as soon as the setter returns.
+typedef struct MniShellWorker {
+    SRWLOCK             lock;
+    SRWLOCK             shell_lock;         // held while modify is pushed, orders it with add and delete
+    HANDLE              wake_event;
+    HANDLE              thread;
+    volatile LONG       stop;
+    MniBackend          backend;            // fixed for life of the icon
+
+    // Mailbox (guarded by lock).
+    UINT                flags;
+    HICON               icon;               // owned copy, not yet applied
+    wchar_t             tip[128];
+    DWORD               state;
+    MniTipType          tip_type;
+    HWND                window;
+    UINT                uid;
+    MniBool             use_guid;
+    GUID                guid;
+    MniBool             notify_complete;    // on_shell_complete is set
+
+    // Worker thread only, and owner thread once worker is stopped.
+    HICON               applied;            // owned copy the shell got last
+
+    volatile LONG       icon_failed;        // last icon push failed, consumed by owner thread
+} MniShellWorker;
+
+// ========================================================================== //
+
+static MniError _MniShellResultFromFlags(UINT flags, DWORD state) {
+    switch (flags) {
+        case NIF_ICON:  return MNI_ERROR_FAILED_TO_CHANGE_ICON;
+        case NIF_TIP:   return MNI_ERROR_FAILED_TO_CHANGE_TIP;
+        case NIF_STATE: return state == 0 ? MNI_ERROR_FAILED_TO_SHOW_ICON : MNI_ERROR_FAILED_TO_HIDE_ICON;
+    }
+
+    return MNI_ERROR_FAILED_TO_UPDATE_ICON;
+}
+
+// ========================================================================== //
+
+static MniBool _MniShellWorkerPublish(
+    ModernNotifyIcon    *mni,
+    MniShellWorker      *worker,
+    UINT                flags,
+    HICON               icon,
+    const wchar_t       *tip,
+    DWORD               state
+) {
+    HICON copy = NULL;
+    HICON superseded = NULL;
+
+    if ((flags & NIF_ICON) == NIF_ICON && icon) {
+        copy = CopyIcon(icon);
+        if (!copy) {
+            return MNI_FALSE;
+        }
+    }
+
+    AcquireSRWLockExclusive(&worker->lock);
+    {
+        if ((flags & NIF_ICON) == NIF_ICON) {
+            // Copy that was never applied is dropped with the value it carried.
+            superseded = worker->icon;
+            worker->icon = copy;
+        }
+
+        if ((flags & NIF_TIP) == NIF_TIP) {
+            _StringCopyW(worker->tip, ARRAYSIZE(worker->tip), tip);
+        }
+
+        if ((flags & NIF_STATE) == NIF_STATE) {
+            worker->state = state;
+        }
+
+        worker->tip_type = mni->tip_type;
+        worker->window = mni->window_handle;
+        worker->uid = mni->uid;
+        worker->use_guid = mni->use_guid;
+        worker->guid = mni->guid;
+        worker->notify_complete = mni->on_shell_complete != NULL;
+        worker->flags |= flags;
+    }
+    ReleaseSRWLockExclusive(&worker->lock);
+
+    if (superseded) {
+        DestroyIcon(superseded);
+    }
+
+    SetEvent(worker->wake_event);
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static void _MniShellWorkerApply(MniShellWorker *worker) {
+    NOTIFYICONDATAW nid = { .cbSize = sizeof(nid) };
+    MniBool notify_complete;
+
+    AcquireSRWLockExclusive(&worker->shell_lock);
+
+    // Take the newest state and leave mailbox empty, icon copy is owned here now.
+    AcquireSRWLockExclusive(&worker->lock);
+    {
+        nid.hWnd = worker->window;
+        nid.uID = worker->uid;
+        nid.uFlags = worker->flags;
+        nid.hIcon = worker->icon;
+        nid.dwState = worker->state;
+
+        if (worker->use_guid) {
+            nid.uFlags |= NIF_GUID;
+            nid.guidItem = worker->guid;
+        }
+
+        if (worker->tip_type == MNI_TIP_TYPE_STANDARD) {
+            nid.uFlags |= NIF_SHOWTIP;
+
+            if ((worker->flags & NIF_TIP) == NIF_TIP) {
+                _StringCopyW(nid.szTip, ARRAYSIZE(nid.szTip), worker->tip);
+            }
+        }
+
+        notify_complete = worker->notify_complete;
+        worker->icon = NULL;
+        worker->flags = 0;
+    }
+    ReleaseSRWLockExclusive(&worker->lock);
+
+    UINT flags = nid.uFlags & (NIF_ICON | NIF_TIP | NIF_STATE);
+    if (flags == 0) {
+        ReleaseSRWLockExclusive(&worker->shell_lock);
+        return;
+    }
+
+    if ((flags & NIF_STATE) == NIF_STATE) {
+        nid.dwStateMask = NIS_HIDDEN;
+    }
+
+    BOOL applied = worker->backend.notify_icon
+        ? worker->backend.notify_icon(worker->backend.context, NIM_MODIFY, &nid)
+        : _MniWin32NotifyIcon(NULL, NIM_MODIFY, &nid);
+
+    MniError result = applied ? MNI_OK : _MniShellResultFromFlags(flags, nid.dwState);
+
+    MNI_TRACE(L"_MniShellWorkerApply(), flags=%x, result=%d", flags, result);
+
+    // Previous copy is released only once the shell has the new one, failed one is not needed.
+    if ((flags & NIF_ICON) == NIF_ICON) {
+        HICON release = applied ? worker->applied : nid.hIcon;
+        if (applied) {
+            worker->applied = nid.hIcon;
+        }
+
+        // Pushes are applied in order, the last one tells what the shell shows.
+        InterlockedExchange(&worker->icon_failed, applied ? 0 : 1);
+
+        if (release) {
+            DestroyIcon(release);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&worker->shell_lock);
+
+    if (notify_complete) {
+        LPARAM lParam = (LPARAM)(((UINT)nid.uID << 16) | (flags & 0xFFFF));
+        if (worker->backend.post_message) {
+            worker->backend.post_message(worker->backend.context, nid.hWnd, WM_MNI_SHELL_COMPLETE, (WPARAM)(INT_PTR)result, lParam);
+        } else {
+            _MniWin32PostMessage(NULL, nid.hWnd, WM_MNI_SHELL_COMPLETE, (WPARAM)(INT_PTR)result, lParam);
+        }
+    }
+}
+
+// ========================================================================== //
+
+static DWORD WINAPI _MniShellWorkerProc(LPVOID param) {
+    MniShellWorker *worker = (MniShellWorker *)param;
+
+    while (1) {
+        WaitForSingleObject(worker->wake_event, INFINITE);
+
+        if (InterlockedCompareExchange(&worker->stop, 0, 0) != 0) {
+            break;
+        }
+
+        _MniShellWorkerApply(worker);
+    }
+
+    return 0;
+}
+
+// ========================================================================== //
+
+static MniBool _MniShellWorkerTryPublish(
+    ModernNotifyIcon    *mni,
+    UINT                flags,
+    HICON               icon,
+    const wchar_t       *tip,
+    DWORD               state
+) {
+    if (!mni->shell_worker) {
+        return MNI_FALSE;
+    }
+
+    // Icon that can't be copied is sent directly, worker is flushed first to keep order.
+    if (!_MniShellWorkerPublish(mni, mni->shell_worker, flags, icon, tip, state)) {
+        MniStopShellWorker(mni);
+        return MNI_FALSE;
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+// NIM_ADD and NIM_DELETE are sent by the owner thread. Pending modify is dropped, add carries
+// current state and after delete there's nothing to modify, and one being pushed is waited
+// for, so no modify lands on the icon once it's recreated or deleted. Shell lock is held
+// until _MniShellWorkerResume.
+static MniShellWorker *_MniShellWorkerSuspend(ModernNotifyIcon *mni) {
+    MniShellWorker *worker = mni->shell_worker;
+    if (!worker) {
+        return NULL;
+    }
+
+    HICON discarded;
+
+    AcquireSRWLockExclusive(&worker->shell_lock);
+    AcquireSRWLockExclusive(&worker->lock);
+    {
+        discarded = worker->icon;
+        worker->icon = NULL;
+        worker->flags = 0;
+    }
+    ReleaseSRWLockExclusive(&worker->lock);
+
+    if (discarded) {
+        DestroyIcon(discarded);
+    }
+
+    return worker;
+}
+
+// ========================================================================== //
+
+static void _MniShellWorkerResume(MniShellWorker *worker) {
+    if (worker) {
+        ReleaseSRWLockExclusive(&worker->shell_lock);
+    }
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Tray Thread
+
+typedef struct MniTrayThread {
+    ModernNotifyIcon    *mni;
+    MniInfo             info;
+    HANDLE              thread;
+    DWORD               thread_id;
+    HANDLE              ready_event;
+    MniError            init_result;
+    volatile LONG       destroy_icon;
+    volatile LONG       destroy_menu;
+} MniTrayThread;
+
+// ========================================================================== //
+
+static DWORD WINAPI _MniTrayThreadProc(LPVOID param) {
+    MniTrayThread *tray = (MniTrayThread *)param;
+    ModernNotifyIcon *mni = tray->mni;
+
+    // Window is created here, so this thread owns it and receives its messages.
+    MniError result = MniInit(mni, tray->info);
+    if (MNI_SUCCEEDED(result)) {
+        result = MniCreateCommandQueue(mni, 0);
+        if (MNI_FAILED(result)) {
+            MniRelease(mni, MNI_FALSE, MNI_FALSE);
+        }
+    }
+
+    tray->init_result = result;
+    if (MNI_FAILED(result)) {
+        SetEvent(tray->ready_event);
+        return 1;
+    }
+
+    mni->tray_thread = tray;
+    SetEvent(tray->ready_event);
+
+    int ret = MniRunMessageLoop();
+
+    MniRelease(
+        mni,
+        (MniBool)InterlockedCompareExchange(&tray->destroy_icon, 0, 0),
+        (MniBool)InterlockedCompareExchange(&tray->destroy_menu, 0, 0)
+    );
+
+    return (DWORD)ret;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Internal Methods
+
+static MniBool _MniIconFingerprint(HICON icon, UINT64 *fingerprint);
+
+// known_fingerprint is used when caller already hashed the content, otherwise icon is hashed.
+static MniError _MniUpdateIconWithFingerprint(ModernNotifyIcon *mni, HICON icon, const UINT64 *known_fingerprint) {
+    MNI_TRACE(L"_MniUpdateIconWithFingerprint(icon=%p), icon_created=%d", icon, mni->icon_created);
+
+    if (mni->icon_created) {
+        // Fingerprint was stored when the icon was published, worker failed to deliver it.
+        if (mni->shell_worker && InterlockedExchange(&mni->shell_worker->icon_failed, 0)) {
+            mni->icon_fingerprint_valid = MNI_FALSE;
+        }
+
+        // Different handle with the same pixels doesn't need cross-process call. Inside a scope
+        // only while no other icon is pending, flush sends the last one either way.
+        UINT64 fingerprint = known_fingerprint ? *known_fingerprint : 0;
+        MniBool fingerprinted = known_fingerprint ? MNI_TRUE : _MniIconFingerprint(icon, &fingerprint);
+        if (fingerprinted && mni->icon_fingerprint_valid && mni->icon_fingerprint == fingerprint
+            && (mni->update_flags & NIF_ICON) == 0) {
+            MNI_TRACE(L"_MniUpdateIconWithFingerprint() suppressed, same content");
+            mni->icon_updates_suppressed += 1;
+            return MNI_OK;
+        }
+
+        mni->icon_fingerprint = fingerprint;
+        mni->icon_fingerprint_valid = fingerprinted;
+
+        // Inside MniBeginUpdate/MniEndUpdate scope, mni->icon is sent and counted on flush.
+        if (mni->update_depth > 0) {
+            mni->update_flags |= NIF_ICON;
+            return MNI_OK;
+        }
+
+        mni->icon_updates_pushed += 1;
+
+        if (_MniShellWorkerTryPublish(mni, NIF_ICON, icon, NULL, 0)) {
+            return MNI_OK;
+        }
+
+        NOTIFYICONDATAW nid = {
+            .cbSize = sizeof(nid),
+            .hWnd   = mni->window_handle,
+            .uID    = mni->uid,
+            .uFlags = NIF_ICON,
+            .hIcon  = icon,
+        };
+
+        if (mni->use_guid) {
+            nid.uFlags |= NIF_GUID;
+            nid.guidItem = mni->guid;
+        }
+
+        if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
+            nid.uFlags |= NIF_SHOWTIP;
+        }
+
+        if (!_MniBackendNotifyIcon(mni, NIM_MODIFY, &nid)) {
+            mni->icon_fingerprint_valid = MNI_FALSE;
+            return MNI_ERROR_FAILED_TO_CHANGE_ICON;
+        }
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static MniError _MniUpdateIcon(ModernNotifyIcon *mni, HICON icon) {
+    return _MniUpdateIconWithFingerprint(mni, icon, NULL);
+}
+
+// ========================================================================== //
+
+static MniError _MniUpdateMenu(ModernNotifyIcon *mni, HMENU menu) {
+    MNI_TRACE(L"_MniUpdateMenu(menu=%p)", menu);
+
+    UNREFERENCED_PARAMETER(menu);
+    UNREFERENCED_PARAMETER(mni);
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static MniError _MniUpdateTip(ModernNotifyIcon *mni, const wchar_t *tip) {
+    MNI_TRACE(L"_MniUpdateTip(tip=%p)", &tip);
+
+    if (mni->icon_created) {
+        // Inside MniBeginUpdate/MniEndUpdate scope, mni->tip is sent on flush.
+        if (mni->update_depth > 0) {
+            mni->update_flags |= NIF_TIP;
+            return MNI_OK;
+        }
+
+        if (_MniShellWorkerTryPublish(mni, NIF_TIP, NULL, tip, 0)) {
+            return MNI_OK;
+        }
+
+        NOTIFYICONDATAW nid = {
+            .cbSize = sizeof(nid),
+            .hWnd   = mni->window_handle,
+            .uID    = mni->uid,
+            .uFlags = NIF_TIP
+        };
+
+        if (mni->use_guid) {
+            nid.uFlags |= NIF_GUID;
+            nid.guidItem = mni->guid;
+        }
+
+        if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
+            nid.uFlags |= NIF_SHOWTIP;
+            _StringCopyW(nid.szTip, ARRAYSIZE(nid.szTip), tip);
+        }
+
+        if (!_MniBackendNotifyIcon(mni, NIM_MODIFY, &nid)) {
+            return MNI_ERROR_FAILED_TO_CHANGE_TIP;
+        }
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static MniError _MniUpdateState(ModernNotifyIcon *mni, MniBool visible) {
+    MNI_TRACE(L"_MniUpdateState(visible=%d)", visible);
+
+    DWORD state = visible ? 0 : NIS_HIDDEN;
+
+    if (mni->update_depth > 0) {
+        mni->update_flags |= NIF_STATE;
+        mni->update_state = state;
+        return MNI_OK;
+    }
+
+    if (_MniShellWorkerTryPublish(mni, NIF_STATE, NULL, NULL, state)) {
+        return MNI_OK;
+    }
+
+    NOTIFYICONDATAW nid = {
+        .cbSize      = sizeof(nid),
+        .hWnd        = mni->window_handle,
+        .uID         = mni->uid,
+        .uFlags      = NIF_STATE,
+        .dwState     = state,
+        .dwStateMask = NIS_HIDDEN
+    };
+
+    if (mni->use_guid) {
+        nid.uFlags |= NIF_GUID;
+        nid.guidItem = mni->guid;
+    }
+
+    if (visible && mni->tip_type == MNI_TIP_TYPE_STANDARD) {
+        nid.uFlags |= NIF_SHOWTIP;
+    }
+
+    if (!_MniBackendNotifyIcon(mni, NIM_MODIFY, &nid)) {
+        return visible ? MNI_ERROR_FAILED_TO_SHOW_ICON : MNI_ERROR_FAILED_TO_HIDE_ICON;
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+// Sends all changes collected since MniBeginUpdate as one NIM_MODIFY.
+static MniError _MniFlushUpdate(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniFlushUpdate(), update_flags=%x", mni->update_flags);
+
+    UINT flags = mni->update_flags;
+    mni->update_flags = 0;
+
+    if (flags == 0 || !mni->icon_created) {
+        return MNI_OK;
+    }
+
+    if ((flags & NIF_ICON) == NIF_ICON) {
+        mni->icon_updates_pushed += 1;
+    }
+
+    if (_MniShellWorkerTryPublish(mni, flags, mni->icon, mni->tip, mni->update_state)) {
+        return MNI_OK;
+    }
+
+    NOTIFYICONDATAW nid = {
+        .cbSize      = sizeof(nid),
+        .hWnd        = mni->window_handle,
+        .uID         = mni->uid,
+        .uFlags      = flags,
+    };
+
+    if (mni->use_guid) {
+        nid.uFlags |= NIF_GUID;
+        nid.guidItem = mni->guid;
+    }
+
+    if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
+        nid.uFlags |= NIF_SHOWTIP;
+
+        if ((flags & NIF_TIP) == NIF_TIP) {
+            _StringCopyW(nid.szTip, ARRAYSIZE(nid.szTip), mni->tip);
+        }
+    }
+
+    if ((flags & NIF_ICON) == NIF_ICON) {
+        nid.hIcon = mni->icon;
+    }
+
+    if ((flags & NIF_STATE) == NIF_STATE) {
+        nid.dwState = mni->update_state;
+        nid.dwStateMask = NIS_HIDDEN;
+    }
+
+    if (!_MniBackendNotifyIcon(mni, NIM_MODIFY, &nid)) {
+        mni->icon_fingerprint_valid = MNI_FALSE;
+        return MNI_ERROR_FAILED_TO_UPDATE_ICON;
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static MniError _MniHostAttach(ModernNotifyIcon *host, ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniHostAttach(host=%p, mni=%p)", host, mni);
+
+    // Only icons that own a window can host others.
+    if (host == mni || host->host != NULL || host->window_handle == NULL) {
+        return MNI_ERROR_INVALID_HOST;
+    }
+
+    // Find free uid, slot 0 belongs to the host itself.
+    int uid = 1;
+    while (uid < host->hosted_capacity && host->hosted_icons[uid] != NULL) {
+        uid += 1;
+    }
+
+    if (uid > MNI_HOSTED_ICONS_MAX) {
+        return MNI_ERROR_INVALID_HOST;
+    }
+
+    if (uid >= host->hosted_capacity) {
+        int capacity = host->hosted_capacity > 0 ? host->hosted_capacity * 2 : 8;
+        ModernNotifyIcon **icons = (ModernNotifyIcon **)_MniAlloc(sizeof(*icons) * (SIZE_T)capacity);
+        if (!icons) {
+            return MNI_ERROR_OUT_OF_MEMORY;
+        }
+
+        if (host->hosted_icons) {
+            memcpy(icons, host->hosted_icons, sizeof(*icons) * (SIZE_T)host->hosted_capacity);
+            _MniFree(host->hosted_icons);
+        }
+
+        host->hosted_icons = icons;
+        host->hosted_capacity = capacity;
+    }
+
+    host->hosted_icons[uid] = mni;
+    host->hosted_count += 1;
+
+    mni->host = host;
+    mni->uid = (UINT)uid;
+    mni->window_handle = host->window_handle;
+    mni->module_handle = host->module_handle;
+    mni->class_name = host->class_name;
+    mni->backend = host->backend;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static void _MniHostDetach(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniHostDetach(mni=%p), host=%p", mni, mni->host);
+
+    ModernNotifyIcon *host = mni->host;
+    if (host && mni->uid < (UINT)host->hosted_capacity && host->hosted_icons[mni->uid] == mni) {
+        host->hosted_icons[mni->uid] = NULL;
+        host->hosted_count -= 1;
+    }
+
+    mni->host = NULL;
+    mni->uid = 0;
+    mni->window_handle = NULL;
+}
+
+// ========================================================================== //
+
+static MniError _MniInternalCreateWindow(ModernNotifyIcon *mni, MniInfo info) {
+    MNI_TRACE(L"_MniInternalCreateWindow()");
+
+    if (mni->window_handle != NULL) {
+        return MNI_WINDOW_ALREADY_CREATED;
+    }
+
+    // Get module handle.
+    HINSTANCE hInstance = info.module_handle;
+    if (hInstance == NULL) {
+        hInstance = GetModuleHandleW(NULL);
+        if (hInstance == NULL) {
+            return MNI_ERROR_INVALID_MODULE_HANDLE;
+        }
+    }
+
+    // Init window class.
+    const wchar_t *class_name = L"MniWndClass";
+    if (info.class_name != NULL && info.class_name[0] != L'\0') {
+        class_name = info.class_name;
+    }
+
+    // Register message when taskbar is created to get notified when explorer.exe gets restarted.
+    if (mni->taskbar_created_message_id == 0) {
+        mni->taskbar_created_message_id = RegisterWindowMessageW(MNI_TASKBAR_CREATED_WINDOW_MESSAGE);
+    }
+
+    // Register window class and create invisible window.
+    HWND hWnd = NULL;
+    MniError result = _MniBackendCreateWindow(
+        mni,
+        hInstance,
+        class_name,
+        info.window_title,
+        info.window_style,
+        info.parent_window,
+        &hWnd
+    );
+
+    if (MNI_FAILED(result)) {
+        return result;
+    }
+
+    mni->window_handle = hWnd;
+    mni->module_handle = hInstance;
+    mni->class_name = class_name;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static MniError _MniInternalDestroyWindow(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"_MniInternalDestroyWindow()");
+
+    if (mni->window_handle == NULL) {
+        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    }
+
+    _MniBackendDestroyWindow(mni);
+    mni->window_handle = NULL;
+    
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static MniError _MniInternalCreateNotifyIcon(ModernNotifyIcon *mni) {
+    MNI_TRACE(
+        L"_MniInternalCreateNotifyIcon(), icon_created=%d, window_handle=%p",
+        mni->icon_created,
+        mni->window_handle
+    );
+
+    // Shell copy of the icon changes, next update must be pushed.
+    mni->icon_fingerprint_valid = MNI_FALSE;
+
+    if (mni->icon_created) {
+        return MNI_ICON_ALREADY_CREATED;
+    }
+
+    if (mni->window_handle == NULL) {
+        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    }
+
+    NOTIFYICONDATAW nid = {
+        .cbSize           = sizeof(nid),
+        .hWnd             = mni->window_handle,
+        .uID              = mni->uid,
+        .uFlags           = NIF_TIP | NIF_ICON | NIF_MESSAGE, // NIF_TIP is required for
+                                                              // standard tip and rich popup
+        .uCallbackMessage = WM_NOTIFYICON,
+        .hIcon            = mni->icon,
+        .szTip            = L"",
+        .dwState          = 0,
+        .dwStateMask      = 0,
+        .szInfo           = L"",
+        .uVersion         = NOTIFYICON_VERSION_4,
+        .szInfoTitle      = L"",
+        .dwInfoFlags      = 0,
+        .guidItem         = MNI_GUID_NULL,
+        .hBalloonIcon     = 0,
+    };
+
+    if (mni->use_guid) {
+        nid.uFlags |= NIF_GUID;
+        nid.guidItem = mni->guid;
+    }
+
+    if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
+        nid.uFlags |= NIF_SHOWTIP;
+        _StringCopyW(nid.szTip, ARRAYSIZE(nid.szTip), mni->tip);
+    }
+    
+    MniShellWorker *worker = _MniShellWorkerSuspend(mni);
+
+    if (!_MniBackendNotifyIcon(mni, NIM_ADD, &nid)) {
+        _MniShellWorkerResume(worker);
+        return MNI_ERROR_FAILED_TO_ADD_ICON;
+    }
+
+    if (!_MniBackendNotifyIcon(mni, NIM_SETVERSION, &nid)) {
+        BOOL deleted = _MniBackendNotifyIcon(mni, NIM_DELETE, &nid);
+        _MniShellWorkerResume(worker);
+
+        if (!deleted) {
+            return MNI_ERROR_FAILED_TO_DELETE_ICON;
+        }
+
+        return MNI_ERROR_UNSUPPORTED_VERSION;
+    }
+
+    _MniShellWorkerResume(worker);
+
+    mni->icon_created = MNI_TRUE;
+    mni->icon_visible = MNI_TRUE;
+
+    // NIM_ADD already carries current icon and tip.
+    mni->update_flags = 0;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static MniError _MniInternalDestroyNotifyIcon(ModernNotifyIcon *mni) {
+    MNI_TRACE(
+        L"_MniInternalDestroyNotifyIcon(), icon_created=%d, window_handle=%p",
+        mni->icon_created,
+        mni->window_handle
+    );
+
+    // Shell copy of the icon changes, next update must be pushed.
+    mni->icon_fingerprint_valid = MNI_FALSE;
+
+    if (mni->icon_created == MNI_FALSE) {
+        return MNI_ERROR_ICON_NOT_CREATED;
+    }
+
+    NOTIFYICONDATAW nid = {
+        .cbSize = sizeof(nid),
+        .hWnd   = mni->window_handle,
+        .uID    = mni->uid
+    };
+
+    if (mni->use_guid) {
+        nid.uFlags |= NIF_GUID;
+        nid.guidItem = mni->guid;
+    }
+
+    MniShellWorker *worker = _MniShellWorkerSuspend(mni);
+    BOOL deleted = _MniBackendNotifyIcon(mni, NIM_DELETE, &nid);
+    _MniShellWorkerResume(worker);
+
+    if (!deleted) {
+        return MNI_ERROR_FAILED_TO_DELETE_ICON;
+    }
+
+    mni->icon_created = MNI_FALSE;
+    mni->icon_visible = MNI_FALSE;
+
+    return MNI_OK;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Animation
+
+static HICON _MniCreateIconWith(int size, void (*draw)(uint32_t *pixels, int size, const void *context), const void *context);
+static void _MniGraphRelease(ModernNotifyIcon *mni, MniBool restore);
+static void _MniOverlayRelease(ModernNotifyIcon *mni, MniBool restore);
+
+// Pixel frames stored compressed against previous frame, only the shown one is decoded.
+typedef struct MniAnimationFrames {
+    int                         width;
+    int                         height;
+    int                         decoded;            // frame held in pixels, -1 for none
+    uint32_t                    *pixels;            // premultiplied, width x height
+    HICON                       icon;               // shown, owned
+    UINT64                      icon_hash;          // of frame and size of shown icon
+    UINT64                      *hashes;            // per frame
+    SIZE_T                      *offsets;           // frame_count + 1 into data
+    BYTE                        *data;
+} MniAnimationFrames;
+
+typedef struct MniAnimation {
+    HICON                       *frames;            // NULL when animation has pixel frames
+    MniAnimationFrames          *pixel_frames;
+    int                         frame_count;
+    int                         frame;              // index of shown frame
+    UINT                        fps;
+    MniBool                     loop;
+    MniBool                     paused;
+    MniBool                     finished;
+    HICON                       base_icon;          // icon set before animation started
+    LONGLONG                    frequency;
+    LONGLONG                    start_counter;      // when frame 0 was due
+    ULONGLONG                   position;           // frames due since start, including dropped
+    UINT64                      frames_shown;
+    UINT64                      frames_dropped;
+    LONGLONG                    latency_last;       // us
+    LONGLONG                    latency_max;
+    double                      latency_sum;
+} MniAnimation;
+
+static LONGLONG _MniAnimationElapsed(MniAnimation *animation) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    LONGLONG elapsed = counter.QuadPart - animation->start_counter;
+    return (elapsed / animation->frequency) * 1000000 + (elapsed % animation->frequency) * 1000000 / animation->frequency;
+}
+
+// ========================================================================== //
+
+static void _MniAnimationSchedule(ModernNotifyIcon *mni, MniAnimation *animation, LONGLONG elapsed) {
+    // Next frame is not scheduled sooner than the shell managed to show the last one,
+    // frames that become due in the meantime are dropped instead of queued.
+    LONGLONG next = (LONGLONG)((animation->position + 1) * 1000000 / animation->fps);
+    LONGLONG delay = max(next - elapsed, animation->latency_last);
+
+    _MniTimerWheelStart(mni, WHEEL_TIMER_ANIMATION, (UINT)((max(delay, 0) + 999) / 1000));
+}
+
+// ========================================================================== //
+
+static void _MniAnimationFramesDraw(uint32_t *pixels, int size, const void *context) {
+    const MniAnimationFrames *frames = (const MniAnimationFrames *)context;
+
+    if (frames->width == size && frames->height == size) {
+        memcpy(pixels, frames->pixels, (SIZE_T)size * (SIZE_T)size * sizeof(uint32_t));
+    } else {
+        _MniPixelsResample(pixels, size, size, size, frames->pixels, frames->width, frames->height, frames->width);
+    }
+}
+
+// ========================================================================== //
+
+// Decodes frames up to frame into reused buffer and builds icon for current dpi.
+// Returns shown icon when frame looks the same, NULL on failure.
+static HICON _MniAnimationFramesDecode(ModernNotifyIcon *mni, MniAnimationFrames *frames, int frame) {
+    int size = _GetSmallIconSize(mni->dpi);
+    UINT64 hash = frames->hashes[frame] ^ ((UINT64)size * 0x9E3779B97F4A7C15ull);
+
+    // Frames in between are still decoded, each one is delta of the previous.
+    if (frame < frames->decoded) {
+        frames->decoded = -1;
+    }
+
+    SIZE_T count = (SIZE_T)frames->width * (SIZE_T)frames->height;
+    while (frames->decoded < frame) {
+        int next = frames->decoded + 1;
+        SIZE_T offset = frames->offsets[next];
+
+        if (!_MniPixelsDeltaDecode(frames->pixels, count, frames->data + offset, frames->offsets[next + 1] - offset)) {
+            frames->decoded = -1;
+            return NULL;
+        }
+
+        frames->decoded = next;
+    }
+
+    if (frames->icon && frames->icon_hash == hash) {
+        return frames->icon;
+    }
+
+    HICON icon = _MniCreateIconWith(size, _MniAnimationFramesDraw, frames);
+    if (!icon) {
+        return NULL;
+    }
+
+    frames->icon_hash = hash;
+
+    return icon;
+}
+
+// ========================================================================== //
+
+static void _MniAnimationFramesFree(MniAnimationFrames *frames) {
+    if (!frames) {
+        return;
+    }
+
+    // Frame may still be shown, shell and shell worker push copies of it.
+    if (frames->icon) {
+        DestroyIcon(frames->icon);
+    }
+
+    _MniFree(frames->pixels);
+    _MniFree(frames->hashes);
+    _MniFree(frames->offsets);
+    _MniFree(frames->data);
+    _MniFree(frames);
+}
+
+// ========================================================================== //
+
+static void _MniAnimationShow(ModernNotifyIcon *mni, MniAnimation *animation, int frame) {
+    LARGE_INTEGER begin;
+    LARGE_INTEGER end;
+
+    QueryPerformanceCounter(&begin);
+
+    HICON icon;
+    if (animation->pixel_frames) {
+        MniAnimationFrames *frames = animation->pixel_frames;
+
+        icon = _MniAnimationFramesDecode(mni, frames, frame);
+        if (!icon) {
+            return;
+        }
+
+        _MniUpdateIconWithFingerprint(mni, icon, &frames->icon_hash);
+
+        // Shell worker pushes its own copy and pending update scope flushes mni->icon,
+        // so nothing refers to the previous frame anymore.
+        if (frames->icon && frames->icon != icon) {
+            DestroyIcon(frames->icon);
+        }
+        frames->icon = icon;
+    } else {
+        icon = animation->frames[frame];
+        _MniUpdateIcon(mni, icon);
+    }
+
+    mni->icon = icon;
+
+    QueryPerformanceCounter(&end);
+
+    LONGLONG latency = (end.QuadPart - begin.QuadPart) * 1000000 / animation->frequency;
+
+    animation->frame = frame;
+    animation->frames_shown += 1;
+    animation->latency_last = latency;
+    animation->latency_max = max(animation->latency_max, latency);
+    animation->latency_sum += (double)latency;
+}
+
+// ========================================================================== //
+
+static void _MniAnimationTick(ModernNotifyIcon *mni) {
+    MniAnimation *animation = mni->animation;
+    if (!animation || animation->paused || animation->finished) {
+        return;
+    }
+
+    LONGLONG elapsed = _MniAnimationElapsed(animation);
+    ULONGLONG due = (ULONGLONG)max(elapsed, 0) * animation->fps / 1000000;
+
+    if (!animation->loop && due >= (ULONGLONG)animation->frame_count - 1) {
+        due = (ULONGLONG)animation->frame_count - 1;
+        animation->finished = MNI_TRUE;
+    }
+
+    if (due <= animation->position) {
+        // Timer fired early, wait for the frame.
+        _MniAnimationSchedule(mni, animation, elapsed);
+        return;
+    }
+
+    animation->frames_dropped += due - animation->position - 1;
+    animation->position = due;
+
+    int frame = (int)(due % (ULONGLONG)animation->frame_count);
+    if (frame != animation->frame) {
+        _MniAnimationShow(mni, animation, frame);
+    }
+
+    if (animation->finished) {
+        _MniTimerWheelStop(mni, WHEEL_TIMER_ANIMATION);
+    } else {
+        _MniAnimationSchedule(mni, animation, _MniAnimationElapsed(animation));
+    }
+}
+
+// ========================================================================== //
+
+static void _MniAnimationSetPaused(ModernNotifyIcon *mni, MniBool paused) {
+    MniAnimation *animation = mni->animation;
+    if (!animation || animation->finished || animation->paused == paused) {
+        return;
+    }
+
+    MNI_TRACE(L"_MniAnimationSetPaused(paused=%d), position=%llu", paused, animation->position);
+
+    animation->paused = paused;
+
+    if (paused) {
+        _MniTimerWheelStop(mni, WHEEL_TIMER_ANIMATION);
+        return;
+    }
+
+    // Continue from the frame where animation was paused.
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    animation->start_counter = counter.QuadPart - (LONGLONG)(animation->position * (ULONGLONG)animation->frequency / animation->fps);
+
+    _MniAnimationSchedule(mni, animation, _MniAnimationElapsed(animation));
+}
+
+// ========================================================================== //
+
+// Restores icon that was set before animation. Icon frames are owned by user, pixel
+// frames by animation.
+static void _MniAnimationRelease(ModernNotifyIcon *mni, MniBool restore) {
+    MniAnimation *animation = mni->animation;
+    if (!animation) {
+        return;
+    }
+
+    _MniTimerWheelStop(mni, WHEEL_TIMER_ANIMATION);
+
+    if (restore && mni->icon != animation->base_icon) {
+        _MniUpdateIcon(mni, animation->base_icon);
+    }
+
+    mni->icon = animation->base_icon;
+    mni->animation = NULL;
+
+    _MniAnimationFramesFree(animation->pixel_frames);
+    _MniFree(animation->frames);
+    _MniFree(animation);
+}
+
+// ========================================================================== //
+
+// Takes over animation with frames set, shows first frame and starts the timer.
+static void _MniAnimationStart(ModernNotifyIcon *mni, MniAnimation *animation, int frame_count, UINT fps, MniBool loop) {
+    // Replaced animation keeps original icon to restore, graph and overlay end on their base icon.
+    _MniAnimationRelease(mni, MNI_FALSE);
+    _MniGraphRelease(mni, MNI_FALSE);
+    _MniOverlayRelease(mni, MNI_FALSE);
+
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    animation->frame_count = frame_count;
+    animation->frame = -1;
+    animation->fps = fps;
+    animation->loop = loop;
+    animation->paused = !mni->icon_visible;
+    animation->finished = !loop && frame_count == 1;
+    animation->base_icon = mni->icon;
+    animation->frequency = frequency.QuadPart;
+    animation->start_counter = counter.QuadPart;
+
+    mni->animation = animation;
+
+    _MniAnimationShow(mni, animation, 0);
+
+    if (!animation->paused && !animation->finished) {
+        _MniAnimationSchedule(mni, animation, _MniAnimationElapsed(animation));
+    }
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Icon Pool
+
+// Process wide pool of icons built by the library, keyed by content hash and size.
+// Icons in use are reference counted, unused ones stay in LRU order until budget is hit.
+
+#define MNI_ICON_POOL_BUCKETS   (256)
+
+// Seeds keep hashes of pixel images and of existing icons apart.
+#define MNI_ICON_POOL_SEED_PIXELS   (0x706978656C73ull)
+#define MNI_ICON_POOL_SEED_ICON     (0x69636F6E6963ull)
+#define MNI_ICON_POOL_SEED_OVERLAY  (0x6F7665726C61ull)
+#define MNI_ICON_POOL_SEED_MASK     (0x6D61736B6D61ull)
+
+typedef struct MniIconPoolEntry {
+    UINT64                      hash;
+    int                         size;
+    HICON                       icon;
+    LONG                        refs;
+    struct MniIconPoolEntry     *hash_next;         // by hash and size
+    struct MniIconPoolEntry     *icon_next;         // by icon handle
+    struct MniIconPoolEntry     *lru_prev;          // unused entries only
+    struct MniIconPoolEntry     *lru_next;
+} MniIconPoolEntry;
+
+typedef struct MniIconPool {
+    SRWLOCK                     lock;
+    MniIconPoolEntry            *hash_buckets[MNI_ICON_POOL_BUCKETS];
+    MniIconPoolEntry            *icon_buckets[MNI_ICON_POOL_BUCKETS];
+    MniIconPoolEntry            *lru_first;         // most recently released
+    MniIconPoolEntry            *lru_last;
+    int                         budget;
+    int                         icons;
+    int                         idle_icons;
+    UINT64                      hits;
+    UINT64                      misses;
+    UINT64                      evictions;
+} MniIconPool;
+
+static MniIconPool _mni_icon_pool = {
+    .lock = SRWLOCK_INIT,
+    .budget = MNI_ICON_POOL_DEFAULT_BUDGET,
+};
+
+static UINT _MniIconPoolHashBucket(UINT64 hash, int size) {
+    return (UINT)((hash ^ ((UINT64)size * 0x9E3779B97F4A7C15ull)) >> 56) & (MNI_ICON_POOL_BUCKETS - 1);
+}
+
+// ========================================================================== //
+
+static UINT _MniIconPoolIconBucket(HICON icon) {
+    UINT64 value = (UINT64)(ULONG_PTR)icon * 0x9E3779B97F4A7C15ull;
+    return (UINT)(value >> 56) & (MNI_ICON_POOL_BUCKETS - 1);
+}
+
+// ========================================================================== //
+
+static MniIconPoolEntry *_MniIconPoolFindIcon(MniIconPool *pool, HICON icon) {
+    MniIconPoolEntry *entry = pool->icon_buckets[_MniIconPoolIconBucket(icon)];
+    while (entry && entry->icon != icon) {
+        entry = entry->icon_next;
+    }
+
+    return entry;
+}
+
+// ========================================================================== //
+
+static void _MniIconPoolLruUnlink(MniIconPool *pool, MniIconPoolEntry *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        pool->lru_first = entry->lru_next;
+    }
+
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        pool->lru_last = entry->lru_prev;
+    }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+    pool->idle_icons -= 1;
+}
+
+// ========================================================================== //
+
+static void _MniIconPoolUnlink(MniIconPool *pool, MniIconPoolEntry *entry) {
+    MniIconPoolEntry **link = &pool->hash_buckets[_MniIconPoolHashBucket(entry->hash, entry->size)];
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+
+    link = &pool->icon_buckets[_MniIconPoolIconBucket(entry->icon)];
+    while (*link != entry) {
+        link = &(*link)->icon_next;
+    }
+    *link = entry->icon_next;
+
+    pool->icons -= 1;
+}
+
+// ========================================================================== //
+
+// Must be called with lock held. Evicted entries are returned as list through
+// hash_next, GDI calls are made after the lock is released.
+static MniIconPoolEntry *_MniIconPoolEvict(MniIconPool *pool) {
+    MniIconPoolEntry *evicted = NULL;
+
+    while (pool->icons > pool->budget && pool->lru_last) {
+        MniIconPoolEntry *entry = pool->lru_last;
+        _MniIconPoolLruUnlink(pool, entry);
+        _MniIconPoolUnlink(pool, entry);
+
+        entry->hash_next = evicted;
+        evicted = entry;
+        pool->evictions += 1;
+    }
+
+    return evicted;
+}
+
+// ========================================================================== //
+
+static void _MniIconPoolDestroy(MniIconPoolEntry *evicted) {
+    while (evicted) {
+        MniIconPoolEntry *next = evicted->hash_next;
+        DestroyIcon(evicted->icon);
+        _MniFree(evicted);
+        evicted = next;
+    }
+}
+
+// ========================================================================== //
+
+// Returns referenced icon with given content or NULL.
+static HICON _MniIconPoolFind(UINT64 hash, int size) {
+    MniIconPool *pool = &_mni_icon_pool;
+    HICON icon = NULL;
+
+    AcquireSRWLockExclusive(&pool->lock);
+
+    MniIconPoolEntry *entry = pool->hash_buckets[_MniIconPoolHashBucket(hash, size)];
+    while (entry && (entry->hash != hash || entry->size != size)) {
+        entry = entry->hash_next;
+    }
+
+    if (entry) {
+        if (entry->refs == 0) {
+            _MniIconPoolLruUnlink(pool, entry);
+        }
+        entry->refs += 1;
+        pool->hits += 1;
+        icon = entry->icon;
+    } else {
+        pool->misses += 1;
+    }
+
+    ReleaseSRWLockExclusive(&pool->lock);
+
+    return icon;
+}
+
+// ========================================================================== //
+
+// Adds new icon with one reference. When the same content was added meanwhile
+// by another thread, icon is destroyed and the pooled one is returned instead.
+static HICON _MniIconPoolAdd(UINT64 hash, int size, HICON icon) {
+    MniIconPool *pool = &_mni_icon_pool;
+
+    MniIconPoolEntry *added = (MniIconPoolEntry *)_MniAlloc(sizeof(*added));
+    if (!added) {
+        // Icon still works, it just isn't shared.
+        return icon;
+    }
+
+    added->hash = hash;
+    added->size = size;
+    added->icon = icon;
+    added->refs = 1;
+
+    AcquireSRWLockExclusive(&pool->lock);
+
+    MniIconPoolEntry **bucket = &pool->hash_buckets[_MniIconPoolHashBucket(hash, size)];
+    MniIconPoolEntry *entry = *bucket;
+    while (entry && (entry->hash != hash || entry->size != size)) {
+        entry = entry->hash_next;
+    }
+
+    HICON result = icon;
+    if (entry) {
+        if (entry->refs == 0) {
+            _MniIconPoolLruUnlink(pool, entry);
+        }
+        entry->refs += 1;
+        result = entry->icon;
+    } else {
+        added->hash_next = *bucket;
+        *bucket = added;
+
+        MniIconPoolEntry **icon_bucket = &pool->icon_buckets[_MniIconPoolIconBucket(icon)];
+        added->icon_next = *icon_bucket;
+        *icon_bucket = added;
+
+        pool->icons += 1;
+    }
+
+    MniIconPoolEntry *evicted = _MniIconPoolEvict(pool);
+
+    ReleaseSRWLockExclusive(&pool->lock);
+
+    if (result != icon) {
+        DestroyIcon(icon);
+        _MniFree(added);
+    }
+
+    _MniIconPoolDestroy(evicted);
+
+    return result;
+}
+
+// ========================================================================== //
+
+// Drops reference of pooled icon, other icons are destroyed right away.
+static void _MniDestroyIcon(HICON icon) {
+    MniIconPool *pool = &_mni_icon_pool;
+
+    if (!icon) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&pool->lock);
+
+    MniIconPoolEntry *entry = _MniIconPoolFindIcon(pool, icon);
+    MniIconPoolEntry *evicted = NULL;
+
+    if (entry) {
+        MNI_ASSERT(entry->refs > 0 && "pooled icon released too many times");
+
+        entry->refs -= 1;
+        if (entry->refs == 0) {
+            entry->lru_next = pool->lru_first;
+            if (pool->lru_first) {
+                pool->lru_first->lru_prev = entry;
+            } else {
+                pool->lru_last = entry;
+            }
+            pool->lru_first = entry;
+            pool->idle_icons += 1;
+
+            evicted = _MniIconPoolEvict(pool);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&pool->lock);
+
+    if (!entry) {
+        DestroyIcon(icon);
+    }
+
+    _MniIconPoolDestroy(evicted);
+}
+
+// ========================================================================== //
+
+// Pooled icons already know their content, no need to read bitmaps back.
+static MniBool _MniIconPoolFingerprint(HICON icon, UINT64 *fingerprint) {
+    MniIconPool *pool = &_mni_icon_pool;
+
+    AcquireSRWLockShared(&pool->lock);
+    MniIconPoolEntry *entry = _MniIconPoolFindIcon(pool, icon);
+    if (entry) {
+        *fingerprint = entry->hash ^ ((UINT64)entry->size * 0x9E3779B97F4A7C15ull);
+    }
+    ReleaseSRWLockShared(&pool->lock);
+
+    return entry != NULL;
+}
+
+// ========================================================================== //
+
+// Hash of color and mask bitmaps of existing icon.
+static MniBool _MniIconContentHash(HICON icon, UINT64 *hash, int *size) {
+    ICONINFO icon_info;
+    if (!GetIconInfo(icon, &icon_info)) {
+        return MNI_FALSE;
+    }
+
+    MniBool result = MNI_FALSE;
+    HBITMAP bitmaps[2] = { icon_info.hbmColor, icon_info.hbmMask };
+    UINT64 content = MNI_ICON_POOL_SEED_ICON;
+    HDC dc = GetDC(NULL);
+
+    BITMAP bitmap;
+    if (dc && icon_info.hbmMask && GetObjectW(icon_info.hbmMask, sizeof(bitmap), &bitmap)) {
+        *size = bitmap.bmWidth;
+        result = MNI_TRUE;
+
+        for (int i = 0; i < 2 && result; i += 1) {
+            if (!bitmaps[i] || !GetObjectW(bitmaps[i], sizeof(bitmap), &bitmap)) {
+                continue;
+            }
+
+            BITMAPINFO bitmap_info = {
+                .bmiHeader = {
+                    .biSize = sizeof(BITMAPINFOHEADER),
+                    .biWidth = bitmap.bmWidth,
+                    .biHeight = -bitmap.bmHeight,
+                    .biPlanes = 1,
+                    .biBitCount = 32,
+                    .biCompression = BI_RGB,
+                },
+            };
+
+            SIZE_T count = (SIZE_T)bitmap.bmWidth * (SIZE_T)bitmap.bmHeight;
+            uint32_t *pixels = (uint32_t *)_MniAlloc(count * sizeof(uint32_t));
+            if (!pixels || !GetDIBits(dc, bitmaps[i], 0, (UINT)bitmap.bmHeight, pixels, &bitmap_info, DIB_RGB_COLORS)) {
+                result = MNI_FALSE;
+            } else {
+                content = _MniPixelsHash(pixels, count, content);
+            }
+            _MniFree(pixels);
+        }
+    }
+
+    if (dc) {
+        ReleaseDC(NULL, dc);
+    }
+
+    if (icon_info.hbmColor) {
+        DeleteObject(icon_info.hbmColor);
+    }
+    if (icon_info.hbmMask) {
+        DeleteObject(icon_info.hbmMask);
+    }
+
+    *hash = content;
+
+    return result;
+}
+
+// ========================================================================== //
+
+// Identifies visible content of icon, used to skip updates which wouldn't change anything.
+static MniBool _MniIconFingerprint(HICON icon, UINT64 *fingerprint) {
+    if (!icon) {
+        *fingerprint = 0;
+        return MNI_TRUE;
+    }
+
+    if (_MniIconPoolFingerprint(icon, fingerprint)) {
+        return MNI_TRUE;
+    }
+
+    UINT64 hash;
+    int size;
+    if (!_MniIconContentHash(icon, &hash, &size)) {
+        return MNI_FALSE;
+    }
+
+    *fingerprint = hash ^ ((UINT64)size * 0x9E3779B97F4A7C15ull);
+
+    return MNI_TRUE;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Icon Cache
+
+static MniBool _MniOverlayRebase(ModernNotifyIcon *mni, struct MniIconCache *cache, HICON icon);
+static MniBool _MniGraphRebase(ModernNotifyIcon *mni, struct MniIconCache *cache, HICON icon);
+
+// Icons built from MniIconSource, one per dpi. Variants live on the window thread,
+// missing ones are built on the thread pool and handed back through completed list.
+
+typedef struct MniIconVariant {
+    int                         dpi;
+    HICON                       icon;
+} MniIconVariant;
+
+typedef struct MniIconJob {
+    struct MniIconJob           *next;
+    struct MniIconCache         *cache;
+    int                         dpi;
+    UINT                        generation;
+    HICON                       icon;
+} MniIconJob;
+
+typedef struct MniIconCache {
+    volatile LONG               refs;               // window thread + jobs in flight
+    SRWLOCK                     lock;
+    MniBool                     released;           // guarded by lock
+    MniIconJob                  *completed;         // guarded by lock
+    MniIconSource               source;             // names are owned copies
+    void                        *owned_context;     // freed with cache
+    HWND                        window;
+    UINT                        uid;
+    MniBackend                  backend;
+    MniIconVariant              *variants;          // window thread only
+    int                         variant_count;
+    int                         variant_capacity;
+    int                         *pending;           // dpis being built
+    int                         pending_count;
+    int                         pending_capacity;
+    UINT                        generation;         // bumped on rebuild, older jobs are dropped
+} MniIconCache;
+
+static wchar_t *_MniIconSourceName(const wchar_t *name) {
+    if (name == NULL || IS_INTRESOURCE(name)) {
+        return (wchar_t *)name;
+    }
+
+    SIZE_T length = wcslen(name) + 1;
+    wchar_t *copy = (wchar_t *)_MniAlloc(length * sizeof(wchar_t));
+    if (copy) {
+        memcpy(copy, name, length * sizeof(wchar_t));
+    }
+
+    return copy;
+}
+
+// ========================================================================== //
+
+static void _MniIconSourceFreeName(const wchar_t *name) {
+    if (name != NULL && !IS_INTRESOURCE(name)) {
+        _MniFree((void *)name);
+    }
+}
+
+// ========================================================================== //
+
+static HICON _MniIconSourceLoad(const MniIconSource *source, int dpi) {
+    int size = _GetSmallIconSize(dpi);
+
+    if (source->load) {
+        return source->load(source->context, size, dpi);
+    }
+
+    if (source->resource_name) {
+        return (HICON)LoadImageW(source->module_handle, source->resource_name, IMAGE_ICON, size, size, 0);
+    }
+
+    if (source->file_name) {
+        return (HICON)LoadImageW(NULL, source->file_name, IMAGE_ICON, size, size, LR_LOADFROMFILE);
+    }
+
+    return NULL;
+}
+
+// ========================================================================== //
+
+static void _MniIconCacheUnref(MniIconCache *cache) {
+    if (InterlockedDecrement(&cache->refs) == 0) {
+        _MniIconSourceFreeName(cache->source.resource_name);
+        _MniIconSourceFreeName(cache->source.file_name);
+        _MniFree(cache->owned_context);
+        _MniFree(cache->variants);
+        _MniFree(cache->pending);
+        _MniFree(cache);
+    }
+}
+
+// ========================================================================== //
+
+static HICON _MniIconCacheFind(MniIconCache *cache, int dpi) {
+    for (int i = 0; i < cache->variant_count; i += 1) {
+        if (cache->variants[i].dpi == dpi) {
+            return cache->variants[i].icon;
+        }
+    }
+
+    return NULL;
+}
+
+// ========================================================================== //
+
+static MniBool _MniIconCacheOwns(MniIconCache *cache, HICON icon) {
+    for (int i = 0; i < cache->variant_count; i += 1) {
+        if (cache->variants[i].icon == icon) {
+            return MNI_TRUE;
+        }
+    }
+
+    return MNI_FALSE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniIconCacheAppend(void **items, int *count, int *capacity, SIZE_T item_size) {
+    if (*count < *capacity) {
+        return MNI_TRUE;
+    }
+
+    int new_capacity = *capacity > 0 ? *capacity * 2 : 4;
+    void *memory = _MniAlloc(item_size * (SIZE_T)new_capacity);
+    if (!memory) {
+        return MNI_FALSE;
+    }
+
+    if (*items) {
+        memcpy(memory, *items, item_size * (SIZE_T)*count);
+        _MniFree(*items);
+    }
+
+    *items = memory;
+    *capacity = new_capacity;
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniBool _MniIconCacheAdd(MniIconCache *cache, int dpi, HICON icon) {
+    if (!_MniIconCacheAppend((void **)&cache->variants, &cache->variant_count, &cache->variant_capacity, sizeof(MniIconVariant))) {
+        return MNI_FALSE;
+    }
+
+    cache->variants[cache->variant_count].dpi = dpi;
+    cache->variants[cache->variant_count].icon = icon;
+    cache->variant_count += 1;
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static void CALLBACK _MniIconCacheBuild(PTP_CALLBACK_INSTANCE instance, PVOID context) {
+    UNREFERENCED_PARAMETER(instance);
+
+    MniIconJob *job = (MniIconJob *)context;
+    MniIconCache *cache = job->cache;
+
+    job->icon = _MniIconSourceLoad(&cache->source, job->dpi);
+
+    AcquireSRWLockExclusive(&cache->lock);
+    MniBool released = cache->released;
+    if (!released) {
+        job->next = cache->completed;
+        cache->completed = job;
+    }
+    ReleaseSRWLockExclusive(&cache->lock);
+
+    if (released) {
+        if (job->icon) {
+            _MniDestroyIcon(job->icon);
+        }
+        _MniFree(job);
+    } else {
+        // Same uid encoding as _MniBackendPostMessage, so hosted icons get routed.
+        LPARAM lParam = (LPARAM)((UINT)cache->uid << 16);
+        if (cache->backend.post_message) {
+            cache->backend.post_message(cache->backend.context, cache->window, WM_MNI_ICON_VARIANT, 0, lParam);
+        } else {
+            PostMessageW(cache->window, WM_MNI_ICON_VARIANT, 0, lParam);
+        }
+    }
+
+    _MniIconCacheUnref(cache);
+}
+
+// ========================================================================== //
+
+static void _MniIconCacheRequest(MniIconCache *cache, int dpi) {
+    for (int i = 0; i < cache->pending_count; i += 1) {
+        if (cache->pending[i] == dpi) {
+            return;
+        }
+    }
+
+    if (!_MniIconCacheAppend((void **)&cache->pending, &cache->pending_count, &cache->pending_capacity, sizeof(int))) {
+        return;
+    }
+
+    MniIconJob *job = (MniIconJob *)_MniAlloc(sizeof(*job));
+    if (!job) {
+        return;
+    }
+
+    job->cache = cache;
+    job->dpi = dpi;
+    job->generation = cache->generation;
+
+    InterlockedIncrement(&cache->refs);
+    if (!TrySubmitThreadpoolCallback(_MniIconCacheBuild, job, NULL)) {
+        InterlockedDecrement(&cache->refs);
+        _MniFree(job);
+        return;
+    }
+
+    cache->pending[cache->pending_count] = dpi;
+    cache->pending_count += 1;
+}
+
+// ========================================================================== //
+
+static void _MniIconCacheShow(ModernNotifyIcon *mni, HICON icon) {
+    MniIconCache *cache = mni->icon_cache;
+
+    // Running animation shows its own frames, the variant is restored when it ends.
+    if (mni->animation) {
+        if (_MniIconCacheOwns(cache, mni->animation->base_icon)) {
+            mni->animation->base_icon = icon;
+        }
+        return;
+    }
+
+    if (_MniOverlayRebase(mni, cache, icon) || _MniGraphRebase(mni, cache, icon)) {
+        return;
+    }
+
+    if (mni->icon != icon && (mni->icon == NULL || _MniIconCacheOwns(cache, mni->icon))) {
+        _MniUpdateIcon(mni, icon);
+        mni->icon = icon;
+    }
+}
+
+// ========================================================================== //
+
+// Called on dpi change, swaps to cached variant or starts building it.
+static void _MniIconCacheApply(ModernNotifyIcon *mni, int dpi) {
+    MniIconCache *cache = mni->icon_cache;
+    if (!cache) {
+        return;
+    }
+
+    HICON icon = _MniIconCacheFind(cache, dpi);
+    if (icon) {
+        _MniIconCacheShow(mni, icon);
+    } else {
+        _MniIconCacheRequest(cache, dpi);
+    }
+}
+
+// ========================================================================== //
+
+// Takes variants built on the thread pool.
+static void _MniIconCacheCollect(ModernNotifyIcon *mni) {
+    MniIconCache *cache = mni->icon_cache;
+    if (!cache) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&cache->lock);
+    MniIconJob *job = cache->completed;
+    cache->completed = NULL;
+    ReleaseSRWLockExclusive(&cache->lock);
+
+    while (job) {
+        MniIconJob *next = job->next;
+
+        if (job->generation != cache->generation) {
+            if (job->icon) {
+                _MniDestroyIcon(job->icon);
+            }
+            _MniFree(job);
+            job = next;
+            continue;
+        }
+
+        for (int i = 0; i < cache->pending_count; i += 1) {
+            if (cache->pending[i] == job->dpi) {
+                cache->pending[i] = cache->pending[cache->pending_count - 1];
+                cache->pending_count -= 1;
+                break;
+            }
+        }
+
+        if (job->icon && !_MniIconCacheFind(cache, job->dpi) && _MniIconCacheAdd(cache, job->dpi, job->icon)) {
+            if (job->dpi == mni->dpi) {
+                _MniIconCacheShow(mni, job->icon);
+            }
+        } else if (job->icon) {
+            _MniDestroyIcon(job->icon);
+        }
+
+        _MniFree(job);
+        job = next;
+    }
+}
+
+// ========================================================================== //
+
+// Source changed its output, e.g. on theme change. Variant for current dpi is loaded and
+// shown right away, other dpis are built again when needed.
+static void _MniIconCacheRebuild(ModernNotifyIcon *mni) {
+    MniIconCache *cache = mni->icon_cache;
+    if (!cache) {
+        return;
+    }
+
+    // Old variants stay when the new one can't be built.
+    HICON icon = _MniIconSourceLoad(&cache->source, mni->dpi);
+    if (!icon) {
+        return;
+    }
+
+    if (!_MniIconCacheAdd(cache, mni->dpi, icon)) {
+        _MniDestroyIcon(icon);
+        return;
+    }
+
+    cache->generation += 1;
+    cache->pending_count = 0;
+
+    // Shown while old variants are still owned, so whatever used them is rebased.
+    _MniIconCacheShow(mni, icon);
+
+    for (int i = 0; i < cache->variant_count - 1; i += 1) {
+        _MniDestroyIcon(cache->variants[i].icon);
+    }
+
+    cache->variants[0] = cache->variants[cache->variant_count - 1];
+    cache->variant_count = 1;
+}
+
+// ========================================================================== //
+
+static void _MniIconCacheRelease(ModernNotifyIcon *mni) {
+    MniIconCache *cache = mni->icon_cache;
+    if (!cache) {
+        return;
+    }
+
+    mni->icon_cache = NULL;
+
+    // Jobs still running destroy their icons themselves.
+    AcquireSRWLockExclusive(&cache->lock);
+    cache->released = MNI_TRUE;
+    MniIconJob *job = cache->completed;
+    cache->completed = NULL;
+    ReleaseSRWLockExclusive(&cache->lock);
+
+    while (job) {
+        MniIconJob *next = job->next;
+        if (job->icon) {
+            _MniDestroyIcon(job->icon);
+        }
+        _MniFree(job);
+        job = next;
+    }
+
+    // Variants are owned by cache, icon must not point to them anymore.
+    if (_MniIconCacheOwns(cache, mni->icon)) {
+        mni->icon = NULL;
+    }
+
+    for (int i = 0; i < cache->variant_count; i += 1) {
+        _MniDestroyIcon(cache->variants[i].icon);
+    }
+    cache->variant_count = 0;
+
+    _MniIconCacheUnref(cache);
+}
+
+// ========================================================================== //
+
+// Replaces current icon with source variant for current dpi. owned_context is freed
+// together with the cache, also when this fails.
+static MniError _MniIconCacheInstall(ModernNotifyIcon *mni, const MniIconSource *source, void *owned_context) {
+    MniIconCache *cache = (MniIconCache *)_MniAlloc(sizeof(*cache));
+    if (!cache) {
+        _MniFree(owned_context);
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    InitializeSRWLock(&cache->lock);
+    cache->refs = 1;
+    cache->source = *source;
+    cache->source.resource_name = _MniIconSourceName(source->resource_name);
+    cache->source.file_name = _MniIconSourceName(source->file_name);
+    cache->owned_context = owned_context;
+    cache->window = mni->window_handle;
+    cache->uid = mni->uid;
+    cache->backend = mni->backend;
+
+    // Icon for current dpi is needed right now, others are built when dpi changes.
+    HICON icon = NULL;
+    if ((cache->source.resource_name || !source->resource_name) && (cache->source.file_name || !source->file_name)) {
+        icon = _MniIconSourceLoad(&cache->source, mni->dpi);
+    }
+
+    if (!icon || !_MniIconCacheAdd(cache, mni->dpi, icon)) {
+        if (icon) {
+            _MniDestroyIcon(icon);
+        }
+        _MniIconCacheUnref(cache);
+        return MNI_ERROR_FAILED_TO_LOAD_ICON;
+    }
+
+    mni->icon_cache = cache;
+
+    MniError result = _MniUpdateIcon(mni, icon);
+    mni->icon = icon;
+
+    if (mni->window_handle) {
+        _MniBackendSendMessage(mni, WM_MNI_ICON_CHANGE, (WPARAM)icon, 0);
+    }
+
+    return result;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Pixel Icons
+
+// Premultiplied BGRA copy of pixels given to MniSetIconFromPixels, resampled for every dpi.
+typedef struct MniPixelImage {
+    UINT64                      hash;               // of premultiplied pixels and dimensions
+    int                         width;
+    int                         height;
+} MniPixelImage;
+
+static uint32_t *_MniPixelImageData(const MniPixelImage *image) {
+    return (uint32_t *)(image + 1);
+}
+
+// ========================================================================== //
+
+// Builds size x size icon, draw fills premultiplied BGRA pixels which start cleared.
+typedef void (*MniDrawPixelsFn)(uint32_t *pixels, int size, const void *context);
+
+static HICON _MniCreateIconWith(int size, MniDrawPixelsFn draw, const void *context) {
+    if (size <= 0 || size > MNI_PIXELS_MAX_SIZE) {
+        return NULL;
+    }
+
+    BITMAPINFO bitmap_info = {
+        .bmiHeader = {
+            .biSize = sizeof(BITMAPINFOHEADER),
+            .biWidth = size,
+            .biHeight = -size,  // top-down
+            .biPlanes = 1,
+            .biBitCount = 32,
+            .biCompression = BI_RGB,
+        },
+    };
+
+    void *bits = NULL;
+    HBITMAP color = CreateDIBSection(NULL, &bitmap_info, DIB_RGB_COLORS, &bits, NULL, 0);
+    if (!color) {
+        return NULL;
+    }
+
+    // Icon bitmaps hold straight alpha, the system premultiplies them itself.
+    SIZE_T count = (SIZE_T)size * (SIZE_T)size;
+    memset(bits, 0, count * sizeof(uint32_t));
+    draw((uint32_t *)bits, size, context);
+    _MniPixelsUnpremultiply((uint32_t *)bits, (const uint32_t *)bits, count);
+
+    // Alpha of color bitmap decides transparency, mask only has to exist. Rows are WORD aligned.
+    void *mask_bits = _MniAlloc((SIZE_T)((size + 15) / 16) * 2 * (SIZE_T)size);
+    HBITMAP mask = mask_bits ? CreateBitmap(size, size, 1, 1, mask_bits) : NULL;
+    _MniFree(mask_bits);
+
+    HICON icon = NULL;
+    if (mask) {
+        ICONINFO icon_info = {
+            .fIcon = TRUE,
+            .hbmMask = mask,
+            .hbmColor = color,
+        };
+
+        icon = CreateIconIndirect(&icon_info);
+        DeleteObject(mask);
+    }
+
+    DeleteObject(color);
+
+    return icon;
+}
+
+// ========================================================================== //
+
+static void _MniPixelImageDraw(uint32_t *pixels, int size, const void *context) {
+    const MniPixelImage *image = (const MniPixelImage *)context;
+    _MniPixelsResample(pixels, size, size, size, _MniPixelImageData(image), image->width, image->height, image->width);
+}
+
+// ========================================================================== //
+
+static HICON _MniPixelImageLoad(void *context, int size, int dpi) {
+    UNREFERENCED_PARAMETER(dpi);
+
+    const MniPixelImage *image = (const MniPixelImage *)context;
+
+    // Repeated states are served from the pool without touching GDI.
+    HICON icon = _MniIconPoolFind(image->hash, size);
+    if (icon) {
+        return icon;
+    }
+
+    icon = _MniCreateIconWith(size, _MniPixelImageDraw, image);
+    if (!icon) {
+        return NULL;
+    }
+
+    return _MniIconPoolAdd(image->hash, size, icon);
+}
+
+// ========================================================================== //
+
+static MniPixelImage *_MniPixelImageAlloc(int width, int height) {
+    MniPixelImage *image = (MniPixelImage *)_MniAlloc(sizeof(*image) + (SIZE_T)width * (SIZE_T)height * sizeof(uint32_t));
+    if (image) {
+        image->width = width;
+        image->height = height;
+    }
+
+    return image;
+}
+
+// ========================================================================== //
+
+// Replaces current icon with image holding premultiplied pixels, image is owned by the
+// icon cache afterwards, also when this fails.
+static MniError _MniPixelImageInstall(ModernNotifyIcon *mni, MniPixelImage *image) {
+    UINT64 seed = MNI_ICON_POOL_SEED_PIXELS ^ ((UINT64)image->width << 32) ^ (UINT64)image->height;
+    image->hash = _MniPixelsHash(_MniPixelImageData(image), (size_t)image->width * (size_t)image->height, seed);
+
+    MniIconSource source = {
+        .load = _MniPixelImageLoad,
+        .context = image,
+    };
+
+    _MniAnimationRelease(mni, MNI_FALSE);
+    _MniGraphRelease(mni, MNI_FALSE);
+    _MniOverlayRelease(mni, MNI_FALSE);
+    _MniIconCacheRelease(mni);
+
+    return _MniIconCacheInstall(mni, &source, image);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Overlay
+
+// Badge or progress ring composited over base icon. Rendered icons are pooled by
+// base content, value, dpi and theme, so cycling through values renders each once.
+
+typedef enum MniOverlayKind {
+    MNI_OVERLAY_BADGE,
+    MNI_OVERLAY_PROGRESS,
+} MniOverlayKind;
+
+typedef struct MniOverlay {
+    HICON                       base_icon;          // not owned, restored when overlay ends
+    UINT64                      base_fingerprint;
+    MniOverlayKind              kind;
+    int                         value;
+    int                         dpi;
+} MniOverlay;
+
+typedef struct MniOverlayDraw {
+    const MniOverlay            *overlay;
+    const uint32_t              *base;              // premultiplied, may be NULL
+    int                         base_width;
+    int                         base_height;
+    uint32_t                    text_color;         // straight BGRA
+    uint32_t                    background_color;
+} MniOverlayDraw;
+
+static uint32_t _MniColorToPixel(DWORD color, BYTE alpha) {
+    return ((uint32_t)alpha << 24) | ((color & 0xFF) << 16) | (color & 0xFF00) | ((color >> 16) & 0xFF);
+}
+
+// ========================================================================== //
+
+static void _MniOverlayDrawPixels(uint32_t *pixels, int size, const void *context) {
+    const MniOverlayDraw *draw = (const MniOverlayDraw *)context;
+    const MniOverlay *overlay = draw->overlay;
+
+    if (overlay->kind == MNI_OVERLAY_PROGRESS) {
+        // Base shrinks to fit inside the ring.
+        int thickness = size / 8 > 2 ? size / 8 : 2;
+        int inset = thickness + 1;
+        int inner = size - 2 * inset;
+
+        if (draw->base && inner > 0) {
+            _MniPixelsResample(pixels + inset * size + inset, inner, inner, size, draw->base, draw->base_width, draw->base_height, draw->base_width);
+        }
+
+        uint32_t track = (draw->text_color & 0x00FFFFFF) | 0x50000000;
+        _MniPixelsDrawRing(pixels, size, thickness, draw->overlay->value, track, draw->text_color);
+    } else {
+        if (draw->base) {
+            _MniPixelsResample(pixels, size, size, size, draw->base, draw->base_width, draw->base_height, draw->base_width);
+        }
+
+        char text[4];
+        if (overlay->value > 99) {
+            memcpy(text, "99+", sizeof("99+"));
+        } else if (overlay->value > 9) {
+            text[0] = (char)('0' + overlay->value / 10);
+            text[1] = (char)('0' + overlay->value % 10);
+            text[2] = '\0';
+        } else {
+            text[0] = (char)('0' + overlay->value);
+            text[1] = '\0';
+        }
+
+        _MniPixelsDrawBadge(pixels, size, text, draw->background_color, draw->text_color);
+    }
+}
+
+// ========================================================================== //
+
+// Reads icon as premultiplied BGRA. Icons without alpha channel get it from mask.
+static uint32_t *_MniReadIconPixels(HICON icon, int *width, int *height) {
+    ICONINFO icon_info;
+    if (!GetIconInfo(icon, &icon_info)) {
+        return NULL;
+    }
+
+    uint32_t *pixels = NULL;
+    uint32_t *mask = NULL;
+    HDC dc = GetDC(NULL);
+
+    BITMAP bitmap;
+    if (dc && icon_info.hbmColor && GetObjectW(icon_info.hbmColor, sizeof(bitmap), &bitmap) &&
+        bitmap.bmWidth > 0 && bitmap.bmHeight > 0 &&
+        bitmap.bmWidth <= MNI_PIXELS_MAX_SIZE && bitmap.bmHeight <= MNI_PIXELS_MAX_SIZE)
+    {
+        BITMAPINFO bitmap_info = {
+            .bmiHeader = {
+                .biSize = sizeof(BITMAPINFOHEADER),
+                .biWidth = bitmap.bmWidth,
+                .biHeight = -bitmap.bmHeight,
+                .biPlanes = 1,
+                .biBitCount = 32,
+                .biCompression = BI_RGB,
+            },
+        };
+
+        SIZE_T count = (SIZE_T)bitmap.bmWidth * (SIZE_T)bitmap.bmHeight;
+        pixels = (uint32_t *)_MniAlloc(count * sizeof(uint32_t));
+
+        if (pixels && GetDIBits(dc, icon_info.hbmColor, 0, (UINT)bitmap.bmHeight, pixels, &bitmap_info, DIB_RGB_COLORS)) {
+            MniBool has_alpha = MNI_FALSE;
+            for (SIZE_T i = 0; i < count && !has_alpha; i += 1) {
+                has_alpha = (pixels[i] >> 24) != 0;
+            }
+
+            // Mask bits set are transparent, read as white.
+            if (!has_alpha) {
+                mask = (uint32_t *)_MniAlloc(count * sizeof(uint32_t));
+                MniBool masked = mask && icon_info.hbmMask &&
+                    GetDIBits(dc, icon_info.hbmMask, 0, (UINT)bitmap.bmHeight, mask, &bitmap_info, DIB_RGB_COLORS);
+
+                for (SIZE_T i = 0; i < count; i += 1) {
+                    MniBool opaque = !masked || (mask[i] & 0x00FFFFFF) == 0;
+                    pixels[i] = opaque ? (pixels[i] | 0xFF000000) : 0;
+                }
+            }
+
+            _MniPixelsPremultiply(pixels, pixels, count, 0);
+
+            *width = bitmap.bmWidth;
+            *height = bitmap.bmHeight;
+        } else {
+            _MniFree(pixels);
+            pixels = NULL;
+        }
+    }
+
+    _MniFree(mask);
+
+    if (dc) {
+        ReleaseDC(NULL, dc);
+    }
+
+    if (icon_info.hbmColor) {
+        DeleteObject(icon_info.hbmColor);
+    }
+    if (icon_info.hbmMask) {
+        DeleteObject(icon_info.hbmMask);
+    }
+
+    return pixels;
+}
+
+// ========================================================================== //
+
+static void _MniOverlaySetBase(MniOverlay *overlay, HICON base_icon) {
+    overlay->base_icon = base_icon;
+
+    // Unreadable icon is still cached, only per handle.
+    if (!_MniIconFingerprint(base_icon, &overlay->base_fingerprint)) {
+        overlay->base_fingerprint = (UINT64)(ULONG_PTR)base_icon;
+    }
+}
+
+// ========================================================================== //
+
+static MniError _MniOverlayRender(ModernNotifyIcon *mni) {
+    MniOverlay *overlay = mni->overlay;
+    if (!overlay) {
+        return MNI_OK;
+    }
+
+    int size = _GetSmallIconSize(overlay->dpi);
+    MniThemeInfo theme = mni->system_theme;
+
+    uint32_t key[] = {
+        (uint32_t)overlay->base_fingerprint,
+        (uint32_t)(overlay->base_fingerprint >> 32),
+        (uint32_t)overlay->kind,
+        (uint32_t)overlay->value,
+        (uint32_t)overlay->dpi,
+        (uint32_t)theme.Theme,
+        (uint32_t)theme.TextColor,
+        (uint32_t)theme.BackgroundColor,
+    };
+    UINT64 hash = _MniPixelsHash(key, ARRAYSIZE(key), MNI_ICON_POOL_SEED_OVERLAY);
+
+    HICON icon = _MniIconPoolFind(hash, size);
+    if (!icon) {
+        MniOverlayDraw draw = {
+            .overlay = overlay,
+            .text_color = _MniColorToPixel(theme.TextColor, 0xFF),
+            // Badge keeps its usual red unless high contrast asks for system colors.
+            .background_color = theme.Theme == MNI_THEME_HIGHCONTRAST
+                ? _MniColorToPixel(theme.TextColor, 0xFF)
+                : 0xFFD13438,
+        };
+
+        if (overlay->kind == MNI_OVERLAY_BADGE) {
+            draw.text_color = theme.Theme == MNI_THEME_HIGHCONTRAST
+                ? _MniColorToPixel(theme.BackgroundColor, 0xFF)
+                : 0xFFFFFFFF;
+        }
+
+        uint32_t *base = overlay->base_icon ? _MniReadIconPixels(overlay->base_icon, &draw.base_width, &draw.base_height) : NULL;
+        draw.base = base;
+
+        icon = _MniCreateIconWith(size, _MniOverlayDrawPixels, &draw);
+        _MniFree(base);
+
+        if (!icon) {
+            return MNI_ERROR_FAILED_TO_RENDER_OVERLAY;
+        }
+
+        icon = _MniIconPoolAdd(hash, size, icon);
+    }
+
+    HICON previous = mni->icon;
+
+    MniError result = _MniUpdateIcon(mni, icon);
+    mni->icon = icon;
+
+    if (previous && previous != overlay->base_icon) {
+        _MniDestroyIcon(previous);
+    }
+
+    if (mni->window_handle && previous != icon) {
+        _MniBackendSendMessage(mni, WM_MNI_ICON_CHANGE, (WPARAM)icon, 0);
+    }
+
+    return result;
+}
+
+// ========================================================================== //
+
+static MniError _MniOverlaySet(ModernNotifyIcon *mni, MniOverlayKind kind, int value) {
+    // Running animation or graph ends on its base icon, which becomes base of the overlay.
+    _MniAnimationRelease(mni, MNI_FALSE);
+    _MniGraphRelease(mni, MNI_FALSE);
+
+    MniOverlay *overlay = mni->overlay;
+
+    if (!overlay) {
+        overlay = (MniOverlay *)_MniAlloc(sizeof(*overlay));
+        if (!overlay) {
+            return MNI_ERROR_OUT_OF_MEMORY;
+        }
+
+        _MniOverlaySetBase(overlay, mni->icon);
+        mni->overlay = overlay;
+    }
+
+    overlay->kind = kind;
+    overlay->value = value;
+    overlay->dpi = mni->dpi;
+
+    return _MniOverlayRender(mni);
+}
+
+// ========================================================================== //
+
+// Puts base icon back, restore also shows it.
+static void _MniOverlayRelease(ModernNotifyIcon *mni, MniBool restore) {
+    MniOverlay *overlay = mni->overlay;
+    if (!overlay) {
+        return;
+    }
+
+    mni->overlay = NULL;
+
+    HICON composed = mni->icon;
+    mni->icon = overlay->base_icon;
+
+    if (restore && composed != overlay->base_icon) {
+        _MniUpdateIcon(mni, overlay->base_icon);
+
+        if (mni->window_handle) {
+            _MniBackendSendMessage(mni, WM_MNI_ICON_CHANGE, (WPARAM)overlay->base_icon, 0);
+        }
+    }
+
+    if (composed && composed != overlay->base_icon) {
+        _MniDestroyIcon(composed);
+    }
+
+    _MniFree(overlay);
+}
+
+// ========================================================================== //
+
+// Called when icon cache has new variant, overlay on top of old variant is redrawn.
+static MniBool _MniOverlayRebase(ModernNotifyIcon *mni, MniIconCache *cache, HICON icon) {
+    MniOverlay *overlay = mni->overlay;
+    if (!overlay) {
+        return MNI_FALSE;
+    }
+
+    if (_MniIconCacheOwns(cache, overlay->base_icon)) {
+        _MniOverlaySetBase(overlay, icon);
+        _MniOverlayRender(mni);
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static void _MniOverlaySetDpi(ModernNotifyIcon *mni, int dpi) {
+    if (mni->overlay) {
+        mni->overlay->dpi = dpi;
+    }
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Graph
+
+// Live graph icon. New sample scrolls pixels by one column and draws only that column,
+// pushes to the shell are limited to max_fps and coalesced by the wheel timer.
+
+typedef struct MniGraph {
+    float                       samples[MNI_PIXELS_MAX_SIZE];   // ring, enough for any size
+    int                         sample_count;
+    int                         sample_next;
+    float                       min_value;
+    float                       max_value;
+    UINT                        max_fps;
+    int                         dpi;
+    int                         size;
+    uint32_t                    *pixels;            // premultiplied, size x size
+    HBITMAP                     color;              // DIB reused by every push
+    uint32_t                    *color_bits;
+    HBITMAP                     mask;
+    HICON                       icon;               // shown icon, owned
+    HICON                       base_icon;          // icon set before graph started
+    UINT64                      pushed_hash;
+    MniBool                     pushed;
+    MniBool                     dirty;
+    MniBool                     timer_armed;
+    LONGLONG                    frequency;
+    LONGLONG                    last_push;
+} MniGraph;
+
+static void _MniGraphColors(ModernNotifyIcon *mni, uint32_t *line_color, uint32_t *fill_color) {
+    *line_color = _MniColorToPixel(mni->system_theme.TextColor, 0xFF);
+    *fill_color = _MniColorToPixel(mni->system_theme.TextColor, 0x60);
+}
+
+// ========================================================================== //
+
+static float _MniGraphLevel(MniGraph *graph, float value) {
+    return (value - graph->min_value) / (graph->max_value - graph->min_value);
+}
+
+// ========================================================================== //
+
+static void _MniGraphFreeBitmaps(MniGraph *graph) {
+    if (graph->color) {
+        DeleteObject(graph->color);
+    }
+    if (graph->mask) {
+        DeleteObject(graph->mask);
+    }
+
+    _MniFree(graph->pixels);
+
+    graph->color = NULL;
+    graph->color_bits = NULL;
+    graph->mask = NULL;
+    graph->pixels = NULL;
+    graph->size = 0;
+}
+
+// ========================================================================== //
+
+static MniError _MniGraphCreateBitmaps(MniGraph *graph, int size) {
+    _MniGraphFreeBitmaps(graph);
+
+    if (size <= 0 || size > MNI_PIXELS_MAX_SIZE) {
+        return MNI_ERROR_FAILED_TO_RENDER_GRAPH;
+    }
+
+    BITMAPINFO bitmap_info = {
+        .bmiHeader = {
+            .biSize = sizeof(BITMAPINFOHEADER),
+            .biWidth = size,
+            .biHeight = -size,  // top-down
+            .biPlanes = 1,
+            .biBitCount = 32,
+            .biCompression = BI_RGB,
+        },
+    };
+
+    void *bits = NULL;
+    void *mask_bits = _MniAlloc((SIZE_T)((size + 15) / 16) * 2 * (SIZE_T)size);
+
+    graph->pixels = (uint32_t *)_MniAlloc((SIZE_T)size * (SIZE_T)size * sizeof(uint32_t));
+    graph->color = CreateDIBSection(NULL, &bitmap_info, DIB_RGB_COLORS, &bits, NULL, 0);
+    graph->mask = mask_bits ? CreateBitmap(size, size, 1, 1, mask_bits) : NULL;
+    graph->color_bits = (uint32_t *)bits;
+    graph->size = size;
+
+    _MniFree(mask_bits);
+
+    if (!graph->pixels || !graph->color || !graph->mask) {
+        _MniGraphFreeBitmaps(graph);
+        return MNI_ERROR_FAILED_TO_RENDER_GRAPH;
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+// Full redraw from sample history, after dpi or theme change.
+static void _MniGraphRedraw(ModernNotifyIcon *mni, MniGraph *graph) {
+    uint32_t line_color;
+    uint32_t fill_color;
+    _MniGraphColors(mni, &line_color, &fill_color);
+
+    int size = graph->size;
+    memset(graph->pixels, 0, (SIZE_T)size * (SIZE_T)size * sizeof(uint32_t));
+
+    int count = min(graph->sample_count, size);
+    for (int i = 0; i < count; i += 1) {
+        int index = (graph->sample_next - count + i + MNI_PIXELS_MAX_SIZE) % MNI_PIXELS_MAX_SIZE;
+        _MniPixelsDrawGraphColumn(graph->pixels, size, size - count + i, _MniGraphLevel(graph, graph->samples[index]), line_color, fill_color);
+    }
+
+    graph->dirty = MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static LONGLONG _MniGraphNow(void) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+// ========================================================================== //
+
+static void _MniGraphPush(ModernNotifyIcon *mni, MniGraph *graph) {
+    int size = graph->size;
+    SIZE_T count = (SIZE_T)size * (SIZE_T)size;
+
+    graph->dirty = MNI_FALSE;
+    graph->last_push = _MniGraphNow();
+
+    // Scrolled flat line looks the same, no new icon needed.
+    UINT64 hash = _MniPixelsHash(graph->pixels, count, (UINT64)size);
+    if (graph->pushed && graph->pushed_hash == hash) {
+        mni->icon_updates_suppressed += 1;
+        return;
+    }
+
+    _MniPixelsUnpremultiply(graph->color_bits, graph->pixels, count);
+
+    ICONINFO icon_info = {
+        .fIcon = TRUE,
+        .hbmMask = graph->mask,
+        .hbmColor = graph->color,
+    };
+
+    HICON icon = CreateIconIndirect(&icon_info);
+    if (!icon) {
+        return;
+    }
+
+    _MniUpdateIconWithFingerprint(mni, icon, &hash);
+    mni->icon = icon;
+
+    // Shell worker has its own copy of the icon, previous one can go right away.
+    if (graph->icon) {
+        DestroyIcon(graph->icon);
+    }
+
+    graph->icon = icon;
+    graph->pushed_hash = hash;
+    graph->pushed = MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static void _MniGraphRequestPush(ModernNotifyIcon *mni, MniGraph *graph) {
+    if (!graph->dirty || graph->timer_armed) {
+        return;
+    }
+
+    LONGLONG interval = graph->frequency / graph->max_fps;
+    LONGLONG elapsed = _MniGraphNow() - graph->last_push;
+
+    if (!graph->pushed || elapsed >= interval) {
+        _MniGraphPush(mni, graph);
+        return;
+    }
+
+    // Samples arriving until then only update pixels.
+    LONGLONG remaining = (interval - elapsed) * 1000 / graph->frequency + 1;
+    if (MNI_SUCCEEDED(_MniTimerWheelStart(mni, WHEEL_TIMER_GRAPH, (UINT)remaining))) {
+        graph->timer_armed = MNI_TRUE;
+    } else {
+        _MniGraphPush(mni, graph);
+    }
+}
+
+// ========================================================================== //
+
+static void _MniGraphTick(ModernNotifyIcon *mni) {
+    MniGraph *graph = mni->graph;
+
+    _MniTimerWheelStop(mni, WHEEL_TIMER_GRAPH);
+    if (!graph) {
+        return;
+    }
+
+    graph->timer_armed = MNI_FALSE;
+    if (graph->dirty) {
+        _MniGraphPush(mni, graph);
+    }
+}
+
+// ========================================================================== //
+
+static void _MniGraphAddSample(ModernNotifyIcon *mni, MniGraph *graph, float value) {
+    graph->samples[graph->sample_next] = value;
+    graph->sample_next = (graph->sample_next + 1) % MNI_PIXELS_MAX_SIZE;
+    graph->sample_count = min(graph->sample_count + 1, MNI_PIXELS_MAX_SIZE);
+
+    uint32_t line_color;
+    uint32_t fill_color;
+    _MniGraphColors(mni, &line_color, &fill_color);
+
+    int size = graph->size;
+    _MniPixelsScrollLeft(graph->pixels, size);
+    _MniPixelsDrawGraphColumn(graph->pixels, size, size - 1, _MniGraphLevel(graph, value), line_color, fill_color);
+
+    graph->dirty = MNI_TRUE;
+    _MniGraphRequestPush(mni, graph);
+}
+
+// ========================================================================== //
+
+// Redraws graph after dpi or theme change.
+static void _MniGraphRefresh(ModernNotifyIcon *mni, int dpi) {
+    MniGraph *graph = mni->graph;
+    if (!graph) {
+        return;
+    }
+
+    if (graph->dpi != dpi) {
+        if (MNI_FAILED(_MniGraphCreateBitmaps(graph, _GetSmallIconSize(dpi)))) {
+            return;
+        }
+        graph->dpi = dpi;
+    }
+
+    _MniGraphRedraw(mni, graph);
+
+    // Visible change, not throttled.
+    _MniTimerWheelStop(mni, WHEEL_TIMER_GRAPH);
+    graph->timer_armed = MNI_FALSE;
+    _MniGraphPush(mni, graph);
+}
+
+// ========================================================================== //
+
+// Called when icon cache has new variant, graph hides base icon until it ends.
+static MniBool _MniGraphRebase(ModernNotifyIcon *mni, MniIconCache *cache, HICON icon) {
+    MniGraph *graph = mni->graph;
+    if (!graph) {
+        return MNI_FALSE;
+    }
+
+    if (_MniIconCacheOwns(cache, graph->base_icon)) {
+        graph->base_icon = icon;
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+// Restores icon that was set before graph started.
+static void _MniGraphRelease(ModernNotifyIcon *mni, MniBool restore) {
+    MniGraph *graph = mni->graph;
+    if (!graph) {
+        return;
+    }
+
+    _MniTimerWheelStop(mni, WHEEL_TIMER_GRAPH);
+
+    mni->graph = NULL;
+    mni->icon = graph->base_icon;
+
+    if (restore) {
+        _MniUpdateIcon(mni, graph->base_icon);
+
+        if (mni->window_handle) {
+            _MniBackendSendMessage(mni, WM_MNI_ICON_CHANGE, (WPARAM)graph->base_icon, 0);
+        }
+    }
+
+    if (graph->icon) {
+        DestroyIcon(graph->icon);
+    }
+
+    _MniGraphFreeBitmaps(graph);
+    _MniFree(graph);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Mask Icons
+
+// Single alpha mask recolored with taskbar text color, so light, dark and high contrast
+// variants come from one icon. Mask is an icon source, variants are pooled by color and
+// size, switching back to a theme seen before reuses them.
+
+typedef struct MniIconMask {
+    UINT64                      hash;               // of premultiplied pixels and dimensions
+    volatile LONG               color;              // premultiplied BGRA, read by cache jobs
+    int                         width;
+    int                         height;
+} MniIconMask;
+
+typedef struct MniIconMaskDraw {
+    const MniIconMask           *mask;
+    uint32_t                    color;
+} MniIconMaskDraw;
+
+static uint32_t *_MniIconMaskData(const MniIconMask *mask) {
+    return (uint32_t *)(mask + 1);
+}
+
+// ========================================================================== //
+
+static void _MniIconMaskDrawPixels(uint32_t *pixels, int size, const void *context) {
+    const MniIconMaskDraw *draw = (const MniIconMaskDraw *)context;
+    const MniIconMask *mask = draw->mask;
+
+    _MniPixelsResample(pixels, size, size, size, _MniIconMaskData(mask), mask->width, mask->height, mask->width);
+    _MniPixelsRecolor(pixels, pixels, (size_t)size * (size_t)size, draw->color);
+}
+
+// ========================================================================== //
+
+static HICON _MniIconMaskLoad(void *context, int size, int dpi) {
+    UNREFERENCED_PARAMETER(dpi);
+
+    MniIconMaskDraw draw = {
+        .mask = (const MniIconMask *)context,
+    };
+
+    // Read once, theme may change while this runs on the thread pool.
+    draw.color = (uint32_t)InterlockedCompareExchange((volatile LONG *)&draw.mask->color, 0, 0);
+
+    UINT64 hash = draw.mask->hash ^ ((UINT64)draw.color * 0x9E3779B97F4A7C15ull);
+    HICON icon = _MniIconPoolFind(hash, size);
+    if (icon) {
+        return icon;
+    }
+
+    icon = _MniCreateIconWith(size, _MniIconMaskDrawPixels, &draw);
+    if (!icon) {
+        return NULL;
+    }
+
+    return _MniIconPoolAdd(hash, size, icon);
+}
+
+// ========================================================================== //
+
+static void _MniIconMaskApplyTheme(ModernNotifyIcon *mni) {
+    MniIconCache *cache = mni->icon_cache;
+    if (!cache || cache->source.load != _MniIconMaskLoad) {
+        return;
+    }
+
+    MniIconMask *mask = (MniIconMask *)cache->source.context;
+    InterlockedExchange(&mask->color, (LONG)_MniColorToPixel(mni->system_theme.TextColor, 0xFF));
+
+    _MniIconCacheRebuild(mni);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Icon Pack
+
+// Frames are used straight from the mapped pack. Pool is keyed by precomputed frame
+// hash, so repeated requests don't even touch the pixels.
+
+typedef struct MniIconPackSource {
+    MniIconPack                 pack;               // copy, caller's struct may go away
+    int                         icon;
+} MniIconPackSource;
+
+typedef struct MniIconPackDraw {
+    const uint32_t              *pixels;
+    int                         width;
+    int                         height;
+} MniIconPackDraw;
+
+static void _MniIconPackDrawPixels(uint32_t *pixels, int size, const void *context) {
+    const MniIconPackDraw *draw = (const MniIconPackDraw *)context;
+
+    if (draw->width == size && draw->height == size) {
+        memcpy(pixels, draw->pixels, (SIZE_T)size * (SIZE_T)size * sizeof(uint32_t));
+    } else {
+        _MniPixelsResample(pixels, size, size, size, draw->pixels, draw->width, draw->height, draw->width);
+    }
+}
+
+// ========================================================================== //
+
+static HICON _MniIconPackLoadIcon(const MniIconPack *pack, int icon, int size) {
+    const MniPackFrame *frame = _MniPackFindFrame(pack->data, icon, size);
+
+    HICON result = _MniIconPoolFind(frame->hash, size);
+    if (result) {
+        return result;
+    }
+
+    MniIconPackDraw draw = {
+        .pixels = _MniPackPixels(pack->data, frame),
+        .width = frame->width,
+        .height = frame->height,
+    };
+
+    result = _MniCreateIconWith(size, _MniIconPackDrawPixels, &draw);
+    if (!result) {
+        return NULL;
+    }
+
+    return _MniIconPoolAdd(frame->hash, size, result);
+}
+
+// ========================================================================== //
+
+static HICON _MniIconPackLoad(void *context, int size, int dpi) {
+    UNREFERENCED_PARAMETER(dpi);
+
+    const MniIconPackSource *source = (const MniIconPackSource *)context;
+    return _MniIconPackLoadIcon(&source->pack, source->icon, size);
+}
+
+// ========================================================================== //
+
+static int _MniIconPackFind(const MniIconPack *pack, const char *name) {
+    if (!pack || !pack->data || !name) {
+        return -1;
+    }
+
+    return _MniPackFindIcon(pack->data, name);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Icon Loader
+
+// Icon files decoded on the thread pool. Every request gets id from the loader, newer
+// request or icon set any other way bumps it and older requests are dropped wherever
+// they are. Results are handed back through completed list like icon cache variants.
+
+#define MNI_ICON_LOAD_MAX_FILE_SIZE     (16 * 1024 * 1024)
+
+typedef struct MniIconLoad {
+    struct MniIconLoad          *next;
+    struct MniIconLoader        *loader;
+    LONG                        id;
+    int                         size;               // icon size at dpi of request
+    wchar_t                     *file_name;         // NULL when loading from memory
+    void                        *data;              // file contents or copy of memory
+    SIZE_T                      data_size;
+    MniPixelImage               *image;
+    MniError                    result;
+} MniIconLoad;
+
+typedef struct MniIconLoader {
+    volatile LONG               refs;               // window thread + loads in flight
+    volatile LONG               latest;             // id of the only request not cancelled
+    SRWLOCK                     lock;
+    MniBool                     released;           // guarded by lock
+    MniIconLoad                 *completed;         // guarded by lock
+    HWND                        window;
+    UINT                        uid;
+    MniBackend                  backend;
+} MniIconLoader;
+
+static void _MniIconLoadFree(MniIconLoad *load) {
+    _MniIconSourceFreeName(load->file_name);
+    _MniFree(load->data);
+    _MniFree(load->image);
+    _MniFree(load);
+}
+
+// ========================================================================== //
+
+static void _MniIconLoaderUnref(MniIconLoader *loader) {
+    if (InterlockedDecrement(&loader->refs) == 0) {
+        _MniFree(loader);
+    }
+}
+
+// ========================================================================== //
+
+static MniBool _MniIconLoadCancelled(const MniIconLoad *load) {
+    return load->id != load->loader->latest;
+}
+
+// ========================================================================== //
+
+static MniError _MniIconLoadReadFile(MniIconLoad *load) {
+    HANDLE file = CreateFileW(load->file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return MNI_ERROR_FAILED_TO_LOAD_ICON;
+    }
+
+    MniError result = MNI_ERROR_FAILED_TO_DECODE_ICON;
+    LARGE_INTEGER size = { 0 };
+
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart <= MNI_ICON_LOAD_MAX_FILE_SIZE) {
+        DWORD read = 0;
+        load->data = _MniAlloc((SIZE_T)size.QuadPart);
+
+        if (!load->data) {
+            result = MNI_ERROR_OUT_OF_MEMORY;
+        } else if (!ReadFile(file, load->data, (DWORD)size.QuadPart, &read, NULL) || read != (DWORD)size.QuadPart) {
+            result = MNI_ERROR_FAILED_TO_LOAD_ICON;
+        } else {
+            load->data_size = (SIZE_T)size.QuadPart;
+            result = MNI_OK;
+        }
+    }
+
+    CloseHandle(file);
+
+    return result;
+}
+
+// ========================================================================== //
+
+static MniError _MniIconLoadDecode(MniIconLoad *load) {
+    MniDecodeInfo info;
+    MniDecodeStatus status = _MniDecodeProbe(load->data, load->data_size, load->size, &info);
+    if (status != MNI_DECODE_OK) {
+        MNI_TRACE(L"_MniIconLoadDecode: %S", _MniDecodeStatusToString(status));
+        return MNI_ERROR_FAILED_TO_DECODE_ICON;
+    }
+
+    MniPixelImage *image = _MniPixelImageAlloc(info.width, info.height);
+    void *scratch = info.scratch_size ? _MniAlloc(info.scratch_size) : NULL;
+    if (!image || (info.scratch_size && !scratch)) {
+        _MniFree(image);
+        _MniFree(scratch);
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    status = _MniDecodeImage(load->data, load->data_size, &info, _MniPixelImageData(image), scratch);
+    _MniFree(scratch);
+
+    if (status != MNI_DECODE_OK) {
+        MNI_TRACE(L"_MniIconLoadDecode: %S", _MniDecodeStatusToString(status));
+        _MniFree(image);
+        return MNI_ERROR_FAILED_TO_DECODE_ICON;
+    }
+
+    load->image = image;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static void CALLBACK _MniIconLoadRun(PTP_CALLBACK_INSTANCE instance, PVOID context) {
+    UNREFERENCED_PARAMETER(instance);
+
+    MniIconLoad *load = (MniIconLoad *)context;
+    MniIconLoader *loader = load->loader;
+
+    // Cancelled loads skip the rest of the work, window thread drops them.
+    if (load->file_name && !_MniIconLoadCancelled(load)) {
+        load->result = _MniIconLoadReadFile(load);
+    }
+
+    if (load->result == MNI_OK && !_MniIconLoadCancelled(load)) {
+        load->result = _MniIconLoadDecode(load);
+    }
+
+    // Encoded data isn't needed anymore, only image is kept until it's applied.
+    _MniFree(load->data);
+    load->data = NULL;
+
+    AcquireSRWLockExclusive(&loader->lock);
+    MniBool released = loader->released;
+    if (!released) {
+        load->next = loader->completed;
+        loader->completed = load;
+    }
+    ReleaseSRWLockExclusive(&loader->lock);
+
+    if (released) {
+        _MniIconLoadFree(load);
+    } else {
+        // Same uid encoding as _MniBackendPostMessage, so hosted icons get routed.
+        LPARAM lParam = (LPARAM)((UINT)loader->uid << 16);
+        if (loader->backend.post_message) {
+            loader->backend.post_message(loader->backend.context, loader->window, WM_MNI_ICON_VARIANT, 0, lParam);
+        } else {
+            PostMessageW(loader->window, WM_MNI_ICON_VARIANT, 0, lParam);
+        }
+    }
+
+    _MniIconLoaderUnref(loader);
+}
+
+// ========================================================================== //
+
+// Takes ownership of load and cancels every earlier request.
+static MniError _MniIconLoaderSubmit(ModernNotifyIcon *mni, MniIconLoad *load) {
+    MniIconLoader *loader = mni->icon_loader;
+    if (!loader) {
+        loader = (MniIconLoader *)_MniAlloc(sizeof(*loader));
+        if (!loader) {
+            _MniIconLoadFree(load);
+            return MNI_ERROR_OUT_OF_MEMORY;
+        }
+
+        InitializeSRWLock(&loader->lock);
+        loader->refs = 1;
+        loader->window = mni->window_handle;
+        loader->uid = mni->uid;
+        loader->backend = mni->backend;
+        mni->icon_loader = loader;
+    }
+
+    load->loader = loader;
+    load->id = InterlockedIncrement(&loader->latest);
+    load->size = _GetSmallIconSize(mni->dpi);
+
+    InterlockedIncrement(&loader->refs);
+    if (!TrySubmitThreadpoolCallback(_MniIconLoadRun, load, NULL)) {
+        InterlockedDecrement(&loader->refs);
+        _MniIconLoadFree(load);
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static void _MniIconLoaderCancel(ModernNotifyIcon *mni) {
+    if (mni->icon_loader) {
+        InterlockedIncrement(&mni->icon_loader->latest);
+    }
+}
+
+// ========================================================================== //
+
+// Applies result of the latest request, cancelled ones are dropped silently.
+static void _MniIconLoaderCollect(ModernNotifyIcon *mni) {
+    MniIconLoader *loader = mni->icon_loader;
+    if (!loader) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&loader->lock);
+    MniIconLoad *load = loader->completed;
+    loader->completed = NULL;
+    ReleaseSRWLockExclusive(&loader->lock);
+
+    while (load) {
+        MniIconLoad *next = load->next;
+
+        if (!_MniIconLoadCancelled(load)) {
+            MniError result = load->result;
+            if (MNI_SUCCEEDED(result)) {
+                result = _MniPixelImageInstall(mni, load->image);
+                load->image = NULL;
+            }
+
+            if (mni->on_icon_load) {
+                mni->on_icon_load(mni, result);
+            }
+        }
+
+        _MniIconLoadFree(load);
+        load = next;
+    }
+}
+
+// ========================================================================== //
+
+static void _MniIconLoaderRelease(ModernNotifyIcon *mni) {
+    MniIconLoader *loader = mni->icon_loader;
+    if (!loader) {
+        return;
+    }
+
+    mni->icon_loader = NULL;
+
+    // Loads still running free themselves.
+    AcquireSRWLockExclusive(&loader->lock);
+    loader->released = MNI_TRUE;
+    MniIconLoad *load = loader->completed;
+    loader->completed = NULL;
+    ReleaseSRWLockExclusive(&loader->lock);
+
+    InterlockedIncrement(&loader->latest);
+
+    while (load) {
+        MniIconLoad *next = load->next;
+        _MniIconLoadFree(load);
+        load = next;
+    }
+
+    _MniIconLoaderUnref(loader);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Text Icons
+
+// Short text drawn with built-in font. Glyph atlas is baked once per text height, which
+// follows the icon size of dpi bucket, and kept for process lifetime.
+
+#define MNI_TEXT_ICON_MAX_LENGTH    4
+#define MNI_ICON_POOL_SEED_TEXT     (0x746578746963ull)
+
+static uint8_t *volatile _mni_text_atlases[MNI_PIXELS_MAX_SIZE + 1];
+
+typedef struct MniTextDraw {
+    const char                  *text;
+    const uint8_t               *atlas;
+    int                         height;
+    uint32_t                    color;              // premultiplied BGRA
+} MniTextDraw;
+
+static const uint8_t *_MniTextAtlas(int height) {
+    uint8_t *atlas = _mni_text_atlases[height];
+    if (atlas) {
+        return atlas;
+    }
+
+    atlas = (uint8_t *)_MniAlloc(_MniTextAtlasSize(height));
+    if (!atlas) {
+        return NULL;
+    }
+
+    _MniTextAtlasBake(atlas, height);
+
+    // Another thread may have baked the same height meanwhile, first one wins.
+    uint8_t *published = (uint8_t *)InterlockedCompareExchangePointer((PVOID volatile *)&_mni_text_atlases[height], atlas, NULL);
+    if (published) {
+        _MniFree(atlas);
+        return published;
+    }
+
+    return atlas;
+}
+
+// ========================================================================== //
+
+// Largest height of text which fits icon, at most three quarters of it.
+static int _MniTextFitHeight(const char *text, int size) {
+    for (int height = size * 3 / 4; height > 1; height -= 1) {
+        if (_MniTextMeasure(text, height) <= size) {
+            return height;
+        }
+    }
+
+    return 1;
+}
+
+// ========================================================================== //
+
+static void _MniTextDrawPixels(uint32_t *pixels, int size, const void *context) {
+    const MniTextDraw *draw = (const MniTextDraw *)context;
+
+    int x = (size - _MniTextMeasure(draw->text, draw->height)) / 2;
+    int y = (size - draw->height) / 2;
+
+    _MniTextDraw(pixels, size, draw->atlas, draw->height, draw->text, x, y, draw->color);
+}
+
+// ========================================================================== //
+
+static HICON _MniCreateTextIcon(const char *text, int size, uint32_t color) {
+    uint32_t key[MNI_TEXT_ICON_MAX_LENGTH + 2] = { 0 };
+    for (int i = 0; text[i]; i += 1) {
+        key[i] = (uint8_t)text[i];
+    }
+    key[MNI_TEXT_ICON_MAX_LENGTH] = color;
+    key[MNI_TEXT_ICON_MAX_LENGTH + 1] = (uint32_t)size;
+    UINT64 hash = _MniPixelsHash(key, ARRAYSIZE(key), MNI_ICON_POOL_SEED_TEXT);
+
+    HICON icon = _MniIconPoolFind(hash, size);
+    if (icon) {
+        return icon;
+    }
+
+    MniTextDraw draw = {
+        .text = text,
+        .height = _MniTextFitHeight(text, size),
+        .color = color,
+    };
+
+    draw.atlas = _MniTextAtlas(draw.height);
+    if (!draw.atlas) {
+        return NULL;
+    }
+
+    icon = _MniCreateIconWith(size, _MniTextDrawPixels, &draw);
+    if (!icon) {
+        return NULL;
+    }
+
+    return _MniIconPoolAdd(hash, size, icon);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Notification Queue
+
+// Balloons posted through MniPostNotification wait here and go out one at a time. Shell
+// reports end of each balloon with NIN_BALLOONHIDE or NIN_BALLOONTIMEOUT, queue timer
+// covers waiting for tokens and balloons the shell never reports back. Journaled queue
+// appends each post, show and outcome to mapped file, see mni_journal.h. Notification
+// is finished only by its outcome, so one on screen during crash is shown again.
+
+typedef struct MniNotification {
+    UINT64                      hash;               // of title and text
+    UINT64                      sequence;
+    MniNotificationPriority     priority;
+    MniBalloonIconType          icon_type;
+    HICON                       icon;
+    MniBalloonFlags             flags;
+    wchar_t                     title[64];          // sizes of NOTIFYICONDATAW
+    wchar_t                     text[256];
+} MniNotification;
+
+typedef struct MniRecentNotification {
+    UINT64                      hash;
+    ULONGLONG                   time;
+} MniRecentNotification;
+
+typedef struct MniNotificationJournal {
+    wchar_t                     *path;              // NULL when queue isn't journaled
+    HANDLE                      file;
+    HANDLE                      mapping;
+    uint8_t                     *data;
+    size_t                      size;
+    size_t                      tail;               // where next record goes
+} MniNotificationJournal;
+
+typedef struct MniNotificationQueue {
+    MniNotificationQueueInfo    info;               // strings point to copies below
+    wchar_t                     summary_title[64];
+    wchar_t                     summary_text[256];
+    MniNotification             *items;             // unordered, highest priority is searched
+    int                         count;
+    UINT64                      next_sequence;
+    ULONGLONG                   tokens;             // thousandths of balloon
+    ULONGLONG                   refilled;           // tick of last refill
+    MniRecentNotification       recent[MNI_NOTIFICATION_RECENT_COUNT];
+    int                         recent_next;
+    MniBool                     showing;
+    ULONGLONG                   shown_at;
+    MniNotification             *shown;             // on screen, summary shows several
+    int                         shown_count;
+    MniNotificationJournal      journal;
+    MniNotificationQueueStats   stats;
+} MniNotificationQueue;
+
+static UINT64 _MniNotificationHash(const wchar_t *title, const wchar_t *text) {
+    // FNV-1a, title and text separated by zero so they can't shift into each other.
+    UINT64 hash = 0xCBF29CE484222325ull;
+    const wchar_t *parts[2] = { title, text };
+
+    for (int i = 0; i < 2; i += 1) {
+        for (const wchar_t *c = parts[i]; c && *c; c += 1) {
+            hash = (hash ^ (UINT64)*c) * 0x100000001B3ull;
+        }
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+// ========================================================================== //
+
+// Replaces first %d of format with count.
+static void _MniNotificationFormat(wchar_t *dest, int cch, const wchar_t *format, int count) {
+    wchar_t digits[16];
+    int digit_count = 0;
+    do {
+        digits[digit_count++] = (wchar_t)(L'0' + count % 10);
+        count /= 10;
+    } while (count > 0);
+
+    int length = 0;
+    MniBool replaced = MNI_FALSE;
+    for (const wchar_t *c = format; *c && length < cch - 1; c += 1) {
+        if (!replaced && c[0] == L'%' && c[1] == L'd') {
+            while (digit_count > 0 && length < cch - 1) {
+                dest[length++] = digits[--digit_count];
+            }
+            replaced = MNI_TRUE;
+            c += 1;
+        } else {
+            dest[length++] = *c;
+        }
+    }
+
+    dest[length] = L'\0';
+}
+
+// ========================================================================== //
+
+static MniBool _MniNotificationIsDuplicate(const MniNotificationQueue *queue, UINT64 hash, ULONGLONG now) {
+    if (queue->info.dedup_window == 0) {
+        return MNI_FALSE;
+    }
+
+    for (int i = 0; i < queue->count; i += 1) {
+        if (queue->items[i].hash == hash) {
+            return MNI_TRUE;
+        }
+    }
+
+    for (int i = 0; i < MNI_NOTIFICATION_RECENT_COUNT; i += 1) {
+        const MniRecentNotification *recent = &queue->recent[i];
+        if (recent->time != 0 && recent->hash == hash && now - recent->time < queue->info.dedup_window) {
+            return MNI_TRUE;
+        }
+    }
+
+    return MNI_FALSE;
+}
+
+// ========================================================================== //
+
+// Only queued notifications are remembered, rejected one may be posted again.
+static void _MniNotificationRemember(MniNotificationQueue *queue, UINT64 hash, ULONGLONG now) {
+    if (queue->info.dedup_window == 0) {
+        return;
+    }
+
+    queue->recent[queue->recent_next].hash = hash;
+    queue->recent[queue->recent_next].time = now;
+    queue->recent_next = (queue->recent_next + 1) % MNI_NOTIFICATION_RECENT_COUNT;
+}
+
+// ========================================================================== //
+
+// Most important notification, oldest first within priority. Lowest and newest with lowest.
+static int _MniNotificationFind(const MniNotificationQueue *queue, MniBool lowest) {
+    int found = -1;
+
+    for (int i = 0; i < queue->count; i += 1) {
+        const MniNotification *item = &queue->items[i];
+        if (found == -1) {
+            found = i;
+            continue;
+        }
+
+        const MniNotification *best = &queue->items[found];
+        MniBool better = lowest
+            ? item->priority < best->priority || (item->priority == best->priority && item->sequence > best->sequence)
+            : item->priority > best->priority || (item->priority == best->priority && item->sequence < best->sequence);
+
+        if (better) {
+            found = i;
+        }
+    }
+
+    return found;
+}
+
+// ========================================================================== //
+
+static void _MniNotificationRemove(MniNotificationQueue *queue, int index) {
+    queue->count -= 1;
+    queue->items[index] = queue->items[queue->count];
+}
+
+// ========================================================================== //
+
+static wchar_t *_MniNotificationJournalPath(const wchar_t *path, const wchar_t *suffix) {
+    SIZE_T path_length = wcslen(path);
+    SIZE_T suffix_length = wcslen(suffix) + 1;
+    wchar_t *copy = (wchar_t *)_MniAlloc((path_length + suffix_length) * sizeof(wchar_t));
+    if (copy) {
+        memcpy(copy, path, path_length * sizeof(wchar_t));
+        memcpy(copy + path_length, suffix, suffix_length * sizeof(wchar_t));
+    }
+
+    return copy;
+}
+
+// ========================================================================== //
+
+static void _MniNotificationJournalUnmap(MniNotificationJournal *journal) {
+    if (journal->data) {
+        FlushViewOfFile(journal->data, 0);
+        UnmapViewOfFile(journal->data);
+    }
+    if (journal->mapping) {
+        CloseHandle(journal->mapping);
+    }
+    if (journal->file) {
+        CloseHandle(journal->file);
+    }
+
+    journal->file = NULL;
+    journal->mapping = NULL;
+    journal->data = NULL;
+    journal->size = 0;
+    journal->tail = 0;
+}
+
+// ========================================================================== //
+
+static void _MniNotificationJournalClose(MniNotificationJournal *journal) {
+    _MniNotificationJournalUnmap(journal);
+    _MniFree(journal->path);
+    journal->path = NULL;
+}
+
+// ========================================================================== //
+
+// Maps whole file, shorter one is extended to size first. Extended part reads as zeros.
+static MniBool _MniNotificationJournalMap(MniNotificationJournal *journal, const wchar_t *path, DWORD disposition, size_t size) {
+    journal->file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (journal->file == INVALID_HANDLE_VALUE) {
+        journal->file = NULL;
+        return MNI_FALSE;
+    }
+
+    LARGE_INTEGER file_size = { 0 };
+    if (!GetFileSizeEx(journal->file, &file_size)) {
+        _MniNotificationJournalUnmap(journal);
+        return MNI_FALSE;
+    }
+
+    if ((ULONGLONG)file_size.QuadPart < size) {
+        file_size.QuadPart = (LONGLONG)size;
+        if (!SetFilePointerEx(journal->file, file_size, NULL, FILE_BEGIN) || !SetEndOfFile(journal->file)) {
+            _MniNotificationJournalUnmap(journal);
+            return MNI_FALSE;
+        }
+    }
+
+    journal->size = (size_t)file_size.QuadPart;
+    journal->mapping = CreateFileMappingW(journal->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+    journal->data = journal->mapping ? (uint8_t *)MapViewOfFile(journal->mapping, FILE_MAP_WRITE, 0, 0, 0) : NULL;
+    if (!journal->data) {
+        _MniNotificationJournalUnmap(journal);
+        return MNI_FALSE;
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+// Maps journal at path, creating it when missing, and finds the tail.
+static MniBool _MniNotificationJournalOpen(MniNotificationJournal *journal, size_t *posted_count, uint64_t *last_id) {
+    if (!_MniNotificationJournalMap(journal, journal->path, OPEN_ALWAYS, MNI_NOTIFICATION_JOURNAL_SIZE)) {
+        return MNI_FALSE;
+    }
+
+    // New file is all zeros, so is one whose creation was cut short.
+    if (((const MniJournalHeader *)journal->data)->magic == 0) {
+        _MniJournalCreate(journal->data, journal->size, 1);
+    }
+
+    MniJournalStatus status = _MniJournalValidate(journal->data, journal->size);
+    if (status != MNI_JOURNAL_OK) {
+        MNI_TRACE(L"_MniNotificationJournalOpen() %S", _MniJournalStatusToString(status));
+        _MniNotificationJournalUnmap(journal);
+        return MNI_FALSE;
+    }
+
+    journal->tail = _MniJournalScan(journal->data, journal->size, posted_count, last_id);
+
+    // Torn append leaves bytes past the tail, records appended there must not run into them.
+    for (size_t i = journal->tail; i < journal->size; i += 1) {
+        if (journal->data[i]) {
+            memset(journal->data + i, 0, journal->size - i);
+            break;
+        }
+    }
+
+    return MNI_TRUE;
+}
+
+// ========================================================================== //
+
+static MniJournalEntry _MniNotificationJournalEntry(MniJournalRecordType type, const MniNotification *item, UINT outcome) {
+    return (MniJournalEntry){
+        .type = type,
+        .id = item->sequence,
+        .outcome = outcome,
+        .priority = (uint8_t)item->priority,
+        .icon_type = (uint8_t)item->icon_type,
+        .flags = (uint16_t)item->flags,
+        .title = (const uint16_t *)item->title,
+        .title_length = (int)wcslen(item->title),
+        .text = (const uint16_t *)item->text,
+        .text_length = (int)wcslen(item->text),
+    };
+}
+
+// ========================================================================== //
+
+static int _MniNotificationCompareSequence(const void *a, const void *b) {
+    UINT64 left = (*(const MniNotification *const *)a)->sequence;
+    UINT64 right = (*(const MniNotification *const *)b)->sequence;
+    return left < right ? -1 : left > right;
+}
+
+// ========================================================================== //
+
+// Writes pending and shown notifications into new journal with next epoch and moves it over
+// the old one. Rename is the commit point, crash before it leaves the old journal whole.
+static MniBool _MniNotificationJournalRewrite(MniNotificationQueue *queue) {
+    MniNotificationJournal *journal = &queue->journal;
+    int live_count = queue->shown_count + queue->count;
+
+    wchar_t *temp_path = _MniNotificationJournalPath(journal->path, L".tmp");
+    const MniNotification **live = (const MniNotification **)_MniAlloc(sizeof(*live) * (SIZE_T)max(live_count, 1));
+    if (!temp_path || !live) {
+        _MniFree(temp_path);
+        _MniFree((void *)live);
+        return MNI_FALSE;
+    }
+
+    // Posted ids have to grow through the journal.
+    for (int i = 0; i < queue->shown_count; i += 1) {
+        live[i] = &queue->shown[i];
+    }
+    for (int i = 0; i < queue->count; i += 1) {
+        live[queue->shown_count + i] = &queue->items[i];
+    }
+    qsort((void *)live, (size_t)live_count, sizeof(*live), _MniNotificationCompareSequence);
+
+    // Twice the room live records take, so busy queue isn't rewritten every few posts.
+    size_t size = sizeof(MniJournalHeader) + (size_t)live_count * MNI_NOTIFICATION_JOURNAL_RECORD_SIZE * 2;
+    size = max(size, MNI_NOTIFICATION_JOURNAL_SIZE);
+    size = (size + MNI_NOTIFICATION_JOURNAL_GRANULARITY - 1) / MNI_NOTIFICATION_JOURNAL_GRANULARITY * MNI_NOTIFICATION_JOURNAL_GRANULARITY;
+
+    UINT_PTR shown_begin = (UINT_PTR)queue->shown;
+    UINT_PTR shown_end = (UINT_PTR)(queue->shown + queue->shown_count);
+
+    MniNotificationJournal temp = { 0 };
+    MniBool written = _MniNotificationJournalMap(&temp, temp_path, CREATE_ALWAYS, size);
+    if (written) {
+        temp.tail = _MniJournalCreate(temp.data, temp.size, ((const MniJournalHeader *)journal->data)->epoch + 1);
+
+        for (int i = 0; i < live_count && temp.tail; i += 1) {
+            MniJournalEntry entry = _MniNotificationJournalEntry(MNI_JOURNAL_POSTED, live[i], 0);
+            temp.tail = _MniJournalAppend(temp.data, temp.size, temp.tail, &entry);
+
+            if (temp.tail && (UINT_PTR)live[i] >= shown_begin && (UINT_PTR)live[i] < shown_end) {
+                entry.type = MNI_JOURNAL_SHOWN;
+                temp.tail = _MniJournalAppend(temp.data, temp.size, temp.tail, &entry);
+            }
+        }
+
+        // New journal must be on disk before it replaces the old one.
+        written = temp.tail != 0 && FlushViewOfFile(temp.data, 0) && FlushFileBuffers(temp.file);
+    }
+    _MniNotificationJournalUnmap(&temp);
+
+    // Mapped file can't be replaced.
+    _MniNotificationJournalUnmap(journal);
+    if (written) {
+        written = MoveFileExW(temp_path, journal->path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    }
+    if (!written) {
+        DeleteFileW(temp_path);
+    }
+
+    size_t posted_count = 0;
+    uint64_t last_id = 0;
+    MniBool opened = _MniNotificationJournalOpen(journal, &posted_count, &last_id);
+
+    _MniFree(temp_path);
+    _MniFree((void *)live);
+
+    return written && opened;
+}
+
+// ========================================================================== //
+
+// Appends record of item, full journal is rewritten first. Journal that can't be written
+// is closed and the queue goes on in memory.
+static void _MniNotificationJournalWrite(MniNotificationQueue *queue, MniJournalRecordType type, const MniNotification *item, UINT outcome) {
+    MniNotificationJournal *journal = &queue->journal;
+    if (!journal->data) {
+        return;
+    }
+
+    MniJournalEntry entry = _MniNotificationJournalEntry(type, item, outcome);
+    size_t tail = _MniJournalAppend(journal->data, journal->size, journal->tail, &entry);
+    if (tail == 0 && _MniNotificationJournalRewrite(queue)) {
+        tail = _MniJournalAppend(journal->data, journal->size, journal->tail, &entry);
+    }
+
+    if (tail == 0) {
+        MNI_TRACE(L"_MniNotificationJournalWrite() failed to write %s", journal->path);
+        _MniNotificationJournalClose(journal);
+        return;
+    }
+
+    journal->tail = tail;
+}
+
+// ========================================================================== //
+
+// Opens journal and queues notifications it has no outcome for, oldest first up to capacity.
+static MniBool _MniNotificationJournalReplay(MniNotificationQueue *queue) {
+    MniNotificationJournal *journal = &queue->journal;
+    size_t posted_count = 0;
+    uint64_t last_id = 0;
+
+    if (!_MniNotificationJournalOpen(journal, &posted_count, &last_id)) {
+        return MNI_FALSE;
+    }
+
+    size_t *offsets = posted_count > 0 ? (size_t *)_MniAlloc(sizeof(*offsets) * posted_count) : NULL;
+    if (posted_count > 0 && !offsets) {
+        _MniNotificationJournalUnmap(journal);
+        return MNI_FALSE;
+    }
+
+    size_t pending = posted_count > 0 ? _MniJournalPending(journal->data, journal->tail, offsets, posted_count) : 0;
+    for (size_t i = 0; i < pending; i += 1) {
+        if (queue->count == queue->info.capacity) {
+            queue->stats.dropped += pending - i;
+            break;
+        }
+
+        MniJournalEntry entry;
+        _MniJournalRead(journal->data, offsets[i], &entry);
+
+        // Custom icon handle didn't survive, shell shows icon of the notify icon instead.
+        MniNotification *item = &queue->items[queue->count];
+        item->sequence = entry.id;
+        item->priority = (MniNotificationPriority)min(entry.priority, MNI_NOTIFICATION_PRIORITY_URGENT);
+        item->icon_type = (MniBalloonIconType)entry.icon_type;
+        item->icon = NULL;
+        item->flags = (MniBalloonFlags)entry.flags;
+        memcpy(item->title, entry.title, (size_t)entry.title_length * sizeof(wchar_t));
+        item->title[entry.title_length] = L'\0';
+        memcpy(item->text, entry.text, (size_t)entry.text_length * sizeof(wchar_t));
+        item->text[entry.text_length] = L'\0';
+        item->hash = _MniNotificationHash(item->title, item->text);
+
+        queue->count += 1;
+        queue->stats.replayed += 1;
+    }
+
+    _MniFree(offsets);
+    queue->next_sequence = last_id + 1;
+
+    // Dropped ones are left out by rewrite, as are finished ones filling most of the journal.
+    if (queue->stats.dropped > 0 || journal->tail > journal->size / 2) {
+        _MniNotificationJournalRewrite(queue);
+    }
+
+    return journal->data != NULL;
+}
+
+// ========================================================================== //
+
+static void _MniNotificationRefill(MniNotificationQueue *queue, ULONGLONG now) {
+    ULONGLONG capacity = (ULONGLONG)queue->info.burst * MNI_NOTIFICATION_TOKEN;
+
+    // Rate is per minute, token is 1000 units, so each ms adds rate / 60 units.
+    if (queue->info.rate == 0) {
+        queue->tokens = capacity;
+    } else {
+        queue->tokens = min(queue->tokens + (now - queue->refilled) * queue->info.rate / 60, capacity);
+    }
+
+    queue->refilled = now;
+}
+
+// ========================================================================== //
+
+static void _MniNotificationSchedule(ModernNotifyIcon *mni, ULONGLONG delay) {
+    _MniTimerWheelStart(mni, WHEEL_TIMER_NOTIFICATION, (UINT)min(max(delay, 1), MNI_NOTIFICATION_BALLOON_TIMEOUT));
+}
+
+// ========================================================================== //
+
+// Records outcome of notifications on screen.
+static void _MniNotificationFinish(MniNotificationQueue *queue, UINT outcome) {
+    for (int i = 0; i < queue->shown_count; i += 1) {
+        _MniNotificationJournalWrite(queue, MNI_JOURNAL_OUTCOME, &queue->shown[i], outcome);
+    }
+
+    queue->shown_count = 0;
+    queue->showing = MNI_FALSE;
+}
+
+// ========================================================================== //
+
+// Shows next balloon if none is shown and a token is available.
+static void _MniNotificationDrain(ModernNotifyIcon *mni) {
+    MniNotificationQueue *queue = mni->notification_queue;
+    if (!queue) {
+        return;
+    }
+
+    ULONGLONG now = GetTickCount64();
+
+    if (queue->showing) {
+        ULONGLONG elapsed = now - queue->shown_at;
+        if (elapsed < MNI_NOTIFICATION_BALLOON_TIMEOUT) {
+            _MniNotificationSchedule(mni, MNI_NOTIFICATION_BALLOON_TIMEOUT - elapsed);
+            return;
+        }
+
+        // Shell never reported the balloon gone, e.g. explorer restarted meanwhile.
+        _MniNotificationFinish(queue, MNI_NOTIFICATION_OUTCOME_EXPIRED);
+    }
+
+    if (queue->count == 0) {
+        _MniTimerWheelStop(mni, WHEEL_TIMER_NOTIFICATION);
+        return;
+    }
+
+    _MniNotificationRefill(queue, now);
+    if (queue->tokens < MNI_NOTIFICATION_TOKEN) {
+        _MniNotificationSchedule(mni, ((MNI_NOTIFICATION_TOKEN - queue->tokens) * 60 + queue->info.rate - 1) / queue->info.rate);
+        return;
+    }
+
+    int index = _MniNotificationFind(queue, MNI_FALSE);
+    const MniNotification *item = &queue->items[index];
+
+    // Urgent one is found first whenever pending, so the rest can all be folded.
+    MniNotification summary;
+    MniBool coalesce = queue->info.coalesce_threshold > 1 &&
+                       (UINT)queue->count >= queue->info.coalesce_threshold &&
+                       item->priority < MNI_NOTIFICATION_PRIORITY_URGENT;
+
+    if (coalesce) {
+        summary = *item;
+        if (queue->summary_title[0]) {
+            _StringCopyW(summary.title, ARRAYSIZE(summary.title), queue->summary_title);
+        }
+        _MniNotificationFormat(summary.text, ARRAYSIZE(summary.text), queue->summary_text, queue->count);
+        item = &summary;
+    }
+
+    if (!mni->icon_created || MNI_FAILED(MniSendBalloonNotification(mni, item->title, item->text, item->icon_type, item->icon, item->flags))) {
+        _MniNotificationSchedule(mni, MNI_NOTIFICATION_RETRY_INTERVAL);
+        return;
+    }
+
+    if (coalesce) {
+        memcpy(queue->shown, queue->items, sizeof(*queue->items) * (SIZE_T)queue->count);
+        queue->shown_count = queue->count;
+        queue->stats.coalesced += (UINT64)queue->count;
+        queue->count = 0;
+    } else {
+        queue->shown[0] = queue->items[index];
+        queue->shown_count = 1;
+        _MniNotificationRemove(queue, index);
+    }
+
+    for (int i = 0; i < queue->shown_count; i += 1) {
+        _MniNotificationJournalWrite(queue, MNI_JOURNAL_SHOWN, &queue->shown[i], 0);
+    }
+
+    queue->tokens -= MNI_NOTIFICATION_TOKEN;
+    queue->showing = MNI_TRUE;
+    queue->shown_at = now;
+    queue->stats.shown += 1;
+
+    _MniNotificationSchedule(mni, MNI_NOTIFICATION_BALLOON_TIMEOUT);
+}
+
+// ========================================================================== //
+
+// Balloon was hidden, timed out or clicked away.
+static void _MniNotificationBalloonDone(ModernNotifyIcon *mni, UINT outcome) {
+    MniNotificationQueue *queue = mni->notification_queue;
+    if (queue && queue->showing) {
+        _MniNotificationFinish(queue, outcome);
+        _MniNotificationDrain(mni);
+    }
+}
+
+// ========================================================================== //
+
+// Pending notifications stay in the journal.
+static void _MniNotificationQueueFree(MniNotificationQueue *queue) {
+    _MniNotificationJournalClose(&queue->journal);
+    _MniFree(queue->shown);
+    _MniFree(queue->items);
+    _MniFree(queue);
+}
+
+// ========================================================================== //
+
+static void _MniNotificationQueueRelease(ModernNotifyIcon *mni) {
+    if (mni->notification_queue) {
+        _MniTimerWheelStop(mni, WHEEL_TIMER_NOTIFICATION);
+        _MniNotificationQueueFree(mni->notification_queue);
+        mni->notification_queue = NULL;
+    }
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Public API
+
+MniError MniInit(ModernNotifyIcon *mni, MniInfo info) {
+    MNI_TRACE(L"MniInit(mni=%p) info={", mni);
+    MNI_TRACE(L"\t.module_handle=%p", info.module_handle);
+    MNI_TRACE(L"\t.class_name=%p", info.class_name);
+    MNI_TRACE(L"\t.guid=%p", &info.guid);
+    MNI_TRACE(L"\t.icon=%p", info.icon);
+    MNI_TRACE(L"\t.menu=%p", info.menu);
+    MNI_TRACE(L"\t.tip=%p", info.tip);
+    MNI_TRACE(L"\t.tip_type=%d", info.tip_type);
+    MNI_TRACE(L"\t.window_title=%p", info.window_title);
+    MNI_TRACE(L"\t.window_style=%x", info.window_style);
+    MNI_TRACE(L"\t.parent_window=%p", info.parent_window);
+    MNI_TRACE(L"\t.backend.context=%p", info.backend.context);
+    MNI_TRACE(L"\t.host=%p", info.host);
+    MNI_TRACE(L"\t.timer_mode=%d", info.timer_mode);
+    MNI_TRACE(L"\t.on_window_create=%p", info.on_window_create);
+    MNI_TRACE(L"\t.on_window_destroy=%p", info.on_window_destroy);
+    MNI_TRACE(L"\t.on_show=%p", info.on_show);
+    MNI_TRACE(L"\t.on_hide=%p", info.on_hide);
+    MNI_TRACE(L"\t.on_icon_change=%p", info.on_icon_change);
+    MNI_TRACE(L"\t.on_menu_change=%p", info.on_menu_change);
+    MNI_TRACE(L"\t.on_tip_change=%p", info.on_tip_change);
+    MNI_TRACE(L"\t.on_tip_type_change=%p", info.on_tip_type_change);
+    MNI_TRACE(L"\t.on_key_select=%p", info.on_key_select);
+    MNI_TRACE(L"\t.on_lmb_click=%p", info.on_lmb_click);
+    MNI_TRACE(L"\t.on_lmb_double_click=%p", info.on_lmb_double_click);
+    MNI_TRACE(L"\t.on_mmb_click=%p", info.on_mmb_click);
+    MNI_TRACE(L"\t.on_context_menu_open=%p", info.on_context_menu_open);
+    MNI_TRACE(L"\t.on_context_menu_item_click =%p", info.on_context_menu_item_click );
+    MNI_TRACE(L"\t.on_context_menu_close=%p", info.on_context_menu_close);
+    MNI_TRACE(L"\t.on_balloon_show=%p", info.on_balloon_show);
+    MNI_TRACE(L"\t.on_balloon_hide=%p", info.on_balloon_hide);
+    MNI_TRACE(L"\t.on_balloon_timeout=%p", info.on_balloon_timeout);
+    MNI_TRACE(L"\t.on_balloon_click=%p", info.on_balloon_click);
+    MNI_TRACE(L"\t.on_rich_popup_open=%p", info.on_rich_popup_open);
+    MNI_TRACE(L"\t.on_rich_popup_close=%p", info.on_rich_popup_close);
+    MNI_TRACE(L"\t.on_dpi_change=%p", info.on_dpi_change);
+    MNI_TRACE(L"\t.on_system_theme_change=%p", info.on_system_theme_change);
+    MNI_TRACE(L"\t.on_apps_theme_change=%p", info.on_apps_theme_change);
+    MNI_TRACE(L"\t.on_taskbar_created=%p", info.on_taskbar_created);
+    MNI_TRACE(L"\t.on_timer=%p", info.on_timer);
+    MNI_TRACE(L"\t.on_timers=%p", info.on_timers);
+    MNI_TRACE(L"\t.on_custom_message=%p", info.on_custom_message);
+    MNI_TRACE(L"\t.on_system_message=%p", info.on_system_message);
+    MNI_TRACE(L"\t.on_shell_complete=%p", info.on_shell_complete);
+    MNI_TRACE(L"\t.on_icon_load=%p", info.on_icon_load);
+    MNI_TRACE(L"}");
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+    
+    memset(mni, 0, sizeof(*mni));
+
+    // Backend must be known before the window is created.
+    mni->backend = info.backend;
+
+    // Hosted icons share window of the host instead of creating their own.
+    MniError ret = info.host ? _MniHostAttach(info.host, mni) : _MniInternalCreateWindow(mni, info);
+    if (MNI_FAILED(ret)) {
+        return ret;
+    }
+
+    if (!_IsGuidEq(info.guid, MNI_GUID_NULL)) {
+        mni->use_guid = MNI_TRUE;
+        mni->guid = info.guid;
+    }
+
+    mni->icon = info.icon;
+    mni->menu = info.menu;
+    _StringCopyW(mni->tip, ARRAYSIZE(mni->tip), info.tip);
+    mni->tip_type = info.tip_type;
+
+    if (mni->host) {
+        // Host already knows state of the window, no need to ask system again.
+        mni->primary_monitor = mni->host->primary_monitor;
+        mni->system_theme = mni->host->system_theme;
+        mni->apps_theme = mni->host->apps_theme;
+        mni->dpi = mni->host->dpi;
+    } else {
+        mni->primary_monitor = _GetPrimaryMonitor();
+        if (_IsHighContrastThemeEnabled()) {
+            MniThemeInfo hcti = _GetHighContrastThemeInfo();
+            mni->system_theme = hcti;
+            mni->apps_theme = hcti;
+        } else {
+            mni->system_theme = _GetSystemThemeInfo();
+            mni->apps_theme = _GetAppsThemeInfo();
+        }
+        mni->dpi = _GetDpi(mni->window_handle);
+    }
+    mni->icm_style = info.icm_style;
+    mni->icm_theme = info.icm_theme;
+
+    mni->menu_position = info.menu_position;
+    mni->menu_animation = info.menu_animation;
+
+    mni->reserved1 = NULL;
+    mni->reserved2 = NULL;
+
+    mni->user_data1 = info.user_data1;
+    mni->user_data2 = info.user_data2;
+
+    mni->on_window_create           = info.on_window_create;
+    mni->on_window_destroy          = info.on_window_destroy;
+    mni->on_init                    = info.on_init;
+    mni->on_release                 = info.on_release;
+    mni->on_show                    = info.on_show;
+    mni->on_hide                    = info.on_hide;
+    mni->on_icon_change             = info.on_icon_change;
+    mni->on_menu_change             = info.on_menu_change;
+    mni->on_tip_change              = info.on_tip_change;
+    mni->on_tip_type_change         = info.on_tip_type_change;
+    mni->on_key_select              = info.on_key_select;
+    mni->on_lmb_click               = info.on_lmb_click;
+    mni->on_lmb_double_click        = info.on_lmb_double_click;
+    mni->on_mmb_click               = info.on_mmb_click;
+    mni->on_context_menu_open       = info.on_context_menu_open;
+    mni->on_context_menu_item_click = info.on_context_menu_item_click;
+    mni->on_context_menu_close      = info.on_context_menu_close;
+    mni->on_balloon_show            = info.on_balloon_show;
+    mni->on_balloon_hide            = info.on_balloon_hide;
+    mni->on_balloon_timeout         = info.on_balloon_timeout;
+    mni->on_balloon_click           = info.on_balloon_click;
+    mni->on_rich_popup_open         = info.on_rich_popup_open;
+    mni->on_rich_popup_close        = info.on_rich_popup_close;
+    mni->on_dpi_change              = info.on_dpi_change;
+    mni->on_system_theme_change     = info.on_system_theme_change;
+    mni->on_apps_theme_change       = info.on_apps_theme_change;
+    mni->on_taskbar_created         = info.on_taskbar_created;
+    mni->timer_mode = info.timer_mode;
+
+    mni->on_timer                   = info.on_timer;
+    mni->on_timers                  = info.on_timers;
+    mni->on_custom_message          = info.on_custom_message;
+    mni->on_system_message          = info.on_system_message;
+    mni->on_shell_complete          = info.on_shell_complete;
+    mni->on_icon_load               = info.on_icon_load;
+
+    mni->subscriptions = _MniComputeSubscriptions(mni);
+
+    if (mni->window_handle) {
+        _MniBackendSendMessage(mni, WM_MNI_INIT, 0, 0);
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniRelease(ModernNotifyIcon *mni, MniBool destroy_icon, MniBool destroy_menu) {
+    MNI_TRACE(L"MniRelease(mni=%p, destroy_icon=%d, destroy_menu=%d)", mni, destroy_icon, destroy_menu);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (mni->window_handle) {
+        _MniBackendSendMessage(mni, WM_MNI_RELEASE, 0, 0);
+    }
+
+    // Worker must not touch the icon once it's gone.
+    MniStopShellWorker(mni);
+
+    // Icon is going away, there's no point in running queued commands.
+    int dropped = _MniCommandQueueDiscard(mni);
+    if (dropped > 0) {
+        MNI_TRACE(L"\tdropped %d queued commands", dropped);
+    }
+
+    // Wheel goes first, no timeout may fire while the rest is torn down.
+    _MniTimerWheelRelease(mni);
+
+    _MniNotificationQueueRelease(mni);
+    _MniAnimationRelease(mni, MNI_FALSE);
+    _MniGraphRelease(mni, MNI_FALSE);
+    _MniOverlayRelease(mni, MNI_FALSE);
+    _MniIconCacheRelease(mni);
+    _MniIconLoaderRelease(mni);
+
+    _MniInternalDestroyNotifyIcon(mni);
+
+    if (mni->host) {
+        _MniHostDetach(mni);
+    } else {
+        // Attached icons lose their window, remove them from the tray while it still exists.
+        for (int i = 1; i < mni->hosted_capacity; i += 1) {
+            ModernNotifyIcon *hosted = mni->hosted_icons[i];
+            if (hosted) {
+                _MniInternalDestroyNotifyIcon(hosted);
+                _MniHostDetach(hosted);
+            }
+        }
+
+        _MniFree(mni->hosted_icons);
+        _MniInternalDestroyWindow(mni);
+    }
+
+    _MniFree(mni->system_message_ranges);
+
+    if (destroy_icon && mni->icon) {
+        _MniDestroyIcon(mni->icon);
+    }
+
+    if (destroy_menu && mni->menu) {
+        DestroyMenu(mni->menu);
+    }
+
+    // Tray thread outlives the release, MniStopThread may be reading it from another thread.
+    size_t tray_begin = offsetof(ModernNotifyIcon, tray_thread);
+    size_t tray_end = tray_begin + sizeof(mni->tray_thread);
+    memset(mni, 0, tray_begin);
+    memset((char *)mni + tray_end, 0, sizeof(*mni) - tray_end);
+
+    return dropped > 0 ? MNI_COMMANDS_DROPPED : MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniShow(ModernNotifyIcon *mni, MniBool recreate) {
+    MNI_TRACE(L"MniShow(mni=%p, recreate=%d)", mni, recreate);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MNI_TRACE(
+        L"\ticon_visible=%d, icon_created=%d, window_handle=%p",
+        mni->icon_visible,
+        mni->icon_created,
+        mni->window_handle
+    );
+
+    if (mni->icon_visible && !recreate) {
+        return MNI_ICON_ALREADY_SHOWN;
+    }
+
+    if (!mni->window_handle) {
+        MniError result = _MniInternalCreateWindow(mni, (MniInfo){0});
+        if (MNI_FAILED(result)) {
+            return result;
+        }
+    }
+
+    if (recreate) {
+        // If this fails, probable cause was the fact that icon doesn't exists anymore.
+        MniError result = _MniInternalDestroyNotifyIcon(mni);
+        if (FAILED(result)) {
+            mni->icon_visible = MNI_FALSE;
+            mni->icon_created = MNI_FALSE;
+        }
+    }
+
+    if (!mni->icon_created) {
+        MniError result = _MniInternalCreateNotifyIcon(mni);
+        if (MNI_FAILED(result)) {
+            return result;
+        }
+    } else {
+        MniError result = _MniUpdateState(mni, MNI_TRUE);
+        if (MNI_FAILED(result)) {
+            return result;
+        }
+    }
+    
+    mni->icon_visible = MNI_TRUE;
+
+    _MniAnimationSetPaused(mni, MNI_FALSE);
+    
+    if (mni->window_handle) {
+        _MniBackendSendMessage(mni, WM_MNI_SHOW, 0, 0);
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniHide(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniHide(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MNI_TRACE(
+        L"\ticon_visible=%d, icon_created=%d, window_handle=%p",
+        mni->icon_visible,
+        mni->icon_created,
+        mni->window_handle
+    );
+
+    if (!mni->icon_visible) {
+        return MNI_ICON_ALREADY_HIDDEN;
+    }
+
+    if (!mni->icon_created) {
+        return MNI_ERROR_ICON_NOT_CREATED;
+    }
+
+    if (!mni->window_handle) {
+        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    }
+
+    MniError result = _MniUpdateState(mni, MNI_FALSE);
+    if (MNI_FAILED(result)) {
+        return result;
+    }
+
+    mni->icon_visible = MNI_FALSE;
+
+    // No point in updating icon nobody can see.
+    _MniAnimationSetPaused(mni, MNI_TRUE);
+
+    _MniBackendSendMessage(mni, WM_MNI_HIDE, 0, 0);
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniRefreshSubscriptions(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniRefreshSubscriptions(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    mni->subscriptions = _MniComputeSubscriptions(mni);
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+static int _MniCompareMessageRanges(const void *a, const void *b) {
+    const MniMessageRange *ra = (const MniMessageRange *)a;
+    const MniMessageRange *rb = (const MniMessageRange *)b;
+
+    if (ra->first != rb->first) {
+        return ra->first < rb->first ? -1 : 1;
+    }
+
+    return 0;
+}
+
+// ========================================================================== //
+
+MniError MniSetSystemMessageFilter(ModernNotifyIcon *mni, const MniMessageRange *ranges, int count) {
+    MNI_TRACE(L"MniSetSystemMessageFilter(mni=%p, ranges=%p, count=%d)", mni, ranges, count);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!ranges) {
+        _MniFree(mni->system_message_ranges);
+        mni->system_message_ranges = NULL;
+        mni->system_message_range_count = 0;
+        memset(mni->system_message_bits, 0, sizeof(mni->system_message_bits));
+        mni->system_message_filtered = MNI_FALSE;
+        return MNI_OK;
+    }
+
+    if (count < 0) {
+        return MNI_ERROR_INVALID_MESSAGE_RANGE;
+    }
+
+    for (int i = 0; i < count; i += 1) {
+        if (ranges[i].first > ranges[i].last) {
+            return MNI_ERROR_INVALID_MESSAGE_RANGE;
+        }
+    }
+
+    // Split ranges into bitmap part and list part above it.
+    DWORD bits[ARRAYSIZE(mni->system_message_bits)] = {0};
+    MniMessageRange *high = NULL;
+    int high_count = 0;
+
+    if (count > 0) {
+        high = (MniMessageRange *)_MniAlloc(sizeof(*high) * (SIZE_T)count);
+        if (!high) {
+            return MNI_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    for (int i = 0; i < count; i += 1) {
+        UINT first = ranges[i].first;
+        UINT last = ranges[i].last;
+
+        for (UINT msg = first; msg <= last && msg < MNI_SYSTEM_MESSAGE_BITMAP_SIZE; msg += 1) {
+            bits[msg / 32] |= (DWORD)1 << (msg % 32);
+        }
+
+        if (last >= MNI_SYSTEM_MESSAGE_BITMAP_SIZE) {
+            high[high_count].first = max(first, MNI_SYSTEM_MESSAGE_BITMAP_SIZE);
+            high[high_count].last = last;
+            high_count += 1;
+        }
+    }
+
+    // Sort and merge overlapping ranges for binary search.
+    if (high_count > 1) {
+        qsort(high, (size_t)high_count, sizeof(*high), _MniCompareMessageRanges);
+
+        int merged = 0;
+        for (int i = 1; i < high_count; i += 1) {
+            if (high[i].first <= high[merged].last || high[i].first - 1 == high[merged].last) {
+                high[merged].last = max(high[merged].last, high[i].last);
+            } else {
+                merged += 1;
+                high[merged] = high[i];
+            }
+        }
+        high_count = merged + 1;
+    }
+
+    if (high_count == 0) {
+        _MniFree(high);
+        high = NULL;
+    }
+
+    _MniFree(mni->system_message_ranges);
+    mni->system_message_ranges = high;
+    mni->system_message_range_count = high_count;
+    memcpy(mni->system_message_bits, bits, sizeof(bits));
+    mni->system_message_filtered = MNI_TRUE;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniBeginUpdate(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniBeginUpdate(mni=%p), update_depth=%d", mni, mni ? mni->update_depth : 0);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    mni->update_depth += 1;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniEndUpdate(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniEndUpdate(mni=%p), update_depth=%d", mni, mni ? mni->update_depth : 0);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (mni->update_depth <= 0) {
+        return MNI_ERROR_UPDATE_NOT_STARTED;
+    }
+
+    mni->update_depth -= 1;
+
+    // Only outermost scope sends changes to the shell.
+    if (mni->update_depth == 0) {
+        return _MniFlushUpdate(mni);
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniSetIcon(ModernNotifyIcon *mni, HICON icon, MniBool destroy_current) {
+    MNI_TRACE(L"MniSetIcon(mni=%p, icon=%p, destroy_current=%d)", mni, icon, destroy_current);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    // Explicit icon ends animation, graph, overlay and icon source, destroy_current applies to icon set before them.
+    // Pending async load would replace it later, so it's cancelled too.
+    _MniIconLoaderCancel(mni);
+    _MniAnimationRelease(mni, MNI_TRUE);
+    _MniGraphRelease(mni, MNI_TRUE);
+    _MniOverlayRelease(mni, MNI_TRUE);
+    _MniIconCacheRelease(mni);
+
+    // Only update if there is change.
+    if (icon != mni->icon) {
+        MniError result = _MniUpdateIcon(mni, icon);
+        if (MNI_FAILED(result)) {
+            return result;
+        }
+    
+        _MniBackendSendMessage(mni, WM_MNI_ICON_CHANGE, (WPARAM)icon, 0);
+
+        if (mni->icon && destroy_current) {
+            _MniDestroyIcon(mni->icon);
+        }
+
+        mni->icon = icon;
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniSetMenu(ModernNotifyIcon *mni, HMENU menu, MniBool destroy_current) {
+    MNI_TRACE(L"MniSetMenu(mni=%p, menu=%p, destroy_current=%d)", mni, menu, destroy_current);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    // Only update if there is change.
+    if (menu != mni->menu) {
+        MniError result = _MniUpdateMenu(mni, menu); 
+        if (MNI_FAILED(result)) {
+            return result;
+        }
+
+        _MniBackendSendMessage(mni, WM_MNI_MENU_CHANGE, (WPARAM)menu, 0);
+
+        if (mni->menu && destroy_current) {
+            DestroyMenu(mni->menu);
+        }
+
+        mni->menu = menu;
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniSetTip(ModernNotifyIcon *mni, const wchar_t *tip) {
+    MNI_TRACE(L"MniSetTip(mni=%p, tip=%p)", mni, tip);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    // Only update if there is change.
+    if (_StringCompareW(mni->tip, tip, ARRAYSIZE(mni->tip)) != 0) {
+        MniError result = _MniUpdateTip(mni, tip); 
+        if (MNI_FAILED(result)) {
+            return result;
+        }
+
+        _MniBackendSendMessage(mni, WM_MNI_TIP_CHANGE, (WPARAM)tip, 0);
+
+        _StringCopyW(mni->tip, ARRAYSIZE(mni->tip), tip);
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniSetTipType(ModernNotifyIcon *mni, MniTipType mtt) {
+    MNI_TRACE(L"MniSetTipType(mni=%p, mtt=%p)", mni, &mtt);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    // Only update if there is change.
+    if (mtt != mni->tip_type)
+    {
+        const wchar_t *tip = L"";
+        if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
+            tip = mni->tip;
+        }
+
+        MniError result = _MniUpdateTip(mni, tip);
+        if (MNI_FAILED(result)) {
+            return result;
+        }
+
+        _MniBackendSendMessage(mni, WM_MNI_TIP_TYPE_CHANGE, (WPARAM)mtt, 0);
+
+        mni->tip_type = mtt;
+    }
+    
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetIcon(ModernNotifyIcon *mni, HICON *icon) {
+    MNI_TRACE(L"MniGetIcon(mni=%p, icon=%p)", mni, icon);
+    MNI_ASSERT(mni && "mni ptr is null");
+    
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!icon) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *icon = mni->icon;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetMenu(ModernNotifyIcon *mni, HMENU *menu) {
+    MNI_TRACE(L"MniGetMenu(mni=%p, menu=%p)", mni, menu);
+    MNI_ASSERT(mni && "mni ptr is null");
+    
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!menu) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *menu = mni->menu;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetTip(ModernNotifyIcon *mni, wchar_t *buffer, int *len) {
+    MNI_TRACE(L"MniGetTip(mni=%p, buffer=%p, len=%p)", mni, buffer, len);
+    MNI_ASSERT(mni && "mni ptr is null");
+    
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!buffer && !len) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    // cch should include '\0'.
+    int cch = _StringLengthMaxW(mni->tip, ARRAYSIZE(mni->tip));
+    if (cch == ARRAYSIZE(mni->tip)) {
+        mni->tip[cch - 1] = L'\0';
+    } else {
+        cch += 1;
+    }
+
+    // Return required length (in characters including '\0').
+    if (!buffer) {
+        *len = cch;
+        return MNI_OK;
+    }
+
+    // Check if buffer can fit the string.
+    if (cch > *len) {
+        return MNI_ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    // Copy tip to destination buffer.
+    _StringCopyW(buffer, cch, mni->tip);
+    *len = cch;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetTipType(ModernNotifyIcon *mni, MniTipType *mtt) {
+    MNI_TRACE(L"MniGetTip(mni=%p, mtt=%p)", mni, mtt);
+    MNI_ASSERT(mni && "mni ptr is null");
+    
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!mtt) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *mtt = mni->tip_type;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniIsNotifyIconCreated(ModernNotifyIcon *mni, MniBool *is_created) {
+    MNI_TRACE(L"MniIsNotifyIconCreated(mni=%p, is_create=%p)", mni, is_created);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!is_created) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *is_created = mni->icon_created;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniIsNotifyIconVisible(ModernNotifyIcon *mni, MniBool *is_visible) {
+    MNI_TRACE(L"MniIsNotifyIconVisible(mni=%p, is_visible=%p)", mni, is_visible);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!is_visible) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *is_visible = mni->icon_visible;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetWindowHandle(ModernNotifyIcon *mni, HWND *window_handle) {
+    MNI_TRACE(L"MniGetWindowHandle(mni=%p, window_handle=%p)", mni, window_handle);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!window_handle) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *window_handle = mni->window_handle;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetModuleHandle(ModernNotifyIcon *mni, HINSTANCE *module_handle) {
+    MNI_TRACE(L"MniGetModuleHandle(mni=%p, module_handle=%p)", mni, module_handle);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!module_handle) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *module_handle = mni->module_handle;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetDpi(ModernNotifyIcon *mni, int *dpi) {
+    MNI_TRACE(L"MniGetDpi(mni=%p, dpi=%p)", mni, dpi);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!dpi) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *dpi = mni->dpi;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetSystemThemeInfo(ModernNotifyIcon *mni, MniThemeInfo *system_theme) {
+    MNI_TRACE(L"MniGetSystemThemeInfo(mni=%p, system_theme=%p)", mni, system_theme);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!system_theme) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *system_theme = mni->system_theme;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetAppsThemeInfo(ModernNotifyIcon *mni, MniThemeInfo *apps_theme) {
+    MNI_TRACE(L"MniGetAppsThemeInfo(mni=%p, apps_theme=%p)", mni, apps_theme);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!apps_theme) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *apps_theme = mni->apps_theme;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MNI_API MniError MniSetIcmStyle(ModernNotifyIcon *mni, IcmStyle icm_style) {
+    MNI_TRACE(L"MniSetIcmTheme(mni=%p, icm_style=%d)", mni, icm_style);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    mni->icm_style = icm_style;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MNI_API MniError MniSetIcmTheme(ModernNotifyIcon *mni, IcmTheme icm_theme) {
+    MNI_TRACE(L"MniSetIcmTheme(mni=%p, icm_theme=%d)", mni, icm_theme);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    mni->icm_theme = icm_theme;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MNI_API MniError MniGetIcmStyle(ModernNotifyIcon *mni, IcmStyle *icm_style) {
+    MNI_TRACE(L"MniGetIcmStyle(mni=%p, icm_style=%p)", mni, icm_style);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!icm_style) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *icm_style = mni->icm_style;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MNI_API MniError MniGetIcmTheme(ModernNotifyIcon *mni, IcmTheme *icm_theme) {
+    MNI_TRACE(L"MniGetIcmTheme(mni=%p, icm_theme=%p)", mni, icm_theme);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!icm_theme) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *icm_theme = mni->icm_theme;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniSetUserData1(ModernNotifyIcon *mni, void *data) {
+    MNI_TRACE(L"MniSetUserData1(mni=%p, data=%p)", mni, data);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    mni->user_data1 = data;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniSetUserData2(ModernNotifyIcon *mni, void *data) {
+    MNI_TRACE(L"MniSetUserData2(mni=%p, data=%p)", mni, data);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    mni->user_data2 = data;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetUserData1(ModernNotifyIcon *mni, void **data) {
+    MNI_TRACE(L"MniGetUserData1(mni=%p, data=%p)", mni, data);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!data) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *data = mni->user_data1;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetUserData2(ModernNotifyIcon *mni, void **data) {
+    MNI_TRACE(L"MniGetUserData2(mni=%p, data=%p)", mni, data);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!data) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *data = mni->user_data2;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+// Balloon with everything but title and text, those are written by caller.
+static void _MniBalloonData(
+    ModernNotifyIcon        *mni,
+    MniBalloonIconType      icon_type,
+    HICON                   icon,
+    MniBalloonFlags         flags,
+    NOTIFYICONDATAW         *nid
+) {
+    *nid = (NOTIFYICONDATAW){
+        .cbSize       = sizeof(*nid),
+        .hWnd         = mni->window_handle,
+        .uID          = mni->uid,
+        .uFlags       = NIF_INFO,
+        .dwInfoFlags  = NIIF_NONE,
+        .hBalloonIcon = NULL
+    };
+
+    if (mni->use_guid) {
+        nid->uFlags |= NIF_GUID;
+        nid->guidItem = mni->guid;
+    }
+
+    if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
+        nid->uFlags |= NIF_SHOWTIP;
+    }
+
+    if ((flags & MNI_BALLOON_FLAGS_REALTIME) == MNI_BALLOON_FLAGS_REALTIME) {
+        nid->uFlags |= NIF_REALTIME;
+    }
+
+    switch (icon_type)
+    {
+    case MNI_BALLOON_ICON_TYPE_NONE:
+        break;
+    case MNI_BALLOON_ICON_TYPE_SYSTEM_INFO:
+        nid->dwInfoFlags = NIIF_INFO | NIIF_LARGE_ICON;
+        break;
+    case MNI_BALLOON_ICON_TYPE_SYSTEM_WARNING:
+        nid->dwInfoFlags = NIIF_WARNING | NIIF_LARGE_ICON;
+        break;
+    case MNI_BALLOON_ICON_TYPE_SYSTEM_ERROR:
+        nid->dwInfoFlags = NIIF_ERROR | NIIF_LARGE_ICON;
+        break;
+    case MNI_BALLOON_ICON_TYPE_CUSTOM:
+        nid->dwInfoFlags  = NIIF_USER | NIIF_LARGE_ICON;
+        nid->hBalloonIcon = icon;
+        break;
+    }
+
+    if ((flags & MNI_BALLOON_FLAGS_PLAY_SOUND) != MNI_BALLOON_FLAGS_PLAY_SOUND) {
+        nid->dwInfoFlags |= NIIF_NOSOUND;
+    }
+
+    if ((flags & MNI_BALLOON_FLAGS_RESPECT_QUIET_TIME) == MNI_BALLOON_FLAGS_RESPECT_QUIET_TIME) {
+        nid->dwInfoFlags |= NIIF_RESPECT_QUIET_TIME;
+    }
+}
+
+// ========================================================================== //
+
+MniError MniSendBalloonNotification(
+    ModernNotifyIcon        *mni,
+    const wchar_t           *title,
+    const wchar_t           *text,
+    MniBalloonIconType      icon_type,
+    HICON                   icon,
+    MniBalloonFlags         flags
+) {
+    MNI_TRACE(
+        L"MniSendBalloonNotification(mni=%p, title=%p, text=%p, icon_type=%d, icon=%p, flags=%x)",
+        mni,
+        title,
+        text,
+        (UINT)icon_type,
+        icon,
+        (UINT)flags
+    );
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MNI_TRACE(
+        L"\ticon_visible=%d, icon_created=%d, window_handle=%p",
+        mni->icon_visible,
+        mni->icon_created,
+        mni->window_handle
+    );
+
+    if (!mni->icon_created) {
+        return MNI_ERROR_ICON_NOT_CREATED;
+    }
+
+    NOTIFYICONDATAW nid;
+    _MniBalloonData(mni, icon_type, icon, flags, &nid);
+
+    _StringCopyW(nid.szInfoTitle, ARRAYSIZE(nid.szInfoTitle), title);
+    _StringCopyW(nid.szInfo, ARRAYSIZE(nid.szInfo), text);
+
+    if (!_MniBackendNotifyIcon(mni, NIM_MODIFY, &nid)) {
+        return MNI_ERROR_FAILED_TO_SHOW_BALLOON;
+    }
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniRemoveBalloonNotification(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniRemoveBalloonNotification(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MNI_TRACE(L"\ticon_created=%d, window_handle=%p", mni->icon_created, mni->window_handle);
+
+    if (!mni->icon_created) {
+        return MNI_ERROR_ICON_NOT_CREATED;
+    }
+
+    NOTIFYICONDATAW nid = {
+        .cbSize       = sizeof(nid),
+        .hWnd         = mni->window_handle,
+        .uID          = mni->uid,
+        .uFlags       = NIF_INFO,
+        .szInfo       = L"",
+        .szInfoTitle  = L"",
+        .dwInfoFlags  = NIIF_NONE,
+        .hBalloonIcon = NULL,
+    };
+
+    if (!_MniBackendNotifyIcon(mni, NIM_MODIFY, &nid)) {
+        return MNI_ERROR_FAILED_TO_REMOVE_BALLOON;
+    }
+    
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniCreateNotificationQueue(ModernNotifyIcon *mni, const MniNotificationQueueInfo *info) {
+    MNI_TRACE(L"MniCreateNotificationQueue(mni=%p, info=%p)", mni, info);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MniNotificationQueueInfo settings = {
+        .capacity = MNI_NOTIFICATION_QUEUE_DEFAULT_CAPACITY,
+        .rate = MNI_NOTIFICATION_DEFAULT_RATE,
+        .burst = MNI_NOTIFICATION_DEFAULT_BURST,
+        .dedup_window = MNI_NOTIFICATION_DEFAULT_DEDUP_WINDOW,
+        .coalesce_threshold = MNI_NOTIFICATION_DEFAULT_COALESCE,
     };
 
-    if (mni->use_guid) {
-        nid.uFlags |= NIF_GUID;
-        nid.guidItem = mni->guid;
+    if (info) {
+        settings = *info;
+        if (settings.capacity == 0) {
+            settings.capacity = MNI_NOTIFICATION_QUEUE_DEFAULT_CAPACITY;
+        }
+        settings.burst = max(settings.burst, 1);
+    }
+
+    if (settings.capacity < 0 || settings.capacity > MNI_NOTIFICATION_QUEUE_MAX_CAPACITY) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    MniNotificationQueue *queue = (MniNotificationQueue *)_MniAlloc(sizeof(*queue));
+    if (!queue) {
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    queue->items = (MniNotification *)_MniAlloc(sizeof(*queue->items) * (SIZE_T)settings.capacity);
+    queue->shown = (MniNotification *)_MniAlloc(sizeof(*queue->shown) * (SIZE_T)settings.capacity);
+    queue->journal.path = settings.journal_file ? _MniNotificationJournalPath(settings.journal_file, L"") : NULL;
+    if (!queue->items || !queue->shown || (settings.journal_file && !queue->journal.path)) {
+        _MniNotificationQueueFree(queue);
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    _StringCopyW(queue->summary_title, ARRAYSIZE(queue->summary_title), settings.summary_title);
+    _StringCopyW(queue->summary_text, ARRAYSIZE(queue->summary_text), settings.summary_text ? settings.summary_text : MNI_NOTIFICATION_DEFAULT_SUMMARY);
+
+    queue->info = settings;
+    queue->info.summary_title = queue->summary_title;
+    queue->info.summary_text = queue->summary_text;
+    queue->info.journal_file = queue->journal.path;
+    queue->tokens = (ULONGLONG)settings.burst * MNI_NOTIFICATION_TOKEN;
+    queue->refilled = GetTickCount64();
+
+    // Recreating drops pending notifications of the old queue, its journal keeps them. Old
+    // journal is closed first, new queue may use the same file.
+    _MniNotificationQueueRelease(mni);
+    mni->subscriptions = _MniComputeSubscriptions(mni);
+
+    if (queue->journal.path && !_MniNotificationJournalReplay(queue)) {
+        _MniNotificationQueueFree(queue);
+        return MNI_ERROR_FAILED_TO_OPEN_JOURNAL;
+    }
+
+    mni->notification_queue = queue;
+    mni->subscriptions = _MniComputeSubscriptions(mni);
+    _MniNotificationDrain(mni);
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniDestroyNotificationQueue(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniDestroyNotificationQueue(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!mni->notification_queue) {
+        return MNI_ERROR_NOTIFICATION_QUEUE_NOT_CREATED;
+    }
+
+    _MniNotificationQueueRelease(mni);
+    mni->subscriptions = _MniComputeSubscriptions(mni);
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniPostNotification(
+    ModernNotifyIcon        *mni,
+    MniNotificationPriority priority,
+    const wchar_t           *title,
+    const wchar_t           *text,
+    MniBalloonIconType      icon_type,
+    HICON                   icon,
+    MniBalloonFlags         flags
+) {
+    MNI_TRACE(
+        L"MniPostNotification(mni=%p, priority=%d, title=%p, text=%p, icon_type=%d, icon=%p, flags=%x)",
+        mni,
+        (int)priority,
+        title,
+        text,
+        (UINT)icon_type,
+        icon,
+        (UINT)flags
+    );
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MniNotificationQueue *queue = mni->notification_queue;
+    if (!queue) {
+        return MNI_ERROR_NOTIFICATION_QUEUE_NOT_CREATED;
+    }
+
+    if (priority < MNI_NOTIFICATION_PRIORITY_LOW || priority > MNI_NOTIFICATION_PRIORITY_URGENT) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    queue->stats.posted += 1;
+
+    UINT64 hash = _MniNotificationHash(title, text);
+    ULONGLONG now = GetTickCount64();
+    if (_MniNotificationIsDuplicate(queue, hash, now)) {
+        queue->stats.deduplicated += 1;
+        return MNI_NOTIFICATION_DEDUPLICATED;
+    }
+
+    // Full queue makes room by dropping the newest of least important ones.
+    if (queue->count == queue->info.capacity) {
+        int lowest = _MniNotificationFind(queue, MNI_TRUE);
+        if (lowest == -1 || queue->items[lowest].priority >= priority) {
+            queue->stats.rejected += 1;
+            return MNI_ERROR_QUEUE_FULL;
+        }
+
+        queue->stats.dropped += 1;
+        _MniNotificationJournalWrite(queue, MNI_JOURNAL_OUTCOME, &queue->items[lowest], MNI_NOTIFICATION_OUTCOME_DROPPED);
+        _MniNotificationRemove(queue, lowest);
+    }
+
+    MniNotification *item = &queue->items[queue->count];
+    item->hash = hash;
+    item->sequence = queue->next_sequence;
+    item->priority = priority;
+    item->icon_type = icon_type;
+    item->icon = icon;
+    item->flags = flags;
+    _StringCopyW(item->title, ARRAYSIZE(item->title), title);
+    _StringCopyW(item->text, ARRAYSIZE(item->text), text);
+
+    // Written before the item counts as pending, rewrite of full journal would take it too.
+    _MniNotificationJournalWrite(queue, MNI_JOURNAL_POSTED, item, 0);
+
+    queue->next_sequence += 1;
+    queue->count += 1;
+
+    _MniNotificationRemember(queue, hash, now);
+    _MniNotificationDrain(mni);
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetNotificationQueueStats(ModernNotifyIcon *mni, MniNotificationQueueStats *stats) {
+    MNI_TRACE(L"MniGetNotificationQueueStats(mni=%p, stats=%p)", mni, stats);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (!stats) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (!mni->notification_queue) {
+        return MNI_ERROR_NOTIFICATION_QUEUE_NOT_CREATED;
+    }
+
+    *stats = mni->notification_queue->stats;
+    stats->pending = mni->notification_queue->count;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniStartThread(ModernNotifyIcon *mni, MniInfo info) {
+    MNI_TRACE(L"MniStartThread(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MniTrayThread *tray = (MniTrayThread *)_MniAlloc(sizeof(MniTrayThread));
+    if (!tray) {
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    tray->mni = mni;
+    tray->info = info;
+
+    tray->ready_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!tray->ready_event) {
+        _MniFree(tray);
+        return MNI_ERROR_FAILED_TO_START_THREAD;
+    }
+
+    tray->thread = CreateThread(NULL, 0, _MniTrayThreadProc, tray, 0, &tray->thread_id);
+    if (!tray->thread) {
+        CloseHandle(tray->ready_event);
+        _MniFree(tray);
+        return MNI_ERROR_FAILED_TO_START_THREAD;
+    }
+
+    // Wait until window exists (or init failed), after that mni is safe to use
+    // through thread-safe API.
+    WaitForSingleObject(tray->ready_event, INFINITE);
+    CloseHandle(tray->ready_event);
+    tray->ready_event = NULL;
+
+    MniError result = tray->init_result;
+    if (MNI_FAILED(result)) {
+        WaitForSingleObject(tray->thread, INFINITE);
+        CloseHandle(tray->thread);
+        _MniFree(tray);
+    }
+
+    return result;
+}
+
+// ========================================================================== //
+
+// NOTE: When called from the tray thread itself (from a callback), this only requests
+//       the stop. Owner thread still has to call MniStopThread to join it.
+MniError MniStopThread(ModernNotifyIcon *mni, MniBool destroy_icon, MniBool destroy_menu) {
+    MNI_TRACE(L"MniStopThread(mni=%p, destroy_icon=%d, destroy_menu=%d)", mni, destroy_icon, destroy_menu);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MniTrayThread *tray = mni->tray_thread;
+    if (!tray) {
+        return MNI_ERROR_THREAD_NOT_RUNNING;
+    }
+
+    InterlockedExchange(&tray->destroy_icon, destroy_icon ? 1 : 0);
+    InterlockedExchange(&tray->destroy_menu, destroy_menu ? 1 : 0);
+
+    if (GetCurrentThreadId() == tray->thread_id) {
+        PostQuitMessage(0);
+        return MNI_OK;
+    }
+
+    // Thread may have already left the loop (MniQuit from a callback).
+    PostThreadMessageW(tray->thread_id, WM_QUIT, 0, 0);
+    WaitForSingleObject(tray->thread, INFINITE);
+    CloseHandle(tray->thread);
+
+    mni->tray_thread = NULL;
+    _MniFree(tray);
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniStartShellWorker(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniStartShellWorker(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    if (mni->shell_worker) {
+        return MNI_SHELL_WORKER_ALREADY_RUNNING;
+    }
+
+    MniShellWorker *worker = (MniShellWorker *)_MniAlloc(sizeof(MniShellWorker));
+    if (!worker) {
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    InitializeSRWLock(&worker->lock);
+    InitializeSRWLock(&worker->shell_lock);
+    worker->backend = mni->backend;
+    worker->tip_type = mni->tip_type;
+
+    worker->wake_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!worker->wake_event) {
+        _MniFree(worker);
+        return MNI_ERROR_FAILED_TO_START_THREAD;
+    }
+
+    worker->thread = CreateThread(NULL, 0, _MniShellWorkerProc, worker, 0, NULL);
+    if (!worker->thread) {
+        CloseHandle(worker->wake_event);
+        _MniFree(worker);
+        return MNI_ERROR_FAILED_TO_START_THREAD;
+    }
+
+    mni->shell_worker = worker;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniStopShellWorker(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniStopShellWorker(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MniShellWorker *worker = mni->shell_worker;
+    if (!worker) {
+        return MNI_SHELL_WORKER_NOT_RUNNING;
+    }
+
+    // From now on setters talk to the shell directly again.
+    mni->shell_worker = NULL;
+
+    InterlockedExchange(&worker->stop, 1);
+    SetEvent(worker->wake_event);
+    WaitForSingleObject(worker->thread, INFINITE);
+
+    // Anything still in the mailbox was never applied, do it synchronously.
+    if (worker->flags != 0) {
+        _MniShellWorkerApply(worker);
     }
 
-    if (!Shell_NotifyIconW(NIM_DELETE, &nid)) {
-        return MNI_ERROR_FAILED_TO_DELETE_ICON;
+    if (worker->icon_failed) {
+        mni->icon_fingerprint_valid = MNI_FALSE;
     }
 
-    mni->icon_created = MNI_FALSE;
-    mni->icon_visible = MNI_FALSE;
+    // Shell copied the icon when it was applied, worker copies are no longer needed.
+    if (worker->icon) {
+        DestroyIcon(worker->icon);
+    }
+    if (worker->applied) {
+        DestroyIcon(worker->applied);
+    }
+
+    CloseHandle(worker->thread);
+    CloseHandle(worker->wake_event);
+    _MniFree(worker);
 
     return MNI_OK;
 }
 
-#pragma endregion
-
 // ========================================================================== //
 
-#pragma region Public API
-
-MniError MniInit(ModernNotifyIcon *mni, MniInfo info) {
-    MNI_TRACE(L"MniInit(mni=%p) info={", mni);
-    MNI_TRACE(L"\t.module_handle=%p", info.module_handle);
-    MNI_TRACE(L"\t.class_name=%p", info.class_name);
-    MNI_TRACE(L"\t.guid=%p", &info.guid);
-    MNI_TRACE(L"\t.icon=%p", info.icon);
-    MNI_TRACE(L"\t.menu=%p", info.menu);
-    MNI_TRACE(L"\t.tip=%p", info.tip);
-    MNI_TRACE(L"\t.tip_type=%d", info.tip_type);
-    MNI_TRACE(L"\t.window_title=%p", info.window_title);
-    MNI_TRACE(L"\t.window_style=%x", info.window_style);
-    MNI_TRACE(L"\t.parent_window=%p", info.parent_window);
-    MNI_TRACE(L"\t.on_window_create=%p", info.on_window_create);
-    MNI_TRACE(L"\t.on_window_destroy=%p", info.on_window_destroy);
-    MNI_TRACE(L"\t.on_show=%p", info.on_show);
-    MNI_TRACE(L"\t.on_hide=%p", info.on_hide);
-    MNI_TRACE(L"\t.on_icon_change=%p", info.on_icon_change);
-    MNI_TRACE(L"\t.on_menu_change=%p", info.on_menu_change);
-    MNI_TRACE(L"\t.on_tip_change=%p", info.on_tip_change);
-    MNI_TRACE(L"\t.on_tip_type_change=%p", info.on_tip_type_change);
-    MNI_TRACE(L"\t.on_key_select=%p", info.on_key_select);
-    MNI_TRACE(L"\t.on_lmb_click=%p", info.on_lmb_click);
-    MNI_TRACE(L"\t.on_lmb_double_click=%p", info.on_lmb_double_click);
-    MNI_TRACE(L"\t.on_mmb_click=%p", info.on_mmb_click);
-    MNI_TRACE(L"\t.on_context_menu_open=%p", info.on_context_menu_open);
-    MNI_TRACE(L"\t.on_context_menu_item_click =%p", info.on_context_menu_item_click );
-    MNI_TRACE(L"\t.on_context_menu_close=%p", info.on_context_menu_close);
-    MNI_TRACE(L"\t.on_balloon_show=%p", info.on_balloon_show);
-    MNI_TRACE(L"\t.on_balloon_hide=%p", info.on_balloon_hide);
-    MNI_TRACE(L"\t.on_balloon_timeout=%p", info.on_balloon_timeout);
-    MNI_TRACE(L"\t.on_balloon_click=%p", info.on_balloon_click);
-    MNI_TRACE(L"\t.on_rich_popup_open=%p", info.on_rich_popup_open);
-    MNI_TRACE(L"\t.on_rich_popup_close=%p", info.on_rich_popup_close);
-    MNI_TRACE(L"\t.on_dpi_change=%p", info.on_dpi_change);
-    MNI_TRACE(L"\t.on_system_theme_change=%p", info.on_system_theme_change);
-    MNI_TRACE(L"\t.on_apps_theme_change=%p", info.on_apps_theme_change);
-    MNI_TRACE(L"\t.on_taskbar_created=%p", info.on_taskbar_created);
-    MNI_TRACE(L"\t.on_timer=%p", info.on_timer);
-    MNI_TRACE(L"\t.on_custom_message=%p", info.on_custom_message);
-    MNI_TRACE(L"\t.on_system_message=%p", info.on_system_message);
-    MNI_TRACE(L"}");
+MniError MniCreateCommandQueue(ModernNotifyIcon *mni, int capacity) {
+    MNI_TRACE(L"MniCreateCommandQueue(mni=%p, capacity=%d)", mni, capacity);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
-    
-    memset(mni, 0, sizeof(*mni));
 
-    MniError ret = _MniInternalCreateWindow(mni, info);
-    if (MNI_FAILED(ret)) {
-        return ret;
+    if (mni->command_queue) {
+        return MNI_OK;
     }
 
-    if (!_IsGuidEq(info.guid, MNI_GUID_NULL)) {
-        mni->use_guid = MNI_TRUE;
-        mni->guid = info.guid;
+    if (capacity <= 0) {
+        capacity = MNI_COMMAND_QUEUE_DEFAULT_CAPACITY;
     }
 
-    mni->icon = info.icon;
-    mni->menu = info.menu;
-    _StringCopyW(mni->tip, ARRAYSIZE(mni->tip), info.tip);
-    mni->tip_type = info.tip_type;
+    // Round capacity up to power of two so position can be masked.
+    LONG size = 2;
+    while (size < capacity && size < (1 << 20)) {
+        size <<= 1;
+    }
 
-    mni->primary_monitor = _GetPrimaryMonitor();
-    if (_IsHighContrastThemeEnabled()) {
-        MniThemeInfo hcti = _GetHighContrastThemeInfo();
-        mni->system_theme = hcti;
-        mni->apps_theme = hcti;
-    } else {
-        mni->system_theme = _GetSystemThemeInfo();
-        mni->apps_theme = _GetAppsThemeInfo();
+    SIZE_T bytes = sizeof(MniCommandQueue) + sizeof(MniCommandCell) * (SIZE_T)size;
+    MniCommandQueue *queue = (MniCommandQueue *)_MniAlloc(bytes);
+    if (!queue) {
+        return MNI_ERROR_OUT_OF_MEMORY;
     }
-    mni->icm_style = info.icm_style;
-    mni->icm_theme = info.icm_theme;
-    mni->dpi = _GetDpi(mni->window_handle);
 
-    mni->menu_position = info.menu_position;
-    mni->menu_animation = info.menu_animation;
+    queue->mask = size - 1;
+    queue->cells = (MniCommandCell *)(queue + 1);
 
-    mni->reserved1 = NULL;
-    mni->reserved2 = NULL;
+    for (LONG i = 0; i < size; i += 1) {
+        queue->cells[i].sequence = i;
+    }
 
-    mni->user_data1 = info.user_data1;
-    mni->user_data2 = info.user_data2;
+    mni->command_queue = queue;
 
-    mni->on_window_create           = info.on_window_create;
-    mni->on_window_destroy          = info.on_window_destroy;
-    mni->on_init                    = info.on_init;
-    mni->on_release                 = info.on_release;
-    mni->on_show                    = info.on_show;
-    mni->on_hide                    = info.on_hide;
-    mni->on_icon_change             = info.on_icon_change;
-    mni->on_menu_change             = info.on_menu_change;
-    mni->on_tip_change              = info.on_tip_change;
-    mni->on_tip_type_change         = info.on_tip_type_change;
-    mni->on_key_select              = info.on_key_select;
-    mni->on_lmb_click               = info.on_lmb_click;
-    mni->on_lmb_double_click        = info.on_lmb_double_click;
-    mni->on_mmb_click               = info.on_mmb_click;
-    mni->on_context_menu_open       = info.on_context_menu_open;
-    mni->on_context_menu_item_click = info.on_context_menu_item_click;
-    mni->on_context_menu_close      = info.on_context_menu_close;
-    mni->on_balloon_show            = info.on_balloon_show;
-    mni->on_balloon_hide            = info.on_balloon_hide;
-    mni->on_balloon_timeout         = info.on_balloon_timeout;
-    mni->on_balloon_click           = info.on_balloon_click;
-    mni->on_rich_popup_open         = info.on_rich_popup_open;
-    mni->on_rich_popup_close        = info.on_rich_popup_close;
-    mni->on_dpi_change              = info.on_dpi_change;
-    mni->on_system_theme_change     = info.on_system_theme_change;
-    mni->on_apps_theme_change       = info.on_apps_theme_change;
-    mni->on_taskbar_created         = info.on_taskbar_created;
-    mni->on_timer                   = info.on_timer;
-    mni->on_custom_message          = info.on_custom_message;
-    mni->on_system_message          = info.on_system_message;
+    return MNI_OK;
+}
 
-    if (mni->window_handle) {
-        SendMessageW(mni->window_handle, WM_MNI_INIT, 0, 0);
+// ========================================================================== //
+
+MniError MniDestroyCommandQueue(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniDestroyCommandQueue(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
+
+    MniCommandQueue *queue = _MniCommandQueueClose(mni);
+    if (!queue) {
+        return MNI_ERROR_QUEUE_NOT_CREATED;
     }
 
+    // Commands accepted before closing still run, in the order a drain would run them.
+    _MniCommandQueueRun(mni, queue);
+    _MniFree(queue);
+
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniRelease(ModernNotifyIcon *mni, MniBool destroy_icon, MniBool destroy_menu) {
-    MNI_TRACE(L"MniRelease(mni=%p, destroy_icon=%d, destroy_menu=%d)", mni, destroy_icon, destroy_menu);
+MniError MniQueueSetIcon(ModernNotifyIcon *mni, HICON icon, MniBool destroy_current) {
+    MNI_TRACE2(L"MniQueueSetIcon(mni=%p, icon=%p, destroy_current=%d)", mni, icon, destroy_current);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (mni->window_handle) {
-        SendMessageW(mni->window_handle, WM_MNI_RELEASE, 0, 0);
-    }
+    MniCommand command = { .type = MNI_COMMAND_SET_ICON };
+    command.data.set_icon.icon = icon;
+    command.data.set_icon.destroy_current = destroy_current;
 
-    _MniInternalDestroyNotifyIcon(mni);
-    _MniInternalDestroyWindow(mni);
+    return _MniCommandQueuePush(mni, &command);
+}
 
-    if (destroy_icon && mni->icon) {
-        DestroyIcon(mni->icon);
-    }
+// ========================================================================== //
 
-    if (destroy_menu && mni->menu) {
-        DestroyMenu(mni->menu);
+MniError MniQueueSetTip(ModernNotifyIcon *mni, const wchar_t *tip) {
+    MNI_TRACE2(L"MniQueueSetTip(mni=%p, tip=%p)", mni, tip);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    memset(mni, 0, sizeof(*mni));
+    MniCommand command = { .type = MNI_COMMAND_SET_TIP };
+    _StringCopyW(command.data.set_tip.tip, ARRAYSIZE(command.data.set_tip.tip), tip);
 
-    return MNI_OK;
+    return _MniCommandQueuePush(mni, &command);
 }
 
 // ========================================================================== //
 
-MniError MniShow(ModernNotifyIcon *mni, MniBool recreate) {
-    MNI_TRACE(L"MniShow(mni=%p, recreate=%d)", mni, recreate);
+MniError MniQueueSetTipType(ModernNotifyIcon *mni, MniTipType mtt) {
+    MNI_TRACE2(L"MniQueueSetTipType(mni=%p, mtt=%d)", mni, mtt);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    MNI_TRACE(
-        L"\ticon_visible=%d, icon_created=%d, window_handle=%p",
-        mni->icon_visible,
-        mni->icon_created,
-        mni->window_handle
-    );
+    MniCommand command = { .type = MNI_COMMAND_SET_TIP_TYPE };
+    command.data.set_tip_type.tip_type = mtt;
 
-    if (mni->icon_visible && !recreate) {
-        return MNI_ICON_ALREADY_SHOWN;
-    }
+    return _MniCommandQueuePush(mni, &command);
+}
 
-    if (!mni->window_handle) {
-        MniError result = _MniInternalCreateWindow(mni, (MniInfo){0});
-        if (MNI_FAILED(result)) {
-            return result;
-        }
-    }
+// ========================================================================== //
 
-    if (recreate) {
-        // If this fails, probable cause was the fact that icon doesn't exists anymore.
-        MniError result = _MniInternalDestroyNotifyIcon(mni);
-        if (FAILED(result)) {
-            mni->icon_visible = MNI_FALSE;
-            mni->icon_created = MNI_FALSE;
-        }
+MniError MniQueueShow(ModernNotifyIcon *mni, MniBool recreate) {
+    MNI_TRACE2(L"MniQueueShow(mni=%p, recreate=%d)", mni, recreate);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!mni->icon_created) {
-        MniError result = _MniInternalCreateNotifyIcon(mni);
-        if (MNI_FAILED(result)) {
-            return result;
-        }
-    } else {
-        NOTIFYICONDATAW nid = {
-            .cbSize      = sizeof(nid),
-            .hWnd        = mni->window_handle,
-            .uID         = 0,
-            .uFlags      = NIF_STATE,
-            .dwState     = 0,
-            .dwStateMask = NIS_HIDDEN
-        };
+    MniCommand command = { .type = MNI_COMMAND_SHOW };
+    command.data.show.recreate = recreate;
 
-        if (mni->use_guid) {
-            nid.uFlags |= NIF_GUID;
-            nid.guidItem = mni->guid;
-        }
+    return _MniCommandQueuePush(mni, &command);
+}
 
-        if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
-            nid.uFlags |= NIF_SHOWTIP;
-        }
+// ========================================================================== //
 
-        if (!Shell_NotifyIconW(NIM_MODIFY, &nid)) {
-            return MNI_ERROR_FAILED_TO_SHOW_ICON;
-        }
-    }
-    
-    mni->icon_visible = MNI_TRUE;
-    
-    if (mni->window_handle) {
-        SendMessageW(mni->window_handle, WM_MNI_SHOW, 0, 0);
+MniError MniQueueHide(ModernNotifyIcon *mni) {
+    MNI_TRACE2(L"MniQueueHide(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    return MNI_OK;
+    MniCommand command = { .type = MNI_COMMAND_HIDE };
+
+    return _MniCommandQueuePush(mni, &command);
 }
 
 // ========================================================================== //
 
-MniError MniHide(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"MniHide(mni=%p)", mni);
+MniError MniQueueBalloonNotification(
+    ModernNotifyIcon        *mni,
+    const wchar_t           *title,
+    const wchar_t           *text,
+    MniBalloonIconType      icon_type,
+    HICON                   icon,
+    MniBalloonFlags         flags
+) {
+    MNI_TRACE2(L"MniQueueBalloonNotification(mni=%p, title=%p, text=%p)", mni, title, text);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    MNI_TRACE(
-        L"\ticon_visible=%d, icon_created=%d, window_handle=%p",
-        mni->icon_visible,
-        mni->icon_created,
-        mni->window_handle
-    );
+    MniCommand command = { .type = MNI_COMMAND_BALLOON };
+    _StringCopyW(command.data.balloon.title, ARRAYSIZE(command.data.balloon.title), title);
+    _StringCopyW(command.data.balloon.text, ARRAYSIZE(command.data.balloon.text), text);
+    command.data.balloon.icon_type = icon_type;
+    command.data.balloon.icon = icon;
+    command.data.balloon.flags = flags;
 
-    if (!mni->icon_visible) {
-        return MNI_ICON_ALREADY_HIDDEN;
-    }
+    return _MniCommandQueuePush(mni, &command);
+}
 
-    if (!mni->icon_created) {
-        return MNI_ERROR_ICON_NOT_CREATED;
+// ========================================================================== //
+
+MniError MniStartTimer(ModernNotifyIcon *mni, UINT timer_id, UINT interval) {
+    MNI_TRACE(L"MniStartTimer(mni=%p, timer_id=%d, interval=%d)", mni, timer_id, interval);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
     if (!mni->window_handle) {
         return MNI_ERROR_INVALID_WINDOW_HANDLE;
     }
 
-    NOTIFYICONDATAW nid = {
-        .cbSize      = sizeof(nid),
-        .hWnd        = mni->window_handle,
-        .uID         = 0,
-        .uFlags      = NIF_STATE,
-        .dwState     = NIS_HIDDEN,
-        .dwStateMask = NIS_HIDDEN
-    };
-
-    if (mni->use_guid) {
-        nid.uFlags |= NIF_GUID;
-        nid.guidItem = mni->guid;
+    if (timer_id < MNI_USER_TIMER_ID) {
+        return MNI_ERROR_INVALID_TIMER_ID;
     }
+    
+    return _MniTimerWheelStart(mni, timer_id, interval);
+}
 
-    if (!Shell_NotifyIconW(NIM_MODIFY, &nid)) {
-        return MNI_ERROR_FAILED_TO_HIDE_ICON;
-    }
+// ========================================================================== //
 
-    mni->icon_visible = MNI_FALSE;
+MniError MniStopTimer(ModernNotifyIcon *mni, UINT timer_id) {
+    MNI_TRACE(L"MniStopTimer(mni=%p, timer_id=%d)", mni, timer_id);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
+    }
 
-    SendMessageW(mni->window_handle, WM_MNI_HIDE, 0, 0);
+    if (!mni->window_handle) {
+        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    }
 
-    return MNI_OK;
+    if (timer_id < MNI_USER_TIMER_ID) {
+        return MNI_ERROR_INVALID_TIMER_ID;
+    }
+    
+    return _MniTimerWheelStop(mni, timer_id);
 }
 
 // ========================================================================== //
 
-MniError MniSetIcon(ModernNotifyIcon *mni, HICON icon, MniBool destroy_current) {
-    MNI_TRACE(L"MniSetIcon(mni=%p, icon=%p, destroy_current=%d)", mni, icon, destroy_current);
+MniError MniSetIconSource(ModernNotifyIcon *mni, const MniIconSource *source) {
+    MNI_TRACE(L"MniSetIconSource(mni=%p, source=%p)", mni, source);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    // Only update if there is change.
-    if (icon != mni->icon) {
-        MniError result = _MniUpdateIcon(mni, icon);
-        if (MNI_FAILED(result)) {
-            return result;
-        }
-    
-        SendMessageW(mni->window_handle, WM_MNI_ICON_CHANGE, (WPARAM)icon, 0);
+    if (source && !source->load && !source->resource_name && !source->file_name) {
+        return MNI_ERROR_INVALID_ICON_SOURCE;
+    }
 
-        if (mni->icon && destroy_current) {
-            DestroyIcon(mni->icon);
-        }
+    // Same as with MniSetIcon, animation, graph and overlay end on the icon they started from.
+    _MniIconLoaderCancel(mni);
+    _MniAnimationRelease(mni, MNI_TRUE);
+    _MniGraphRelease(mni, MNI_TRUE);
+    _MniOverlayRelease(mni, MNI_TRUE);
+    _MniIconCacheRelease(mni);
 
-        mni->icon = icon;
+    if (!source) {
+        // Variant of previous source was destroyed, don't leave it in the tray.
+        if (!mni->icon) {
+            _MniUpdateIcon(mni, NULL);
+        }
+        return MNI_OK;
     }
 
-    return MNI_OK;
+    return _MniIconCacheInstall(mni, source, NULL);
 }
 
 // ========================================================================== //
 
-MniError MniSetMenu(ModernNotifyIcon *mni, HMENU menu, MniBool destroy_current) {
-    MNI_TRACE(L"MniSetMenu(mni=%p, menu=%p, destroy_current=%d)", mni, menu, destroy_current);
+MniError MniSetIconFromPixels(
+    ModernNotifyIcon *mni,
+    const void *pixels,
+    int width,
+    int height,
+    int stride,
+    MniPixelFormat format
+) {
+    MNI_TRACE(
+        L"MniSetIconFromPixels(mni=%p, pixels=%p, width=%d, height=%d, stride=%d, format=%d)",
+        mni,
+        pixels,
+        width,
+        height,
+        stride,
+        format
+    );
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    // Only update if there is change.
-    if (menu != mni->menu) {
-        MniError result = _MniUpdateMenu(mni, menu); 
-        if (MNI_FAILED(result)) {
-            return result;
-        }
+    if (stride == 0) {
+        stride = width * 4;
+    }
 
-        SendMessageW(mni->window_handle, WM_MNI_MENU_CHANGE, (WPARAM)menu, 0);
+    if (!pixels || width <= 0 || height <= 0 || width > MNI_PIXELS_MAX_SIZE || height > MNI_PIXELS_MAX_SIZE ||
+        stride < width * 4 || (format != MNI_PIXEL_FORMAT_RGBA && format != MNI_PIXEL_FORMAT_BGRA))
+    {
+        return MNI_ERROR_INVALID_PIXELS;
+    }
 
-        if (mni->menu && destroy_current) {
-            DestroyMenu(mni->menu);
-        }
+    MniPixelImage *image = _MniPixelImageAlloc(width, height);
+    if (!image) {
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
 
-        mni->menu = menu;
+    // Converted once, every dpi variant is resampled from the premultiplied copy.
+    uint32_t *data = _MniPixelImageData(image);
+    for (int y = 0; y < height; y += 1) {
+        const uint32_t *row = (const uint32_t *)((const BYTE *)pixels + (SIZE_T)y * (SIZE_T)stride);
+        _MniPixelsPremultiply(data + y * width, row, (size_t)width, format == MNI_PIXEL_FORMAT_RGBA);
     }
 
-    return MNI_OK;
+    _MniIconLoaderCancel(mni);
+
+    return _MniPixelImageInstall(mni, image);
 }
 
 // ========================================================================== //
 
-MniError MniSetTip(ModernNotifyIcon *mni, const wchar_t *tip) {
-    MNI_TRACE(L"MniSetTip(mni=%p, tip=%p)", mni, tip);
+MniError MniSetIconMask(ModernNotifyIcon *mni, HICON mask) {
+    MNI_TRACE(L"MniSetIconMask(mni=%p, mask=%p)", mni, mask);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    // Only update if there is change.
-    if (_StringCompareW(mni->tip, tip, ARRAYSIZE(mni->tip)) != 0) {
-        MniError result = _MniUpdateTip(mni, tip); 
-        if (MNI_FAILED(result)) {
-            return result;
-        }
+    if (!mask) {
+        return MNI_ERROR_INVALID_ICON;
+    }
 
-        SendMessageW(mni->window_handle, WM_MNI_TIP_CHANGE, (WPARAM)tip, 0);
+    int width;
+    int height;
+    uint32_t *pixels = _MniReadIconPixels(mask, &width, &height);
+    if (!pixels) {
+        return MNI_ERROR_INVALID_ICON;
+    }
 
-        _StringCopyW(mni->tip, ARRAYSIZE(mni->tip), tip);
+    MniIconMask *data = (MniIconMask *)_MniAlloc(sizeof(*data) + (SIZE_T)width * (SIZE_T)height * sizeof(uint32_t));
+    if (!data) {
+        _MniFree(pixels);
+        return MNI_ERROR_OUT_OF_MEMORY;
     }
 
-    return MNI_OK;
+    SIZE_T count = (SIZE_T)width * (SIZE_T)height;
+    memcpy(_MniIconMaskData(data), pixels, count * sizeof(uint32_t));
+    _MniFree(pixels);
+
+    UINT64 seed = MNI_ICON_POOL_SEED_MASK ^ ((UINT64)width << 32) ^ (UINT64)height;
+    data->hash = _MniPixelsHash(_MniIconMaskData(data), count, seed);
+    data->color = (LONG)_MniColorToPixel(mni->system_theme.TextColor, 0xFF);
+    data->width = width;
+    data->height = height;
+
+    MniIconSource source = {
+        .load = _MniIconMaskLoad,
+        .context = data,
+    };
+
+    _MniIconLoaderCancel(mni);
+    _MniAnimationRelease(mni, MNI_FALSE);
+    _MniGraphRelease(mni, MNI_FALSE);
+    _MniOverlayRelease(mni, MNI_FALSE);
+    _MniIconCacheRelease(mni);
+
+    return _MniIconCacheInstall(mni, &source, data);
 }
 
 // ========================================================================== //
 
-MniError MniSetTipType(ModernNotifyIcon *mni, MniTipType mtt) {
-    MNI_TRACE(L"MniSetTipType(mni=%p, mtt=%p)", mni, &mtt);
-    MNI_ASSERT(mni && "mni ptr is null");
+MniError MniOpenIconPack(MniIconPack *pack, const wchar_t *file_name) {
+    MNI_TRACE(L"MniOpenIconPack(pack=%p, file_name=%s)", pack, file_name ? file_name : L"(null)");
 
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
+    if (!pack || !file_name) {
+        return MNI_ERROR_INVALID_ARGUMENT;
     }
 
-    // Only update if there is change.
-    if (mtt != mni->tip_type)
-    {
-        const wchar_t *tip = L"";
-        if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
-            tip = mni->tip;
-        }
-
-        MniError result = _MniUpdateTip(mni, tip);
-        if (MNI_FAILED(result)) {
-            return result;
-        }
-
-        SendMessageW(mni->window_handle, WM_MNI_TIP_TYPE_CHANGE, (WPARAM)mtt, 0);
+    *pack = (MniIconPack){ 0 };
 
-        mni->tip_type = mtt;
+    HANDLE file = CreateFileW(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return MNI_ERROR_FAILED_TO_OPEN_ICON_PACK;
     }
-    
-    return MNI_OK;
-}
 
-// ========================================================================== //
+    // Pack offsets are 32-bit.
+    LARGE_INTEGER size = { 0 };
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 || (ULONGLONG)size.QuadPart > MAXDWORD) {
+        CloseHandle(file);
+        return MNI_ERROR_INVALID_ICON_PACK;
+    }
 
-MniError MniGetIcon(ModernNotifyIcon *mni, HICON *icon) {
-    MNI_TRACE(L"MniGetIcon(mni=%p, icon=%p)", mni, icon);
-    MNI_ASSERT(mni && "mni ptr is null");
-    
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!data) {
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return MNI_ERROR_FAILED_TO_OPEN_ICON_PACK;
     }
 
-    if (!icon) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+    // Only header and index are checked, frame pages are read when first used.
+    if (_MniPackValidate(data, (size_t)size.QuadPart, 0) != MNI_PACK_OK) {
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return MNI_ERROR_INVALID_ICON_PACK;
     }
 
-    *icon = mni->icon;
+    pack->file = file;
+    pack->mapping = mapping;
+    pack->data = data;
+    pack->size = (SIZE_T)size.QuadPart;
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniGetMenu(ModernNotifyIcon *mni, HMENU *menu) {
-    MNI_TRACE(L"MniGetMenu(mni=%p, menu=%p)", mni, menu);
-    MNI_ASSERT(mni && "mni ptr is null");
-    
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
-    }
+MniError MniCloseIconPack(MniIconPack *pack) {
+    MNI_TRACE(L"MniCloseIconPack(pack=%p)", pack);
 
-    if (!menu) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+    if (!pack || !pack->data) {
+        return MNI_ERROR_INVALID_ICON_PACK;
     }
 
-    *menu = mni->menu;
+    UnmapViewOfFile(pack->data);
+    CloseHandle(pack->mapping);
+    CloseHandle(pack->file);
+
+    *pack = (MniIconPack){ 0 };
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniGetTip(ModernNotifyIcon *mni, wchar_t *buffer, int *len) {
-    MNI_TRACE(L"MniGetTip(mni=%p, buffer=%p, len=%p)", mni, buffer, len);
-    MNI_ASSERT(mni && "mni ptr is null");
-    
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
-    }
+MniError MniLoadIconFromPack(const MniIconPack *pack, const char *name, int dpi, HICON *icon) {
+    MNI_TRACE(L"MniLoadIconFromPack(pack=%p, name=%S, dpi=%d, icon=%p)", pack, name ? name : "(null)", dpi, icon);
 
-    if (!buffer && !len) {
+    if (!icon) {
         return MNI_ERROR_INVALID_ARGUMENT;
     }
 
-    // cch should include '\0'.
-    int cch = _StringLengthMaxW(mni->tip, ARRAYSIZE(mni->tip));
-    if (cch == ARRAYSIZE(mni->tip)) {
-        mni->tip[cch - 1] = L'\0';
-    } else {
-        cch += 1;
-    }
+    *icon = NULL;
 
-    // Return required length (in characters including '\0').
-    if (!buffer) {
-        *len = cch;
-        return MNI_OK;
+    if (!pack || !pack->data) {
+        return MNI_ERROR_INVALID_ICON_PACK;
     }
 
-    // Check if buffer can fit the string.
-    if (cch > *len) {
-        return MNI_ERROR_INSUFFICIENT_BUFFER;
+    int index = _MniIconPackFind(pack, name);
+    if (index < 0) {
+        return MNI_ERROR_ICON_NOT_IN_PACK;
     }
 
-    // Copy tip to destination buffer.
-    _StringCopyW(buffer, cch, mni->tip);
-    *len = cch;
+    *icon = _MniIconPackLoadIcon(pack, index, _GetSmallIconSize(dpi > 0 ? dpi : 96));
+    if (!*icon) {
+        return MNI_ERROR_FAILED_TO_LOAD_ICON;
+    }
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniGetTipType(ModernNotifyIcon *mni, MniTipType *mtt) {
-    MNI_TRACE(L"MniGetTip(mni=%p, mtt=%p)", mni, mtt);
+MniError MniSetIconFromPack(ModernNotifyIcon *mni, const MniIconPack *pack, const char *name) {
+    MNI_TRACE(L"MniSetIconFromPack(mni=%p, pack=%p, name=%S)", mni, pack, name ? name : "(null)");
     MNI_ASSERT(mni && "mni ptr is null");
-    
+
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!mtt) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+    if (!pack || !pack->data) {
+        return MNI_ERROR_INVALID_ICON_PACK;
     }
 
-    *mtt = mni->tip_type;
+    int index = _MniIconPackFind(pack, name);
+    if (index < 0) {
+        return MNI_ERROR_ICON_NOT_IN_PACK;
+    }
 
-    return MNI_OK;
+    MniIconPackSource *context = (MniIconPackSource *)_MniAlloc(sizeof(*context));
+    if (!context) {
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    context->pack = *pack;
+    context->icon = index;
+
+    MniIconSource source = {
+        .load = _MniIconPackLoad,
+        .context = context,
+    };
+
+    _MniIconLoaderCancel(mni);
+    _MniAnimationRelease(mni, MNI_FALSE);
+    _MniGraphRelease(mni, MNI_FALSE);
+    _MniOverlayRelease(mni, MNI_FALSE);
+    _MniIconCacheRelease(mni);
+
+    return _MniIconCacheInstall(mni, &source, context);
 }
 
 // ========================================================================== //
 
-MniError MniIsNotifyIconCreated(ModernNotifyIcon *mni, MniBool *is_created) {
-    MNI_TRACE(L"MniIsNotifyIconCreated(mni=%p, is_create=%p)", mni, is_created);
+MniError MniSetIconFromFileAsync(ModernNotifyIcon *mni, const wchar_t *file_name) {
+    MNI_TRACE(L"MniSetIconFromFileAsync(mni=%p, file_name=%s)", mni, file_name ? file_name : L"(null)");
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!is_created) {
+    if (!file_name) {
         return MNI_ERROR_INVALID_ARGUMENT;
     }
 
-    *is_created = mni->icon_created;
+    if (!mni->window_handle) {
+        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    }
 
-    return MNI_OK;
+    MniIconLoad *load = (MniIconLoad *)_MniAlloc(sizeof(*load));
+    if (!load) {
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    load->file_name = _MniIconSourceName(file_name);
+    if (!load->file_name) {
+        _MniFree(load);
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    return _MniIconLoaderSubmit(mni, load);
 }
 
 // ========================================================================== //
 
-MniError MniIsNotifyIconVisible(ModernNotifyIcon *mni, MniBool *is_visible) {
-    MNI_TRACE(L"MniIsNotifyIconVisible(mni=%p, is_visible=%p)", mni, is_visible);
+MniError MniSetIconFromMemoryAsync(ModernNotifyIcon *mni, const void *data, SIZE_T size) {
+    MNI_TRACE(L"MniSetIconFromMemoryAsync(mni=%p, data=%p, size=%llu)", mni, data, (ULONGLONG)size);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!is_visible) {
+    if (!data || size == 0) {
         return MNI_ERROR_INVALID_ARGUMENT;
     }
 
-    *is_visible = mni->icon_visible;
+    if (!mni->window_handle) {
+        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    }
 
-    return MNI_OK;
+    MniIconLoad *load = (MniIconLoad *)_MniAlloc(sizeof(*load));
+    void *copy = load ? _MniAlloc(size) : NULL;
+    if (!copy) {
+        _MniFree(load);
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    memcpy(copy, data, size);
+    load->data = copy;
+    load->data_size = size;
+
+    return _MniIconLoaderSubmit(mni, load);
 }
 
 // ========================================================================== //
 
-MniError MniGetWindowHandle(ModernNotifyIcon *mni, HWND *window_handle) {
-    MNI_TRACE(L"MniGetWindowHandle(mni=%p, window_handle=%p)", mni, window_handle);
+MniError MniGetIconUpdateStats(ModernNotifyIcon *mni, MniIconUpdateStats *stats) {
+    MNI_TRACE(L"MniGetIconUpdateStats(mni=%p, stats=%p)", mni, stats);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!window_handle) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+    if (!stats) {
+        return MNI_ERROR_INVALID_ICON_UPDATE_STATS;
     }
 
-    *window_handle = mni->window_handle;
+    stats->pushed = mni->icon_updates_pushed;
+    stats->suppressed = mni->icon_updates_suppressed;
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniGetModuleHandle(ModernNotifyIcon *mni, HINSTANCE *module_handle) {
-    MNI_TRACE(L"MniGetModuleHandle(mni=%p, module_handle=%p)", mni, module_handle);
-    MNI_ASSERT(mni && "mni ptr is null");
+HICON MniAcquireIcon(HICON icon) {
+    MNI_TRACE(L"MniAcquireIcon(icon=%p)", icon);
 
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
+    if (!icon) {
+        return NULL;
     }
 
-    if (!module_handle) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+    UINT64 hash;
+    int size;
+    if (!_MniIconContentHash(icon, &hash, &size)) {
+        return icon;
     }
 
-    *module_handle = mni->module_handle;
+    HICON pooled = _MniIconPoolFind(hash, size);
+    if (pooled) {
+        // Same content is already pooled, caller's copy isn't needed.
+        if (pooled != icon) {
+            DestroyIcon(icon);
+        }
+        return pooled;
+    }
 
-    return MNI_OK;
+    return _MniIconPoolAdd(hash, size, icon);
 }
 
 // ========================================================================== //
 
-MniError MniGetDpi(ModernNotifyIcon *mni, int *dpi) {
-    MNI_TRACE(L"MniGetDpi(mni=%p, dpi=%p)", mni, dpi);
-    MNI_ASSERT(mni && "mni ptr is null");
+void MniReleaseIcon(HICON icon) {
+    MNI_TRACE(L"MniReleaseIcon(icon=%p)", icon);
 
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
-    }
+    _MniDestroyIcon(icon);
+}
 
-    if (!dpi) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+// ========================================================================== //
+
+MniError MniSetIconPoolBudget(int budget) {
+    MNI_TRACE(L"MniSetIconPoolBudget(budget=%d)", budget);
+
+    if (budget < 0) {
+        return MNI_ERROR_INVALID_ICON_POOL_BUDGET;
     }
 
-    *dpi = mni->dpi;
+    MniIconPool *pool = &_mni_icon_pool;
+
+    AcquireSRWLockExclusive(&pool->lock);
+    pool->budget = budget;
+    MniIconPoolEntry *evicted = _MniIconPoolEvict(pool);
+    ReleaseSRWLockExclusive(&pool->lock);
+
+    _MniIconPoolDestroy(evicted);
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniGetSystemThemeInfo(ModernNotifyIcon *mni, MniThemeInfo *system_theme) {
-    MNI_TRACE(L"MniGetSystemThemeInfo(mni=%p, system_theme=%p)", mni, system_theme);
-    MNI_ASSERT(mni && "mni ptr is null");
+MniError MniGetIconPoolStats(MniIconPoolStats *stats) {
+    MNI_TRACE(L"MniGetIconPoolStats(stats=%p)", stats);
 
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
+    if (!stats) {
+        return MNI_ERROR_INVALID_ICON_POOL_STATS;
     }
 
-    if (!system_theme) {
-        return MNI_ERROR_INVALID_ARGUMENT;
-    }
+    MniIconPool *pool = &_mni_icon_pool;
 
-    *system_theme = mni->system_theme;
+    AcquireSRWLockShared(&pool->lock);
+    stats->budget = pool->budget;
+    stats->icons = pool->icons;
+    stats->idle_icons = pool->idle_icons;
+    stats->hits = pool->hits;
+    stats->misses = pool->misses;
+    stats->evictions = pool->evictions;
+    ReleaseSRWLockShared(&pool->lock);
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniGetAppsThemeInfo(ModernNotifyIcon *mni, MniThemeInfo *apps_theme) {
-    MNI_TRACE(L"MniGetAppsThemeInfo(mni=%p, apps_theme=%p)", mni, apps_theme);
-    MNI_ASSERT(mni && "mni ptr is null");
-
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
-    }
+void MniTrimIconPool(void) {
+    MNI_TRACE(L"MniTrimIconPool()");
 
-    if (!apps_theme) {
-        return MNI_ERROR_INVALID_ARGUMENT;
-    }
+    MniIconPool *pool = &_mni_icon_pool;
 
-    *apps_theme = mni->apps_theme;
+    AcquireSRWLockExclusive(&pool->lock);
+    int budget = pool->budget;
+    pool->budget = 0;
+    MniIconPoolEntry *evicted = _MniIconPoolEvict(pool);
+    pool->budget = budget;
+    ReleaseSRWLockExclusive(&pool->lock);
 
-    return MNI_OK;
+    _MniIconPoolDestroy(evicted);
 }
 
 // ========================================================================== //
 
-MNI_API MniError MniSetIcmStyle(ModernNotifyIcon *mni, IcmStyle icm_style) {
-    MNI_TRACE(L"MniSetIcmTheme(mni=%p, icm_style=%d)", mni, icm_style);
+MniError MniSetBadge(ModernNotifyIcon *mni, int value) {
+    MNI_TRACE(L"MniSetBadge(mni=%p, value=%d)", mni, value);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    mni->icm_style = icm_style;
+    if (value < 0) {
+        return MNI_ERROR_INVALID_BADGE;
+    }
 
-    return MNI_OK;
+    if (value == 0) {
+        if (mni->overlay && mni->overlay->kind == MNI_OVERLAY_BADGE) {
+            _MniOverlayRelease(mni, MNI_TRUE);
+        }
+        return MNI_OK;
+    }
+
+    return _MniOverlaySet(mni, MNI_OVERLAY_BADGE, value);
 }
 
 // ========================================================================== //
 
-MNI_API MniError MniSetIcmTheme(ModernNotifyIcon *mni, IcmTheme icm_theme) {
-    MNI_TRACE(L"MniSetIcmTheme(mni=%p, icm_theme=%d)", mni, icm_theme);
+MniError MniSetProgress(ModernNotifyIcon *mni, int percent) {
+    MNI_TRACE(L"MniSetProgress(mni=%p, percent=%d)", mni, percent);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    mni->icm_theme = icm_theme;
+    if (percent < -1 || percent > 100) {
+        return MNI_ERROR_INVALID_PROGRESS;
+    }
 
-    return MNI_OK;
+    if (percent == -1) {
+        if (mni->overlay && mni->overlay->kind == MNI_OVERLAY_PROGRESS) {
+            _MniOverlayRelease(mni, MNI_TRUE);
+        }
+        return MNI_OK;
+    }
+
+    return _MniOverlaySet(mni, MNI_OVERLAY_PROGRESS, percent);
 }
 
 // ========================================================================== //
 
-MNI_API MniError MniGetIcmStyle(ModernNotifyIcon *mni, IcmStyle *icm_style) {
-    MNI_TRACE(L"MniGetIcmStyle(mni=%p, icm_style=%p)", mni, icm_style);
+MniError MniStartGraph(ModernNotifyIcon *mni, float min_value, float max_value, UINT max_fps) {
+    MNI_TRACE(
+        L"MniStartGraph(mni=%p, min_value=%f, max_value=%f, max_fps=%u)",
+        mni,
+        (double)min_value,
+        (double)max_value,
+        max_fps
+    );
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!icm_style) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+    if (!(max_value > min_value)) {
+        return MNI_ERROR_INVALID_GRAPH;
     }
 
-    *icm_style = mni->icm_style;
+    MniGraph *graph = mni->graph;
+
+    // Running graph keeps its history, only range and rate change.
+    if (!graph) {
+        graph = (MniGraph *)_MniAlloc(sizeof(*graph));
+        if (!graph) {
+            return MNI_ERROR_OUT_OF_MEMORY;
+        }
+
+        MniError result = _MniGraphCreateBitmaps(graph, _GetSmallIconSize(mni->dpi));
+        if (MNI_FAILED(result)) {
+            _MniFree(graph);
+            return result;
+        }
 
-    return MNI_OK;
-}
+        _MniAnimationRelease(mni, MNI_FALSE);
+        _MniOverlayRelease(mni, MNI_FALSE);
 
-// ========================================================================== //
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
 
-MNI_API MniError MniGetIcmTheme(ModernNotifyIcon *mni, IcmTheme *icm_theme) {
-    MNI_TRACE(L"MniGetIcmTheme(mni=%p, icm_theme=%p)", mni, icm_theme);
-    MNI_ASSERT(mni && "mni ptr is null");
+        graph->frequency = frequency.QuadPart;
+        graph->dpi = mni->dpi;
+        graph->base_icon = mni->icon;
 
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
+        mni->graph = graph;
     }
 
-    if (!icm_theme) {
-        return MNI_ERROR_INVALID_ARGUMENT;
-    }
+    graph->min_value = min_value;
+    graph->max_value = max_value;
+    graph->max_fps = max_fps ? max_fps : MNI_GRAPH_DEFAULT_FPS;
 
-    *icm_theme = mni->icm_theme;
+    _MniGraphRefresh(mni, graph->dpi);
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniSetUserData1(ModernNotifyIcon *mni, void *data) {
-    MNI_TRACE(L"MniSetUserData1(mni=%p, data=%p)", mni, data);
+MniError MniAddGraphSample(ModernNotifyIcon *mni, float value) {
+    MNI_TRACE(L"MniAddGraphSample(mni=%p, value=%f)", mni, (double)value);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    mni->user_data1 = data;
+    if (!mni->graph) {
+        return MNI_ERROR_GRAPH_NOT_STARTED;
+    }
+
+    _MniGraphAddSample(mni, mni->graph, value);
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniSetUserData2(ModernNotifyIcon *mni, void *data) {
-    MNI_TRACE(L"MniSetUserData2(mni=%p, data=%p)", mni, data);
+MniError MniStopGraph(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniStopGraph(mni=%p)", mni);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    mni->user_data2 = data;
+    _MniGraphRelease(mni, MNI_TRUE);
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniGetUserData1(ModernNotifyIcon *mni, void **data) {
-    MNI_TRACE(L"MniGetUserData1(mni=%p, data=%p)", mni, data);
-    MNI_ASSERT(mni && "mni ptr is null");
+MniError MniCreateTextIcon(const wchar_t *text, int dpi, DWORD color, HICON *icon) {
+    MNI_TRACE(L"MniCreateTextIcon(text=%s, dpi=%d, color=%06X, icon=%p)", text ? text : L"(null)", dpi, color, icon);
 
-    if (!mni) {
-        return MNI_ERROR_MNI_PTR_IS_NULL;
+    if (!icon) {
+        return MNI_ERROR_INVALID_ARGUMENT;
     }
 
-    if (!data) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+    *icon = NULL;
+
+    if (!text || !text[0] || wcslen(text) > MNI_TEXT_ICON_MAX_LENGTH) {
+        return MNI_ERROR_INVALID_TEXT;
     }
 
-    *data = mni->user_data1;
+    // Font covers ASCII only, the rest is drawn as '?'.
+    char ascii[MNI_TEXT_ICON_MAX_LENGTH + 1] = { 0 };
+    for (int i = 0; text[i]; i += 1) {
+        ascii[i] = text[i] < 0x80 ? (char)text[i] : '?';
+    }
+
+    int size = _GetSmallIconSize(dpi > 0 ? dpi : 96);
+
+    *icon = _MniCreateTextIcon(ascii, size, _MniColorToPixel(color, 0xFF));
+    if (!*icon) {
+        return MNI_ERROR_FAILED_TO_RENDER_TEXT;
+    }
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniGetUserData2(ModernNotifyIcon *mni, void **data) {
-    MNI_TRACE(L"MniGetUserData2(mni=%p, data=%p)", mni, data);
+MniError MniAnimateIcon(ModernNotifyIcon *mni, const HICON *frames, int frame_count, UINT fps, MniBool loop) {
+    MNI_TRACE(
+        L"MniAnimateIcon(mni=%p, frames=%p, frame_count=%d, fps=%u, loop=%d)",
+        mni,
+        frames,
+        frame_count,
+        fps,
+        loop
+    );
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!data) {
-        return MNI_ERROR_INVALID_ARGUMENT;
+    if (!frames || frame_count <= 0 || fps == 0 || fps > 1000) {
+        return MNI_ERROR_INVALID_ANIMATION;
     }
 
-    *data = mni->user_data2;
+    if (!mni->window_handle) {
+        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    }
+
+    MniAnimation *animation = (MniAnimation *)_MniAlloc(sizeof(*animation));
+    HICON *copy = (HICON *)_MniAlloc(sizeof(*copy) * (SIZE_T)frame_count);
+    if (!animation || !copy) {
+        _MniFree(animation);
+        _MniFree(copy);
+        return MNI_ERROR_OUT_OF_MEMORY;
+    }
+
+    memcpy(copy, frames, sizeof(*copy) * (SIZE_T)frame_count);
+    animation->frames = copy;
+
+    _MniAnimationStart(mni, animation, frame_count, fps, loop);
 
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniSendBalloonNotification(
-    ModernNotifyIcon        *mni,
-    const wchar_t           *title,
-    const wchar_t           *text,
-    MniBalloonIconType      icon_type,
-    HICON                   icon,
-    MniBalloonFlags         flags
+MniError MniAnimatePixels(
+    ModernNotifyIcon *mni,
+    const void *pixels,
+    int width,
+    int height,
+    int frame_count,
+    MniPixelFormat format,
+    UINT fps,
+    MniBool loop
 ) {
     MNI_TRACE(
-        L"MniSendBalloonNotification(mni=%p, title=%p, text=%p, icon_type=%d, icon=%p, flags=%x)",
+        L"MniAnimatePixels(mni=%p, pixels=%p, width=%d, height=%d, frame_count=%d, format=%d, fps=%u, loop=%d)",
         mni,
-        title,
-        text,
-        (UINT)icon_type,
-        icon,
-        (UINT)flags
+        pixels,
+        width,
+        height,
+        frame_count,
+        format,
+        fps,
+        loop
     );
     MNI_ASSERT(mni && "mni ptr is null");
 
@@ -2249,159 +9102,202 @@ MniError MniSendBalloonNotification(
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    MNI_TRACE(
-        L"\ticon_visible=%d, icon_created=%d, window_handle=%p",
-        mni->icon_visible,
-        mni->icon_created,
-        mni->window_handle
-    );
-
-    if (!mni->icon_created) {
-        return MNI_ERROR_ICON_NOT_CREATED;
+    if (!pixels || width <= 0 || height <= 0 || width > MNI_PIXELS_MAX_SIZE || height > MNI_PIXELS_MAX_SIZE ||
+        (format != MNI_PIXEL_FORMAT_RGBA && format != MNI_PIXEL_FORMAT_BGRA))
+    {
+        return MNI_ERROR_INVALID_PIXELS;
     }
 
-    NOTIFYICONDATAW nid = {
-        .cbSize       = sizeof(nid),
-        .hWnd         = mni->window_handle,
-        .uID          = 0,
-        .uFlags       = NIF_INFO,
-        .dwInfoFlags  = NIIF_NONE,
-        .hBalloonIcon = NULL
-    };
-
-    if (mni->use_guid) {
-        nid.uFlags |= NIF_GUID;
-        nid.guidItem = mni->guid;
+    if (frame_count <= 0 || fps == 0 || fps > 1000) {
+        return MNI_ERROR_INVALID_ANIMATION;
     }
 
-    if (mni->tip_type == MNI_TIP_TYPE_STANDARD) {
-        nid.uFlags |= NIF_SHOWTIP;
+    if (!mni->window_handle) {
+        return MNI_ERROR_INVALID_WINDOW_HANDLE;
     }
 
-    if ((flags & MNI_BALLOON_FLAGS_REALTIME) == MNI_BALLOON_FLAGS_REALTIME) {
-        nid.uFlags |= NIF_REALTIME;
-    }
+    SIZE_T count = (SIZE_T)width * (SIZE_T)height;
+    SIZE_T bound = _MniPixelsDeltaBound(count);
 
-    switch (icon_type)
-    {
-    case MNI_BALLOON_ICON_TYPE_NONE:
-        break;
-    case MNI_BALLOON_ICON_TYPE_SYSTEM_INFO:
-        nid.dwInfoFlags = NIIF_INFO | NIIF_LARGE_ICON;
-        break;
-    case MNI_BALLOON_ICON_TYPE_SYSTEM_WARNING:
-        nid.dwInfoFlags = NIIF_WARNING | NIIF_LARGE_ICON;
-        break;
-    case MNI_BALLOON_ICON_TYPE_SYSTEM_ERROR:
-        nid.dwInfoFlags = NIIF_ERROR | NIIF_LARGE_ICON;
-        break;
-    case MNI_BALLOON_ICON_TYPE_CUSTOM:
-        nid.dwInfoFlags  = NIIF_USER | NIIF_LARGE_ICON;
-        nid.hBalloonIcon = icon;
-        break;
+    MniAnimation *animation = (MniAnimation *)_MniAlloc(sizeof(*animation));
+    MniAnimationFrames *frames = (MniAnimationFrames *)_MniAlloc(sizeof(*frames));
+    uint32_t *previous = (uint32_t *)_MniAlloc(count * sizeof(uint32_t));
+    uint32_t *current = (uint32_t *)_MniAlloc(count * sizeof(uint32_t));
+    BYTE *encoded = (BYTE *)_MniAlloc(bound);
+
+    MniError result = MNI_OK;
+
+    if (!animation || !frames || !previous || !current || !encoded) {
+        result = MNI_ERROR_OUT_OF_MEMORY;
+        goto done;
     }
 
-    if ((flags & MNI_BALLOON_FLAGS_PLAY_SOUND) != MNI_BALLOON_FLAGS_PLAY_SOUND) {
-        nid.dwInfoFlags |= NIIF_NOSOUND;
+    frames->width = width;
+    frames->height = height;
+    frames->decoded = -1;
+    frames->pixels = previous;
+    frames->hashes = (UINT64 *)_MniAlloc(sizeof(UINT64) * (SIZE_T)frame_count);
+    frames->offsets = (SIZE_T *)_MniAlloc(sizeof(SIZE_T) * ((SIZE_T)frame_count + 1));
+    previous = NULL;
+
+    if (!frames->hashes || !frames->offsets) {
+        result = MNI_ERROR_OUT_OF_MEMORY;
+        goto done;
     }
 
-    if ((flags & MNI_BALLOON_FLAGS_RESPECT_QUIET_TIME) == MNI_BALLOON_FLAGS_RESPECT_QUIET_TIME) {
-        nid.dwInfoFlags |= NIIF_RESPECT_QUIET_TIME;
+    // Frames are premultiplied once and kept only as deltas, grown like the icon cache lists.
+    SIZE_T capacity = 0;
+    for (int i = 0; i < frame_count; i += 1) {
+        const uint32_t *source = (const uint32_t *)pixels + count * (SIZE_T)i;
+        _MniPixelsPremultiply(current, source, count, format == MNI_PIXEL_FORMAT_RGBA);
+
+        frames->hashes[i] = _MniPixelsHash(current, count, MNI_ICON_POOL_SEED_PIXELS);
+
+        SIZE_T size = _MniPixelsDeltaEncode(encoded, current, i > 0 ? frames->pixels : NULL, count);
+        SIZE_T offset = frames->offsets[i];
+
+        if (offset + size > capacity) {
+            SIZE_T new_capacity = max(capacity * 2, offset + size);
+            BYTE *data = (BYTE *)_MniAlloc(new_capacity);
+            if (!data) {
+                result = MNI_ERROR_OUT_OF_MEMORY;
+                goto done;
+            }
+
+            if (frames->data) {
+                memcpy(data, frames->data, offset);
+                _MniFree(frames->data);
+            }
+
+            frames->data = data;
+            capacity = new_capacity;
+        }
+
+        memcpy(frames->data + offset, encoded, size);
+        frames->offsets[i + 1] = offset + size;
+
+        // Current frame becomes the reference of the next one.
+        uint32_t *swap = frames->pixels;
+        frames->pixels = current;
+        current = swap;
     }
-    
-    _StringCopyW(nid.szInfoTitle, ARRAYSIZE(nid.szInfoTitle), title);
-    _StringCopyW(nid.szInfo, ARRAYSIZE(nid.szInfo), text);
 
-    if (!Shell_NotifyIconW(NIM_MODIFY, &nid)) {
-        return MNI_ERROR_FAILED_TO_SHOW_BALLOON;
+    MNI_TRACE(L"MniAnimatePixels() %llu bytes of frames stored in %llu", (ULONGLONG)(count * 4 * (SIZE_T)frame_count), (ULONGLONG)frames->offsets[frame_count]);
+
+    animation->pixel_frames = frames;
+    frames = NULL;
+
+    _MniAnimationStart(mni, animation, frame_count, fps, loop);
+    animation = NULL;
+
+done:
+    _MniAnimationFramesFree(frames);
+    _MniFree(animation);
+    _MniFree(previous);
+    _MniFree(current);
+    _MniFree(encoded);
+
+    return result;
+}
+
+// ========================================================================== //
+
+MniError MniStopAnimation(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniStopAnimation(mni=%p)", mni);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
+    _MniAnimationRelease(mni, MNI_TRUE);
+
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniRemoveBalloonNotification(ModernNotifyIcon *mni) {
-    MNI_TRACE(L"MniRemoveBalloonNotification(mni=%p)", mni);
+MniError MniGetAnimationStats(ModernNotifyIcon *mni, MniAnimationStats *stats) {
+    MNI_TRACE(L"MniGetAnimationStats(mni=%p, stats=%p)", mni, stats);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    MNI_TRACE(L"\ticon_created=%d, window_handle=%p", mni->icon_created, mni->window_handle);
-
-    if (!mni->icon_created) {
-        return MNI_ERROR_ICON_NOT_CREATED;
+    if (!stats) {
+        return MNI_ERROR_INVALID_ARGUMENT;
     }
 
-    NOTIFYICONDATAW nid = {
-        .cbSize       = sizeof(nid),
-        .hWnd         = mni->window_handle,
-        .uID          = 0,
-        .uFlags       = NIF_INFO,
-        .szInfo       = L"",
-        .szInfoTitle  = L"",
-        .dwInfoFlags  = NIIF_NONE,
-        .hBalloonIcon = NULL,
-    };
+    MniAnimation *animation = mni->animation;
+    *stats = (MniAnimationStats){0};
 
-    if (!Shell_NotifyIconW(NIM_MODIFY, &nid)) {
-        return MNI_ERROR_FAILED_TO_REMOVE_BALLOON;
+    if (animation) {
+        stats->frames_shown = animation->frames_shown;
+        stats->frames_dropped = animation->frames_dropped;
+        stats->latency_last = animation->latency_last;
+        stats->latency_max = animation->latency_max;
+        if (animation->frames_shown > 0) {
+            stats->latency_mean = (LONGLONG)(animation->latency_sum / (double)animation->frames_shown);
+        }
     }
-    
+
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniStartTimer(ModernNotifyIcon *mni, UINT timer_id, UINT interval) {
-    MNI_TRACE(L"MniStartTimer(mni=%p, timer_id=%d, interval=%d)", mni, timer_id, interval);
+MniError MniGetTimerStats(ModernNotifyIcon *mni, MniTimerStats *stats) {
+    MNI_TRACE(L"MniGetTimerStats(mni=%p, stats=%p)", mni, stats);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!mni->window_handle) {
-        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    if (!stats) {
+        return MNI_ERROR_INVALID_ARGUMENT;
     }
 
-    if (timer_id < MNI_USER_TIMER_ID) {
-        return MNI_ERROR_INVALID_TIMER_ID;
-    }
-    
-    UINT_PTR ret = SetTimer(mni->window_handle, timer_id, interval, NULL);
-    if (!ret) {
-        return MNI_ERROR_FAILED_TO_START_TIMER;
+    MniTimerWheel *wheel = mni->timer_wheel;
+    *stats = (MniTimerStats){0};
+
+    if (wheel && wheel->jitter_samples > 0) {
+        double n = (double)wheel->jitter_samples;
+        double mean = wheel->jitter_sum / n;
+        double variance = wheel->jitter_sum_sq / n - mean * mean;
+
+        stats->samples = wheel->jitter_samples;
+        stats->last = wheel->jitter_last;
+        stats->min = wheel->jitter_min;
+        stats->max = wheel->jitter_max;
+        stats->mean = (LONGLONG)mean;
+        stats->stddev = (LONGLONG)sqrt(variance > 0.0 ? variance : 0.0);
     }
-    
+
     return MNI_OK;
 }
 
 // ========================================================================== //
 
-MniError MniStopTimer(ModernNotifyIcon *mni, UINT timer_id) {
-    MNI_TRACE(L"MniStopTimer(mni=%p, timer_id=%d)", mni, timer_id);
+MniError MniResetTimerStats(ModernNotifyIcon *mni) {
+    MNI_TRACE(L"MniResetTimerStats(mni=%p)", mni);
     MNI_ASSERT(mni && "mni ptr is null");
 
     if (!mni) {
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    if (!mni->window_handle) {
-        return MNI_ERROR_INVALID_WINDOW_HANDLE;
+    MniTimerWheel *wheel = mni->timer_wheel;
+    if (wheel) {
+        wheel->jitter_samples = 0;
+        wheel->jitter_last = 0;
+        wheel->jitter_min = 0;
+        wheel->jitter_max = 0;
+        wheel->jitter_sum = 0.0;
+        wheel->jitter_sum_sq = 0.0;
     }
 
-    if (timer_id < MNI_USER_TIMER_ID) {
-        return MNI_ERROR_INVALID_TIMER_ID;
-    }
-    
-    MniBool ret = KillTimer(mni->window_handle, timer_id);
-    if (!ret) {
-        return MNI_ERROR_FAILED_TO_STOP_TIMER;
-    }
-    
     return MNI_OK;
 }
 
@@ -2466,6 +9362,10 @@ const wchar_t *MniErrorToString(MniError error) {
     case MNI_ICON_ALREADY_CREATED:                  return L"MNI_ICON_ALREADY_CREATED";
     case MNI_ICON_ALREADY_SHOWN:                    return L"MNI_ICON_ALREADY_SHOWN";
     case MNI_ICON_ALREADY_HIDDEN:                   return L"MNI_ICON_ALREADY_HIDDEN";
+    case MNI_SHELL_WORKER_ALREADY_RUNNING:          return L"MNI_SHELL_WORKER_ALREADY_RUNNING";
+    case MNI_SHELL_WORKER_NOT_RUNNING:              return L"MNI_SHELL_WORKER_NOT_RUNNING";
+    case MNI_NOTIFICATION_DEDUPLICATED:             return L"MNI_NOTIFICATION_DEDUPLICATED";
+    case MNI_COMMANDS_DROPPED:                      return L"MNI_COMMANDS_DROPPED";
 
     case MNI_ERROR_MNI_PTR_IS_NULL:                 return L"MNI_ERROR_MNI_PTR_IS_NULL";
     case MNI_ERROR_UNSUPPORTED_VERSION:             return L"MNI_ERROR_UNSUPPORTED_VERSION";
@@ -2497,6 +9397,36 @@ const wchar_t *MniErrorToString(MniError error) {
     case MNI_ERROR_FAILED_TO_CONVERT_TEXT:          return L"MNI_ERROR_FAILED_TO_CONVERT_TEXT";
     case MNI_ERROR_FAILED_TO_SEND_MESSAGE:          return L"MNI_ERROR_FAILED_TO_SEND_MESSAGE";
     case MNI_ERROR_FAILED_TO_POST_MESSAGE:          return L"MNI_ERROR_FAILED_TO_POST_MESSAGE";
+    case MNI_ERROR_FAILED_TO_UPDATE_ICON:           return L"MNI_ERROR_FAILED_TO_UPDATE_ICON";
+    case MNI_ERROR_UPDATE_NOT_STARTED:              return L"MNI_ERROR_UPDATE_NOT_STARTED";
+    case MNI_ERROR_FAILED_TO_START_THREAD:          return L"MNI_ERROR_FAILED_TO_START_THREAD";
+    case MNI_ERROR_OUT_OF_MEMORY:                   return L"MNI_ERROR_OUT_OF_MEMORY";
+    case MNI_ERROR_QUEUE_FULL:                      return L"MNI_ERROR_QUEUE_FULL";
+    case MNI_ERROR_QUEUE_NOT_CREATED:               return L"MNI_ERROR_QUEUE_NOT_CREATED";
+    case MNI_ERROR_THREAD_NOT_RUNNING:              return L"MNI_ERROR_THREAD_NOT_RUNNING";
+    case MNI_ERROR_INVALID_HOST:                    return L"MNI_ERROR_INVALID_HOST";
+    case MNI_ERROR_INVALID_MESSAGE_RANGE:           return L"MNI_ERROR_INVALID_MESSAGE_RANGE";
+    case MNI_ERROR_INVALID_ANIMATION:               return L"MNI_ERROR_INVALID_ANIMATION";
+    case MNI_ERROR_INVALID_ICON_SOURCE:             return L"MNI_ERROR_INVALID_ICON_SOURCE";
+    case MNI_ERROR_FAILED_TO_LOAD_ICON:             return L"MNI_ERROR_FAILED_TO_LOAD_ICON";
+    case MNI_ERROR_INVALID_PIXELS:                  return L"MNI_ERROR_INVALID_PIXELS";
+    case MNI_ERROR_INVALID_ICON_POOL_BUDGET:        return L"MNI_ERROR_INVALID_ICON_POOL_BUDGET";
+    case MNI_ERROR_INVALID_ICON_POOL_STATS:         return L"MNI_ERROR_INVALID_ICON_POOL_STATS";
+    case MNI_ERROR_INVALID_ICON_UPDATE_STATS:       return L"MNI_ERROR_INVALID_ICON_UPDATE_STATS";
+    case MNI_ERROR_INVALID_BADGE:                   return L"MNI_ERROR_INVALID_BADGE";
+    case MNI_ERROR_INVALID_PROGRESS:                return L"MNI_ERROR_INVALID_PROGRESS";
+    case MNI_ERROR_FAILED_TO_RENDER_OVERLAY:        return L"MNI_ERROR_FAILED_TO_RENDER_OVERLAY";
+    case MNI_ERROR_INVALID_GRAPH:                   return L"MNI_ERROR_INVALID_GRAPH";
+    case MNI_ERROR_FAILED_TO_RENDER_GRAPH:          return L"MNI_ERROR_FAILED_TO_RENDER_GRAPH";
+    case MNI_ERROR_GRAPH_NOT_STARTED:               return L"MNI_ERROR_GRAPH_NOT_STARTED";
+    case MNI_ERROR_INVALID_TEXT:                    return L"MNI_ERROR_INVALID_TEXT";
+    case MNI_ERROR_FAILED_TO_RENDER_TEXT:           return L"MNI_ERROR_FAILED_TO_RENDER_TEXT";
+    case MNI_ERROR_FAILED_TO_OPEN_ICON_PACK:        return L"MNI_ERROR_FAILED_TO_OPEN_ICON_PACK";
+    case MNI_ERROR_INVALID_ICON_PACK:               return L"MNI_ERROR_INVALID_ICON_PACK";
+    case MNI_ERROR_ICON_NOT_IN_PACK:                return L"MNI_ERROR_ICON_NOT_IN_PACK";
+    case MNI_ERROR_FAILED_TO_DECODE_ICON:           return L"MNI_ERROR_FAILED_TO_DECODE_ICON";
+    case MNI_ERROR_NOTIFICATION_QUEUE_NOT_CREATED:  return L"MNI_ERROR_NOTIFICATION_QUEUE_NOT_CREATED";
+    case MNI_ERROR_FAILED_TO_OPEN_JOURNAL:          return L"MNI_ERROR_FAILED_TO_OPEN_JOURNAL";
     }
 
     return L"MNI_UNKNOWN_ERROR_CODE";
@@ -2504,25 +9434,123 @@ const wchar_t *MniErrorToString(MniError error) {
 
 // ========================================================================== //
 
+MniError MniGetDefaultBackend(MniBackend *backend) {
+    MNI_TRACE(L"MniGetDefaultBackend(backend=%p)", backend);
+
+    if (!backend) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *backend = (MniBackend){
+        .context        = NULL,
+        .notify_icon    = _MniWin32NotifyIcon,
+        .create_window  = _MniWin32CreateWindow,
+        .destroy_window = _MniWin32DestroyWindow,
+        .send_message   = _MniWin32SendMessage,
+        .post_message   = _MniWin32PostMessage,
+        .set_timer      = _MniWin32SetTimer,
+        .kill_timer     = _MniWin32KillTimer,
+    };
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniInitRecorder(MniRecorder *recorder, MniRecord *records, int capacity) {
+    MNI_TRACE(L"MniInitRecorder(recorder=%p, records=%p, capacity=%d)", recorder, records, capacity);
+
+    if (!recorder || capacity < 0 || (!records && capacity > 0)) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->records = records;
+    recorder->capacity = (LONG)capacity;
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniResetRecorder(MniRecorder *recorder) {
+    MNI_TRACE(L"MniResetRecorder(recorder=%p)", recorder);
+
+    if (!recorder) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    InterlockedExchange(&recorder->count, 0);
+    InterlockedExchange(&recorder->total_count, 0);
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+MniError MniGetRecordingBackend(MniRecorder *recorder, MniBackend *backend) {
+    MNI_TRACE(L"MniGetRecordingBackend(recorder=%p, backend=%p)", recorder, backend);
+
+    if (!recorder || !backend) {
+        return MNI_ERROR_INVALID_ARGUMENT;
+    }
+
+    *backend = (MniBackend){
+        .context        = recorder,
+        .notify_icon    = _MniRecorderNotifyIcon,
+        .create_window  = _MniRecorderCreateWindow,
+        .destroy_window = _MniRecorderDestroyWindow,
+        .send_message   = _MniRecorderSendMessage,
+        .post_message   = _MniRecorderPostMessage,
+        .set_timer      = _MniRecorderSetTimer,
+        .kill_timer     = _MniRecorderKillTimer,
+    };
+
+    return MNI_OK;
+}
+
+// ========================================================================== //
+
+LRESULT MniDispatchMessage(ModernNotifyIcon *mni, UINT msg, WPARAM wParam, LPARAM lParam) {
+    MNI_TRACE2(L"MniDispatchMessage(mni=%p, msg=0x%04x)", mni, msg);
+    MNI_ASSERT(mni && "mni ptr is null");
+
+    if (!mni) {
+        return 0;
+    }
+
+    return _MniDispatch(mni, mni->window_handle, msg, wParam, lParam);
+}
+
+// ========================================================================== //
+
 int MniRunMessageLoop(void) {
     MNI_TRACE(L"MniRunMessageLoop()");
     MSG msg;
 
     while (1) {
-        MniBool ret = GetMessage(&msg, NULL, 0, 0);
-        if (ret == -1) {
+        // Alertable wait runs completion routines of high resolution timers.
+        DWORD ret = MsgWaitForMultipleObjectsEx(
+            0,
+            NULL,
+            INFINITE,
+            QS_ALLINPUT,
+            MWMO_ALERTABLE | MWMO_INPUTAVAILABLE
+        );
+
+        if (ret == WAIT_FAILED) {
             return -1;
         }
 
-        if (ret == MNI_FALSE) {
-            break;
-        } 
-        
-        TranslateMessage(&msg); 
-        DispatchMessageW(&msg);
-    }
+        while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                return (int)(msg.wParam);
+            }
 
-    return (int)(msg.wParam);
+            TranslateMessage(&msg);
+            DispatchMessageW(&msg);
+        }
+    }
 }
 
 // ========================================================================== //
@@ -2544,13 +9572,8 @@ MniError MniSetTipUTF8(ModernNotifyIcon *mni, const char *tip) {
 
     // Convert tip.
     wchar_t tip_buffer[128];
-    if (!tip) {
-        tip_buffer[0] = L'\0';
-    } else {
-        MniBool ret = _UTF8ToUTF16(tip, tip_buffer, ARRAYSIZE(tip_buffer));
-        if (ret == MNI_FALSE) {
-            return MNI_ERROR_FAILED_TO_CONVERT_TIP;
-        }
+    if (!_UTF8ToUTF16(tip, tip_buffer, ARRAYSIZE(tip_buffer))) {
+        return MNI_ERROR_FAILED_TO_CONVERT_TIP;
     }
 
     return MniSetTip(mni, tip_buffer);
@@ -2634,29 +9657,27 @@ MniError MniSendBalloonNotificationUTF8(
         return MNI_ERROR_MNI_PTR_IS_NULL;
     }
 
-    // Convert title.
-    wchar_t title_buffer[64];
-    if (!title) {
-        title_buffer[0] = L'\0';
-    } else {
-        MniBool ret = _UTF8ToUTF16(title, title_buffer, ARRAYSIZE(title_buffer));
-        if (ret == MNI_FALSE) {
-            return MNI_ERROR_FAILED_TO_CONVERT_TITLE;
-        }
+    if (!mni->icon_created) {
+        return MNI_ERROR_ICON_NOT_CREATED;
     }
 
-    // Convert text.
-    wchar_t text_buffer[256];
-    if (!text) {
-        text_buffer[0] = L'\0';
-    } else {
-        MniBool ret = _UTF8ToUTF16(title, text_buffer, ARRAYSIZE(text_buffer));
-        if (ret == MNI_FALSE) {
-            return MNI_ERROR_FAILED_TO_CONVERT_TEXT;
-        }
+    NOTIFYICONDATAW nid;
+    _MniBalloonData(mni, icon_type, icon, flags, &nid);
+
+    // Converted straight into the balloon, no intermediate buffers.
+    if (!_UTF8ToUTF16(title, nid.szInfoTitle, ARRAYSIZE(nid.szInfoTitle))) {
+        return MNI_ERROR_FAILED_TO_CONVERT_TITLE;
+    }
+
+    if (!_UTF8ToUTF16(text, nid.szInfo, ARRAYSIZE(nid.szInfo))) {
+        return MNI_ERROR_FAILED_TO_CONVERT_TEXT;
     }
 
-    return MniSendBalloonNotification(mni, title_buffer, text_buffer, icon_type, icon, flags);
+    if (!_MniBackendNotifyIcon(mni, NIM_MODIFY, &nid)) {
+        return MNI_ERROR_FAILED_TO_SHOW_BALLOON;
+    }
+
+    return MNI_OK;
 }
 
 // ========================================================================== //
@@ -2669,6 +9690,10 @@ const char *MniErrorToStringUTF8(MniError error) {
     case MNI_ICON_ALREADY_CREATED:                  return "MNI_ICON_ALREADY_CREATED";
     case MNI_ICON_ALREADY_SHOWN:                    return "MNI_ICON_ALREADY_SHOWN";
     case MNI_ICON_ALREADY_HIDDEN:                   return "MNI_ICON_ALREADY_HIDDEN";
+    case MNI_SHELL_WORKER_ALREADY_RUNNING:          return "MNI_SHELL_WORKER_ALREADY_RUNNING";
+    case MNI_SHELL_WORKER_NOT_RUNNING:              return "MNI_SHELL_WORKER_NOT_RUNNING";
+    case MNI_NOTIFICATION_DEDUPLICATED:             return "MNI_NOTIFICATION_DEDUPLICATED";
+    case MNI_COMMANDS_DROPPED:                      return "MNI_COMMANDS_DROPPED";
 
     case MNI_ERROR_MNI_PTR_IS_NULL:                 return "MNI_ERROR_MNI_PTR_IS_NULL";
     case MNI_ERROR_UNSUPPORTED_VERSION:             return "MNI_ERROR_UNSUPPORTED_VERSION";
@@ -2700,6 +9725,36 @@ const char *MniErrorToStringUTF8(MniError error) {
     case MNI_ERROR_FAILED_TO_CONVERT_TEXT:          return "MNI_ERROR_FAILED_TO_CONVERT_TEXT";
     case MNI_ERROR_FAILED_TO_SEND_MESSAGE:          return "MNI_ERROR_FAILED_TO_SEND_MESSAGE";
     case MNI_ERROR_FAILED_TO_POST_MESSAGE:          return "MNI_ERROR_FAILED_TO_POST_MESSAGE";
+    case MNI_ERROR_FAILED_TO_UPDATE_ICON:           return "MNI_ERROR_FAILED_TO_UPDATE_ICON";
+    case MNI_ERROR_UPDATE_NOT_STARTED:              return "MNI_ERROR_UPDATE_NOT_STARTED";
+    case MNI_ERROR_FAILED_TO_START_THREAD:          return "MNI_ERROR_FAILED_TO_START_THREAD";
+    case MNI_ERROR_OUT_OF_MEMORY:                   return "MNI_ERROR_OUT_OF_MEMORY";
+    case MNI_ERROR_QUEUE_FULL:                      return "MNI_ERROR_QUEUE_FULL";
+    case MNI_ERROR_QUEUE_NOT_CREATED:               return "MNI_ERROR_QUEUE_NOT_CREATED";
+    case MNI_ERROR_THREAD_NOT_RUNNING:              return "MNI_ERROR_THREAD_NOT_RUNNING";
+    case MNI_ERROR_INVALID_HOST:                    return "MNI_ERROR_INVALID_HOST";
+    case MNI_ERROR_INVALID_MESSAGE_RANGE:           return "MNI_ERROR_INVALID_MESSAGE_RANGE";
+    case MNI_ERROR_INVALID_ANIMATION:               return "MNI_ERROR_INVALID_ANIMATION";
+    case MNI_ERROR_INVALID_ICON_SOURCE:             return "MNI_ERROR_INVALID_ICON_SOURCE";
+    case MNI_ERROR_FAILED_TO_LOAD_ICON:             return "MNI_ERROR_FAILED_TO_LOAD_ICON";
+    case MNI_ERROR_INVALID_PIXELS:                  return "MNI_ERROR_INVALID_PIXELS";
+    case MNI_ERROR_INVALID_ICON_POOL_BUDGET:        return "MNI_ERROR_INVALID_ICON_POOL_BUDGET";
+    case MNI_ERROR_INVALID_ICON_POOL_STATS:         return "MNI_ERROR_INVALID_ICON_POOL_STATS";
+    case MNI_ERROR_INVALID_ICON_UPDATE_STATS:       return "MNI_ERROR_INVALID_ICON_UPDATE_STATS";
+    case MNI_ERROR_INVALID_BADGE:                   return "MNI_ERROR_INVALID_BADGE";
+    case MNI_ERROR_INVALID_PROGRESS:                return "MNI_ERROR_INVALID_PROGRESS";
+    case MNI_ERROR_FAILED_TO_RENDER_OVERLAY:        return "MNI_ERROR_FAILED_TO_RENDER_OVERLAY";
+    case MNI_ERROR_INVALID_GRAPH:                   return "MNI_ERROR_INVALID_GRAPH";
+    case MNI_ERROR_FAILED_TO_RENDER_GRAPH:          return "MNI_ERROR_FAILED_TO_RENDER_GRAPH";
+    case MNI_ERROR_GRAPH_NOT_STARTED:               return "MNI_ERROR_GRAPH_NOT_STARTED";
+    case MNI_ERROR_INVALID_TEXT:                    return "MNI_ERROR_INVALID_TEXT";
+    case MNI_ERROR_FAILED_TO_RENDER_TEXT:           return "MNI_ERROR_FAILED_TO_RENDER_TEXT";
+    case MNI_ERROR_FAILED_TO_OPEN_ICON_PACK:        return "MNI_ERROR_FAILED_TO_OPEN_ICON_PACK";
+    case MNI_ERROR_INVALID_ICON_PACK:               return "MNI_ERROR_INVALID_ICON_PACK";
+    case MNI_ERROR_ICON_NOT_IN_PACK:                return "MNI_ERROR_ICON_NOT_IN_PACK";
+    case MNI_ERROR_FAILED_TO_DECODE_ICON:           return "MNI_ERROR_FAILED_TO_DECODE_ICON";
+    case MNI_ERROR_NOTIFICATION_QUEUE_NOT_CREATED:  return "MNI_ERROR_NOTIFICATION_QUEUE_NOT_CREATED";
+    case MNI_ERROR_FAILED_TO_OPEN_JOURNAL:          return "MNI_ERROR_FAILED_TO_OPEN_JOURNAL";
 
     }
 
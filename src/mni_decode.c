@@ -0,0 +1,1054 @@
+#include "mni_decode.h"
+#include "mni_pixels.h"
+
+#include <string.h>     // memcmp, memcpy, memset
+
+// ========================================================================== //
+
+#pragma region Helpers
+
+static uint32_t _MniDecodeRead16(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+// ========================================================================== //
+
+static uint32_t _MniDecodeRead32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ========================================================================== //
+
+static uint32_t _MniDecodeRead32BE(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// ========================================================================== //
+
+static const uint8_t _mni_png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+static int _MniDecodeIsPng(const uint8_t *data, size_t size) {
+    return size >= 8 && memcmp(data, _mni_png_signature, 8) == 0;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Bitmap
+
+typedef struct MniDib {
+    int         width;
+    int         height;
+    int         top_down;
+    uint32_t    bpp;
+    uint32_t    masks[4];           // red, green, blue, alpha of 32-bit bitfields
+    int         bitfields;
+    size_t      palette_offset;
+    uint32_t    palette_count;
+    size_t      pixels_offset;
+    size_t      stride;
+    size_t      mask_offset;        // AND mask of ICO image, 0 when none
+    size_t      mask_stride;
+} MniDib;
+
+// Parses bitmap header at offset header, pixels_offset is where bitmap file says pixels
+// start, 0 means right after palette.
+static MniDecodeStatus _MniDibParse(const uint8_t *data, size_t size, size_t header, size_t pixels_offset, int is_ico, MniDib *dib) {
+    if (size < header || size - header < 40) {
+        return MNI_DECODE_CORRUPT;
+    }
+
+    const uint8_t *p = data + header;
+    uint32_t header_size = _MniDecodeRead32(p);
+    if (header_size < 40 || header_size > size - header) {
+        return header_size == 12 ? MNI_DECODE_UNSUPPORTED : MNI_DECODE_CORRUPT;
+    }
+
+    int32_t width = (int32_t)_MniDecodeRead32(p + 4);
+    int32_t height = (int32_t)_MniDecodeRead32(p + 8);
+    uint32_t bpp = _MniDecodeRead16(p + 14);
+    uint32_t compression = _MniDecodeRead32(p + 16);
+    uint32_t colors_used = _MniDecodeRead32(p + 32);
+
+    memset(dib, 0, sizeof(*dib));
+
+    // ICO stores height of color and mask together.
+    if (is_ico) {
+        height /= 2;
+    }
+
+    // Negative height means top-down rows, INT32_MIN can't be negated.
+    if (height < 0 && !is_ico) {
+        if (height < -MNI_PIXELS_MAX_SIZE) {
+            return MNI_DECODE_TOO_LARGE;
+        }
+        dib->top_down = 1;
+        height = -height;
+    }
+
+    if (width <= 0 || height <= 0) {
+        return MNI_DECODE_CORRUPT;
+    }
+
+    if (width > MNI_PIXELS_MAX_SIZE || height > MNI_PIXELS_MAX_SIZE) {
+        return MNI_DECODE_TOO_LARGE;
+    }
+
+    dib->width = width;
+    dib->height = height;
+    dib->bpp = bpp;
+
+    size_t masks_size = 0;
+    if (compression == 3 && bpp == 32) {
+        // Masks follow 40-byte header, newer headers contain them. Headers between those
+        // sizes don't, masks are then read past the header and still have to be in data.
+        const uint8_t *masks = p + 40;
+        if (header_size == 40) {
+            masks_size = 12;
+        }
+        if (size - header - 40 < 12) {
+            return MNI_DECODE_CORRUPT;
+        }
+
+        dib->bitfields = 1;
+        dib->masks[0] = _MniDecodeRead32(masks);
+        dib->masks[1] = _MniDecodeRead32(masks + 4);
+        dib->masks[2] = _MniDecodeRead32(masks + 8);
+        dib->masks[3] = header_size >= 56 ? _MniDecodeRead32(masks + 12) : 0;
+    } else if (compression != 0) {
+        return MNI_DECODE_UNSUPPORTED;
+    }
+
+    if (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 24 && bpp != 32) {
+        return MNI_DECODE_UNSUPPORTED;
+    }
+
+    if (bpp <= 8) {
+        dib->palette_count = colors_used ? colors_used : (1u << bpp);
+        if (dib->palette_count > (1u << bpp)) {
+            return MNI_DECODE_CORRUPT;
+        }
+    }
+
+    dib->palette_offset = header + header_size + masks_size;
+    size_t palette_end = dib->palette_offset + (size_t)dib->palette_count * 4;
+
+    dib->pixels_offset = pixels_offset ? pixels_offset : palette_end;
+    dib->stride = ((size_t)width * bpp + 31) / 32 * 4;
+
+    // Offset comes from the file, sums are checked as differences so 32-bit size_t can't wrap.
+    if (palette_end > size || dib->pixels_offset < palette_end || dib->pixels_offset > size ||
+        dib->stride * (size_t)height > size - dib->pixels_offset)
+    {
+        return MNI_DECODE_CORRUPT;
+    }
+
+    size_t end = dib->pixels_offset + dib->stride * (size_t)height;
+
+    // Some ICO writers leave the mask out of 32-bit images, alpha is used then.
+    dib->mask_stride = ((size_t)width + 31) / 32 * 4;
+    if (is_ico && dib->mask_stride * (size_t)height <= size - end) {
+        dib->mask_offset = end;
+    } else if (is_ico && bpp != 32) {
+        return MNI_DECODE_CORRUPT;
+    }
+
+    return MNI_DECODE_OK;
+}
+
+// ========================================================================== //
+
+static uint32_t _MniDibChannel(uint32_t value, uint32_t mask) {
+    if (!mask) {
+        return 0;
+    }
+
+    int shift = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        shift += 1;
+    }
+
+    value = (value >> shift) & mask;
+    return mask == 0xFF ? value : (uint32_t)((uint64_t)value * 255 / mask);
+}
+
+// ========================================================================== //
+
+static MniDecodeStatus _MniDibDecode(const uint8_t *data, size_t size, const MniDib *dib, uint32_t *pixels) {
+    (void)size;
+
+    int has_alpha = 0;
+
+    for (int y = 0; y < dib->height; y += 1) {
+        int row_index = dib->top_down ? y : dib->height - 1 - y;
+        const uint8_t *row = data + dib->pixels_offset + dib->stride * (size_t)row_index;
+        uint32_t *out = pixels + (size_t)y * (size_t)dib->width;
+
+        for (int x = 0; x < dib->width; x += 1) {
+            uint32_t pixel;
+
+            switch (dib->bpp) {
+                case 32:
+                    pixel = _MniDecodeRead32(row + x * 4);
+                    if (dib->bitfields) {
+                        pixel = (_MniDibChannel(pixel, dib->masks[3]) << 24) |
+                                (_MniDibChannel(pixel, dib->masks[0]) << 16) |
+                                (_MniDibChannel(pixel, dib->masks[1]) << 8) |
+                                _MniDibChannel(pixel, dib->masks[2]);
+                    }
+                    break;
+
+                case 24:
+                    pixel = _MniDecodeRead16(row + x * 3) | ((uint32_t)row[x * 3 + 2] << 16);
+                    break;
+
+                default: {
+                    uint32_t bit = (uint32_t)x * dib->bpp;
+                    uint32_t index = (row[bit / 8] >> (8 - dib->bpp - bit % 8)) & ((1u << dib->bpp) - 1);
+                    if (index >= dib->palette_count) {
+                        return MNI_DECODE_CORRUPT;
+                    }
+                    pixel = _MniDecodeRead32(data + dib->palette_offset + index * 4) & 0x00FFFFFF;
+                    break;
+                }
+            }
+
+            has_alpha |= (pixel >> 24) != 0;
+            out[x] = pixel;
+        }
+    }
+
+    // Without alpha channel the AND mask, or nothing for bitmap files, decides transparency.
+    if (dib->bpp != 32 || !has_alpha) {
+        for (int y = 0; y < dib->height; y += 1) {
+            int row_index = dib->top_down ? y : dib->height - 1 - y;
+            const uint8_t *mask = dib->mask_offset ? data + dib->mask_offset + dib->mask_stride * (size_t)row_index : NULL;
+            uint32_t *out = pixels + (size_t)y * (size_t)dib->width;
+
+            for (int x = 0; x < dib->width; x += 1) {
+                int transparent = mask && ((mask[x / 8] >> (7 - x % 8)) & 1);
+                out[x] = transparent ? 0 : (out[x] | 0xFF000000);
+            }
+        }
+    }
+
+    _MniPixelsPremultiply(pixels, pixels, (size_t)dib->width * (size_t)dib->height, 0);
+
+    return MNI_DECODE_OK;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Inflate
+
+// Inflate of zlib stream into buffer of known size, enough for PNG.
+
+typedef struct MniInflate {
+    const uint8_t   *in;
+    size_t          in_size;
+    size_t          in_pos;
+    uint32_t        bits;
+    int             bit_count;
+    uint8_t         *out;
+    size_t          out_size;
+    size_t          out_pos;
+} MniInflate;
+
+typedef struct MniHuffman {
+    uint16_t        counts[16];     // codes of each length
+    uint16_t        symbols[288];   // ordered by code
+} MniHuffman;
+
+static const uint16_t _mni_length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t _mni_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t _mni_distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t _mni_distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static int _MniInflateBits(MniInflate *s, int count, uint32_t *value) {
+    while (s->bit_count < count) {
+        if (s->in_pos >= s->in_size) {
+            return 0;
+        }
+        s->bits |= (uint32_t)s->in[s->in_pos++] << s->bit_count;
+        s->bit_count += 8;
+    }
+
+    *value = s->bits & ((1u << count) - 1);
+    s->bits >>= count;
+    s->bit_count -= count;
+
+    return 1;
+}
+
+// ========================================================================== //
+
+// Canonical code from code lengths. Incomplete codes are allowed, over-subscribed aren't.
+static int _MniHuffmanBuild(MniHuffman *h, const uint8_t *lengths, int count) {
+    uint16_t offsets[16];
+
+    memset(h->counts, 0, sizeof(h->counts));
+    for (int i = 0; i < count; i += 1) {
+        h->counts[lengths[i]] += 1;
+    }
+    h->counts[0] = 0;
+
+    int left = 1;
+    for (int length = 1; length < 16; length += 1) {
+        left = (left << 1) - h->counts[length];
+        if (left < 0) {
+            return 0;
+        }
+    }
+
+    offsets[1] = 0;
+    for (int length = 1; length < 15; length += 1) {
+        offsets[length + 1] = (uint16_t)(offsets[length] + h->counts[length]);
+    }
+
+    for (int i = 0; i < count; i += 1) {
+        if (lengths[i]) {
+            h->symbols[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+
+    return 1;
+}
+
+// ========================================================================== //
+
+static int _MniHuffmanDecode(MniInflate *s, const MniHuffman *h) {
+    int code = 0;
+    int first = 0;
+    int index = 0;
+
+    for (int length = 1; length < 16; length += 1) {
+        uint32_t bit;
+        if (!_MniInflateBits(s, 1, &bit)) {
+            return -1;
+        }
+
+        code |= (int)bit;
+        int count = h->counts[length];
+        if (code - first < count) {
+            return h->symbols[index + code - first];
+        }
+
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+// ========================================================================== //
+
+static int _MniInflateStored(MniInflate *s) {
+    // Rest of current byte is padding.
+    s->bits >>= s->bit_count % 8;
+    s->bit_count -= s->bit_count % 8;
+
+    uint32_t length;
+    uint32_t complement;
+    if (!_MniInflateBits(s, 16, &length) || !_MniInflateBits(s, 16, &complement) || (length ^ 0xFFFF) != complement) {
+        return 0;
+    }
+
+    if (length > s->out_size - s->out_pos) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < length; i += 1) {
+        uint32_t byte;
+        if (!_MniInflateBits(s, 8, &byte)) {
+            return 0;
+        }
+        s->out[s->out_pos++] = (uint8_t)byte;
+    }
+
+    return 1;
+}
+
+// ========================================================================== //
+
+static int _MniInflateCodes(MniInflate *s, const MniHuffman *literals, const MniHuffman *distances) {
+    for (;;) {
+        int symbol = _MniHuffmanDecode(s, literals);
+        if (symbol < 0) {
+            return 0;
+        }
+
+        if (symbol < 256) {
+            if (s->out_pos >= s->out_size) {
+                return 0;
+            }
+            s->out[s->out_pos++] = (uint8_t)symbol;
+            continue;
+        }
+
+        if (symbol == 256) {
+            return 1;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            return 0;
+        }
+
+        uint32_t extra;
+        if (!_MniInflateBits(s, _mni_length_extra[symbol], &extra)) {
+            return 0;
+        }
+        size_t length = _mni_length_base[symbol] + extra;
+
+        symbol = _MniHuffmanDecode(s, distances);
+        if (symbol < 0 || symbol >= 30 || !_MniInflateBits(s, _mni_distance_extra[symbol], &extra)) {
+            return 0;
+        }
+        size_t distance = _mni_distance_base[symbol] + extra;
+
+        if (distance > s->out_pos || length > s->out_size - s->out_pos) {
+            return 0;
+        }
+
+        // Byte by byte, source may overlap what is being written.
+        for (size_t i = 0; i < length; i += 1) {
+            s->out[s->out_pos] = s->out[s->out_pos - distance];
+            s->out_pos += 1;
+        }
+    }
+}
+
+// ========================================================================== //
+
+static int _MniInflateFixed(MniInflate *s) {
+    MniHuffman literals;
+    MniHuffman distances;
+    uint8_t lengths[288];
+
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    _MniHuffmanBuild(&literals, lengths, 288);
+
+    memset(lengths, 5, 30);
+    _MniHuffmanBuild(&distances, lengths, 30);
+
+    return _MniInflateCodes(s, &literals, &distances);
+}
+
+// ========================================================================== //
+
+static int _MniInflateDynamic(MniInflate *s) {
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    uint32_t literal_count;
+    uint32_t distance_count;
+    uint32_t code_count;
+    if (!_MniInflateBits(s, 5, &literal_count) || !_MniInflateBits(s, 5, &distance_count) || !_MniInflateBits(s, 4, &code_count)) {
+        return 0;
+    }
+
+    literal_count += 257;
+    distance_count += 1;
+    code_count += 4;
+    if (literal_count > 286 || distance_count > 30) {
+        return 0;
+    }
+
+    uint8_t lengths[286 + 30] = { 0 };
+    for (uint32_t i = 0; i < code_count; i += 1) {
+        uint32_t length;
+        if (!_MniInflateBits(s, 3, &length)) {
+            return 0;
+        }
+        lengths[order[i]] = (uint8_t)length;
+    }
+
+    MniHuffman codes;
+    if (!_MniHuffmanBuild(&codes, lengths, 19)) {
+        return 0;
+    }
+
+    uint32_t total = literal_count + distance_count;
+    uint32_t i = 0;
+    while (i < total) {
+        int symbol = _MniHuffmanDecode(s, &codes);
+        if (symbol < 0) {
+            return 0;
+        }
+
+        if (symbol < 16) {
+            lengths[i++] = (uint8_t)symbol;
+            continue;
+        }
+
+        uint32_t repeat;
+        uint8_t value = 0;
+        if (symbol == 16) {
+            if (i == 0 || !_MniInflateBits(s, 2, &repeat)) {
+                return 0;
+            }
+            value = lengths[i - 1];
+            repeat += 3;
+        } else if (symbol == 17) {
+            if (!_MniInflateBits(s, 3, &repeat)) {
+                return 0;
+            }
+            repeat += 3;
+        } else {
+            if (!_MniInflateBits(s, 7, &repeat)) {
+                return 0;
+            }
+            repeat += 11;
+        }
+
+        if (repeat > total - i) {
+            return 0;
+        }
+
+        while (repeat--) {
+            lengths[i++] = value;
+        }
+    }
+
+    // End of block code has to exist.
+    if (lengths[256] == 0) {
+        return 0;
+    }
+
+    MniHuffman literals;
+    MniHuffman distances;
+    if (!_MniHuffmanBuild(&literals, lengths, (int)literal_count) ||
+        !_MniHuffmanBuild(&distances, lengths + literal_count, (int)distance_count))
+    {
+        return 0;
+    }
+
+    return _MniInflateCodes(s, &literals, &distances);
+}
+
+// ========================================================================== //
+
+// Stream has to fill out exactly.
+static int _MniInflateZlib(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size) {
+    if (in_size < 2 || (in[0] & 0x0F) != 8 || (in[0] >> 4) > 7 || (in[1] & 0x20) || ((in[0] << 8) | in[1]) % 31) {
+        return 0;
+    }
+
+    MniInflate s = {
+        .in = in,
+        .in_size = in_size,
+        .in_pos = 2,
+        .out = out,
+        .out_size = out_size,
+    };
+
+    uint32_t last = 0;
+    while (!last) {
+        uint32_t type;
+        if (!_MniInflateBits(&s, 1, &last) || !_MniInflateBits(&s, 2, &type)) {
+            return 0;
+        }
+
+        int ok;
+        switch (type) {
+            case 0:  ok = _MniInflateStored(&s); break;
+            case 1:  ok = _MniInflateFixed(&s); break;
+            case 2:  ok = _MniInflateDynamic(&s); break;
+            default: ok = 0; break;
+        }
+
+        if (!ok) {
+            return 0;
+        }
+    }
+
+    return s.out_pos == out_size;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Png
+
+typedef struct MniPng {
+    int         width;
+    int         height;
+    uint32_t    depth;
+    uint32_t    color_type;
+    uint32_t    channels;
+    size_t      row_size;           // without filter byte
+    size_t      raw_size;           // filtered rows with filter bytes
+    size_t      compressed_size;    // of all IDAT chunks
+    size_t      palette_offset;
+    uint32_t    palette_count;
+    size_t      transparency_offset;
+    uint32_t    transparency_size;
+} MniPng;
+
+static MniDecodeStatus _MniPngParse(const uint8_t *data, size_t size, MniPng *png) {
+    memset(png, 0, sizeof(*png));
+
+    if (!_MniDecodeIsPng(data, size)) {
+        return MNI_DECODE_UNKNOWN_FORMAT;
+    }
+
+    size_t offset = 8;
+    int has_header = 0;
+    int has_end = 0;
+
+    while (!has_end) {
+        if (size - offset < 12) {
+            return MNI_DECODE_CORRUPT;
+        }
+
+        uint32_t length = _MniDecodeRead32BE(data + offset);
+        const uint8_t *type = data + offset + 4;
+        const uint8_t *chunk = data + offset + 8;
+
+        if (length > size - offset - 12) {
+            return MNI_DECODE_CORRUPT;
+        }
+
+        if (!has_header && memcmp(type, "IHDR", 4) != 0) {
+            return MNI_DECODE_CORRUPT;
+        }
+
+        if (memcmp(type, "IHDR", 4) == 0) {
+            if (has_header || length != 13) {
+                return MNI_DECODE_CORRUPT;
+            }
+            has_header = 1;
+
+            uint32_t width = _MniDecodeRead32BE(chunk);
+            uint32_t height = _MniDecodeRead32BE(chunk + 4);
+            png->depth = chunk[8];
+            png->color_type = chunk[9];
+
+            if (width == 0 || height == 0 || chunk[10] != 0 || chunk[11] != 0) {
+                return MNI_DECODE_CORRUPT;
+            }
+
+            if (width > MNI_PIXELS_MAX_SIZE || height > MNI_PIXELS_MAX_SIZE) {
+                return MNI_DECODE_TOO_LARGE;
+            }
+
+            if (chunk[12] != 0) {
+                return MNI_DECODE_UNSUPPORTED;
+            }
+
+            png->width = (int)width;
+            png->height = (int)height;
+
+            // Allowed depths per color type.
+            switch (png->color_type) {
+                case 0:  png->channels = 1; if (png->depth != 1 && png->depth != 2 && png->depth != 4 && png->depth != 8 && png->depth != 16) return MNI_DECODE_CORRUPT; break;
+                case 3:  png->channels = 1; if (png->depth != 1 && png->depth != 2 && png->depth != 4 && png->depth != 8) return MNI_DECODE_CORRUPT; break;
+                case 2:  png->channels = 3; if (png->depth != 8 && png->depth != 16) return MNI_DECODE_CORRUPT; break;
+                case 4:  png->channels = 2; if (png->depth != 8 && png->depth != 16) return MNI_DECODE_CORRUPT; break;
+                case 6:  png->channels = 4; if (png->depth != 8 && png->depth != 16) return MNI_DECODE_CORRUPT; break;
+                default: return MNI_DECODE_CORRUPT;
+            }
+
+            png->row_size = ((size_t)png->width * png->channels * png->depth + 7) / 8;
+            png->raw_size = (png->row_size + 1) * (size_t)png->height;
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            if (length % 3 || length / 3 > 256) {
+                return MNI_DECODE_CORRUPT;
+            }
+            png->palette_offset = offset + 8;
+            png->palette_count = length / 3;
+        } else if (memcmp(type, "tRNS", 4) == 0) {
+            png->transparency_offset = offset + 8;
+            png->transparency_size = length;
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            png->compressed_size += length;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            has_end = 1;
+        }
+
+        offset += 12 + (size_t)length;
+    }
+
+    if (png->compressed_size == 0 || (png->color_type == 3 && png->palette_count == 0)) {
+        return MNI_DECODE_CORRUPT;
+    }
+
+    return MNI_DECODE_OK;
+}
+
+// ========================================================================== //
+
+static uint8_t _MniPngPaeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = (int)a + (int)b - (int)c;
+    int pa = p > a ? p - a : a - p;
+    int pb = p > b ? p - b : b - p;
+    int pc = p > c ? p - c : c - p;
+
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// ========================================================================== //
+
+// Unfilters rows in place, row y ends up at raw + y * (row_size + 1) + 1.
+static int _MniPngUnfilter(const MniPng *png, uint8_t *raw) {
+    size_t step = (png->channels * png->depth + 7) / 8;
+    const uint8_t *previous = NULL;
+
+    for (int y = 0; y < png->height; y += 1) {
+        uint8_t *row = raw + (size_t)y * (png->row_size + 1);
+        uint8_t filter = row[0];
+        row += 1;
+
+        for (size_t i = 0; i < png->row_size; i += 1) {
+            uint8_t a = i >= step ? row[i - step] : 0;
+            uint8_t b = previous ? previous[i] : 0;
+            uint8_t c = previous && i >= step ? previous[i - step] : 0;
+
+            switch (filter) {
+                case 0:  break;
+                case 1:  row[i] = (uint8_t)(row[i] + a); break;
+                case 2:  row[i] = (uint8_t)(row[i] + b); break;
+                case 3:  row[i] = (uint8_t)(row[i] + ((a + b) >> 1)); break;
+                case 4:  row[i] = (uint8_t)(row[i] + _MniPngPaeth(a, b, c)); break;
+                default: return 0;
+            }
+        }
+
+        previous = row;
+    }
+
+    return 1;
+}
+
+// ========================================================================== //
+
+// Sample at full depth, 16-bit samples are big endian.
+static uint32_t _MniPngSample(const MniPng *png, const uint8_t *row, size_t index) {
+    switch (png->depth) {
+        case 16: return ((uint32_t)row[index * 2] << 8) | row[index * 2 + 1];
+        case 8:  return row[index];
+        default: {
+            size_t bit = index * png->depth;
+            return (row[bit / 8] >> (8 - png->depth - bit % 8)) & ((1u << png->depth) - 1);
+        }
+    }
+}
+
+// ========================================================================== //
+
+static uint32_t _MniPngTo8(const MniPng *png, uint32_t sample) {
+    if (png->depth == 16) {
+        return sample >> 8;
+    }
+    return sample * 255 / ((1u << png->depth) - 1);
+}
+
+// ========================================================================== //
+
+static MniDecodeStatus _MniPngDecode(const uint8_t *data, size_t size, uint32_t *pixels, uint8_t *scratch) {
+    MniPng png;
+    MniDecodeStatus status = _MniPngParse(data, size, &png);
+    if (status != MNI_DECODE_OK) {
+        return status;
+    }
+
+    // IDAT chunks are joined first, zlib stream may be split anywhere.
+    uint8_t *compressed = scratch;
+    uint8_t *raw = scratch + png.compressed_size;
+    size_t joined = 0;
+
+    for (size_t offset = 8; offset + 12 <= size;) {
+        uint32_t length = _MniDecodeRead32BE(data + offset);
+        if (memcmp(data + offset + 4, "IDAT", 4) == 0) {
+            memcpy(compressed + joined, data + offset + 8, length);
+            joined += length;
+        } else if (memcmp(data + offset + 4, "IEND", 4) == 0) {
+            break;
+        }
+        offset += 12 + (size_t)length;
+    }
+
+    if (!_MniInflateZlib(compressed, joined, raw, png.raw_size) || !_MniPngUnfilter(&png, raw)) {
+        return MNI_DECODE_CORRUPT;
+    }
+
+    const uint8_t *palette = data + png.palette_offset;
+    const uint8_t *transparency = png.transparency_size ? data + png.transparency_offset : NULL;
+
+    // Color key of gray and truecolor images, compared at full depth.
+    uint32_t key[3] = { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF };
+    if (transparency && png.color_type == 0 && png.transparency_size >= 2) {
+        key[0] = ((uint32_t)transparency[0] << 8) | transparency[1];
+    } else if (transparency && png.color_type == 2 && png.transparency_size >= 6) {
+        for (int c = 0; c < 3; c += 1) {
+            key[c] = ((uint32_t)transparency[c * 2] << 8) | transparency[c * 2 + 1];
+        }
+    }
+
+    for (int y = 0; y < png.height; y += 1) {
+        const uint8_t *row = raw + (size_t)y * (png.row_size + 1) + 1;
+        uint32_t *out = pixels + (size_t)y * (size_t)png.width;
+
+        for (int x = 0; x < png.width; x += 1) {
+            size_t index = (size_t)x * png.channels;
+            uint32_t r, g, b, a = 255;
+
+            switch (png.color_type) {
+                case 0: {
+                    uint32_t gray = _MniPngSample(&png, row, index);
+                    a = gray == key[0] ? 0 : 255;
+                    r = g = b = _MniPngTo8(&png, gray);
+                    break;
+                }
+
+                case 2: {
+                    uint32_t sr = _MniPngSample(&png, row, index);
+                    uint32_t sg = _MniPngSample(&png, row, index + 1);
+                    uint32_t sb = _MniPngSample(&png, row, index + 2);
+                    a = sr == key[0] && sg == key[1] && sb == key[2] ? 0 : 255;
+                    r = _MniPngTo8(&png, sr);
+                    g = _MniPngTo8(&png, sg);
+                    b = _MniPngTo8(&png, sb);
+                    break;
+                }
+
+                case 3: {
+                    uint32_t entry = _MniPngSample(&png, row, index);
+                    if (entry >= png.palette_count) {
+                        return MNI_DECODE_CORRUPT;
+                    }
+                    r = palette[entry * 3];
+                    g = palette[entry * 3 + 1];
+                    b = palette[entry * 3 + 2];
+                    a = transparency && entry < png.transparency_size ? transparency[entry] : 255;
+                    break;
+                }
+
+                case 4:
+                    r = g = b = _MniPngTo8(&png, _MniPngSample(&png, row, index));
+                    a = _MniPngTo8(&png, _MniPngSample(&png, row, index + 1));
+                    break;
+
+                default:
+                    r = _MniPngTo8(&png, _MniPngSample(&png, row, index));
+                    g = _MniPngTo8(&png, _MniPngSample(&png, row, index + 1));
+                    b = _MniPngTo8(&png, _MniPngSample(&png, row, index + 2));
+                    a = _MniPngTo8(&png, _MniPngSample(&png, row, index + 3));
+                    break;
+            }
+
+            out[x] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+
+    _MniPixelsPremultiply(pixels, pixels, (size_t)png.width * (size_t)png.height, 0);
+
+    return MNI_DECODE_OK;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Probe
+
+// Dimensions and scratch size of image at offset, which is PNG or bitmap of ICO.
+static MniDecodeStatus _MniDecodeProbeImage(const uint8_t *data, size_t size, MniDecodeFormat format, MniDecodeInfo *info) {
+    if (format == MNI_DECODE_FORMAT_PNG) {
+        MniPng png;
+        MniDecodeStatus status = _MniPngParse(data, size, &png);
+        if (status != MNI_DECODE_OK) {
+            return status;
+        }
+
+        info->width = png.width;
+        info->height = png.height;
+        info->scratch_size = png.compressed_size + png.raw_size;
+        return MNI_DECODE_OK;
+    }
+
+    MniDib dib;
+    MniDecodeStatus status;
+    if (format == MNI_DECODE_FORMAT_BMP) {
+        if (size < 14) {
+            return MNI_DECODE_CORRUPT;
+        }
+        status = _MniDibParse(data, size, 14, _MniDecodeRead32(data + 10), 0, &dib);
+    } else {
+        status = _MniDibParse(data, size, 0, 0, 1, &dib);
+    }
+
+    if (status != MNI_DECODE_OK) {
+        return status;
+    }
+
+    info->width = dib.width;
+    info->height = dib.height;
+    info->scratch_size = 0;
+    return MNI_DECODE_OK;
+}
+
+// ========================================================================== //
+
+static MniDecodeStatus _MniDecodeProbeIco(const uint8_t *data, size_t size, int target_size, MniDecodeInfo *info) {
+    uint32_t count = _MniDecodeRead16(data + 4);
+    if (count == 0 || size < 6 + (size_t)count * 16) {
+        return MNI_DECODE_CORRUPT;
+    }
+
+    MniDecodeStatus result = MNI_DECODE_CORRUPT;
+    int best_size = 0;
+    uint32_t best_depth = 0;
+
+    for (uint32_t i = 0; i < count; i += 1) {
+        const uint8_t *entry = data + 6 + i * 16;
+        uint32_t image_size = _MniDecodeRead32(entry + 8);
+        uint32_t image_offset = _MniDecodeRead32(entry + 12);
+
+        if (image_offset > size || image_size > size - image_offset) {
+            continue;
+        }
+
+        MniDecodeInfo candidate = {
+            .format = _MniDecodeIsPng(data + image_offset, image_size) ? MNI_DECODE_FORMAT_PNG : MNI_DECODE_FORMAT_DIB,
+            .offset = image_offset,
+            .size = image_size,
+        };
+
+        // Directory may lie, real size comes from the image itself.
+        MniDecodeStatus status = _MniDecodeProbeImage(data + image_offset, image_size, candidate.format, &candidate);
+        if (status != MNI_DECODE_OK) {
+            if (result != MNI_DECODE_OK) {
+                result = status;
+            }
+            continue;
+        }
+
+        int image_dimension = candidate.width > candidate.height ? candidate.width : candidate.height;
+        uint32_t depth = candidate.format == MNI_DECODE_FORMAT_PNG ? 32 : _MniDecodeRead16(data + image_offset + 14);
+
+        // Exact size, then smallest larger, then largest smaller; deeper color on ties.
+        int better;
+        if (result != MNI_DECODE_OK) {
+            better = 1;
+        } else if (image_dimension == best_size) {
+            better = depth > best_depth;
+        } else if (best_size >= target_size) {
+            better = image_dimension >= target_size && image_dimension < best_size;
+        } else {
+            better = image_dimension > best_size;
+        }
+
+        if (better) {
+            *info = candidate;
+            best_size = image_dimension;
+            best_depth = depth;
+            result = MNI_DECODE_OK;
+        }
+    }
+
+    return result;
+}
+
+// ========================================================================== //
+
+MniDecodeStatus _MniDecodeProbe(const void *data, size_t size, int target_size, MniDecodeInfo *info) {
+    const uint8_t *bytes = (const uint8_t *)data;
+
+    memset(info, 0, sizeof(*info));
+
+    if (!data) {
+        return MNI_DECODE_UNKNOWN_FORMAT;
+    }
+
+    if (_MniDecodeIsPng(bytes, size)) {
+        info->format = MNI_DECODE_FORMAT_PNG;
+        info->size = size;
+        return _MniDecodeProbeImage(bytes, size, MNI_DECODE_FORMAT_PNG, info);
+    }
+
+    if (size >= 2 && bytes[0] == 'B' && bytes[1] == 'M') {
+        info->format = MNI_DECODE_FORMAT_BMP;
+        info->size = size;
+        return _MniDecodeProbeImage(bytes, size, MNI_DECODE_FORMAT_BMP, info);
+    }
+
+    if (size >= 6 && _MniDecodeRead16(bytes) == 0 && _MniDecodeRead16(bytes + 2) == 1) {
+        return _MniDecodeProbeIco(bytes, size, target_size, info);
+    }
+
+    return MNI_DECODE_UNKNOWN_FORMAT;
+}
+
+// ========================================================================== //
+
+MniDecodeStatus _MniDecodeImage(const void *data, size_t size, const MniDecodeInfo *info, uint32_t *pixels, void *scratch) {
+    if (!data || info->offset > size || info->size > size - info->offset) {
+        return MNI_DECODE_CORRUPT;
+    }
+
+    const uint8_t *image = (const uint8_t *)data + info->offset;
+    MniDib dib;
+    MniDecodeStatus status;
+
+    switch (info->format) {
+        case MNI_DECODE_FORMAT_PNG:
+            return _MniPngDecode(image, info->size, pixels, (uint8_t *)scratch);
+
+        case MNI_DECODE_FORMAT_BMP:
+            if (info->size < 14) {
+                return MNI_DECODE_CORRUPT;
+            }
+            status = _MniDibParse(image, info->size, 14, _MniDecodeRead32(image + 10), 0, &dib);
+            break;
+
+        default:
+            status = _MniDibParse(image, info->size, 0, 0, 1, &dib);
+            break;
+    }
+
+    if (status != MNI_DECODE_OK) {
+        return status;
+    }
+
+    return _MniDibDecode(image, info->size, &dib, pixels);
+}
+
+// ========================================================================== //
+
+const char *_MniDecodeStatusToString(MniDecodeStatus status) {
+    switch (status) {
+        case MNI_DECODE_OK:             return "ok";
+        case MNI_DECODE_UNKNOWN_FORMAT: return "unknown format";
+        case MNI_DECODE_UNSUPPORTED:    return "unsupported image";
+        case MNI_DECODE_CORRUPT:        return "corrupt image";
+        case MNI_DECODE_TOO_LARGE:      return "image is too large";
+    }
+
+    return "unknown status";
+}
+
+#pragma endregion
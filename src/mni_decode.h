@@ -0,0 +1,53 @@
+#ifndef MNI_DECODE_H
+#define MNI_DECODE_H
+
+// Decoders of ICO, BMP and PNG images into premultiplied BGRA. Like mni_pixels this part
+// doesn't depend on Windows headers and doesn't allocate, so it can be fuzzed on any
+// platform. Input is untrusted, every offset and length is checked.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef enum MniDecodeStatus {
+    MNI_DECODE_OK               = 0,
+    MNI_DECODE_UNKNOWN_FORMAT   = 1,
+    MNI_DECODE_UNSUPPORTED      = 2,    // e.g. interlaced PNG or RLE bitmap
+    MNI_DECODE_CORRUPT          = 3,
+    MNI_DECODE_TOO_LARGE        = 4,    // wider or taller than MNI_PIXELS_MAX_SIZE
+} MniDecodeStatus;
+
+typedef enum MniDecodeFormat {
+    MNI_DECODE_FORMAT_BMP       = 0,    // bitmap file
+    MNI_DECODE_FORMAT_DIB       = 1,    // bitmap inside ICO, followed by AND mask
+    MNI_DECODE_FORMAT_PNG       = 2,
+} MniDecodeFormat;
+
+// Image chosen by _MniDecodeProbe. scratch_size bytes of scratch memory have to be
+// passed to _MniDecodeImage.
+typedef struct MniDecodeInfo {
+    MniDecodeFormat     format;
+    int                 width;
+    int                 height;
+    size_t              offset;         // of chosen image in data
+    size_t              size;
+    size_t              scratch_size;
+} MniDecodeInfo;
+
+// Finds image to decode. For ICO the image closest to target_size is picked, exact size
+// first, then smallest larger one, then largest one. Deeper color wins for same size.
+MniDecodeStatus _MniDecodeProbe(const void *data, size_t size, int target_size, MniDecodeInfo *info);
+
+// Decodes image found by _MniDecodeProbe into width x height premultiplied BGRA pixels.
+MniDecodeStatus _MniDecodeImage(const void *data, size_t size, const MniDecodeInfo *info, uint32_t *pixels, void *scratch);
+
+const char *_MniDecodeStatusToString(MniDecodeStatus status);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // MNI_DECODE_H
@@ -0,0 +1,293 @@
+#include "mni_journal.h"
+
+#include <string.h>     // memcpy, memset
+
+// ========================================================================== //
+
+#pragma region Records
+
+static size_t _MniJournalAlign(size_t offset) {
+    return (offset + MNI_JOURNAL_ALIGNMENT - 1) & ~(size_t)(MNI_JOURNAL_ALIGNMENT - 1);
+}
+
+// ========================================================================== //
+
+static uint32_t _MniJournalChecksum(const MniJournalRecord *record) {
+    // Everything after checksum field, so size is covered too.
+    const uint8_t *bytes = (const uint8_t *)record + 8;
+    size_t count = record->size - 8;
+    uint32_t hash = 0x811C9DC5u;
+
+    for (size_t i = 0; i < count; i += 1) {
+        hash = (hash ^ bytes[i]) * 0x01000193u;
+    }
+
+    return hash;
+}
+
+// ========================================================================== //
+
+static const MniJournalHeader *_MniJournalHeader(const void *data) {
+    return (const MniJournalHeader *)data;
+}
+
+// ========================================================================== //
+
+// Record at offset if it's whole, of current epoch and well formed.
+static const MniJournalRecord *_MniJournalRecordAt(const void *data, size_t size, size_t offset) {
+    if (size - offset < sizeof(MniJournalRecord)) {
+        return NULL;
+    }
+
+    const MniJournalRecord *record = (const MniJournalRecord *)((const uint8_t *)data + offset);
+    if (record->size < sizeof(MniJournalRecord) || record->size % MNI_JOURNAL_ALIGNMENT || record->size > size - offset) {
+        return NULL;
+    }
+
+    if (record->epoch != _MniJournalHeader(data)->epoch || _MniJournalChecksum(record) != record->checksum) {
+        return NULL;
+    }
+
+    size_t payload = record->size - sizeof(MniJournalRecord);
+
+    switch (record->type) {
+        case MNI_JOURNAL_POSTED: {
+            if (payload < sizeof(MniJournalNotification)) {
+                return NULL;
+            }
+
+            const MniJournalNotification *notification = (const MniJournalNotification *)(record + 1);
+            if (notification->title_length > MNI_JOURNAL_TITLE_LENGTH || notification->text_length > MNI_JOURNAL_TEXT_LENGTH ||
+                payload < sizeof(MniJournalNotification) + ((size_t)notification->title_length + notification->text_length) * 2)
+            {
+                return NULL;
+            }
+            return record;
+        }
+
+        case MNI_JOURNAL_SHOWN:
+            return record;
+
+        case MNI_JOURNAL_OUTCOME:
+            return payload >= sizeof(MniJournalOutcome) ? record : NULL;
+    }
+
+    return NULL;
+}
+
+// ========================================================================== //
+
+static size_t _MniJournalRecordSize(const MniJournalEntry *entry, int title_length, int text_length) {
+    switch (entry->type) {
+        case MNI_JOURNAL_POSTED:
+            return _MniJournalAlign(sizeof(MniJournalRecord) + sizeof(MniJournalNotification) + ((size_t)title_length + (size_t)text_length) * 2);
+        case MNI_JOURNAL_OUTCOME:
+            return sizeof(MniJournalRecord) + sizeof(MniJournalOutcome);
+        default:
+            return sizeof(MniJournalRecord);
+    }
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Journal
+
+size_t _MniJournalCreate(void *data, size_t size, uint32_t epoch) {
+    MniJournalHeader *header = (MniJournalHeader *)data;
+
+    memset(header, 0, sizeof(*header));
+    header->magic = MNI_JOURNAL_MAGIC;
+    header->version = MNI_JOURNAL_VERSION;
+    header->header_size = sizeof(MniJournalHeader);
+    header->epoch = epoch;
+    header->size = size;
+
+    return sizeof(MniJournalHeader);
+}
+
+// ========================================================================== //
+
+MniJournalStatus _MniJournalValidate(const void *data, size_t size) {
+    if (!data || size < sizeof(MniJournalHeader)) {
+        return MNI_JOURNAL_TRUNCATED;
+    }
+
+    const MniJournalHeader *header = _MniJournalHeader(data);
+    if (header->magic != MNI_JOURNAL_MAGIC) {
+        return MNI_JOURNAL_BAD_MAGIC;
+    }
+
+    if (header->version != MNI_JOURNAL_VERSION || header->header_size != sizeof(MniJournalHeader)) {
+        return MNI_JOURNAL_BAD_VERSION;
+    }
+
+    return MNI_JOURNAL_OK;
+}
+
+// ========================================================================== //
+
+const char *_MniJournalStatusToString(MniJournalStatus status) {
+    switch (status) {
+        case MNI_JOURNAL_OK:            return "ok";
+        case MNI_JOURNAL_TRUNCATED:     return "file is truncated";
+        case MNI_JOURNAL_BAD_MAGIC:     return "not a notification journal";
+        case MNI_JOURNAL_BAD_VERSION:   return "unsupported version";
+    }
+
+    return "unknown status";
+}
+
+// ========================================================================== //
+
+size_t _MniJournalScan(const void *data, size_t size, size_t *posted_count, uint64_t *last_id) {
+    size_t offset = sizeof(MniJournalHeader);
+    size_t count = 0;
+    uint64_t last = 0;
+
+    for (;;) {
+        const MniJournalRecord *record = _MniJournalRecordAt(data, size, offset);
+        if (!record) {
+            break;
+        }
+
+        // Pending lookup is a binary search over posted ids.
+        if (record->type == MNI_JOURNAL_POSTED) {
+            if (count > 0 && record->id <= last) {
+                break;
+            }
+            count += 1;
+        }
+
+        if (record->id > last) {
+            last = record->id;
+        }
+
+        offset += record->size;
+    }
+
+    *posted_count = count;
+    *last_id = last;
+
+    return offset;
+}
+
+// ========================================================================== //
+
+size_t _MniJournalPending(const void *data, size_t tail, size_t *offsets, size_t posted_count) {
+    size_t offset = sizeof(MniJournalHeader);
+    size_t count = 0;
+
+    while (offset < tail) {
+        const MniJournalRecord *record = (const MniJournalRecord *)((const uint8_t *)data + offset);
+
+        if (record->type == MNI_JOURNAL_POSTED && count < posted_count) {
+            offsets[count] = offset;
+            count += 1;
+        } else if (record->type == MNI_JOURNAL_OUTCOME) {
+            size_t low = 0;
+            size_t high = count;
+
+            while (low < high) {
+                size_t middle = low + (high - low) / 2;
+                const MniJournalRecord *posted = (const MniJournalRecord *)((const uint8_t *)data + (offsets[middle] & ~(size_t)1));
+
+                if (posted->id < record->id) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+
+            // Offsets are aligned, low bit marks finished ones.
+            if (low < count && ((const MniJournalRecord *)((const uint8_t *)data + (offsets[low] & ~(size_t)1)))->id == record->id) {
+                offsets[low] |= 1;
+            }
+        }
+
+        offset += record->size;
+    }
+
+    // Finished records were only marked, searched ids had to stay in place.
+    size_t pending = 0;
+    for (size_t i = 0; i < count; i += 1) {
+        if (!(offsets[i] & 1)) {
+            offsets[pending] = offsets[i];
+            pending += 1;
+        }
+    }
+
+    return pending;
+}
+
+// ========================================================================== //
+
+void _MniJournalRead(const void *data, size_t offset, MniJournalEntry *entry) {
+    const MniJournalRecord *record = (const MniJournalRecord *)((const uint8_t *)data + offset);
+
+    memset(entry, 0, sizeof(*entry));
+    entry->type = (MniJournalRecordType)record->type;
+    entry->id = record->id;
+
+    if (record->type == MNI_JOURNAL_POSTED) {
+        const MniJournalNotification *notification = (const MniJournalNotification *)(record + 1);
+        const uint16_t *strings = (const uint16_t *)(notification + 1);
+
+        entry->priority = notification->priority;
+        entry->icon_type = notification->icon_type;
+        entry->flags = notification->flags;
+        entry->title = strings;
+        entry->title_length = notification->title_length;
+        entry->text = strings + notification->title_length;
+        entry->text_length = notification->text_length;
+    } else if (record->type == MNI_JOURNAL_OUTCOME) {
+        entry->outcome = ((const MniJournalOutcome *)(record + 1))->outcome;
+    }
+}
+
+// ========================================================================== //
+
+size_t _MniJournalAppend(void *data, size_t size, size_t tail, const MniJournalEntry *entry) {
+    int title_length = entry->title_length < MNI_JOURNAL_TITLE_LENGTH ? entry->title_length : MNI_JOURNAL_TITLE_LENGTH;
+    int text_length = entry->text_length < MNI_JOURNAL_TEXT_LENGTH ? entry->text_length : MNI_JOURNAL_TEXT_LENGTH;
+    size_t record_size = _MniJournalRecordSize(entry, title_length, text_length);
+
+    if (tail > size || size - tail < record_size) {
+        return 0;
+    }
+
+    // Room is zeroed first, padding is part of checksum.
+    MniJournalRecord *record = (MniJournalRecord *)((uint8_t *)data + tail);
+    memset(record, 0, record_size);
+    record->size = (uint32_t)record_size;
+    record->epoch = _MniJournalHeader(data)->epoch;
+    record->type = (uint16_t)entry->type;
+    record->id = entry->id;
+
+    if (entry->type == MNI_JOURNAL_POSTED) {
+        MniJournalNotification *notification = (MniJournalNotification *)(record + 1);
+        uint16_t *strings = (uint16_t *)(notification + 1);
+
+        notification->priority = entry->priority;
+        notification->icon_type = entry->icon_type;
+        notification->flags = entry->flags;
+        notification->title_length = (uint16_t)title_length;
+        notification->text_length = (uint16_t)text_length;
+
+        if (title_length > 0) {
+            memcpy(strings, entry->title, (size_t)title_length * 2);
+        }
+        if (text_length > 0) {
+            memcpy(strings + title_length, entry->text, (size_t)text_length * 2);
+        }
+    } else if (entry->type == MNI_JOURNAL_OUTCOME) {
+        ((MniJournalOutcome *)(record + 1))->outcome = entry->outcome;
+    }
+
+    record->checksum = _MniJournalChecksum(record);
+
+    return tail + record_size;
+}
+
+#pragma endregion
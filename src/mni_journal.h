@@ -0,0 +1,111 @@
+#ifndef MNI_JOURNAL_H
+#define MNI_JOURNAL_H
+
+// Notification outbox journal, append-only log of posted notifications and their outcome.
+// Journal is meant to be memory mapped. Every record is checksummed and stamped with epoch
+// of the journal, recovery takes records up to the first one that doesn't check out, so
+// torn append at the end is dropped. Like mni_pixels this part doesn't depend on Windows
+// headers, recovery is fuzzed on any platform by tools/mni_journal_fuzz.c.
+//
+// Layout, all fields little endian:
+//   MniJournalHeader
+//   records                     every record aligned to MNI_JOURNAL_ALIGNMENT
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define MNI_JOURNAL_MAGIC           0x4A494E4Du     // "MNIJ"
+#define MNI_JOURNAL_VERSION         1
+#define MNI_JOURNAL_ALIGNMENT       8
+#define MNI_JOURNAL_TITLE_LENGTH    63              // characters, sizes of NOTIFYICONDATAW
+#define MNI_JOURNAL_TEXT_LENGTH     255
+
+typedef struct MniJournalHeader {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    header_size;
+    uint32_t    epoch;          // bumped when journal is rewritten
+    uint32_t    reserved;
+    uint64_t    size;           // of journal when created
+} MniJournalHeader;
+
+typedef enum MniJournalRecordType {
+    MNI_JOURNAL_POSTED          = 1,    // followed by MniJournalNotification
+    MNI_JOURNAL_SHOWN           = 2,
+    MNI_JOURNAL_OUTCOME         = 3,    // followed by MniJournalOutcome
+} MniJournalRecordType;
+
+typedef struct MniJournalRecord {
+    uint32_t    size;           // whole record, multiple of MNI_JOURNAL_ALIGNMENT
+    uint32_t    checksum;       // FNV-1a of everything after this field
+    uint32_t    epoch;
+    uint16_t    type;
+    uint16_t    reserved;
+    uint64_t    id;             // of notification, ids of posted records only grow
+} MniJournalRecord;
+
+typedef struct MniJournalNotification {
+    uint8_t     priority;
+    uint8_t     icon_type;
+    uint16_t    flags;
+    uint16_t    title_length;   // UTF-16 title and text follow, without terminators
+    uint16_t    text_length;
+} MniJournalNotification;
+
+typedef struct MniJournalOutcome {
+    uint32_t    outcome;
+    uint32_t    reserved;
+} MniJournalOutcome;
+
+// Decoded record, strings point into journal and aren't terminated.
+typedef struct MniJournalEntry {
+    MniJournalRecordType    type;
+    uint64_t                id;
+    uint32_t                outcome;
+    uint8_t                 priority;
+    uint8_t                 icon_type;
+    uint16_t                flags;
+    const uint16_t          *title;
+    int                     title_length;
+    const uint16_t          *text;
+    int                     text_length;
+} MniJournalEntry;
+
+typedef enum MniJournalStatus {
+    MNI_JOURNAL_OK              = 0,
+    MNI_JOURNAL_TRUNCATED       = 1,
+    MNI_JOURNAL_BAD_MAGIC       = 2,
+    MNI_JOURNAL_BAD_VERSION     = 3,
+} MniJournalStatus;
+
+// Writes header of empty journal, returns offset of first record. Rest of data has to be zero.
+size_t _MniJournalCreate(void *data, size_t size, uint32_t epoch);
+MniJournalStatus _MniJournalValidate(const void *data, size_t size);
+const char *_MniJournalStatusToString(MniJournalStatus status);
+
+// Following expect journal which passed _MniJournalValidate.
+
+// Walks valid records and returns end of the last one, where next append goes. Counts
+// posted records and returns highest id seen.
+size_t _MniJournalScan(const void *data, size_t size, size_t *posted_count, uint64_t *last_id);
+
+// Fills offsets of posted records without outcome in id order and returns their count.
+// offsets has room for posted_count from _MniJournalScan.
+size_t _MniJournalPending(const void *data, size_t tail, size_t *offsets, size_t posted_count);
+
+// Decodes record at offset returned by _MniJournalPending or walked by _MniJournalScan.
+void _MniJournalRead(const void *data, size_t offset, MniJournalEntry *entry);
+
+// Appends record at tail and returns new tail, 0 when it doesn't fit. Strings longer than
+// MNI_JOURNAL_TITLE_LENGTH and MNI_JOURNAL_TEXT_LENGTH are cut.
+size_t _MniJournalAppend(void *data, size_t size, size_t tail, const MniJournalEntry *entry);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // MNI_JOURNAL_H
@@ -0,0 +1,347 @@
+#include "mni_pack.h"
+#include "mni_pixels.h"
+
+#include <string.h>     // memcpy, memset, strcmp, strlen
+
+// Offsets are 32-bit, packs are small and mapped whole.
+
+// ========================================================================== //
+
+#pragma region Reader
+
+static size_t _MniPackAlign(size_t offset) {
+    return (offset + MNI_PACK_ALIGNMENT - 1) & ~(size_t)(MNI_PACK_ALIGNMENT - 1);
+}
+
+// ========================================================================== //
+
+static int _MniPackNameValid(const char *name) {
+    size_t length = 0;
+    while (length < MNI_PACK_NAME_SIZE && name[length]) {
+        length += 1;
+    }
+
+    if (length == 0 || length == MNI_PACK_NAME_SIZE) {
+        return 0;
+    }
+
+    // Rest is zero, so names can be compared as fixed size blocks.
+    for (size_t i = length; i < MNI_PACK_NAME_SIZE; i += 1) {
+        if (name[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// ========================================================================== //
+
+MniPackStatus _MniPackValidate(const void *data, size_t size, int check_pixels) {
+    if (!data || size < sizeof(MniPackHeader)) {
+        return MNI_PACK_TRUNCATED;
+    }
+
+    const MniPackHeader *header = (const MniPackHeader *)data;
+    if (header->magic != MNI_PACK_MAGIC) {
+        return MNI_PACK_BAD_MAGIC;
+    }
+
+    if (header->version != MNI_PACK_VERSION || header->header_size != sizeof(MniPackHeader)) {
+        return MNI_PACK_BAD_VERSION;
+    }
+
+    if (header->file_size > size) {
+        return MNI_PACK_TRUNCATED;
+    }
+
+    // Sizes are checked in 64 bits, counts come from the file.
+    uint64_t file_size = header->file_size;
+    uint64_t icons_end = (uint64_t)header->icons_offset + (uint64_t)header->icon_count * sizeof(MniPackIcon);
+    uint64_t frames_end = (uint64_t)header->frames_offset + (uint64_t)header->frame_count * sizeof(MniPackFrame);
+
+    if (header->icons_offset < sizeof(MniPackHeader) || header->icons_offset % 8 || icons_end > file_size ||
+        header->frames_offset < icons_end || header->frames_offset % 8 || frames_end > file_size)
+    {
+        return MNI_PACK_BAD_INDEX;
+    }
+
+    const MniPackIcon *icons = _MniPackIcons(data);
+    const MniPackFrame *frames = _MniPackFrames(data);
+
+    uint32_t next_frame = 0;
+    for (uint32_t i = 0; i < header->icon_count; i += 1) {
+        const MniPackIcon *icon = &icons[i];
+
+        if (!_MniPackNameValid(icon->name)) {
+            return MNI_PACK_BAD_NAME;
+        }
+
+        // Sorted and unique, lookup is a binary search.
+        if (i > 0 && memcmp(icons[i - 1].name, icon->name, MNI_PACK_NAME_SIZE) >= 0) {
+            return MNI_PACK_BAD_NAME;
+        }
+
+        if (icon->first_frame != next_frame || icon->frame_count == 0 ||
+            (uint64_t)icon->first_frame + icon->frame_count > header->frame_count)
+        {
+            return MNI_PACK_BAD_INDEX;
+        }
+
+        next_frame += icon->frame_count;
+
+        for (uint32_t j = icon->first_frame; j < next_frame; j += 1) {
+            const MniPackFrame *frame = &frames[j];
+
+            if (frame->width == 0 || frame->height == 0 ||
+                frame->width > MNI_PIXELS_MAX_SIZE || frame->height > MNI_PIXELS_MAX_SIZE ||
+                frame->offset < frames_end || frame->offset % MNI_PACK_ALIGNMENT ||
+                (uint64_t)frame->offset + (uint64_t)frame->width * frame->height * 4 > file_size)
+            {
+                return MNI_PACK_BAD_FRAME;
+            }
+
+            if (j > icon->first_frame && frames[j - 1].width >= frame->width) {
+                return MNI_PACK_BAD_FRAME;
+            }
+
+            if (check_pixels) {
+                size_t count = (size_t)frame->width * frame->height;
+                if (_MniPixelsHash(_MniPackPixels(data, frame), count, MNI_PACK_HASH_SEED) != frame->hash) {
+                    return MNI_PACK_BAD_HASH;
+                }
+            }
+        }
+    }
+
+    if (next_frame != header->frame_count) {
+        return MNI_PACK_BAD_INDEX;
+    }
+
+    return MNI_PACK_OK;
+}
+
+// ========================================================================== //
+
+const char *_MniPackStatusToString(MniPackStatus status) {
+    switch (status) {
+        case MNI_PACK_OK:           return "ok";
+        case MNI_PACK_TRUNCATED:    return "file is truncated";
+        case MNI_PACK_BAD_MAGIC:    return "not an icon pack";
+        case MNI_PACK_BAD_VERSION:  return "unsupported version";
+        case MNI_PACK_BAD_INDEX:    return "index is out of range";
+        case MNI_PACK_BAD_NAME:     return "icon names are invalid, duplicate or unsorted";
+        case MNI_PACK_BAD_FRAME:    return "frame is invalid or out of range";
+        case MNI_PACK_BAD_HASH:     return "frame pixels don't match hash";
+    }
+
+    return "unknown status";
+}
+
+// ========================================================================== //
+
+const MniPackHeader *_MniPackHeader(const void *data) {
+    return (const MniPackHeader *)data;
+}
+
+// ========================================================================== //
+
+const MniPackIcon *_MniPackIcons(const void *data) {
+    return (const MniPackIcon *)((const uint8_t *)data + _MniPackHeader(data)->icons_offset);
+}
+
+// ========================================================================== //
+
+const MniPackFrame *_MniPackFrames(const void *data) {
+    return (const MniPackFrame *)((const uint8_t *)data + _MniPackHeader(data)->frames_offset);
+}
+
+// ========================================================================== //
+
+const uint32_t *_MniPackPixels(const void *data, const MniPackFrame *frame) {
+    return (const uint32_t *)((const uint8_t *)data + frame->offset);
+}
+
+// ========================================================================== //
+
+int _MniPackFindIcon(const void *data, const char *name) {
+    if (strlen(name) >= MNI_PACK_NAME_SIZE) {
+        return -1;
+    }
+
+    char key[MNI_PACK_NAME_SIZE] = { 0 };
+    memcpy(key, name, strlen(name));
+
+    const MniPackIcon *icons = _MniPackIcons(data);
+    int low = 0;
+    int high = (int)_MniPackHeader(data)->icon_count - 1;
+
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int order = memcmp(icons[middle].name, key, MNI_PACK_NAME_SIZE);
+
+        if (order == 0) {
+            return middle;
+        } else if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return -1;
+}
+
+// ========================================================================== //
+
+const MniPackFrame *_MniPackFindFrame(const void *data, int icon, int size) {
+    const MniPackIcon *entry = &_MniPackIcons(data)[icon];
+    const MniPackFrame *frames = _MniPackFrames(data) + entry->first_frame;
+
+    // Frames are sorted by size, downscaling looks better than upscaling.
+    for (uint32_t i = 0; i < entry->frame_count; i += 1) {
+        if (frames[i].width >= size) {
+            return &frames[i];
+        }
+    }
+
+    return &frames[entry->frame_count - 1];
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Writer
+
+static int _MniPackCompareNames(const char *a, const char *b) {
+    char key_a[MNI_PACK_NAME_SIZE] = { 0 };
+    char key_b[MNI_PACK_NAME_SIZE] = { 0 };
+    memcpy(key_a, a, strlen(a));
+    memcpy(key_b, b, strlen(b));
+
+    return memcmp(key_a, key_b, MNI_PACK_NAME_SIZE);
+}
+
+// ========================================================================== //
+
+size_t _MniPackWrite(void *out, size_t capacity, const MniPackSourceIcon *icons, int icon_count) {
+    if (!icons || icon_count <= 0) {
+        return 0;
+    }
+
+    size_t frame_count = 0;
+    size_t pixels_size = 0;
+
+    for (int i = 0; i < icon_count; i += 1) {
+        const MniPackSourceIcon *icon = &icons[i];
+
+        if (!icon->name || !icon->name[0] || strlen(icon->name) >= MNI_PACK_NAME_SIZE ||
+            !icon->frames || icon->frame_count <= 0)
+        {
+            return 0;
+        }
+
+        for (int j = 0; j < i; j += 1) {
+            if (strcmp(icons[j].name, icon->name) == 0) {
+                return 0;
+            }
+        }
+
+        for (int j = 0; j < icon->frame_count; j += 1) {
+            const MniPackSourceFrame *frame = &icon->frames[j];
+
+            if (!frame->pixels || frame->width <= 0 || frame->height <= 0 ||
+                frame->width > MNI_PIXELS_MAX_SIZE || frame->height > MNI_PIXELS_MAX_SIZE)
+            {
+                return 0;
+            }
+
+            // Frames are told apart by width.
+            for (int k = 0; k < j; k += 1) {
+                if (icon->frames[k].width == frame->width) {
+                    return 0;
+                }
+            }
+
+            pixels_size += _MniPackAlign((size_t)frame->width * (size_t)frame->height * 4);
+        }
+
+        frame_count += (size_t)icon->frame_count;
+    }
+
+    size_t icons_offset = sizeof(MniPackHeader);
+    size_t frames_offset = icons_offset + (size_t)icon_count * sizeof(MniPackIcon);
+    size_t pixels_offset = _MniPackAlign(frames_offset + frame_count * sizeof(MniPackFrame));
+    size_t size = pixels_offset + pixels_size;
+
+    if (size > UINT32_MAX) {
+        return 0;
+    }
+
+    if (!out || capacity < size) {
+        return size;
+    }
+
+    memset(out, 0, size);
+
+    MniPackHeader *header = (MniPackHeader *)out;
+    header->magic = MNI_PACK_MAGIC;
+    header->version = MNI_PACK_VERSION;
+    header->header_size = sizeof(MniPackHeader);
+    header->icon_count = (uint32_t)icon_count;
+    header->frame_count = (uint32_t)frame_count;
+    header->icons_offset = (uint32_t)icons_offset;
+    header->frames_offset = (uint32_t)frames_offset;
+    header->file_size = size;
+
+    MniPackIcon *entries = (MniPackIcon *)((uint8_t *)out + icons_offset);
+    MniPackFrame *frames = (MniPackFrame *)((uint8_t *)out + frames_offset);
+    size_t next_pixels = pixels_offset;
+    uint32_t next_frame = 0;
+
+    // Icons go out sorted by name and frames by width, both selection sorted, counts are small.
+    const char *previous_name = NULL;
+    for (int i = 0; i < icon_count; i += 1) {
+        const MniPackSourceIcon *icon = NULL;
+        for (int j = 0; j < icon_count; j += 1) {
+            if ((!previous_name || _MniPackCompareNames(icons[j].name, previous_name) > 0) &&
+                (!icon || _MniPackCompareNames(icons[j].name, icon->name) < 0))
+            {
+                icon = &icons[j];
+            }
+        }
+        previous_name = icon->name;
+
+        MniPackIcon *entry = &entries[i];
+        memcpy(entry->name, icon->name, strlen(icon->name));
+        entry->first_frame = next_frame;
+        entry->frame_count = (uint32_t)icon->frame_count;
+
+        int previous_width = 0;
+        for (int j = 0; j < icon->frame_count; j += 1) {
+            const MniPackSourceFrame *source = NULL;
+            for (int k = 0; k < icon->frame_count; k += 1) {
+                if (icon->frames[k].width > previous_width && (!source || icon->frames[k].width < source->width)) {
+                    source = &icon->frames[k];
+                }
+            }
+            previous_width = source->width;
+
+            size_t count = (size_t)source->width * (size_t)source->height;
+            MniPackFrame *frame = &frames[next_frame];
+            frame->width = (uint16_t)source->width;
+            frame->height = (uint16_t)source->height;
+            frame->offset = (uint32_t)next_pixels;
+            frame->hash = _MniPixelsHash(source->pixels, count, MNI_PACK_HASH_SEED);
+
+            memcpy((uint8_t *)out + next_pixels, source->pixels, count * 4);
+            next_pixels += _MniPackAlign(count * 4);
+            next_frame += 1;
+        }
+    }
+
+    return size;
+}
+
+#pragma endregion
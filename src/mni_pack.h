@@ -0,0 +1,101 @@
+#ifndef MNI_PACK_H
+#define MNI_PACK_H
+
+// Icon pack, premultiplied BGRA frames of named icons at several sizes behind offset index.
+// Pack is meant to be memory mapped, frames are used in place. Like mni_pixels this part
+// doesn't depend on Windows headers, the converter and validator build on any platform.
+//
+// Layout, all fields little endian:
+//   MniPackHeader
+//   MniPackIcon[icon_count]     sorted by name
+//   MniPackFrame[frame_count]   frames of one icon are consecutive, sorted by size
+//   pixel data                  every frame aligned to MNI_PACK_ALIGNMENT
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define MNI_PACK_MAGIC          0x50494E4Du     // "MNIP"
+#define MNI_PACK_VERSION        1
+#define MNI_PACK_NAME_SIZE      32              // including terminating zero
+#define MNI_PACK_ALIGNMENT      16
+
+typedef struct MniPackHeader {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    header_size;
+    uint32_t    icon_count;
+    uint32_t    frame_count;
+    uint32_t    icons_offset;
+    uint32_t    frames_offset;
+    uint64_t    file_size;
+} MniPackHeader;
+
+typedef struct MniPackIcon {
+    char        name[MNI_PACK_NAME_SIZE];
+    uint32_t    first_frame;
+    uint32_t    frame_count;
+} MniPackIcon;
+
+typedef struct MniPackFrame {
+    uint16_t    width;
+    uint16_t    height;
+    uint32_t    offset;         // of pixels, width * height * 4 bytes
+    uint64_t    hash;           // _MniPixelsHash of pixels, seeded with MNI_PACK_HASH_SEED
+} MniPackFrame;
+
+#define MNI_PACK_HASH_SEED      0x6D6E697061636Bull
+
+typedef enum MniPackStatus {
+    MNI_PACK_OK                 = 0,
+    MNI_PACK_TRUNCATED          = 1,
+    MNI_PACK_BAD_MAGIC          = 2,
+    MNI_PACK_BAD_VERSION        = 3,
+    MNI_PACK_BAD_INDEX          = 4,
+    MNI_PACK_BAD_NAME           = 5,
+    MNI_PACK_BAD_FRAME          = 6,
+    MNI_PACK_BAD_HASH           = 7,
+} MniPackStatus;
+
+// Checks header and index, cheap enough to do on every open. Pixels are only hashed
+// when check_pixels is set, that touches every page of the pack.
+MniPackStatus _MniPackValidate(const void *data, size_t size, int check_pixels);
+const char *_MniPackStatusToString(MniPackStatus status);
+
+// Following expect pack which passed _MniPackValidate.
+const MniPackHeader *_MniPackHeader(const void *data);
+const MniPackIcon *_MniPackIcons(const void *data);
+const MniPackFrame *_MniPackFrames(const void *data);
+const uint32_t *_MniPackPixels(const void *data, const MniPackFrame *frame);
+
+// Returns index of icon or -1.
+int _MniPackFindIcon(const void *data, const char *name);
+
+// Frame of exact size, else smallest larger one, else largest one.
+const MniPackFrame *_MniPackFindFrame(const void *data, int icon, int size);
+
+// Source for _MniPackWrite. Pixels are premultiplied BGRA, sizes in range 1..MNI_PIXELS_MAX_SIZE.
+typedef struct MniPackSourceFrame {
+    int             width;
+    int             height;
+    const uint32_t  *pixels;
+} MniPackSourceFrame;
+
+typedef struct MniPackSourceIcon {
+    const char                  *name;
+    const MniPackSourceFrame    *frames;
+    int                         frame_count;
+} MniPackSourceIcon;
+
+// Writes pack into out and returns its size. With out NULL or too small capacity only
+// returns the size needed. Returns 0 for invalid source, e.g. duplicate or too long name.
+size_t _MniPackWrite(void *out, size_t capacity, const MniPackSourceIcon *icons, int icon_count);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // MNI_PACK_H
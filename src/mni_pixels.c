@@ -0,0 +1,1447 @@
+#include "mni_pixels.h"
+
+#include <string.h>     // memcpy, memmove, strlen
+#include <math.h>       // ceilf, sqrtf, atan2f
+
+// Pixels are handled as little endian uint32, byte 0 is blue (red for RGBA) and byte 3 is alpha.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define MNI_PIXELS_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>     // __cpuidex, _xgetbv
+    #else
+        #include <cpuid.h>      // __cpuid_count
+    #endif
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+    #define MNI_PIXELS_NEON
+    #include <arm_neon.h>
+#endif
+
+// MSVC allows intrinsics of any instruction set, GCC and Clang need them enabled per function.
+#if defined(__GNUC__) || defined(__clang__)
+    #define MNI_PIXELS_TARGET_SSE2  __attribute__((target("sse2")))
+    #define MNI_PIXELS_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+    #define MNI_PIXELS_TARGET_SSE2
+    #define MNI_PIXELS_TARGET_AVX2
+#endif
+
+// ========================================================================== //
+
+#pragma region Cpu
+
+#if defined(MNI_PIXELS_X86)
+
+static void _MniPixelsCpuid(int leaf, int subleaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    for (int i = 0; i < 4; i += 1) {
+        regs[i] = (unsigned int)info[i];
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// ========================================================================== //
+
+static uint64_t _MniPixelsXgetbv(void) {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+#endif // MNI_PIXELS_X86
+
+// ========================================================================== //
+
+static MniPixelKernel _MniPixelsDetectKernel(void) {
+#if defined(MNI_PIXELS_X86)
+    unsigned int regs[4];
+
+    _MniPixelsCpuid(0, 0, regs);
+    unsigned int max_leaf = regs[0];
+    if (max_leaf < 1) {
+        return MNI_PIXEL_KERNEL_SCALAR;
+    }
+
+    _MniPixelsCpuid(1, 0, regs);
+    int sse2 = (regs[3] >> 26) & 1;
+    int osxsave = (regs[2] >> 27) & 1;
+    int avx = (regs[2] >> 28) & 1;
+
+    int avx2 = 0;
+    if (max_leaf >= 7) {
+        _MniPixelsCpuid(7, 0, regs);
+        avx2 = (regs[1] >> 5) & 1;
+    }
+
+    // AVX2 also needs the system to save ymm registers.
+    if (avx2 && avx && osxsave && (_MniPixelsXgetbv() & 0x6) == 0x6) {
+        return MNI_PIXEL_KERNEL_AVX2;
+    }
+
+    if (sse2) {
+        return MNI_PIXEL_KERNEL_SSE2;
+    }
+
+    return MNI_PIXEL_KERNEL_SCALAR;
+#elif defined(MNI_PIXELS_NEON)
+    return MNI_PIXEL_KERNEL_NEON;
+#else
+    return MNI_PIXEL_KERNEL_SCALAR;
+#endif
+}
+
+// ========================================================================== //
+
+MniPixelKernel _MniPixelsBestKernel(void) {
+    // Racing threads detect the same value, no synchronization needed.
+    static volatile int best_kernel = -1;
+
+    if (best_kernel < 0) {
+        best_kernel = (int)_MniPixelsDetectKernel();
+    }
+
+    return (MniPixelKernel)best_kernel;
+}
+
+// ========================================================================== //
+
+int _MniPixelsKernelSupported(MniPixelKernel kernel) {
+    MniPixelKernel best = _MniPixelsBestKernel();
+
+    switch (kernel) {
+        case MNI_PIXEL_KERNEL_SCALAR:   return 1;
+        case MNI_PIXEL_KERNEL_SSE2:     return best == MNI_PIXEL_KERNEL_SSE2 || best == MNI_PIXEL_KERNEL_AVX2;
+        case MNI_PIXEL_KERNEL_AVX2:     return best == MNI_PIXEL_KERNEL_AVX2;
+        case MNI_PIXEL_KERNEL_NEON:     return best == MNI_PIXEL_KERNEL_NEON;
+    }
+
+    return 0;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Premultiply
+
+// c * a / 255 rounded, exact for all inputs. SIMD kernels use the same formula.
+static uint32_t _MniPixelsMul(uint32_t c, uint32_t a) {
+    uint32_t t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// ========================================================================== //
+
+static void _MniPixelsPremultiplyScalar(uint32_t *dest, const uint32_t *src, size_t count, int swap_red_blue) {
+    for (size_t i = 0; i < count; i += 1) {
+        uint32_t pixel = src[i];
+        uint32_t a = pixel >> 24;
+        uint32_t c0 = pixel & 0xFF;
+        uint32_t c1 = (pixel >> 8) & 0xFF;
+        uint32_t c2 = (pixel >> 16) & 0xFF;
+
+        if (swap_red_blue) {
+            uint32_t c = c0;
+            c0 = c2;
+            c2 = c;
+        }
+
+        dest[i] = (a << 24) | (_MniPixelsMul(c2, a) << 16) | (_MniPixelsMul(c1, a) << 8) | _MniPixelsMul(c0, a);
+    }
+}
+
+// ========================================================================== //
+
+#if defined(MNI_PIXELS_X86)
+
+// Channels are 16-bit, alpha of each pixel is in lane 3 of its group of four.
+MNI_PIXELS_TARGET_SSE2
+static __m128i _MniPixelsMulSse2(__m128i channels, int swap_red_blue) {
+    if (swap_red_blue) {
+        channels = _mm_shufflelo_epi16(channels, _MM_SHUFFLE(3, 0, 1, 2));
+        channels = _mm_shufflehi_epi16(channels, _MM_SHUFFLE(3, 0, 1, 2));
+    }
+
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(channels, 0xFF), 0xFF);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(channels, alpha), _mm_set1_epi16(128));
+
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_SSE2
+static void _MniPixelsPremultiplySse2(uint32_t *dest, const uint32_t *src, size_t count, int swap_red_blue) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _MniPixelsMulSse2(_mm_unpacklo_epi8(pixels, zero), swap_red_blue);
+        __m128i hi = _MniPixelsMulSse2(_mm_unpackhi_epi8(pixels, zero), swap_red_blue);
+
+        // Alpha itself is kept, not multiplied by itself.
+        __m128i result = _mm_packus_epi16(lo, hi);
+        result = _mm_or_si128(_mm_andnot_si128(alpha_mask, result), _mm_and_si128(alpha_mask, pixels));
+
+        _mm_storeu_si128((__m128i *)(dest + i), result);
+    }
+
+    _MniPixelsPremultiplyScalar(dest + i, src + i, count - i, swap_red_blue);
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_AVX2
+static __m256i _MniPixelsMulAvx2(__m256i channels, int swap_red_blue) {
+    if (swap_red_blue) {
+        channels = _mm256_shufflelo_epi16(channels, _MM_SHUFFLE(3, 0, 1, 2));
+        channels = _mm256_shufflehi_epi16(channels, _MM_SHUFFLE(3, 0, 1, 2));
+    }
+
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(channels, 0xFF), 0xFF);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(channels, alpha), _mm256_set1_epi16(128));
+
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// ========================================================================== //
+
+// Unpack and pack work within 128-bit lanes, so pixel order comes out unchanged.
+MNI_PIXELS_TARGET_AVX2
+static void _MniPixelsPremultiplyAvx2(uint32_t *dest, const uint32_t *src, size_t count, int swap_red_blue) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_mask = _mm256_set1_epi32((int)0xFF000000);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i lo = _MniPixelsMulAvx2(_mm256_unpacklo_epi8(pixels, zero), swap_red_blue);
+        __m256i hi = _MniPixelsMulAvx2(_mm256_unpackhi_epi8(pixels, zero), swap_red_blue);
+
+        __m256i result = _mm256_packus_epi16(lo, hi);
+        result = _mm256_or_si256(_mm256_andnot_si256(alpha_mask, result), _mm256_and_si256(alpha_mask, pixels));
+
+        _mm256_storeu_si256((__m256i *)(dest + i), result);
+    }
+
+    _MniPixelsPremultiplyScalar(dest + i, src + i, count - i, swap_red_blue);
+}
+
+#endif // MNI_PIXELS_X86
+
+// ========================================================================== //
+
+#if defined(MNI_PIXELS_NEON)
+
+// (t + 128 + ((t + 128) >> 8)) >> 8, same as _MniPixelsMul.
+static uint8x8_t _MniPixelsMulNeon(uint8x8_t c, uint8x8_t a) {
+    uint16x8_t t = vmull_u8(c, a);
+    return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+}
+
+// ========================================================================== //
+
+static void _MniPixelsPremultiplyNeon(uint32_t *dest, const uint32_t *src, size_t count, int swap_red_blue) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t pixels = vld4_u8((const uint8_t *)(src + i));
+        uint8x8_t a = pixels.val[3];
+
+        uint8x8x4_t result;
+        result.val[0] = _MniPixelsMulNeon(pixels.val[swap_red_blue ? 2 : 0], a);
+        result.val[1] = _MniPixelsMulNeon(pixels.val[1], a);
+        result.val[2] = _MniPixelsMulNeon(pixels.val[swap_red_blue ? 0 : 2], a);
+        result.val[3] = a;
+
+        vst4_u8((uint8_t *)(dest + i), result);
+    }
+
+    _MniPixelsPremultiplyScalar(dest + i, src + i, count - i, swap_red_blue);
+}
+
+#endif // MNI_PIXELS_NEON
+
+// ========================================================================== //
+
+void _MniPixelsPremultiplyWith(MniPixelKernel kernel, uint32_t *dest, const uint32_t *src, size_t count, int swap_red_blue) {
+    if (!_MniPixelsKernelSupported(kernel)) {
+        kernel = MNI_PIXEL_KERNEL_SCALAR;
+    }
+
+    switch (kernel) {
+#if defined(MNI_PIXELS_X86)
+        case MNI_PIXEL_KERNEL_SSE2:
+            _MniPixelsPremultiplySse2(dest, src, count, swap_red_blue);
+            return;
+        case MNI_PIXEL_KERNEL_AVX2:
+            _MniPixelsPremultiplyAvx2(dest, src, count, swap_red_blue);
+            return;
+#endif
+#if defined(MNI_PIXELS_NEON)
+        case MNI_PIXEL_KERNEL_NEON:
+            _MniPixelsPremultiplyNeon(dest, src, count, swap_red_blue);
+            return;
+#endif
+        default:
+            _MniPixelsPremultiplyScalar(dest, src, count, swap_red_blue);
+            return;
+    }
+}
+
+// ========================================================================== //
+
+void _MniPixelsPremultiply(uint32_t *dest, const uint32_t *src, size_t count, int swap_red_blue) {
+    _MniPixelsPremultiplyWith(_MniPixelsBestKernel(), dest, src, count, swap_red_blue);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Resample
+
+typedef struct MniPixelsTaps {
+    int     first;
+    int     count;
+    float   weights[MNI_PIXELS_MAX_SIZE + 2];
+} MniPixelsTaps;
+
+// Source pixels contributing to dest pixel at index along one axis.
+static void _MniPixelsTaps(MniPixelsTaps *taps, int index, int dest_length, int src_length) {
+    if (dest_length < src_length) {
+        // Box filter, weight is the part of source pixel covered by dest pixel.
+        float scale = (float)src_length / (float)dest_length;
+        float begin = (float)index * scale;
+        float end = begin + scale;
+
+        int first = (int)begin;
+        int last = (int)ceilf(end);
+        if (last > src_length) {
+            last = src_length;
+        }
+
+        taps->first = first;
+        taps->count = 0;
+
+        for (int i = first; i < last; i += 1) {
+            float lo = begin > (float)i ? begin : (float)i;
+            float hi = end < (float)(i + 1) ? end : (float)(i + 1);
+            taps->weights[taps->count] = hi > lo ? (hi - lo) / scale : 0.0f;
+            taps->count += 1;
+        }
+    } else {
+        // Bilinear with pixel centers aligned, edges are clamped.
+        float position = ((float)index + 0.5f) * (float)src_length / (float)dest_length - 0.5f;
+        if (position < 0.0f) {
+            position = 0.0f;
+        }
+
+        int first = (int)position;
+        if (first >= src_length - 1) {
+            taps->first = src_length - 1;
+            taps->count = 1;
+            taps->weights[0] = 1.0f;
+            return;
+        }
+
+        float fraction = position - (float)first;
+        taps->first = first;
+        taps->count = 2;
+        taps->weights[0] = 1.0f - fraction;
+        taps->weights[1] = fraction;
+    }
+}
+
+// ========================================================================== //
+
+static uint32_t _MniPixelsRound(float value, uint32_t limit) {
+    if (value <= 0.0f) {
+        return 0;
+    }
+
+    uint32_t result = (uint32_t)(value + 0.5f);
+    return result > limit ? limit : result;
+}
+
+// ========================================================================== //
+
+void _MniPixelsResample(uint32_t *dest, int dest_width, int dest_height, ptrdiff_t dest_stride,
+                        const uint32_t *src, int src_width, int src_height, ptrdiff_t src_stride)
+{
+    if (dest_width == src_width && dest_height == src_height) {
+        for (int y = 0; y < dest_height; y += 1) {
+            memcpy(dest + y * dest_stride, src + y * src_stride, (size_t)dest_width * sizeof(uint32_t));
+        }
+        return;
+    }
+
+    // Icons are small, taps are cheaper to recompute than to keep for every column.
+    MniPixelsTaps row_taps;
+    MniPixelsTaps column_taps;
+
+    for (int y = 0; y < dest_height; y += 1) {
+        _MniPixelsTaps(&row_taps, y, dest_height, src_height);
+
+        for (int x = 0; x < dest_width; x += 1) {
+            _MniPixelsTaps(&column_taps, x, dest_width, src_width);
+
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+            for (int ty = 0; ty < row_taps.count; ty += 1) {
+                const uint32_t *row = src + (row_taps.first + ty) * src_stride + column_taps.first;
+
+                for (int tx = 0; tx < column_taps.count; tx += 1) {
+                    uint32_t pixel = row[tx];
+                    float weight = row_taps.weights[ty] * column_taps.weights[tx];
+
+                    sum[0] += (float)(pixel & 0xFF) * weight;
+                    sum[1] += (float)((pixel >> 8) & 0xFF) * weight;
+                    sum[2] += (float)((pixel >> 16) & 0xFF) * weight;
+                    sum[3] += (float)(pixel >> 24) * weight;
+                }
+            }
+
+            // Premultiplied color can't be above alpha, rounding must not break that.
+            uint32_t a = _MniPixelsRound(sum[3], 255);
+            uint32_t c0 = _MniPixelsRound(sum[0], a);
+            uint32_t c1 = _MniPixelsRound(sum[1], a);
+            uint32_t c2 = _MniPixelsRound(sum[2], a);
+
+            dest[y * dest_stride + x] = (a << 24) | (c2 << 16) | (c1 << 8) | c0;
+        }
+    }
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Hash
+
+// Eight 32-bit lanes with xxHash32 rounds, each lane takes every eighth pixel. Lanes are
+// independent so SIMD kernels process whole blocks at once, then lanes are folded into
+// 64 bits with the remaining pixels.
+
+#define MNI_PIXELS_HASH_LANES   8
+#define MNI_PIXELS_HASH_PRIME1  0x9E3779B1u
+#define MNI_PIXELS_HASH_PRIME2  0x85EBCA77u
+
+static uint32_t _MniPixelsHashRound(uint32_t lane, uint32_t pixel) {
+    lane += pixel * MNI_PIXELS_HASH_PRIME2;
+    lane = (lane << 13) | (lane >> 19);
+    return lane * MNI_PIXELS_HASH_PRIME1;
+}
+
+// ========================================================================== //
+
+static size_t _MniPixelsHashScalar(uint32_t lanes[MNI_PIXELS_HASH_LANES], const uint32_t *pixels, size_t count) {
+    size_t i = 0;
+    for (; i + MNI_PIXELS_HASH_LANES <= count; i += MNI_PIXELS_HASH_LANES) {
+        for (int k = 0; k < MNI_PIXELS_HASH_LANES; k += 1) {
+            lanes[k] = _MniPixelsHashRound(lanes[k], pixels[i + k]);
+        }
+    }
+
+    return i;
+}
+
+// ========================================================================== //
+
+#if defined(MNI_PIXELS_X86)
+
+// SSE2 has no 32-bit mullo, it is built from two 32x32->64 multiplies.
+MNI_PIXELS_TARGET_SSE2
+static __m128i _MniPixelsMullo32Sse2(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_SSE2
+static __m128i _MniPixelsHashRoundSse2(__m128i lanes, __m128i pixels) {
+    lanes = _mm_add_epi32(lanes, _MniPixelsMullo32Sse2(pixels, _mm_set1_epi32((int)MNI_PIXELS_HASH_PRIME2)));
+    lanes = _mm_or_si128(_mm_slli_epi32(lanes, 13), _mm_srli_epi32(lanes, 19));
+
+    return _MniPixelsMullo32Sse2(lanes, _mm_set1_epi32((int)MNI_PIXELS_HASH_PRIME1));
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_SSE2
+static size_t _MniPixelsHashSse2(uint32_t lanes[MNI_PIXELS_HASH_LANES], const uint32_t *pixels, size_t count) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)lanes);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(lanes + 4));
+
+    size_t i = 0;
+    for (; i + MNI_PIXELS_HASH_LANES <= count; i += MNI_PIXELS_HASH_LANES) {
+        lo = _MniPixelsHashRoundSse2(lo, _mm_loadu_si128((const __m128i *)(pixels + i)));
+        hi = _MniPixelsHashRoundSse2(hi, _mm_loadu_si128((const __m128i *)(pixels + i + 4)));
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, lo);
+    _mm_storeu_si128((__m128i *)(lanes + 4), hi);
+
+    return i;
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_AVX2
+static size_t _MniPixelsHashAvx2(uint32_t lanes[MNI_PIXELS_HASH_LANES], const uint32_t *pixels, size_t count) {
+    const __m256i prime1 = _mm256_set1_epi32((int)MNI_PIXELS_HASH_PRIME1);
+    const __m256i prime2 = _mm256_set1_epi32((int)MNI_PIXELS_HASH_PRIME2);
+
+    __m256i state = _mm256_loadu_si256((const __m256i *)lanes);
+
+    size_t i = 0;
+    for (; i + MNI_PIXELS_HASH_LANES <= count; i += MNI_PIXELS_HASH_LANES) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(pixels + i));
+        state = _mm256_add_epi32(state, _mm256_mullo_epi32(block, prime2));
+        state = _mm256_or_si256(_mm256_slli_epi32(state, 13), _mm256_srli_epi32(state, 19));
+        state = _mm256_mullo_epi32(state, prime1);
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, state);
+
+    return i;
+}
+
+#endif // MNI_PIXELS_X86
+
+// ========================================================================== //
+
+#if defined(MNI_PIXELS_NEON)
+
+static uint32x4_t _MniPixelsHashRoundNeon(uint32x4_t lanes, uint32x4_t pixels) {
+    lanes = vmlaq_n_u32(lanes, pixels, MNI_PIXELS_HASH_PRIME2);
+    lanes = vorrq_u32(vshlq_n_u32(lanes, 13), vshrq_n_u32(lanes, 19));
+
+    return vmulq_n_u32(lanes, MNI_PIXELS_HASH_PRIME1);
+}
+
+// ========================================================================== //
+
+static size_t _MniPixelsHashNeon(uint32_t lanes[MNI_PIXELS_HASH_LANES], const uint32_t *pixels, size_t count) {
+    uint32x4_t lo = vld1q_u32(lanes);
+    uint32x4_t hi = vld1q_u32(lanes + 4);
+
+    size_t i = 0;
+    for (; i + MNI_PIXELS_HASH_LANES <= count; i += MNI_PIXELS_HASH_LANES) {
+        lo = _MniPixelsHashRoundNeon(lo, vld1q_u32(pixels + i));
+        hi = _MniPixelsHashRoundNeon(hi, vld1q_u32(pixels + i + 4));
+    }
+
+    vst1q_u32(lanes, lo);
+    vst1q_u32(lanes + 4, hi);
+
+    return i;
+}
+
+#endif // MNI_PIXELS_NEON
+
+// ========================================================================== //
+
+static uint64_t _MniPixelsHashMix(uint64_t hash, uint32_t value) {
+    hash ^= value;
+    hash *= 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
+// ========================================================================== //
+
+uint64_t _MniPixelsHashWith(MniPixelKernel kernel, const uint32_t *pixels, size_t count, uint64_t seed) {
+    uint32_t lanes[MNI_PIXELS_HASH_LANES];
+    for (int k = 0; k < MNI_PIXELS_HASH_LANES; k += 1) {
+        lanes[k] = (uint32_t)seed + (uint32_t)(seed >> 32) + (uint32_t)(k + 1) * MNI_PIXELS_HASH_PRIME1;
+    }
+
+    if (!_MniPixelsKernelSupported(kernel)) {
+        kernel = MNI_PIXEL_KERNEL_SCALAR;
+    }
+
+    size_t hashed;
+    switch (kernel) {
+#if defined(MNI_PIXELS_X86)
+        case MNI_PIXEL_KERNEL_SSE2: hashed = _MniPixelsHashSse2(lanes, pixels, count); break;
+        case MNI_PIXEL_KERNEL_AVX2: hashed = _MniPixelsHashAvx2(lanes, pixels, count); break;
+#endif
+#if defined(MNI_PIXELS_NEON)
+        case MNI_PIXEL_KERNEL_NEON: hashed = _MniPixelsHashNeon(lanes, pixels, count); break;
+#endif
+        default:                    hashed = _MniPixelsHashScalar(lanes, pixels, count); break;
+    }
+
+    uint64_t hash = seed ^ ((uint64_t)count * 0x9E3779B97F4A7C15ull);
+
+    for (int k = 0; k < MNI_PIXELS_HASH_LANES; k += 1) {
+        hash = _MniPixelsHashMix(hash, lanes[k]);
+    }
+
+    for (size_t i = hashed; i < count; i += 1) {
+        hash = _MniPixelsHashMix(hash, pixels[i]);
+    }
+
+    // Final mix from splitmix64, spreads last pixels over all bits.
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+// ========================================================================== //
+
+uint64_t _MniPixelsHash(const uint32_t *pixels, size_t count, uint64_t seed) {
+    return _MniPixelsHashWith(_MniPixelsBestKernel(), pixels, count, seed);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Draw
+
+#define MNI_PIXELS_PI           3.14159265f
+
+#define MNI_PIXELS_GLYPH_WIDTH  3
+#define MNI_PIXELS_GLYPH_HEIGHT 5
+
+// 3x5 glyphs, rows top to bottom, highest bit of each row is the left pixel.
+static const uint16_t _mni_pixels_glyphs[] = {
+    0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF,  // 0-9
+    0x05D0,                                                                         // +
+};
+
+static int _MniPixelsGlyph(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    if (c == '+') {
+        return 10;
+    }
+
+    return -1;
+}
+
+// ========================================================================== //
+
+// Premultiplied color scaled by coverage over premultiplied pixel, exact rounding.
+static uint32_t _MniPixelsBlendCoverageOne(uint32_t pixel, uint8_t coverage, uint32_t color) {
+    uint32_t src_alpha = _MniPixelsMul(color >> 24, coverage);
+    uint32_t keep = 255 - src_alpha;
+    uint32_t result = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t src = _MniPixelsMul((color >> shift) & 0xFF, coverage);
+        uint32_t dst = _MniPixelsMul((pixel >> shift) & 0xFF, keep);
+        result |= (src + dst) << shift;
+    }
+
+    return result;
+}
+
+// ========================================================================== //
+
+static void _MniPixelsBlendCoverageScalar(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i += 1) {
+        if (coverage[i]) {
+            dest[i] = _MniPixelsBlendCoverageOne(dest[i], coverage[i], color);
+        }
+    }
+}
+
+// ========================================================================== //
+
+#if defined(MNI_PIXELS_X86)
+
+MNI_PIXELS_TARGET_SSE2
+static __m128i _MniPixelsDiv255Sse2(__m128i value) {
+    __m128i t = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// ========================================================================== //
+
+// 16-bit channels of two pixels, coverage repeated for each channel.
+MNI_PIXELS_TARGET_SSE2
+static __m128i _MniPixelsBlendCoverageSse2Pair(__m128i pixels, __m128i coverage, __m128i color) {
+    __m128i src = _MniPixelsDiv255Sse2(_mm_mullo_epi16(color, coverage));
+    __m128i src_alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF);
+    __m128i keep = _mm_sub_epi16(_mm_set1_epi16(255), src_alpha);
+
+    return _mm_add_epi16(src, _MniPixelsDiv255Sse2(_mm_mullo_epi16(pixels, keep)));
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_SSE2
+static void _MniPixelsBlendCoverageSse2(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t quad;
+        memcpy(&quad, coverage + i, sizeof(quad));
+        if (quad == 0) {
+            continue;
+        }
+
+        // Each coverage byte repeated for four channels of its pixel.
+        __m128i spread = _mm_cvtsi32_si128((int)quad);
+        spread = _mm_unpacklo_epi8(spread, spread);
+        spread = _mm_unpacklo_epi16(spread, spread);
+
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(dest + i));
+        __m128i lo = _MniPixelsBlendCoverageSse2Pair(_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi8(spread, zero), color16);
+        __m128i hi = _MniPixelsBlendCoverageSse2Pair(_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi8(spread, zero), color16);
+
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+    }
+
+    _MniPixelsBlendCoverageScalar(dest + i, coverage + i, count - i, color);
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_AVX2
+static __m256i _MniPixelsDiv255Avx2(__m256i value) {
+    __m256i t = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_AVX2
+static __m256i _MniPixelsBlendCoverageAvx2Pair(__m256i pixels, __m256i coverage, __m256i color) {
+    __m256i src = _MniPixelsDiv255Avx2(_mm256_mullo_epi16(color, coverage));
+    __m256i src_alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xFF), 0xFF);
+    __m256i keep = _mm256_sub_epi16(_mm256_set1_epi16(255), src_alpha);
+
+    return _mm256_add_epi16(src, _MniPixelsDiv255Avx2(_mm256_mullo_epi16(pixels, keep)));
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_AVX2
+static void _MniPixelsBlendCoverageAvx2(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i color16 = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)color), zero);
+
+    // Lane 0 spreads coverage of pixels 0-3, lane 1 of pixels 4-7.
+    const __m256i spread_mask = _mm256_setr_epi8(
+        0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+        4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7
+    );
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint64_t octet;
+        memcpy(&octet, coverage + i, sizeof(octet));
+        if (octet == 0) {
+            continue;
+        }
+
+        __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi64x((long long)octet), spread_mask);
+
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(dest + i));
+        __m256i lo = _MniPixelsBlendCoverageAvx2Pair(_mm256_unpacklo_epi8(pixels, zero), _mm256_unpacklo_epi8(spread, zero), color16);
+        __m256i hi = _MniPixelsBlendCoverageAvx2Pair(_mm256_unpackhi_epi8(pixels, zero), _mm256_unpackhi_epi8(spread, zero), color16);
+
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    _MniPixelsBlendCoverageScalar(dest + i, coverage + i, count - i, color);
+}
+
+#endif // MNI_PIXELS_X86
+
+// ========================================================================== //
+
+#if defined(MNI_PIXELS_NEON)
+
+static void _MniPixelsBlendCoverageNeon(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    const uint8x8_t color_b = vdup_n_u8((uint8_t)color);
+    const uint8x8_t color_g = vdup_n_u8((uint8_t)(color >> 8));
+    const uint8x8_t color_r = vdup_n_u8((uint8_t)(color >> 16));
+    const uint8x8_t color_a = vdup_n_u8((uint8_t)(color >> 24));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8_t cover = vld1_u8(coverage + i);
+        uint8x8x4_t pixels = vld4_u8((const uint8_t *)(dest + i));
+
+        uint8x8_t src_alpha = _MniPixelsMulNeon(color_a, cover);
+        uint8x8_t keep = vsub_u8(vdup_n_u8(255), src_alpha);
+
+        pixels.val[0] = vadd_u8(_MniPixelsMulNeon(color_b, cover), _MniPixelsMulNeon(pixels.val[0], keep));
+        pixels.val[1] = vadd_u8(_MniPixelsMulNeon(color_g, cover), _MniPixelsMulNeon(pixels.val[1], keep));
+        pixels.val[2] = vadd_u8(_MniPixelsMulNeon(color_r, cover), _MniPixelsMulNeon(pixels.val[2], keep));
+        pixels.val[3] = vadd_u8(src_alpha, _MniPixelsMulNeon(pixels.val[3], keep));
+
+        vst4_u8((uint8_t *)(dest + i), pixels);
+    }
+
+    _MniPixelsBlendCoverageScalar(dest + i, coverage + i, count - i, color);
+}
+
+#endif // MNI_PIXELS_NEON
+
+// ========================================================================== //
+
+void _MniPixelsBlendCoverageWith(MniPixelKernel kernel, uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    if (!_MniPixelsKernelSupported(kernel)) {
+        kernel = MNI_PIXEL_KERNEL_SCALAR;
+    }
+
+    switch (kernel) {
+#if defined(MNI_PIXELS_X86)
+        case MNI_PIXEL_KERNEL_SSE2:
+            _MniPixelsBlendCoverageSse2(dest, coverage, count, color);
+            return;
+        case MNI_PIXEL_KERNEL_AVX2:
+            _MniPixelsBlendCoverageAvx2(dest, coverage, count, color);
+            return;
+#endif
+#if defined(MNI_PIXELS_NEON)
+        case MNI_PIXEL_KERNEL_NEON:
+            _MniPixelsBlendCoverageNeon(dest, coverage, count, color);
+            return;
+#endif
+        default:
+            _MniPixelsBlendCoverageScalar(dest, coverage, count, color);
+            return;
+    }
+}
+
+// ========================================================================== //
+
+void _MniPixelsBlendCoverage(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color) {
+    _MniPixelsBlendCoverageWith(_MniPixelsBestKernel(), dest, coverage, count, color);
+}
+
+// ========================================================================== //
+
+void _MniPixelsUnpremultiply(uint32_t *dest, const uint32_t *src, size_t count) {
+    for (size_t i = 0; i < count; i += 1) {
+        uint32_t pixel = src[i];
+        uint32_t a = pixel >> 24;
+
+        if (a == 0 || a == 255) {
+            dest[i] = a == 0 ? 0 : pixel;
+            continue;
+        }
+
+        uint32_t result = a << 24;
+        for (int shift = 0; shift < 24; shift += 8) {
+            uint32_t c = (((pixel >> shift) & 0xFF) * 255 + a / 2) / a;
+            result |= (c > 255 ? 255 : c) << shift;
+        }
+
+        dest[i] = result;
+    }
+}
+
+// ========================================================================== //
+
+// Source over blend of straight alpha color covering part of premultiplied pixel.
+static void _MniPixelsBlend(uint32_t *pixel, uint32_t color, float coverage) {
+    if (coverage <= 0.0f) {
+        return;
+    }
+
+    if (coverage > 1.0f) {
+        coverage = 1.0f;
+    }
+
+    float alpha = (float)(color >> 24) * coverage / 255.0f;
+    float keep = 1.0f - alpha;
+    uint32_t result = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        float src = shift == 24 ? 255.0f : (float)((color >> shift) & 0xFF);
+        float value = src * alpha + (float)((*pixel >> shift) & 0xFF) * keep;
+        uint32_t c = (uint32_t)(value + 0.5f);
+        result |= (c > 255 ? 255 : c) << shift;
+    }
+
+    *pixel = result;
+}
+
+// ========================================================================== //
+
+void _MniPixelsDrawRing(uint32_t *pixels, int size, int thickness, int percent, uint32_t track_color, uint32_t arc_color) {
+    float center = (float)size * 0.5f;
+    float outer = center;
+    float inner = outer - (float)thickness;
+    float limit = (float)percent * (2.0f * MNI_PIXELS_PI) / 100.0f;
+
+    for (int y = 0; y < size; y += 1) {
+        for (int x = 0; x < size; x += 1) {
+            float dx = (float)x + 0.5f - center;
+            float dy = (float)y + 0.5f - center;
+            float distance = sqrtf(dx * dx + dy * dy);
+
+            // Approximate antialiasing, distance to the nearer edge of the ring.
+            float inside = distance - inner < outer - distance ? distance - inner : outer - distance;
+            float coverage = inside + 0.5f;
+            if (coverage <= 0.0f) {
+                continue;
+            }
+
+            // Clockwise from the top.
+            float angle = atan2f(dx, -dy);
+            if (angle < 0.0f) {
+                angle += 2.0f * MNI_PIXELS_PI;
+            }
+
+            _MniPixelsBlend(&pixels[y * size + x], angle < limit ? arc_color : track_color, coverage);
+        }
+    }
+}
+
+// ========================================================================== //
+
+void _MniPixelsDrawBadge(uint32_t *pixels, int size, const char *text, uint32_t background_color, uint32_t text_color) {
+    int scale = size / 16 > 1 ? size / 16 : 1;
+    int length = (int)strlen(text);
+
+    int text_width = length * (MNI_PIXELS_GLYPH_WIDTH + 1) * scale - scale;
+    int text_height = MNI_PIXELS_GLYPH_HEIGHT * scale;
+
+    // Pill in the bottom right corner, circle for a single digit.
+    int height = text_height + 2 * scale;
+    int width = text_width + 2 * scale > height ? text_width + 2 * scale : height;
+    if (width > size) {
+        width = size;
+    }
+    if (height > size) {
+        height = size;
+    }
+
+    int left = size - width;
+    int top = size - height;
+    float radius = (float)height * 0.5f;
+
+    for (int y = top; y < size; y += 1) {
+        for (int x = left; x < size; x += 1) {
+            float px = (float)x + 0.5f;
+            float py = (float)y + 0.5f;
+
+            float cx = px;
+            if (cx < (float)left + radius) {
+                cx = (float)left + radius;
+            } else if (cx > (float)size - radius) {
+                cx = (float)size - radius;
+            }
+            float cy = (float)top + radius;
+
+            float distance = sqrtf((px - cx) * (px - cx) + (py - cy) * (py - cy));
+            _MniPixelsBlend(&pixels[y * size + x], background_color, radius - distance + 0.5f);
+        }
+    }
+
+    int pen_x = left + (width - text_width) / 2;
+    int pen_y = top + (height - text_height) / 2;
+
+    for (int i = 0; i < length; i += 1) {
+        int glyph = _MniPixelsGlyph(text[i]);
+
+        for (int row = 0; glyph >= 0 && row < MNI_PIXELS_GLYPH_HEIGHT; row += 1) {
+            for (int column = 0; column < MNI_PIXELS_GLYPH_WIDTH; column += 1) {
+                int bit = (MNI_PIXELS_GLYPH_HEIGHT - row) * MNI_PIXELS_GLYPH_WIDTH - 1 - column;
+                if (!((_mni_pixels_glyphs[glyph] >> bit) & 1)) {
+                    continue;
+                }
+
+                for (int sy = 0; sy < scale; sy += 1) {
+                    for (int sx = 0; sx < scale; sx += 1) {
+                        int x = pen_x + column * scale + sx;
+                        int y = pen_y + row * scale + sy;
+                        if (x >= 0 && x < size && y >= 0 && y < size) {
+                            _MniPixelsBlend(&pixels[y * size + x], text_color, 1.0f);
+                        }
+                    }
+                }
+            }
+        }
+
+        pen_x += (MNI_PIXELS_GLYPH_WIDTH + 1) * scale;
+    }
+}
+
+// ========================================================================== //
+
+void _MniPixelsScrollLeft(uint32_t *pixels, int size) {
+    for (int y = 0; y < size; y += 1) {
+        uint32_t *row = pixels + y * size;
+        memmove(row, row + 1, (size_t)(size - 1) * sizeof(uint32_t));
+        row[size - 1] = 0;
+    }
+}
+
+// ========================================================================== //
+
+void _MniPixelsDrawGraphColumn(uint32_t *pixels, int size, int x, float level, uint32_t line_color, uint32_t fill_color) {
+    // Negated compare so NaN, from a 0/0 sample or an empty range, is drawn as 0.
+    if (!(level >= 0.0f)) {
+        level = 0.0f;
+    } else if (level > 1.0f) {
+        level = 1.0f;
+    }
+
+    float top = (float)size - level * (float)size;
+
+    // Area under the value, partly covered pixel at the top is blended.
+    for (int y = (int)top; y < size; y += 1) {
+        _MniPixelsBlend(&pixels[y * size + x], fill_color, (float)(y + 1) - top);
+    }
+
+    int line = (int)top < size ? (int)top : size - 1;
+    _MniPixelsBlend(&pixels[line * size + x], line_color, 1.0f);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Recolor
+
+static void _MniPixelsRecolorScalar(uint32_t *dest, const uint32_t *src, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i += 1) {
+        uint32_t a = src[i] >> 24;
+        uint32_t result = 0;
+
+        for (int shift = 0; shift < 32; shift += 8) {
+            result |= _MniPixelsMul((color >> shift) & 0xFF, a) << shift;
+        }
+
+        dest[i] = result;
+    }
+}
+
+// ========================================================================== //
+
+#if defined(MNI_PIXELS_X86)
+
+MNI_PIXELS_TARGET_SSE2
+static void _MniPixelsRecolorSse2(uint32_t *dest, const uint32_t *src, size_t count, uint32_t color) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32((int)color), zero);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // Alpha byte copied to all four bytes of its pixel.
+        __m128i a = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + i)), 24);
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+
+        __m128i lo = _MniPixelsDiv255Sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), color16));
+        __m128i hi = _MniPixelsDiv255Sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), color16));
+
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+    }
+
+    _MniPixelsRecolorScalar(dest + i, src + i, count - i, color);
+}
+
+// ========================================================================== //
+
+MNI_PIXELS_TARGET_AVX2
+static void _MniPixelsRecolorAvx2(uint32_t *dest, const uint32_t *src, size_t count, uint32_t color) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i color16 = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)color), zero);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = _mm256_srli_epi32(_mm256_loadu_si256((const __m256i *)(src + i)), 24);
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+
+        __m256i lo = _MniPixelsDiv255Avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), color16));
+        __m256i hi = _MniPixelsDiv255Avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), color16));
+
+        _mm256_storeu_si256((__m256i *)(dest + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    _MniPixelsRecolorScalar(dest + i, src + i, count - i, color);
+}
+
+#endif // MNI_PIXELS_X86
+
+// ========================================================================== //
+
+#if defined(MNI_PIXELS_NEON)
+
+static void _MniPixelsRecolorNeon(uint32_t *dest, const uint32_t *src, size_t count, uint32_t color) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t pixels = vld4_u8((const uint8_t *)(src + i));
+        uint8x8_t a = pixels.val[3];
+
+        pixels.val[0] = _MniPixelsMulNeon(vdup_n_u8((uint8_t)color), a);
+        pixels.val[1] = _MniPixelsMulNeon(vdup_n_u8((uint8_t)(color >> 8)), a);
+        pixels.val[2] = _MniPixelsMulNeon(vdup_n_u8((uint8_t)(color >> 16)), a);
+        pixels.val[3] = _MniPixelsMulNeon(vdup_n_u8((uint8_t)(color >> 24)), a);
+
+        vst4_u8((uint8_t *)(dest + i), pixels);
+    }
+
+    _MniPixelsRecolorScalar(dest + i, src + i, count - i, color);
+}
+
+#endif // MNI_PIXELS_NEON
+
+// ========================================================================== //
+
+void _MniPixelsRecolorWith(MniPixelKernel kernel, uint32_t *dest, const uint32_t *src, size_t count, uint32_t color) {
+    if (!_MniPixelsKernelSupported(kernel)) {
+        kernel = MNI_PIXEL_KERNEL_SCALAR;
+    }
+
+    switch (kernel) {
+#if defined(MNI_PIXELS_X86)
+        case MNI_PIXEL_KERNEL_SSE2:
+            _MniPixelsRecolorSse2(dest, src, count, color);
+            return;
+        case MNI_PIXEL_KERNEL_AVX2:
+            _MniPixelsRecolorAvx2(dest, src, count, color);
+            return;
+#endif
+#if defined(MNI_PIXELS_NEON)
+        case MNI_PIXEL_KERNEL_NEON:
+            _MniPixelsRecolorNeon(dest, src, count, color);
+            return;
+#endif
+        default:
+            _MniPixelsRecolorScalar(dest, src, count, color);
+            return;
+    }
+}
+
+// ========================================================================== //
+
+void _MniPixelsRecolor(uint32_t *dest, const uint32_t *src, size_t count, uint32_t color) {
+    _MniPixelsRecolorWith(_MniPixelsBestKernel(), dest, src, count, color);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Text
+
+// 5x7 font for printable ASCII up to 'Z', rows top to bottom, bit 4 is the left column.
+// Lowercase is drawn as uppercase, other characters as '?'.
+static const uint8_t _mni_text_font[MNI_TEXT_GLYPH_COUNT][MNI_TEXT_FONT_HEIGHT] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  // space
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },  // !
+    { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 },  // "
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A },  // #
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 },  // $
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },  // %
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D },  // &
+    { 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 },  // '
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },  // (
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },  // )
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 },  // *
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },  // +
+    { 0x00, 0x00, 0x00, 0x00, 0x06, 0x02, 0x04 },  // ,
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },  // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },  // .
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },  // /
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },  // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },  // 1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },  // 2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },  // 3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },  // 4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },  // 5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },  // 6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },  // 7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },  // 8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },  // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },  // :
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 },  // ;
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },  // <
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },  // =
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },  // >
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 },  // ?
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E },  // @
+    { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },  // A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },  // B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },  // C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },  // D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },  // E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },  // F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },  // G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },  // H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },  // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },  // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },  // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },  // L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },  // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },  // N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },  // O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },  // P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },  // Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },  // R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },  // S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },  // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },  // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },  // W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },  // X
+    { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 },  // Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },  // Z
+};
+
+static int _MniTextGlyph(char c) {
+    if (c >= 'a' && c <= 'z') {
+        c = (char)(c - 'a' + 'A');
+    }
+
+    if (c < MNI_TEXT_FIRST_CHAR || c > MNI_TEXT_LAST_CHAR) {
+        c = '?';
+    }
+
+    return c - MNI_TEXT_FIRST_CHAR;
+}
+
+// ========================================================================== //
+
+int _MniTextGlyphWidth(int height) {
+    int width = (height * MNI_TEXT_FONT_WIDTH + MNI_TEXT_FONT_HEIGHT / 2) / MNI_TEXT_FONT_HEIGHT;
+    return width > 0 ? width : 1;
+}
+
+// ========================================================================== //
+
+static int _MniTextGap(int height) {
+    return height / MNI_TEXT_FONT_HEIGHT > 1 ? height / MNI_TEXT_FONT_HEIGHT : 1;
+}
+
+// ========================================================================== //
+
+size_t _MniTextAtlasSize(int height) {
+    return (size_t)MNI_TEXT_GLYPH_COUNT * (size_t)_MniTextGlyphWidth(height) * (size_t)height;
+}
+
+// ========================================================================== //
+
+// Coverage of every glyph scaled to height, 4x4 samples per pixel. Heights which are
+// multiples of 7 come out sharp.
+void _MniTextAtlasBake(uint8_t *atlas, int height) {
+    int width = _MniTextGlyphWidth(height);
+
+    for (int glyph = 0; glyph < MNI_TEXT_GLYPH_COUNT; glyph += 1) {
+        const uint8_t *rows = _mni_text_font[glyph];
+        uint8_t *coverage = atlas + (size_t)glyph * (size_t)width * (size_t)height;
+
+        for (int y = 0; y < height; y += 1) {
+            for (int x = 0; x < width; x += 1) {
+                int hits = 0;
+
+                for (int sy = 0; sy < 4; sy += 1) {
+                    int fy = ((y * 4 + sy) * MNI_TEXT_FONT_HEIGHT + 2) / (height * 4);
+
+                    for (int sx = 0; sx < 4; sx += 1) {
+                        int fx = ((x * 4 + sx) * MNI_TEXT_FONT_WIDTH + 2) / (width * 4);
+                        hits += (rows[fy] >> (MNI_TEXT_FONT_WIDTH - 1 - fx)) & 1;
+                    }
+                }
+
+                coverage[y * width + x] = (uint8_t)(hits * 255 / 16);
+            }
+        }
+    }
+}
+
+// ========================================================================== //
+
+int _MniTextMeasure(const char *text, int height) {
+    int length = (int)strlen(text);
+    if (length == 0) {
+        return 0;
+    }
+
+    return length * _MniTextGlyphWidth(height) + (length - 1) * _MniTextGap(height);
+}
+
+// ========================================================================== //
+
+void _MniTextDraw(uint32_t *pixels, int size, const uint8_t *atlas, int height, const char *text, int x, int y, uint32_t color) {
+    int width = _MniTextGlyphWidth(height);
+    int advance = width + _MniTextGap(height);
+
+    for (const char *c = text; *c; c += 1, x += advance) {
+        const uint8_t *coverage = atlas + (size_t)_MniTextGlyph(*c) * (size_t)width * (size_t)height;
+
+        // Glyph is clipped to the image.
+        int left = x < 0 ? -x : 0;
+        int right = x + width > size ? size - x : width;
+        if (left >= right) {
+            continue;
+        }
+
+        for (int row = 0; row < height; row += 1) {
+            int py = y + row;
+            if (py < 0 || py >= size) {
+                continue;
+            }
+
+            _MniPixelsBlendCoverage(pixels + py * size + x + left, coverage + row * width + left, (size_t)(right - left), color);
+        }
+    }
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Delta
+
+// Frame is a list of ops, each starts with LEB128 varint of (length << 2) | op.
+#define MNI_PIXELS_DELTA_SKIP   0   // length pixels same as in previous frame
+#define MNI_PIXELS_DELTA_FILL   1   // one pixel follows, repeated length times
+#define MNI_PIXELS_DELTA_COPY   2   // length pixels follow
+
+static uint8_t *_MniPixelsDeltaOp(uint8_t *out, size_t length, uint32_t op) {
+    size_t value = (length << 2) | op;
+
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+
+    return out;
+}
+
+// ========================================================================== //
+
+size_t _MniPixelsDeltaBound(size_t count) {
+    // Worst case alternates one pixel copy with one pixel skip, 3 bytes per pixel.
+    return count * 4 + 16;
+}
+
+// ========================================================================== //
+
+size_t _MniPixelsDeltaEncode(uint8_t *out, const uint32_t *frame, const uint32_t *previous, size_t count) {
+    uint8_t *begin = out;
+    size_t i = 0;
+
+    while (i < count) {
+        size_t j = i;
+
+        if (previous && frame[i] == previous[i]) {
+            while (j < count && frame[j] == previous[j]) {
+                j += 1;
+            }
+            out = _MniPixelsDeltaOp(out, j - i, MNI_PIXELS_DELTA_SKIP);
+        } else if (i + 2 < count && frame[i] == frame[i + 1] && frame[i] == frame[i + 2]) {
+            while (j < count && frame[j] == frame[i]) {
+                j += 1;
+            }
+            out = _MniPixelsDeltaOp(out, j - i, MNI_PIXELS_DELTA_FILL);
+            memcpy(out, &frame[i], 4);
+            out += 4;
+        } else {
+            // Copy ends where skip or fill would be cheaper.
+            while (j < count && !(previous && frame[j] == previous[j]) &&
+                   !(j + 2 < count && frame[j] == frame[j + 1] && frame[j] == frame[j + 2]))
+            {
+                j += 1;
+            }
+            out = _MniPixelsDeltaOp(out, j - i, MNI_PIXELS_DELTA_COPY);
+            memcpy(out, &frame[i], (j - i) * 4);
+            out += (j - i) * 4;
+        }
+
+        i = j;
+    }
+
+    return (size_t)(out - begin);
+}
+
+// ========================================================================== //
+
+int _MniPixelsDeltaDecode(uint32_t *frame, size_t count, const uint8_t *data, size_t size) {
+    const uint8_t *end = data + size;
+    size_t i = 0;
+
+    while (data < end) {
+        size_t value = 0;
+        int shift = 0;
+        uint8_t byte;
+
+        do {
+            if (data == end || shift > 28) {
+                return 0;
+            }
+            byte = *data++;
+            value |= (size_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        size_t length = value >> 2;
+        if (length == 0 || length > count - i) {
+            return 0;
+        }
+
+        switch (value & 3) {
+            case MNI_PIXELS_DELTA_SKIP:
+                break;
+
+            case MNI_PIXELS_DELTA_FILL: {
+                if ((size_t)(end - data) < 4) {
+                    return 0;
+                }
+
+                uint32_t pixel;
+                memcpy(&pixel, data, 4);
+                data += 4;
+
+                for (size_t k = 0; k < length; k += 1) {
+                    frame[i + k] = pixel;
+                }
+                break;
+            }
+
+            case MNI_PIXELS_DELTA_COPY:
+                if ((size_t)(end - data) / 4 < length) {
+                    return 0;
+                }
+
+                memcpy(frame + i, data, length * 4);
+                data += length * 4;
+                break;
+
+            default:
+                return 0;
+        }
+
+        i += length;
+    }
+
+    return i == count;
+}
+
+#pragma endregion
+
@@ -0,0 +1,94 @@
+#ifndef MNI_PIXELS_H
+#define MNI_PIXELS_H
+
+// Pixel kernels used to build icons from raw pixels. This part doesn't depend on
+// Windows headers, so it can be compiled, tested and benchmarked on any platform.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Largest width or height of source and destination image.
+#define MNI_PIXELS_MAX_SIZE     256
+
+typedef enum MniPixelKernel {
+    MNI_PIXEL_KERNEL_SCALAR = 0,
+    MNI_PIXEL_KERNEL_SSE2   = 1,
+    MNI_PIXEL_KERNEL_AVX2   = 2,
+    MNI_PIXEL_KERNEL_NEON   = 3,
+} MniPixelKernel;
+
+// Best kernel supported by this build and cpu, detected once.
+MniPixelKernel _MniPixelsBestKernel(void);
+
+// Returns 0 when kernel is not supported by this build or cpu.
+int _MniPixelsKernelSupported(MniPixelKernel kernel);
+
+// Converts count straight alpha pixels to premultiplied BGRA, the layout of 32-bit DIB.
+// Source is BGRA, or RGBA when swap_red_blue is set. dest and src may be the same.
+// All kernels give bit identical results.
+void _MniPixelsPremultiply(uint32_t *dest, const uint32_t *src, size_t count, int swap_red_blue);
+void _MniPixelsPremultiplyWith(MniPixelKernel kernel, uint32_t *dest, const uint32_t *src, size_t count, int swap_red_blue);
+
+// Resamples premultiplied image, box filter when shrinking and bilinear when growing.
+// Strides are in pixels. Sizes must be in range 1..MNI_PIXELS_MAX_SIZE.
+void _MniPixelsResample(uint32_t *dest, int dest_width, int dest_height, ptrdiff_t dest_stride,
+                        const uint32_t *src, int src_width, int src_height, ptrdiff_t src_stride);
+
+// 64-bit content hash, not cryptographic. Different seeds give unrelated hashes.
+// All kernels give the same hash.
+uint64_t _MniPixelsHash(const uint32_t *pixels, size_t count, uint64_t seed);
+uint64_t _MniPixelsHashWith(MniPixelKernel kernel, const uint32_t *pixels, size_t count, uint64_t seed);
+
+// Converts premultiplied BGRA back to straight alpha, which icon bitmaps expect.
+void _MniPixelsUnpremultiply(uint32_t *dest, const uint32_t *src, size_t count);
+
+// Drawing on premultiplied size x size image, colors are straight alpha BGRA.
+// Ring goes along the edge clockwise from the top, badge text may contain digits and '+'.
+void _MniPixelsDrawRing(uint32_t *pixels, int size, int thickness, int percent, uint32_t track_color, uint32_t arc_color);
+void _MniPixelsDrawBadge(uint32_t *pixels, int size, const char *text, uint32_t background_color, uint32_t text_color);
+
+// Graph is drawn column by column, scrolling moves it left and clears the last column.
+// level is 0..1 from the bottom, outside values are clamped, NaN is drawn as 0.
+void _MniPixelsScrollLeft(uint32_t *pixels, int size);
+void _MniPixelsDrawGraphColumn(uint32_t *pixels, int size, int x, float level, uint32_t line_color, uint32_t fill_color);
+
+// Blends premultiplied color scaled by 8-bit coverage over premultiplied pixels.
+// All kernels give bit identical results.
+void _MniPixelsBlendCoverage(uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color);
+void _MniPixelsBlendCoverageWith(MniPixelKernel kernel, uint32_t *dest, const uint8_t *coverage, size_t count, uint32_t color);
+
+// Replaces colors of premultiplied pixels by premultiplied color, keeping only their alpha
+// as coverage. dest and src may be the same. All kernels give bit identical results.
+void _MniPixelsRecolor(uint32_t *dest, const uint32_t *src, size_t count, uint32_t color);
+void _MniPixelsRecolorWith(MniPixelKernel kernel, uint32_t *dest, const uint32_t *src, size_t count, uint32_t color);
+
+// Tiny text from built-in 5x7 font. Glyphs are baked once per height into coverage atlas
+// of _MniTextAtlasSize bytes, then blended with _MniPixelsBlendCoverage.
+#define MNI_TEXT_FIRST_CHAR     0x20
+#define MNI_TEXT_LAST_CHAR      0x5A
+#define MNI_TEXT_GLYPH_COUNT    (MNI_TEXT_LAST_CHAR - MNI_TEXT_FIRST_CHAR + 1)
+#define MNI_TEXT_FONT_WIDTH     5
+#define MNI_TEXT_FONT_HEIGHT    7
+
+int _MniTextGlyphWidth(int height);
+size_t _MniTextAtlasSize(int height);
+void _MniTextAtlasBake(uint8_t *atlas, int height);
+int _MniTextMeasure(const char *text, int height);
+void _MniTextDraw(uint32_t *pixels, int size, const uint8_t *atlas, int height, const char *text, int x, int y, uint32_t color);
+
+// Frame compressed against previous one, unchanged pixels are skipped and runs are filled.
+// previous NULL encodes whole frame. out must hold _MniPixelsDeltaBound(count) bytes.
+// Decode applies frame on top of previous one in frame, returns 0 for malformed data.
+size_t _MniPixelsDeltaBound(size_t count);
+size_t _MniPixelsDeltaEncode(uint8_t *out, const uint32_t *frame, const uint32_t *previous, size_t count);
+int _MniPixelsDeltaDecode(uint32_t *frame, size_t count, const uint8_t *data, size_t size);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // MNI_PIXELS_H
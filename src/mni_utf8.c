@@ -0,0 +1,192 @@
+#include "mni_utf8.h"
+
+// SSE2 is part of x64 and default target of 32-bit MSVC, so unlike mni_pixels no cpuid is needed.
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define MNI_UTF8_SSE2
+    #include <emmintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>     // _BitScanForward
+    #endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+    #define MNI_UTF8_NEON
+    #include <arm_neon.h>
+#endif
+
+#if defined(MNI_UTF8_SSE2) || defined(MNI_UTF8_NEON)
+    #define MNI_UTF8_VECTOR     16
+#endif
+
+// Vector loads may read past the terminator, but never into next page, which might not be mapped.
+#define MNI_UTF8_PAGE_SIZE      4096
+
+// ========================================================================== //
+
+#pragma region Scalar
+
+// Decodes code point at utf8 and returns bytes it took. Malformed sequence gives replacement
+// and takes only its valid prefix, byte that broke it starts the next one.
+static int _MniUtf8Decode(const uint8_t *utf8, uint32_t *code_point) {
+    uint8_t lead = utf8[0];
+    uint8_t low = 0x80;
+    uint8_t high = 0xBF;
+    uint32_t value = 0;
+    int length = 0;
+
+    // Second byte ranges rule out overlong forms, surrogates and values above U+10FFFF.
+    if (lead < 0x80) {
+        *code_point = lead;
+        return 1;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        value = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        value = lead & 0x0F;
+        low = lead == 0xE0 ? 0xA0 : 0x80;
+        high = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        value = lead & 0x07;
+        low = lead == 0xF0 ? 0x90 : 0x80;
+        high = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        *code_point = MNI_UTF8_REPLACEMENT;
+        return 1;
+    }
+
+    // Terminator fails the range check too, nothing after it is read.
+    for (int i = 1; i < length; i += 1) {
+        uint8_t c = utf8[i];
+        if (c < low || c > high) {
+            *code_point = MNI_UTF8_REPLACEMENT;
+            return i;
+        }
+
+        value = (value << 6) | (c & 0x3F);
+        low = 0x80;
+        high = 0xBF;
+    }
+
+    *code_point = value;
+    return length;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Vector
+
+// Widens 16 bytes into dest and returns how many leading ones are ASCII, stopping at the
+// terminator. Units past that are garbage the caller overwrites.
+
+#if defined(MNI_UTF8_SSE2)
+
+static int _MniUtf8Widen(const uint8_t *src, uint16_t *dest) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)src);
+    __m128i zero = _mm_setzero_si128();
+
+    _mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi8(bytes, zero));
+    _mm_storeu_si128((__m128i *)(dest + 8), _mm_unpackhi_epi8(bytes, zero));
+
+    // High bit is set for non-ASCII bytes, compare sets it for terminator.
+    unsigned long stop = (unsigned long)_mm_movemask_epi8(_mm_or_si128(bytes, _mm_cmpeq_epi8(bytes, zero)));
+    if (stop == 0) {
+        return 16;
+    }
+
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, stop);
+    return (int)index;
+#else
+    return __builtin_ctzl(stop);
+#endif
+}
+
+#elif defined(MNI_UTF8_NEON)
+
+static int _MniUtf8Widen(const uint8_t *src, uint16_t *dest) {
+    uint8x16_t bytes = vld1q_u8(src);
+
+    vst1q_u16(dest, vmovl_u8(vget_low_u8(bytes)));
+    vst1q_u16(dest + 8, vmovl_u8(vget_high_u8(bytes)));
+
+    // As signed, non-ASCII bytes are negative and terminator is zero.
+    uint8x16_t ascii = vcgtq_s8(vreinterpretq_s8_u8(bytes), vdupq_n_s8(0));
+    if (vminvq_u8(ascii) == 0xFF) {
+        return 16;
+    }
+
+    int count = 0;
+    while (src[count] != 0 && src[count] < 0x80) {
+        count += 1;
+    }
+
+    return count;
+}
+
+#endif
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Transcoder
+
+int _MniUtf8ToUtf16(const char *utf8, uint16_t *dest, int cch) {
+    if (!dest || cch <= 0) {
+        return 0;
+    }
+
+    const uint8_t *src = (const uint8_t *)utf8;
+    int room = cch - 1;
+    int count = 0;
+
+    while (src && count < room) {
+        uint8_t c = *src;
+        if (c == 0) {
+            break;
+        }
+
+        if (c < 0x80) {
+#if defined(MNI_UTF8_VECTOR)
+            if (room - count >= MNI_UTF8_VECTOR && ((uintptr_t)src & (MNI_UTF8_PAGE_SIZE - 1)) <= MNI_UTF8_PAGE_SIZE - MNI_UTF8_VECTOR) {
+                int ascii = _MniUtf8Widen(src, dest + count);
+                src += ascii;
+                count += ascii;
+                continue;
+            }
+#endif
+            dest[count] = c;
+            src += 1;
+            count += 1;
+            continue;
+        }
+
+        uint32_t code_point;
+        int length = _MniUtf8Decode(src, &code_point);
+
+        if (code_point >= 0x10000) {
+            // Half of a pair would be shown as garbage, it's dropped with the rest.
+            if (room - count < 2) {
+                break;
+            }
+
+            code_point -= 0x10000;
+            dest[count] = (uint16_t)(0xD800 | (code_point >> 10));
+            dest[count + 1] = (uint16_t)(0xDC00 | (code_point & 0x3FF));
+            count += 2;
+        } else {
+            dest[count] = (uint16_t)code_point;
+            count += 1;
+        }
+
+        src += length;
+    }
+
+    dest[count] = 0;
+    return count;
+}
+
+#pragma endregion
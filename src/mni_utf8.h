@@ -0,0 +1,28 @@
+#ifndef MNI_UTF8_H
+#define MNI_UTF8_H
+
+// UTF-8 to UTF-16 transcoder for tip and balloon strings. Converts in one pass straight into
+// fixed size fields like those of NOTIFYICONDATAW, input isn't measured first. ASCII runs are
+// widened 16 bytes at a time with SSE2 or NEON. Like mni_pixels this part doesn't depend on
+// Windows headers, it can be benchmarked and fuzzed on any platform.
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define MNI_UTF8_REPLACEMENT    0xFFFD
+
+// Converts zero terminated utf8 into dest of cch units, result is always terminated. Input
+// that doesn't fit is cut at code point boundary, surrogate pair is never split. Each maximal
+// invalid subsequence becomes MNI_UTF8_REPLACEMENT, same as MultiByteToWideChar does. Input
+// is read up to what fits, vector loads may touch bytes past the terminator but never cross
+// into the next page. Returns units written without terminator.
+int _MniUtf8ToUtf16(const char *utf8, uint16_t *dest, int cch);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif // MNI_UTF8_H
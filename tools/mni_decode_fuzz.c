@@ -0,0 +1,361 @@
+// Fuzz harness of ICO, BMP and PNG decoders. Every input is copied into buffer of exactly
+// its size, so sanitizers catch reads past the end.
+//
+// Standalone, mutates built-in BMP, ICO and PNG seeds or replays given files:
+//   cc -O1 -g -fsanitize=address,undefined -o mni_decode_fuzz tools/mni_decode_fuzz.c src/mni_decode.c src/mni_pixels.c -lm
+//   ./mni_decode_fuzz [iterations [seed]]
+//   ./mni_decode_fuzz -replay <file> ...
+//
+// libFuzzer:
+//   clang -O1 -g -fsanitize=fuzzer,address,undefined -DMNI_DECODE_FUZZ_LIBFUZZER -o mni_decode_fuzz tools/mni_decode_fuzz.c src/mni_decode.c src/mni_pixels.c -lm
+//
+// 32-bit build (-m32) covers offset arithmetic of the Win32 configuration.
+
+#include "../src/mni_decode.h"
+#include "../src/mni_pixels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+    #pragma warning(disable: 4996)  // fopen
+#endif
+
+// ========================================================================== //
+
+#pragma region Target
+
+static void _DecodeOne(const uint8_t *input, size_t size, int target_size) {
+    MniDecodeInfo info;
+    if (_MniDecodeProbe(input, size, target_size, &info) != MNI_DECODE_OK) {
+        return;
+    }
+
+    if (info.width <= 0 || info.height <= 0 || info.width > MNI_PIXELS_MAX_SIZE || info.height > MNI_PIXELS_MAX_SIZE) {
+        fprintf(stderr, "probe returned %dx%d\n", info.width, info.height);
+        abort();
+    }
+
+    uint32_t *pixels = (uint32_t *)malloc((size_t)info.width * (size_t)info.height * sizeof(uint32_t));
+    void *scratch = malloc(info.scratch_size ? info.scratch_size : 1);
+    if (pixels && scratch) {
+        _MniDecodeImage(input, size, &info, pixels, scratch);
+    }
+
+    free(scratch);
+    free(pixels);
+}
+
+// ========================================================================== //
+
+static int _Decode(const uint8_t *data, size_t size) {
+    // Exact copy, malloc(0) may return NULL which decoders have to handle too.
+    uint8_t *input = (uint8_t *)malloc(size ? size : 1);
+    if (!input) {
+        return 0;
+    }
+    memcpy(input, data, size);
+
+    static const int target_sizes[] = { 16, 32, 256 };
+    for (size_t i = 0; i < sizeof(target_sizes) / sizeof(target_sizes[0]); i += 1) {
+        _DecodeOne(input, size, target_sizes[i]);
+    }
+
+    free(input);
+    return 0;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#if defined(MNI_DECODE_FUZZ_LIBFUZZER)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    return _Decode(data, size);
+}
+
+#else
+
+// ========================================================================== //
+
+#pragma region Seeds
+
+#define SEED_CAPACITY   1024
+
+typedef struct Seed {
+    uint8_t     data[SEED_CAPACITY];
+    size_t      size;
+} Seed;
+
+static void _Put16(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void _Put32(uint8_t *p, uint32_t value) {
+    _Put16(p, value);
+    _Put16(p + 2, value >> 16);
+}
+
+static void _Put32BE(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+// ========================================================================== //
+
+// BITMAPINFOHEADER of width x height image, returns its size.
+static size_t _PutInfoHeader(uint8_t *p, int width, int height, int bpp, int compression) {
+    memset(p, 0, 40);
+    _Put32(p, 40);
+    _Put32(p + 4, (uint32_t)width);
+    _Put32(p + 8, (uint32_t)height);
+    _Put16(p + 12, 1);
+    _Put16(p + 14, (uint32_t)bpp);
+    _Put32(p + 16, (uint32_t)compression);
+    return 40;
+}
+
+// ========================================================================== //
+
+// 32-bit bitfields bitmap file, masks follow the header.
+static void _SeedBmp(Seed *seed) {
+    uint8_t *p = seed->data;
+    size_t header = 14 + _PutInfoHeader(p + 14, 4, 4, 32, 3);
+
+    _Put32(p + header, 0x00FF0000);
+    _Put32(p + header + 4, 0x0000FF00);
+    _Put32(p + header + 8, 0x000000FF);
+    size_t pixels = header + 12;
+
+    for (int i = 0; i < 16; i += 1) {
+        _Put32(p + pixels + (size_t)i * 4, 0x80402010u * (uint32_t)(i + 1));
+    }
+
+    p[0] = 'B';
+    p[1] = 'M';
+    seed->size = pixels + 64;
+    _Put32(p + 2, (uint32_t)seed->size);
+    _Put32(p + 10, (uint32_t)pixels);
+}
+
+// ========================================================================== //
+
+// ICO with 8-bit paletted image and its AND mask.
+static void _SeedIco(Seed *seed) {
+    uint8_t *p = seed->data;
+    memset(p, 0, 22);
+    _Put16(p + 2, 1);
+    _Put16(p + 4, 1);
+    p[6] = 8;
+    p[7] = 8;
+    _Put16(p + 10, 1);
+    _Put16(p + 12, 8);
+
+    uint8_t *dib = p + 22;
+    size_t offset = _PutInfoHeader(dib, 8, 16, 8, 0);
+    _Put32(dib + 32, 4);
+    for (int i = 0; i < 4; i += 1) {
+        _Put32(dib + offset + (size_t)i * 4, 0x00112233u * (uint32_t)i);
+    }
+    offset += 16;
+
+    for (int i = 0; i < 64; i += 1) {
+        dib[offset + (size_t)i] = (uint8_t)(i & 3);
+    }
+    offset += 64;
+
+    memset(dib + offset, 0x0F, 32);
+    offset += 32;
+
+    _Put32(p + 14, (uint32_t)offset);
+    _Put32(p + 18, 22);
+    seed->size = 22 + offset;
+}
+
+// ========================================================================== //
+
+// 3x3 RGBA PNG, zlib stream is one stored block. Decoder checks neither CRC nor Adler-32.
+static void _SeedPng(Seed *seed) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t *p = seed->data;
+    size_t offset = 0;
+
+    memcpy(p, signature, 8);
+    offset += 8;
+
+    _Put32BE(p + offset, 13);
+    memcpy(p + offset + 4, "IHDR", 4);
+    _Put32BE(p + offset + 8, 3);
+    _Put32BE(p + offset + 12, 3);
+    memcpy(p + offset + 16, "\x08\x06\x00\x00\x00", 5);
+    offset += 12 + 13;
+
+    // Each row is filter byte and 3 RGBA pixels.
+    uint8_t raw[3 * 13];
+    for (size_t i = 0; i < sizeof(raw); i += 1) {
+        raw[i] = i % 13 == 0 ? (uint8_t)(i / 13) : (uint8_t)(i * 37);
+    }
+
+    uint32_t length = 2 + 5 + (uint32_t)sizeof(raw) + 4;
+    _Put32BE(p + offset, length);
+    memcpy(p + offset + 4, "IDAT", 4);
+    uint8_t *zlib = p + offset + 8;
+    zlib[0] = 0x78;
+    zlib[1] = 0x01;
+    zlib[2] = 1;
+    _Put16(zlib + 3, sizeof(raw));
+    _Put16(zlib + 5, (uint32_t)~sizeof(raw) & 0xFFFF);
+    memcpy(zlib + 7, raw, sizeof(raw));
+    memset(zlib + 7 + sizeof(raw), 0, 4);
+    offset += 12 + length;
+
+    _Put32BE(p + offset, 0);
+    memcpy(p + offset + 4, "IEND", 4);
+    offset += 12;
+
+    seed->size = offset;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Mutator
+
+static uint64_t g_random;
+
+static uint32_t _Random(void) {
+    // xorshift64*
+    g_random ^= g_random >> 12;
+    g_random ^= g_random << 25;
+    g_random ^= g_random >> 27;
+    return (uint32_t)((g_random * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// ========================================================================== //
+
+static size_t _Mutate(uint8_t *data, size_t size, size_t capacity) {
+    // Sizes and offsets are where decoders go wrong, so whole fields get boundary values.
+    static const uint32_t interesting[] = {
+        0, 1, 2, 3, 4, 8, 12, 13, 16, 32, 40, 44, 52, 56, 64, 108, 124, 255, 256, 257,
+        0x7FFF, 0x8000, 0xFFFF, 0x10000, 0x7FFFFFFF, 0x80000000, 0xFFFFFFF0, 0xFFFFFFFF,
+    };
+
+    int rounds = 1 + (int)(_Random() % 4);
+    for (int round = 0; round < rounds && size > 0; round += 1) {
+        size_t at = _Random() % size;
+
+        switch (_Random() % 6) {
+            case 0:
+                data[at] ^= (uint8_t)(1u << (_Random() % 8));
+                break;
+            case 1:
+                data[at] = (uint8_t)_Random();
+                break;
+            case 2:
+                if (size - at >= 2) {
+                    _Put16(data + at, interesting[_Random() % (sizeof(interesting) / sizeof(interesting[0]))]);
+                }
+                break;
+            case 3:
+                if (size - at >= 4) {
+                    uint32_t value = interesting[_Random() % (sizeof(interesting) / sizeof(interesting[0]))];
+                    if (_Random() % 2) {
+                        _Put32(data + at, value);
+                    } else {
+                        _Put32BE(data + at, value);
+                    }
+                }
+                break;
+            case 4:
+                size = at + 1;
+                break;
+            default:
+                if (size < capacity) {
+                    size_t grow = 1 + _Random() % 16;
+                    if (grow > capacity - size) {
+                        grow = capacity - size;
+                    }
+                    for (size_t i = 0; i < grow; i += 1) {
+                        data[size + i] = (uint8_t)_Random();
+                    }
+                    size += grow;
+                }
+                break;
+        }
+    }
+
+    return size;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+static int _Replay(int count, char **paths) {
+    for (int i = 0; i < count; i += 1) {
+        FILE *file = fopen(paths[i], "rb");
+        if (!file) {
+            fprintf(stderr, "can't open %s\n", paths[i]);
+            return 1;
+        }
+
+        static uint8_t data[1 << 24];
+        size_t size = fread(data, 1, sizeof(data), file);
+        fclose(file);
+
+        _Decode(data, size);
+        printf("%s ok\n", paths[i]);
+    }
+
+    return 0;
+}
+
+// ========================================================================== //
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && strcmp(argv[1], "-replay") == 0) {
+        return _Replay(argc - 2, argv + 2);
+    }
+
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    g_random = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x9E3779B97F4A7C15ull;
+    if (iterations <= 0 || g_random == 0) {
+        fprintf(stderr, "usage: mni_decode_fuzz [iterations [seed]]\n       mni_decode_fuzz -replay <file> ...\n");
+        return 1;
+    }
+
+    static Seed seeds[3];
+    _SeedBmp(&seeds[0]);
+    _SeedIco(&seeds[1]);
+    _SeedPng(&seeds[2]);
+
+    // Seeds must decode, otherwise mutations only exercise early rejection.
+    for (int i = 0; i < 3; i += 1) {
+        MniDecodeInfo info;
+        MniDecodeStatus status = _MniDecodeProbe(seeds[i].data, seeds[i].size, 32, &info);
+        if (status != MNI_DECODE_OK) {
+            fprintf(stderr, "seed %d: %s\n", i, _MniDecodeStatusToString(status));
+            return 1;
+        }
+    }
+
+    for (long i = 0; i < iterations; i += 1) {
+        const Seed *seed = &seeds[_Random() % 3];
+        uint8_t data[SEED_CAPACITY];
+        memcpy(data, seed->data, seed->size);
+
+        size_t size = _Mutate(data, seed->size, sizeof(data));
+        _Decode(data, size);
+    }
+
+    printf("%ld inputs decoded\n", iterations);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,436 @@
+// Fuzz harness of notification journal recovery. Every input is copied into buffer of exactly
+// its size, so sanitizers catch reads past the end, then it's recovered the way the queue does
+// it: validate, scan for the tail, zero what's past it, collect pending records and read them.
+// Recovered journal must be consistent and take a new record at its tail.
+//
+// Standalone, checks recovery of torn and corrupted records of a built-in journal first, then
+// mutates it, or replays given files:
+//   cc -O1 -g -fsanitize=address,undefined -o mni_journal_fuzz tools/mni_journal_fuzz.c src/mni_journal.c
+//   ./mni_journal_fuzz [iterations [seed]]
+//   ./mni_journal_fuzz -replay <file> ...
+//
+// libFuzzer:
+//   clang -O1 -g -fsanitize=fuzzer,address,undefined -DMNI_JOURNAL_FUZZ_LIBFUZZER -o mni_journal_fuzz tools/mni_journal_fuzz.c src/mni_journal.c
+
+#include "../src/mni_journal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+    #pragma warning(disable: 4996)  // fopen
+#endif
+
+// ========================================================================== //
+
+#pragma region Target
+
+static void _Fail(const char *what, size_t value) {
+    fprintf(stderr, "%s (%zu)\n", what, value);
+    abort();
+}
+
+// ========================================================================== //
+
+// Recovers journal in place and returns its tail, 0 when it isn't a journal.
+static size_t _RecoverOne(uint8_t *data, size_t size, uint64_t *out_last_id) {
+    if (_MniJournalValidate(data, size) != MNI_JOURNAL_OK) {
+        return 0;
+    }
+
+    size_t posted_count = 0;
+    uint64_t last_id = 0;
+    size_t tail = _MniJournalScan(data, size, &posted_count, &last_id);
+    *out_last_id = last_id;
+
+    if (tail < sizeof(MniJournalHeader) || tail > size || tail % MNI_JOURNAL_ALIGNMENT) {
+        _Fail("scan returned bad tail", tail);
+    }
+    if (posted_count > (tail - sizeof(MniJournalHeader)) / sizeof(MniJournalRecord)) {
+        _Fail("scan counted more posted records than fit", posted_count);
+    }
+
+    // Same as journal open, appends must not run into bytes of a torn record.
+    memset(data + tail, 0, size - tail);
+
+    size_t *offsets = (size_t *)malloc((posted_count ? posted_count : 1) * sizeof(size_t));
+    if (!offsets) {
+        return tail;
+    }
+
+    size_t pending = posted_count > 0 ? _MniJournalPending(data, tail, offsets, posted_count) : 0;
+    if (pending > posted_count) {
+        _Fail("more pending than posted records", pending);
+    }
+
+    uint64_t previous_id = 0;
+    for (size_t i = 0; i < pending; i += 1) {
+        if (offsets[i] < sizeof(MniJournalHeader) || offsets[i] >= tail || offsets[i] % MNI_JOURNAL_ALIGNMENT) {
+            _Fail("pending offset outside of records", offsets[i]);
+        }
+
+        MniJournalEntry entry;
+        _MniJournalRead(data, offsets[i], &entry);
+
+        if (entry.type != MNI_JOURNAL_POSTED || (i > 0 && entry.id <= previous_id) || entry.id > last_id) {
+            _Fail("pending record out of order", i);
+        }
+        if (entry.title_length > MNI_JOURNAL_TITLE_LENGTH || entry.text_length > MNI_JOURNAL_TEXT_LENGTH) {
+            _Fail("pending record has string too long", i);
+        }
+
+        const uint8_t *end = (const uint8_t *)(entry.text + entry.text_length);
+        if ((const uint8_t *)entry.title < data + offsets[i] || end > data + tail) {
+            _Fail("pending record strings outside of records", i);
+        }
+
+        previous_id = entry.id;
+    }
+
+    free(offsets);
+
+    return tail;
+}
+
+// ========================================================================== //
+
+static int _Recover(const uint8_t *data, size_t size) {
+    // Exact copy, recovery writes past the tail like it does to the mapped file.
+    uint8_t *input = (uint8_t *)malloc(size ? size : 1);
+    if (!input) {
+        return 0;
+    }
+    memcpy(input, data, size);
+
+    uint64_t last_id = 0;
+    size_t tail = _RecoverOne(input, size, &last_id);
+
+    // Queue goes on appending at the tail with the next id, the record must be found by next recovery.
+    static const uint16_t title[] = { 'n', 'e', 'x', 't' };
+    MniJournalEntry entry = {
+        .type = MNI_JOURNAL_POSTED,
+        .id = last_id + 1,
+        .title = title,
+        .title_length = 4,
+    };
+
+    size_t appended = tail && last_id != UINT64_MAX ? _MniJournalAppend(input, size, tail, &entry) : 0;
+    if (appended && _RecoverOne(input, size, &last_id) != appended) {
+        _Fail("record appended at tail is not recovered", appended);
+    }
+
+    free(input);
+    return 0;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#if defined(MNI_JOURNAL_FUZZ_LIBFUZZER)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    return _Recover(data, size);
+}
+
+#else
+
+// ========================================================================== //
+
+#pragma region Seed
+
+#define SEED_CAPACITY   1024
+#define SEED_RECORDS    8
+
+typedef struct Seed {
+    uint8_t     data[SEED_CAPACITY];
+    size_t      size;
+    size_t      ends[SEED_RECORDS];     // end of each record
+    size_t      count;
+} Seed;
+
+// ========================================================================== //
+
+static void _SeedAppend(Seed *seed, MniJournalRecordType type, uint64_t id, const char *title, const char *text) {
+    uint16_t title16[MNI_JOURNAL_TITLE_LENGTH];
+    uint16_t text16[MNI_JOURNAL_TEXT_LENGTH];
+    int title_length = (int)strlen(title);
+    int text_length = (int)strlen(text);
+
+    for (int i = 0; i < title_length; i += 1) {
+        title16[i] = (uint8_t)title[i];
+    }
+    for (int i = 0; i < text_length; i += 1) {
+        text16[i] = (uint8_t)text[i];
+    }
+
+    MniJournalEntry entry = {
+        .type = type,
+        .id = id,
+        .priority = 1,
+        .title = title16,
+        .title_length = title_length,
+        .text = text16,
+        .text_length = text_length,
+    };
+
+    size_t tail = seed->count ? seed->ends[seed->count - 1] : sizeof(MniJournalHeader);
+    seed->ends[seed->count] = _MniJournalAppend(seed->data, SEED_CAPACITY, tail, &entry);
+    seed->count += 1;
+}
+
+// ========================================================================== //
+
+// Two of three posted notifications are pending, seed ends right after the last record.
+static void _SeedJournal(Seed *seed) {
+    memset(seed, 0, sizeof(*seed));
+    _MniJournalCreate(seed->data, SEED_CAPACITY, 7);
+
+    _SeedAppend(seed, MNI_JOURNAL_POSTED, 1, "Build", "Finished in 12 s");
+    _SeedAppend(seed, MNI_JOURNAL_POSTED, 2, "Mail", "3 new messages");
+    _SeedAppend(seed, MNI_JOURNAL_SHOWN, 1, "", "");
+    _SeedAppend(seed, MNI_JOURNAL_OUTCOME, 1, "", "");
+    _SeedAppend(seed, MNI_JOURNAL_POSTED, 3, "Backup", "");
+    _SeedAppend(seed, MNI_JOURNAL_SHOWN, 2, "", "");
+
+    seed->size = seed->ends[seed->count - 1];
+}
+
+// ========================================================================== //
+
+static size_t _Scan(const uint8_t *data, size_t size) {
+    size_t posted_count;
+    uint64_t last_id;
+    return _MniJournalScan(data, size, &posted_count, &last_id);
+}
+
+// ========================================================================== //
+
+// Recovery must keep every record before the damaged one and nothing after it.
+static int _CheckSeed(const Seed *seed) {
+    static uint8_t data[SEED_CAPACITY];
+
+    memcpy(data, seed->data, seed->size);
+    size_t posted_count;
+    uint64_t last_id;
+    size_t tail = _MniJournalScan(data, seed->size, &posted_count, &last_id);
+    if (tail != seed->size || posted_count != 3 || last_id != 3) {
+        fprintf(stderr, "seed: tail %zu, %zu posted, last id %llu\n", tail, posted_count, (unsigned long long)last_id);
+        return 0;
+    }
+
+    size_t offsets[3];
+    size_t pending = _MniJournalPending(data, tail, offsets, posted_count);
+    if (pending != 2 || offsets[0] != seed->ends[0] || offsets[1] != seed->ends[3]) {
+        fprintf(stderr, "seed: %zu pending\n", pending);
+        return 0;
+    }
+
+    // Torn append, journal cut at every byte.
+    for (size_t cut = sizeof(MniJournalHeader); cut <= seed->size; cut += 1) {
+        size_t expected = sizeof(MniJournalHeader);
+        for (size_t i = 0; i < seed->count && seed->ends[i] <= cut; i += 1) {
+            expected = seed->ends[i];
+        }
+
+        uint8_t *torn = (uint8_t *)malloc(cut);
+        if (!torn) {
+            return 0;
+        }
+        memcpy(torn, seed->data, cut);
+        tail = _Scan(torn, cut);
+        free(torn);
+
+        if (tail != expected) {
+            fprintf(stderr, "cut at %zu: tail %zu, expected %zu\n", cut, tail, expected);
+            return 0;
+        }
+    }
+
+    // Record with corrupted size, or any byte flipped, ends recovery right before it.
+    for (size_t i = 0; i < seed->count; i += 1) {
+        size_t begin = i ? seed->ends[i - 1] : sizeof(MniJournalHeader);
+
+        static const uint32_t sizes[] = { 0, 4, 8, 16, 0x7FFFFFF8u, 0xFFFFFFF8u };
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s += 1) {
+            memcpy(data, seed->data, seed->size);
+            memcpy(data + begin, &sizes[s], sizeof(uint32_t));
+
+            tail = _Scan(data, seed->size);
+            if (tail != begin) {
+                fprintf(stderr, "record %zu with size %u: tail %zu, expected %zu\n", i, (unsigned)sizes[s], tail, begin);
+                return 0;
+            }
+        }
+
+        for (size_t at = begin; at < seed->ends[i]; at += 1) {
+            memcpy(data, seed->data, seed->size);
+            data[at] ^= 0x40;
+
+            tail = _Scan(data, seed->size);
+            if (tail != begin) {
+                fprintf(stderr, "record %zu with byte %zu flipped: tail %zu, expected %zu\n", i, at, tail, begin);
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Mutator
+
+static uint64_t g_random;
+
+static uint32_t _Random(void) {
+    // xorshift64*
+    g_random ^= g_random >> 12;
+    g_random ^= g_random << 25;
+    g_random ^= g_random >> 27;
+    return (uint32_t)((g_random * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// ========================================================================== //
+
+static void _Put16(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void _Put32(uint8_t *p, uint32_t value) {
+    _Put16(p, value);
+    _Put16(p + 2, value >> 16);
+}
+
+// ========================================================================== //
+
+static size_t _Mutate(const Seed *seed, uint8_t *data, size_t size, size_t capacity) {
+    // Record sizes and string lengths are where recovery goes wrong, they get boundary values.
+    static const uint32_t interesting[] = {
+        0, 1, 2, 7, 8, 16, 24, 32, 40, 63, 64, 255, 256, 0x7FFF, 0x8000, 0xFFFF,
+        0x10000, 0x7FFFFFF8, 0x80000000, 0xFFFFFFF0, 0xFFFFFFF8, 0xFFFFFFFF,
+    };
+
+    int rounds = 1 + (int)(_Random() % 4);
+    for (int round = 0; round < rounds && size > 0; round += 1) {
+        // Fields are aligned, half of the writes hit record boundary exactly.
+        size_t at = _Random() % size;
+        if (_Random() % 2) {
+            size_t record = _Random() % seed->count;
+            at = record ? seed->ends[record - 1] : sizeof(MniJournalHeader);
+            at += (_Random() % 4) * 4;
+            if (at >= size) {
+                continue;
+            }
+        }
+
+        switch (_Random() % 6) {
+            case 0:
+                data[at] ^= (uint8_t)(1u << (_Random() % 8));
+                break;
+            case 1:
+                if (size - at >= 2) {
+                    _Put16(data + at, interesting[_Random() % (sizeof(interesting) / sizeof(interesting[0]))]);
+                }
+                break;
+            case 2:
+                if (size - at >= 4) {
+                    _Put32(data + at, interesting[_Random() % (sizeof(interesting) / sizeof(interesting[0]))]);
+                }
+                break;
+            case 3:
+                // Torn append, cut inside of a record.
+                size = at + 1;
+                break;
+            case 4:
+                // Record copied over another one, ids and outcomes get out of order.
+                if (seed->count > 1) {
+                    size_t from = _Random() % (seed->count - 1);
+                    size_t begin = from ? seed->ends[from - 1] : sizeof(MniJournalHeader);
+                    size_t length = seed->ends[from] - begin;
+                    if (length <= size - at) {
+                        memmove(data + at, seed->data + begin, length);
+                    }
+                }
+                break;
+            default:
+                if (size < capacity) {
+                    size_t grow = 1 + _Random() % 64;
+                    if (grow > capacity - size) {
+                        grow = capacity - size;
+                    }
+                    for (size_t i = 0; i < grow; i += 1) {
+                        data[size + i] = (uint8_t)(_Random() % 4 ? 0 : _Random());
+                    }
+                    size += grow;
+                }
+                break;
+        }
+    }
+
+    return size;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+static int _Replay(int count, char **paths) {
+    for (int i = 0; i < count; i += 1) {
+        FILE *file = fopen(paths[i], "rb");
+        if (!file) {
+            fprintf(stderr, "can't open %s\n", paths[i]);
+            return 1;
+        }
+
+        static uint8_t data[1 << 24];
+        size_t size = fread(data, 1, sizeof(data), file);
+        fclose(file);
+
+        _Recover(data, size);
+        printf("%s ok\n", paths[i]);
+    }
+
+    return 0;
+}
+
+// ========================================================================== //
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && strcmp(argv[1], "-replay") == 0) {
+        return _Replay(argc - 2, argv + 2);
+    }
+
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    g_random = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x9E3779B97F4A7C15ull;
+    if (iterations <= 0 || g_random == 0) {
+        fprintf(stderr, "usage: mni_journal_fuzz [iterations [seed]]\n       mni_journal_fuzz -replay <file> ...\n");
+        return 1;
+    }
+
+    static Seed seed;
+    _SeedJournal(&seed);
+    if (!_CheckSeed(&seed)) {
+        return 1;
+    }
+
+    for (long i = 0; i < iterations; i += 1) {
+        uint8_t data[SEED_CAPACITY];
+        memcpy(data, seed.data, SEED_CAPACITY);
+
+        // Mapped journal is usually longer than its records, zeros follow the tail.
+        size_t size = seed.size + (_Random() % 2 ? 0 : _Random() % (SEED_CAPACITY - seed.size));
+        size = _Mutate(&seed, data, size, sizeof(data));
+        _Recover(data, size);
+    }
+
+    printf("%ld inputs recovered\n", iterations);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,371 @@
+// Icon pack converter and validator.
+//
+//   mni_pack create <pack> <name>=<file.ico> ...   builds pack from 32-bit and 24-bit ico images
+//   mni_pack check <pack>                          validates index and pixel hashes
+//   mni_pack list <pack>                           prints icons and frame sizes
+//
+// Portable C, builds on Linux too:
+//   cc -O2 -o mni_pack tools/mni_pack.c src/mni_pack.c src/mni_pixels.c -lm
+
+#include "../src/mni_pack.h"
+#include "../src/mni_pixels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+    #pragma warning(disable: 4996)  // fopen
+#endif
+
+// ========================================================================== //
+
+#pragma region Files
+
+static uint8_t *_ReadFile(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    uint8_t *data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long length = ftell(file);
+        if (length >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+            data = (uint8_t *)malloc(length > 0 ? (size_t)length : 1);
+            if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+                free(data);
+                data = NULL;
+            }
+            *size = (size_t)length;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+// ========================================================================== //
+
+static int _WriteFile(const char *path, const void *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+
+    int result = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && result;
+}
+
+// ========================================================================== //
+
+static uint32_t _Read16(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+// ========================================================================== //
+
+static uint32_t _Read32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Ico
+
+// Decodes one BMP image of ico into premultiplied BGRA. Returns NULL for formats
+// other than 32-bit and 24-bit, PNG images included.
+static uint32_t *_DecodeIcoImage(const uint8_t *data, size_t size, int *width, int *height) {
+    if (size < 40 || _Read32(data) < 40) {
+        return NULL;
+    }
+
+    int w = (int)_Read32(data + 4);
+    int h = (int)_Read32(data + 8) / 2;     // color and mask
+    uint32_t bpp = _Read16(data + 14);
+    uint32_t compression = _Read32(data + 16);
+
+    if (w <= 0 || h <= 0 || w > MNI_PIXELS_MAX_SIZE || h > MNI_PIXELS_MAX_SIZE ||
+        (bpp != 32 && bpp != 24) || compression != 0)
+    {
+        return NULL;
+    }
+
+    size_t color_stride = ((size_t)w * bpp / 8 + 3) & ~(size_t)3;
+    size_t mask_stride = ((size_t)w + 31) / 32 * 4;
+    const uint8_t *color = data + _Read32(data);
+    const uint8_t *mask = color + color_stride * (size_t)h;
+
+    if ((size_t)(mask - data) + mask_stride * (size_t)h > size) {
+        return NULL;
+    }
+
+    uint32_t *pixels = (uint32_t *)malloc((size_t)w * (size_t)h * 4);
+    if (!pixels) {
+        return NULL;
+    }
+
+    int has_alpha = 0;
+    for (int y = 0; y < h; y += 1) {
+        // Rows are stored bottom-up.
+        const uint8_t *row = color + color_stride * (size_t)(h - 1 - y);
+        const uint8_t *mask_row = mask + mask_stride * (size_t)(h - 1 - y);
+
+        for (int x = 0; x < w; x += 1) {
+            uint32_t pixel;
+            if (bpp == 32) {
+                pixel = _Read32(row + x * 4);
+                has_alpha |= (pixel >> 24) != 0;
+            } else {
+                pixel = _Read16(row + x * 3) | ((uint32_t)row[x * 3 + 2] << 16);
+            }
+
+            // Mask bit set is transparent, only used when there is no alpha channel.
+            if ((mask_row[x / 8] >> (7 - x % 8)) & 1) {
+                pixel &= 0x00FFFFFF;
+            } else if (bpp == 24) {
+                pixel |= 0xFF000000;
+            }
+
+            pixels[y * w + x] = pixel;
+        }
+    }
+
+    if (bpp == 32 && !has_alpha) {
+        for (int y = 0; y < h; y += 1) {
+            const uint8_t *mask_row = mask + mask_stride * (size_t)(h - 1 - y);
+            for (int x = 0; x < w; x += 1) {
+                if (!((mask_row[x / 8] >> (7 - x % 8)) & 1)) {
+                    pixels[y * w + x] |= 0xFF000000;
+                }
+            }
+        }
+    }
+
+    _MniPixelsPremultiply(pixels, pixels, (size_t)w * (size_t)h, 0);
+
+    *width = w;
+    *height = h;
+    return pixels;
+}
+
+// ========================================================================== //
+
+// Adds every supported square image of ico as frame, larger color depth wins for same size.
+static int _LoadIco(const char *path, MniPackSourceFrame **frames, int *frame_count) {
+    size_t size;
+    uint8_t *data = _ReadFile(path, &size);
+    if (!data) {
+        fprintf(stderr, "%s: can't read file\n", path);
+        return 0;
+    }
+
+    if (size < 6 || _Read16(data) != 0 || _Read16(data + 2) != 1) {
+        fprintf(stderr, "%s: not an ico file\n", path);
+        free(data);
+        return 0;
+    }
+
+    int count = (int)_Read16(data + 4);
+    if (size < 6 + (size_t)count * 16) {
+        fprintf(stderr, "%s: ico directory is truncated\n", path);
+        free(data);
+        return 0;
+    }
+
+    MniPackSourceFrame *result = (MniPackSourceFrame *)calloc(count > 0 ? (size_t)count : 1, sizeof(*result));
+    int *depths = (int *)calloc(count > 0 ? (size_t)count : 1, sizeof(int));
+    int result_count = 0;
+
+    for (int i = 0; result && depths && i < count; i += 1) {
+        const uint8_t *entry = data + 6 + i * 16;
+        uint32_t image_size = _Read32(entry + 8);
+        uint32_t image_offset = _Read32(entry + 12);
+
+        if (image_offset > size || image_size > size - image_offset) {
+            fprintf(stderr, "%s: image %d is out of range, skipped\n", path, i);
+            continue;
+        }
+
+        int width;
+        int height;
+        uint32_t *pixels = _DecodeIcoImage(data + image_offset, image_size, &width, &height);
+        if (!pixels) {
+            fprintf(stderr, "%s: image %d is not 32-bit or 24-bit bitmap, skipped\n", path, i);
+            continue;
+        }
+
+        if (width != height) {
+            fprintf(stderr, "%s: image %d is not square, skipped\n", path, i);
+            free(pixels);
+            continue;
+        }
+
+        int depth = (int)_Read16(data + image_offset + 14);
+        int existing = -1;
+        for (int j = 0; j < result_count; j += 1) {
+            if (result[j].width == width) {
+                existing = j;
+            }
+        }
+
+        if (existing < 0) {
+            existing = result_count;
+            result_count += 1;
+        } else if (depths[existing] >= depth) {
+            free(pixels);
+            continue;
+        } else {
+            free((void *)result[existing].pixels);
+        }
+
+        result[existing].width = width;
+        result[existing].height = height;
+        result[existing].pixels = pixels;
+        depths[existing] = depth;
+    }
+
+    free(depths);
+    free(data);
+
+    if (!result || result_count == 0) {
+        fprintf(stderr, "%s: no usable images\n", path);
+        free(result);
+        return 0;
+    }
+
+    *frames = result;
+    *frame_count = result_count;
+    return 1;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Commands
+
+static int _Create(const char *path, int argc, char **argv) {
+    MniPackSourceIcon *icons = (MniPackSourceIcon *)calloc((size_t)argc, sizeof(*icons));
+    if (!icons) {
+        return 1;
+    }
+
+    int result = 1;
+    int icon_count = 0;
+
+    for (int i = 0; i < argc; i += 1) {
+        char *separator = strchr(argv[i], '=');
+        if (!separator || separator == argv[i] || separator - argv[i] >= MNI_PACK_NAME_SIZE) {
+            fprintf(stderr, "%s: expected <name>=<file.ico>, name up to %d characters\n", argv[i], MNI_PACK_NAME_SIZE - 1);
+            goto done;
+        }
+
+        *separator = '\0';
+
+        MniPackSourceFrame *frames;
+        int frame_count;
+        if (!_LoadIco(separator + 1, &frames, &frame_count)) {
+            goto done;
+        }
+
+        icons[icon_count].name = argv[i];
+        icons[icon_count].frames = frames;
+        icons[icon_count].frame_count = frame_count;
+        icon_count += 1;
+    }
+
+    size_t size = _MniPackWrite(NULL, 0, icons, icon_count);
+    if (size == 0) {
+        fprintf(stderr, "%s: icon names must be unique\n", path);
+        goto done;
+    }
+
+    void *pack = malloc(size);
+    if (pack && _MniPackWrite(pack, size, icons, icon_count) == size && _WriteFile(path, pack, size)) {
+        printf("%s: %d icons, %u frames, %zu bytes\n", path, icon_count, _MniPackHeader(pack)->frame_count, size);
+        result = 0;
+    } else {
+        fprintf(stderr, "%s: can't write file\n", path);
+    }
+    free(pack);
+
+done:
+    for (int i = 0; i < icon_count; i += 1) {
+        for (int j = 0; j < icons[i].frame_count; j += 1) {
+            free((void *)icons[i].frames[j].pixels);
+        }
+        free((void *)icons[i].frames);
+    }
+    free(icons);
+
+    return result;
+}
+
+// ========================================================================== //
+
+static int _CheckOrList(const char *path, int list) {
+    size_t size;
+    uint8_t *data = _ReadFile(path, &size);
+    if (!data) {
+        fprintf(stderr, "%s: can't read file\n", path);
+        return 1;
+    }
+
+    MniPackStatus status = _MniPackValidate(data, size, !list);
+    if (status != MNI_PACK_OK) {
+        fprintf(stderr, "%s: %s\n", path, _MniPackStatusToString(status));
+        free(data);
+        return 1;
+    }
+
+    const MniPackHeader *header = _MniPackHeader(data);
+
+    if (list) {
+        const MniPackIcon *icons = _MniPackIcons(data);
+        const MniPackFrame *frames = _MniPackFrames(data);
+
+        for (uint32_t i = 0; i < header->icon_count; i += 1) {
+            printf("%-*s", MNI_PACK_NAME_SIZE, icons[i].name);
+            for (uint32_t j = 0; j < icons[i].frame_count; j += 1) {
+                const MniPackFrame *frame = &frames[icons[i].first_frame + j];
+                printf(" %ux%u", frame->width, frame->height);
+            }
+            printf("\n");
+        }
+    } else {
+        printf("%s: ok, %u icons, %u frames\n", path, header->icon_count, header->frame_count);
+    }
+
+    free(data);
+    return 0;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+int main(int argc, char **argv) {
+    if (argc >= 4 && strcmp(argv[1], "create") == 0) {
+        return _Create(argv[2], argc - 3, argv + 3);
+    }
+
+    if (argc == 3 && strcmp(argv[1], "check") == 0) {
+        return _CheckOrList(argv[2], 0);
+    }
+
+    if (argc == 3 && strcmp(argv[1], "list") == 0) {
+        return _CheckOrList(argv[2], 1);
+    }
+
+    fprintf(stderr,
+        "usage:\n"
+        "  mni_pack create <pack> <name>=<file.ico> ...\n"
+        "  mni_pack check <pack>\n"
+        "  mni_pack list <pack>\n"
+    );
+
+    return 2;
+}
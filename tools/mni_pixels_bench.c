@@ -0,0 +1,143 @@
+// Benchmark of coverage blend, every SIMD kernel this cpu supports against the scalar one.
+// Output of each kernel is compared with scalar before it's timed.
+//
+// Linux, x86 or arm64:
+//   cc -O2 -o mni_pixels_bench tools/mni_pixels_bench.c src/mni_pixels.c -lm
+//   ./mni_pixels_bench [iterations]
+
+#include "../src/mni_pixels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MAX_COUNT     (MNI_PIXELS_MAX_SIZE * MNI_PIXELS_MAX_SIZE)
+
+typedef enum BenchCoverage {
+    BENCH_COVERAGE_TEXT,        // sparse glyph strokes, most of the icon is untouched
+    BENCH_COVERAGE_SOLID,
+    BENCH_COVERAGE_GRADIENT,
+} BenchCoverage;
+
+typedef struct BenchCase {
+    const char      *name;
+    int             size;
+    BenchCoverage   coverage;
+} BenchCase;
+
+static const char *g_kernel_names[] = { "scalar", "sse2", "avx2", "neon" };
+
+// ========================================================================== //
+
+#pragma region Bench
+
+static double _Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// ========================================================================== //
+
+static void _FillCoverage(uint8_t *coverage, int size, BenchCoverage kind) {
+    for (int y = 0; y < size; y += 1) {
+        for (int x = 0; x < size; x += 1) {
+            uint8_t value;
+            switch (kind) {
+                case BENCH_COVERAGE_TEXT:
+                    // Strokes two pixels wide with antialiased edges.
+                    value = (x % 6 < 2 || y % 9 < 2) ? 255 : (x % 6 == 2 || y % 9 == 2) ? 96 : 0;
+                    break;
+                case BENCH_COVERAGE_SOLID:
+                    value = 255;
+                    break;
+                default:
+                    value = (uint8_t)((x + y) * 255 / (2 * size - 2));
+                    break;
+            }
+            coverage[y * size + x] = value;
+        }
+    }
+}
+
+// ========================================================================== //
+
+static void _Run(const BenchCase *bench, long iterations) {
+    static uint32_t background[BENCH_MAX_COUNT];
+    static uint32_t expected[BENCH_MAX_COUNT];
+    static uint32_t pixels[BENCH_MAX_COUNT];
+    static uint8_t coverage[BENCH_MAX_COUNT];
+
+    size_t count = (size_t)bench->size * (size_t)bench->size;
+    const uint32_t color = 0xE0C02010;      // premultiplied
+
+    // Half transparent premultiplied background, blend can't take the opaque shortcut.
+    for (size_t i = 0; i < count; i += 1) {
+        background[i] = 0x80000000u | (uint32_t)((i * 7) & 0x7F) << 8 | (uint32_t)(i & 0x7F);
+    }
+    _FillCoverage(coverage, bench->size, bench->coverage);
+
+    memcpy(expected, background, count * sizeof(uint32_t));
+    _MniPixelsBlendCoverageWith(MNI_PIXEL_KERNEL_SCALAR, expected, coverage, count, color);
+
+    double scalar_time = 0.0;
+    for (int kernel = MNI_PIXEL_KERNEL_SCALAR; kernel <= MNI_PIXEL_KERNEL_NEON; kernel += 1) {
+        if (!_MniPixelsKernelSupported((MniPixelKernel)kernel)) {
+            continue;
+        }
+
+        memcpy(pixels, background, count * sizeof(uint32_t));
+        _MniPixelsBlendCoverageWith((MniPixelKernel)kernel, pixels, coverage, count, color);
+        if (memcmp(pixels, expected, count * sizeof(uint32_t)) != 0) {
+            printf("%-20s %-6s output differs from scalar\n", bench->name, g_kernel_names[kernel]);
+            continue;
+        }
+
+        // Blending over the same pixels again and again still does the same work per pixel.
+        double start = _Now();
+        for (long i = 0; i < iterations; i += 1) {
+            _MniPixelsBlendCoverageWith((MniPixelKernel)kernel, pixels, coverage, count, color);
+        }
+        double time = _Now() - start;
+
+        if (kernel == MNI_PIXEL_KERNEL_SCALAR) {
+            scalar_time = time;
+        }
+
+        printf(
+            "%-20s %-6s %9.1f ns  %6.2f ns/pixel  %5.1fx\n",
+            bench->name,
+            g_kernel_names[kernel],
+            time * 1e9 / (double)iterations,
+            time * 1e9 / (double)iterations / (double)count,
+            scalar_time / time
+        );
+    }
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: mni_pixels_bench [iterations]\n");
+        return 1;
+    }
+
+    static const BenchCase cases[] = {
+        { .name = "text 16x16",         .size = 16,     .coverage = BENCH_COVERAGE_TEXT },
+        { .name = "text 32x32",         .size = 32,     .coverage = BENCH_COVERAGE_TEXT },
+        { .name = "solid 32x32",        .size = 32,     .coverage = BENCH_COVERAGE_SOLID },
+        { .name = "gradient 64x64",     .size = 64,     .coverage = BENCH_COVERAGE_GRADIENT },
+        { .name = "gradient 256x256",   .size = 256,    .coverage = BENCH_COVERAGE_GRADIENT },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i += 1) {
+        _Run(&cases[i], cases[i].size >= 256 ? iterations / 64 + 1 : iterations);
+    }
+
+    return 0;
+}
@@ -0,0 +1,308 @@
+// Checks that every SIMD kernel of mni_pixels supported by this cpu gives bit identical
+// results to the scalar one. Premultiply is checked for all channel and alpha pairs, coverage
+// blend for all coverage and channel pairs, all kernels for counts and offsets that exercise
+// vector tails and unaligned buffers. Graph columns are checked to stay in bounds for levels
+// outside 0..1, infinite and NaN ones.
+//
+// Linux, x86 or arm64:
+//   cc -O2 -o mni_pixels_check tools/mni_pixels_check.c src/mni_pixels.c -lm
+//   ./mni_pixels_check [rounds [seed]]
+//
+// Exits with 1 on first mismatch.
+
+#include "../src/mni_pixels.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Largest count of random runs, covers several blocks of the widest kernel and its tail.
+#define CHECK_MAX_COUNT     300
+#define CHECK_MAX_OFFSET    4
+
+static const char *g_kernel_names[] = { "scalar", "sse2", "avx2", "neon" };
+
+static uint64_t g_random;
+
+// ========================================================================== //
+
+#pragma region Helpers
+
+static uint32_t _Random(void) {
+    // xorshift64*
+    g_random ^= g_random >> 12;
+    g_random ^= g_random << 25;
+    g_random ^= g_random >> 27;
+    return (uint32_t)((g_random * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// ========================================================================== //
+
+// Mostly random pixels, with runs of opaque and transparent ones that kernels may special case.
+static void _RandomPixels(uint32_t *pixels, size_t count) {
+    for (size_t i = 0; i < count; i += 1) {
+        uint32_t pixel = _Random();
+        switch (_Random() % 8) {
+            case 0: pixel |= 0xFF000000u; break;
+            case 1: pixel &= 0x00FFFFFFu; break;
+            case 2: pixel = 0; break;
+            default: break;
+        }
+        pixels[i] = pixel;
+    }
+}
+
+// ========================================================================== //
+
+static int _Compare(const char *what, MniPixelKernel kernel, const uint32_t *expected, const uint32_t *actual, size_t count, size_t offset) {
+    for (size_t i = 0; i < count; i += 1) {
+        if (expected[i] != actual[i]) {
+            printf(
+                "%s %s: count %zu offset %zu, pixel %zu is %08" PRIx32 ", scalar gives %08" PRIx32 "\n",
+                what,
+                g_kernel_names[kernel],
+                count,
+                offset,
+                i,
+                actual[i],
+                expected[i]
+            );
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Checks
+
+// Every channel value against every alpha, both byte orders, in place and not.
+static int _CheckPremultiplyAll(MniPixelKernel kernel) {
+    static uint32_t src[65536];
+    static uint32_t expected[65536];
+    static uint32_t actual[65536];
+
+    for (uint32_t a = 0; a < 256; a += 1) {
+        for (uint32_t c = 0; c < 256; c += 1) {
+            src[a * 256 + c] = (a << 24) | ((c ^ 0x5A) << 16) | ((255 - c) << 8) | c;
+        }
+    }
+
+    for (int swap_red_blue = 0; swap_red_blue < 2; swap_red_blue += 1) {
+        _MniPixelsPremultiplyWith(MNI_PIXEL_KERNEL_SCALAR, expected, src, 65536, swap_red_blue);
+
+        _MniPixelsPremultiplyWith(kernel, actual, src, 65536, swap_red_blue);
+        if (!_Compare(swap_red_blue ? "premultiply rgba" : "premultiply bgra", kernel, expected, actual, 65536, 0)) {
+            return 0;
+        }
+
+        memcpy(actual, src, sizeof(actual));
+        _MniPixelsPremultiplyWith(kernel, actual, actual, 65536, swap_red_blue);
+        if (!_Compare(swap_red_blue ? "premultiply rgba in place" : "premultiply bgra in place", kernel, expected, actual, 65536, 0)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// ========================================================================== //
+
+// Every coverage against every destination alpha, for a few colors. Blend takes premultiplied
+// pixels and color, kernels may differ for channels above alpha, so none are generated.
+static int _CheckBlendCoverageAll(MniPixelKernel kernel) {
+    static uint32_t dest[65536];
+    static uint8_t coverage[65536];
+    static uint32_t expected[65536];
+    static uint32_t actual[65536];
+
+    for (uint32_t c = 0; c < 256; c += 1) {
+        for (uint32_t v = 0; v < 256; v += 1) {
+            dest[c * 256 + v] = (v << 24) | ((v * 3 / 4) << 16) | (v << 8) | (v / 3);
+            coverage[c * 256 + v] = (uint8_t)c;
+        }
+    }
+
+    uint32_t colors[] = { 0xFFFFFFFFu, 0xFF000000u, 0x80402010u, 0x00000000u, _Random(), _Random() };
+    _MniPixelsPremultiplyWith(MNI_PIXEL_KERNEL_SCALAR, colors + 4, colors + 4, 2, 0);
+
+    for (size_t i = 0; i < sizeof(colors) / sizeof(colors[0]); i += 1) {
+        memcpy(expected, dest, sizeof(expected));
+        memcpy(actual, dest, sizeof(actual));
+
+        _MniPixelsBlendCoverageWith(MNI_PIXEL_KERNEL_SCALAR, expected, coverage, 65536, colors[i]);
+        _MniPixelsBlendCoverageWith(kernel, actual, coverage, 65536, colors[i]);
+        if (!_Compare("blend coverage", kernel, expected, actual, 65536, 0)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// ========================================================================== //
+
+static int _CheckRound(MniPixelKernel kernel, size_t count, size_t offset) {
+    static uint32_t src[CHECK_MAX_COUNT + CHECK_MAX_OFFSET];
+    static uint32_t expected[CHECK_MAX_COUNT + CHECK_MAX_OFFSET];
+    static uint32_t actual[CHECK_MAX_COUNT + CHECK_MAX_OFFSET];
+
+    // Pixels past count must stay untouched, guard value tells if kernel wrote there.
+    _RandomPixels(src, CHECK_MAX_COUNT + CHECK_MAX_OFFSET);
+    uint32_t guard = _Random();
+    for (size_t i = 0; i < CHECK_MAX_COUNT + CHECK_MAX_OFFSET; i += 1) {
+        expected[i] = guard;
+        actual[i] = guard;
+    }
+
+    int swap_red_blue = (int)(_Random() & 1);
+    _MniPixelsPremultiplyWith(MNI_PIXEL_KERNEL_SCALAR, expected + offset, src + offset, count, swap_red_blue);
+    _MniPixelsPremultiplyWith(kernel, actual + offset, src + offset, count, swap_red_blue);
+    if (!_Compare("premultiply", kernel, expected, actual, CHECK_MAX_COUNT + CHECK_MAX_OFFSET, offset)) {
+        return 0;
+    }
+
+    uint32_t color = _Random();
+    _MniPixelsRecolorWith(MNI_PIXEL_KERNEL_SCALAR, expected + offset, src + offset, count, color);
+    _MniPixelsRecolorWith(kernel, actual + offset, src + offset, count, color);
+    if (!_Compare("recolor", kernel, expected, actual, CHECK_MAX_COUNT + CHECK_MAX_OFFSET, offset)) {
+        return 0;
+    }
+
+    uint8_t coverage[CHECK_MAX_COUNT + CHECK_MAX_OFFSET];
+    for (size_t i = 0; i < CHECK_MAX_COUNT + CHECK_MAX_OFFSET; i += 1) {
+        uint32_t value = _Random();
+        coverage[i] = (uint8_t)(value % 4 == 0 ? 0 : value % 4 == 1 ? 255 : value >> 8);
+    }
+
+    // Blend works on premultiplied pixels and color.
+    uint32_t premultiplied_color;
+    _MniPixelsPremultiplyWith(MNI_PIXEL_KERNEL_SCALAR, &premultiplied_color, &color, 1, 0);
+    _MniPixelsPremultiplyWith(MNI_PIXEL_KERNEL_SCALAR, expected, src, CHECK_MAX_COUNT + CHECK_MAX_OFFSET, 0);
+    memcpy(actual, expected, sizeof(actual));
+    color = premultiplied_color;
+
+    _MniPixelsBlendCoverageWith(MNI_PIXEL_KERNEL_SCALAR, expected + offset, coverage + offset, count, color);
+    _MniPixelsBlendCoverageWith(kernel, actual + offset, coverage + offset, count, color);
+    if (!_Compare("blend coverage", kernel, expected, actual, CHECK_MAX_COUNT + CHECK_MAX_OFFSET, offset)) {
+        return 0;
+    }
+
+    uint64_t seed = ((uint64_t)_Random() << 32) | _Random();
+    uint64_t expected_hash = _MniPixelsHashWith(MNI_PIXEL_KERNEL_SCALAR, src + offset, count, seed);
+    uint64_t actual_hash = _MniPixelsHashWith(kernel, src + offset, count, seed);
+    if (expected_hash != actual_hash) {
+        printf(
+            "hash %s: count %zu offset %zu is %016" PRIx64 ", scalar gives %016" PRIx64 "\n",
+            g_kernel_names[kernel],
+            count,
+            offset,
+            actual_hash,
+            expected_hash
+        );
+        return 0;
+    }
+
+    return 1;
+}
+
+// ========================================================================== //
+
+// Column drawn at non finite or out of range level must look like the clamped one and never
+// write outside of its column, guard value tells if it did.
+static int _CheckGraphColumn(void) {
+    enum { SIZE = 16, X = 5 };
+    static uint32_t expected[SIZE * SIZE];
+    static uint32_t actual[SIZE * SIZE];
+
+    const uint32_t guard = 0xDEADBEEFu;
+    const struct {
+        float   level;
+        float   clamped;
+    } levels[] = {
+        { NAN,          0.0f },
+        { -NAN,         0.0f },
+        { INFINITY,     1.0f },
+        { -INFINITY,    0.0f },
+        { -1e30f,       0.0f },
+        { 1e30f,        1.0f },
+        { 0.5f,         0.5f },
+    };
+
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i += 1) {
+        for (size_t p = 0; p < SIZE * SIZE; p += 1) {
+            expected[p] = guard;
+            actual[p] = guard;
+        }
+
+        _MniPixelsDrawGraphColumn(expected, SIZE, X, levels[i].clamped, 0xFFFFFFFFu, 0x80404040u);
+        _MniPixelsDrawGraphColumn(actual, SIZE, X, levels[i].level, 0xFFFFFFFFu, 0x80404040u);
+
+        for (size_t p = 0; p < SIZE * SIZE; p += 1) {
+            if (expected[p] != actual[p] || (p % SIZE != X && actual[p] != guard)) {
+                printf(
+                    "graph column: level %f, pixel %zu is %08" PRIx32 ", expected %08" PRIx32 "\n",
+                    (double)levels[i].level,
+                    p,
+                    actual[p],
+                    p % SIZE != X ? guard : expected[p]
+                );
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+int main(int argc, char **argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : 20;
+    g_random = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x9E3779B97F4A7C15ull;
+    if (rounds <= 0 || g_random == 0) {
+        fprintf(stderr, "usage: mni_pixels_check [rounds [seed]]\n");
+        return 1;
+    }
+
+    if (!_CheckGraphColumn()) {
+        return 1;
+    }
+
+    int checked = 0;
+    for (int kernel = MNI_PIXEL_KERNEL_SSE2; kernel <= MNI_PIXEL_KERNEL_NEON; kernel += 1) {
+        if (!_MniPixelsKernelSupported((MniPixelKernel)kernel)) {
+            printf("%-6s not supported, skipped\n", g_kernel_names[kernel]);
+            continue;
+        }
+
+        if (!_CheckPremultiplyAll((MniPixelKernel)kernel) || !_CheckBlendCoverageAll((MniPixelKernel)kernel)) {
+            return 1;
+        }
+
+        for (long round = 0; round < rounds; round += 1) {
+            for (size_t count = 0; count <= CHECK_MAX_COUNT; count += 1) {
+                if (!_CheckRound((MniPixelKernel)kernel, count, count % CHECK_MAX_OFFSET)) {
+                    return 1;
+                }
+            }
+        }
+
+        printf("%-6s matches scalar\n", g_kernel_names[kernel]);
+        checked += 1;
+    }
+
+    if (checked == 0) {
+        printf("no SIMD kernel supported, nothing to check\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,324 @@
+// Regression check and benchmark of setter and dispatch paths, driven through the recording
+// backend, so neither explorer.exe nor a window is involved. Recorded Shell_NotifyIconW calls
+// are checked first: which NIM_* message, which NIF_* flags and how many of them each setter
+// makes. Then every setter is timed together with the number of shell calls it costs.
+//
+// Windows, MSVC or mingw-w64, links the library sources with icm:
+//   cl /O2 /I deps\icm\include tools\mni_recorder_bench.c src\mni.c src\mni_pixels.c src\mni_pack.c src\mni_journal.c src\mni_utf8.c src\mni_decode.c deps\icm\lib\msvc\x64\icm.lib user32.lib gdi32.lib shell32.lib advapi32.lib dwmapi.lib uxtheme.lib shcore.lib
+//   cc -O2 -Ideps/icm/include -o mni_recorder_bench tools/mni_recorder_bench.c src/mni.c src/mni_pixels.c src/mni_pack.c src/mni_journal.c src/mni_utf8.c src/mni_decode.c -Ldeps/icm/lib -licm -luser32 -lgdi32 -lshell32 -ladvapi32 -ldwmapi -luxtheme -lshcore -lm
+//   mni_recorder_bench [iterations]
+//
+// Exits with 1 on first check that fails.
+
+#include "../include/mni/mni.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#define BENCH_RECORDS   64
+
+static MniRecord g_records[BENCH_RECORDS];
+static MniRecorder g_recorder;
+
+static int g_lmb_clicks;
+static int g_lmb_x;
+static int g_lmb_y;
+
+// ========================================================================== //
+
+#pragma region Helpers
+
+static void _OnLmbClick(ModernNotifyIcon *mni, int x, int y) {
+    (void)mni;
+    g_lmb_clicks += 1;
+    g_lmb_x = x;
+    g_lmb_y = y;
+}
+
+// ========================================================================== //
+
+// Number of recorded Shell_NotifyIconW calls with given NIM_* message, last one goes to nid.
+static int _CountNotify(DWORD message, NOTIFYICONDATAW *nid) {
+    int count = 0;
+
+    for (LONG i = 0; i < g_recorder.count; i += 1) {
+        const MniRecord *record = &g_records[i];
+        if (record->type == MNI_RECORD_NOTIFY_ICON && record->message == message) {
+            if (nid) {
+                *nid = record->nid;
+            }
+            count += 1;
+        }
+    }
+
+    return count;
+}
+
+// ========================================================================== //
+
+static int _CountRecords(MniRecordType type) {
+    int count = 0;
+
+    for (LONG i = 0; i < g_recorder.count; i += 1) {
+        if (g_records[i].type == type) {
+            count += 1;
+        }
+    }
+
+    return count;
+}
+
+// ========================================================================== //
+
+#define CHECK(_condition)                                                       \
+    do {                                                                        \
+        if (!(_condition)) {                                                    \
+            printf("line %d, check failed: %s\n", __LINE__, #_condition);       \
+            return 0;                                                           \
+        }                                                                       \
+    } while (0)
+
+// ========================================================================== //
+
+static double _Now(void) {
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Checks
+
+static int _CheckSetters(ModernNotifyIcon *mni, HICON icon_a, HICON icon_b) {
+    NOTIFYICONDATAW nid;
+
+    // Window is created through the backend, icon is added only by MniShow.
+    CHECK(_CountRecords(MNI_RECORD_CREATE_WINDOW) == 1);
+    CHECK(_CountRecords(MNI_RECORD_NOTIFY_ICON) == 0);
+
+    MniResetRecorder(&g_recorder);
+    CHECK(MniShow(mni, MNI_FALSE) == MNI_OK);
+    CHECK(_CountNotify(NIM_ADD, &nid) == 1);
+    CHECK((nid.uFlags & (NIF_ICON | NIF_TIP | NIF_MESSAGE)) == (NIF_ICON | NIF_TIP | NIF_MESSAGE));
+    CHECK(nid.hIcon == icon_a);
+    CHECK(wcscmp(nid.szTip, L"first") == 0);
+    CHECK(_CountNotify(NIM_SETVERSION, NULL) == 1);
+    CHECK(_CountNotify(NIM_MODIFY, NULL) == 0);
+
+    MniResetRecorder(&g_recorder);
+    CHECK(MniSetTip(mni, L"second") == MNI_OK);
+    CHECK(_CountNotify(NIM_MODIFY, &nid) == 1);
+    CHECK((nid.uFlags & NIF_TIP) == NIF_TIP);
+    CHECK(wcscmp(nid.szTip, L"second") == 0);
+
+    // Unchanged values don't reach the shell.
+    MniResetRecorder(&g_recorder);
+    CHECK(MniSetTip(mni, L"second") == MNI_OK);
+    CHECK(MniSetIcon(mni, icon_a, MNI_FALSE) == MNI_OK);
+    CHECK(_CountRecords(MNI_RECORD_NOTIFY_ICON) == 0);
+
+    MniResetRecorder(&g_recorder);
+    CHECK(MniSetIcon(mni, icon_b, MNI_FALSE) == MNI_OK);
+    CHECK(_CountNotify(NIM_MODIFY, &nid) == 1);
+    CHECK((nid.uFlags & NIF_ICON) == NIF_ICON);
+    CHECK(nid.hIcon == icon_b);
+
+    // Changes inside update scope go out as one call, and are counted as one icon update.
+    MniIconUpdateStats before, after;
+    CHECK(MniGetIconUpdateStats(mni, &before) == MNI_OK);
+    MniResetRecorder(&g_recorder);
+    CHECK(MniBeginUpdate(mni) == MNI_OK);
+    CHECK(MniSetTip(mni, L"third") == MNI_OK);
+    CHECK(MniSetIcon(mni, icon_a, MNI_FALSE) == MNI_OK);
+    CHECK(_CountRecords(MNI_RECORD_NOTIFY_ICON) == 0);
+    CHECK(MniEndUpdate(mni) == MNI_OK);
+    CHECK(_CountNotify(NIM_MODIFY, &nid) == 1);
+    CHECK((nid.uFlags & (NIF_ICON | NIF_TIP)) == (NIF_ICON | NIF_TIP));
+    CHECK(nid.hIcon == icon_a);
+    CHECK(wcscmp(nid.szTip, L"third") == 0);
+    CHECK(MniGetIconUpdateStats(mni, &after) == MNI_OK);
+    CHECK(after.pushed == before.pushed + 1);
+    CHECK(after.suppressed == before.suppressed);
+
+    MniResetRecorder(&g_recorder);
+    CHECK(MniHide(mni) == MNI_OK);
+    CHECK(_CountNotify(NIM_MODIFY, &nid) == 1);
+    CHECK((nid.uFlags & NIF_STATE) == NIF_STATE);
+    CHECK(nid.dwState == NIS_HIDDEN);
+
+    MniResetRecorder(&g_recorder);
+    CHECK(MniShow(mni, MNI_FALSE) == MNI_OK);
+    CHECK(_CountNotify(NIM_ADD, NULL) == 0);
+    CHECK(_CountNotify(NIM_MODIFY, &nid) == 1);
+    CHECK((nid.uFlags & NIF_STATE) == NIF_STATE);
+    CHECK(nid.dwState == 0);
+
+    MniResetRecorder(&g_recorder);
+    CHECK(MniSendBalloonNotification(mni, L"title", L"text", MNI_BALLOON_ICON_TYPE_NONE, NULL, MNI_BALLOON_FLAGS_DEFAULT) == MNI_OK);
+    CHECK(_CountNotify(NIM_MODIFY, &nid) == 1);
+    CHECK((nid.uFlags & NIF_INFO) == NIF_INFO);
+    CHECK(wcscmp(nid.szInfoTitle, L"title") == 0);
+    CHECK(wcscmp(nid.szInfo, L"text") == 0);
+
+    // Shell failure is reported and the value is pushed again next time.
+    MniResetRecorder(&g_recorder);
+    g_recorder.fail_notify_icon = MNI_TRUE;
+    CHECK(MniSetTip(mni, L"fourth") == MNI_ERROR_FAILED_TO_CHANGE_TIP);
+    g_recorder.fail_notify_icon = MNI_FALSE;
+    CHECK(MniSetTip(mni, L"fourth") == MNI_OK);
+    CHECK(_CountNotify(NIM_MODIFY, NULL) == 2);
+
+    return 1;
+}
+
+// ========================================================================== //
+
+static int _CheckDispatch(ModernNotifyIcon *mni) {
+    MniResetRecorder(&g_recorder);
+    g_lmb_clicks = 0;
+
+    MniDispatchMessage(mni, MNI_NOTIFYICON_MESSAGE_ID, MAKEWPARAM(12, 34), MAKELPARAM(WM_LBUTTONUP, 0));
+    CHECK(g_lmb_clicks == 1);
+    CHECK(g_lmb_x == 12 && g_lmb_y == 34);
+
+    // Nobody listens to middle button, message is swallowed.
+    MniDispatchMessage(mni, MNI_NOTIFYICON_MESSAGE_ID, MAKEWPARAM(12, 34), MAKELPARAM(WM_MBUTTONUP, 0));
+    CHECK(g_lmb_clicks == 1);
+    CHECK(_CountRecords(MNI_RECORD_NOTIFY_ICON) == 0);
+
+    return 1;
+}
+
+// ========================================================================== //
+
+static int _CheckRelease(ModernNotifyIcon *mni) {
+    MniResetRecorder(&g_recorder);
+    CHECK(MniRelease(mni, MNI_FALSE, MNI_FALSE) == MNI_OK);
+    CHECK(_CountNotify(NIM_DELETE, NULL) == 1);
+    CHECK(_CountRecords(MNI_RECORD_DESTROY_WINDOW) == 1);
+
+    return 1;
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Bench
+
+typedef enum BenchOp {
+    BENCH_OP_SET_TIP,
+    BENCH_OP_SET_ICON,
+    BENCH_OP_UPDATE_SCOPE,
+    BENCH_OP_DISPATCH_CLICK,
+    BENCH_OP_DISPATCH_IGNORED,
+} BenchOp;
+
+static void _RunOp(ModernNotifyIcon *mni, BenchOp op, long i, HICON icon_a, HICON icon_b) {
+    HICON icon = (i & 1) ? icon_b : icon_a;
+    const wchar_t *tip = (i & 1) ? L"odd" : L"even";
+
+    switch (op) {
+        case BENCH_OP_SET_TIP:
+            MniSetTip(mni, tip);
+            break;
+        case BENCH_OP_SET_ICON:
+            MniSetIcon(mni, icon, MNI_FALSE);
+            break;
+        case BENCH_OP_UPDATE_SCOPE:
+            MniBeginUpdate(mni);
+            MniSetTip(mni, tip);
+            MniSetIcon(mni, icon, MNI_FALSE);
+            MniEndUpdate(mni);
+            break;
+        case BENCH_OP_DISPATCH_CLICK:
+            MniDispatchMessage(mni, MNI_NOTIFYICON_MESSAGE_ID, MAKEWPARAM(12, 34), MAKELPARAM(WM_LBUTTONUP, 0));
+            break;
+        case BENCH_OP_DISPATCH_IGNORED:
+            MniDispatchMessage(mni, MNI_NOTIFYICON_MESSAGE_ID, MAKEWPARAM(12, 34), MAKELPARAM(WM_MBUTTONUP, 0));
+            break;
+    }
+}
+
+// ========================================================================== //
+
+static void _Bench(ModernNotifyIcon *mni, const char *name, BenchOp op, long iterations, HICON icon_a, HICON icon_b) {
+    // Warm up, first distinct icons are hashed for the fingerprint.
+    for (long i = 0; i < 16; i += 1) {
+        _RunOp(mni, op, i, icon_a, icon_b);
+    }
+
+    MniResetRecorder(&g_recorder);
+
+    double start = _Now();
+    for (long i = 0; i < iterations; i += 1) {
+        _RunOp(mni, op, i, icon_a, icon_b);
+    }
+    double time = _Now() - start;
+
+    // Records past capacity are dropped, total_count still counts every backend call.
+    printf(
+        "%-20s %8.1f ns/call  %5.2f backend calls/call\n",
+        name,
+        time * 1e9 / (double)iterations,
+        (double)g_recorder.total_count / (double)iterations
+    );
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: mni_recorder_bench [iterations]\n");
+        return 1;
+    }
+
+    HICON icon_a = LoadIconW(NULL, IDI_APPLICATION);
+    HICON icon_b = LoadIconW(NULL, IDI_WARNING);
+
+    MniInitRecorder(&g_recorder, g_records, BENCH_RECORDS);
+
+    MniInfo info = {
+        .icon = icon_a,
+        .tip = L"first",
+        .on_lmb_click = _OnLmbClick,
+    };
+    MniGetRecordingBackend(&g_recorder, &info.backend);
+
+    ModernNotifyIcon mni = { 0 };
+    if (MniInit(&mni, info) != MNI_OK) {
+        printf("MniInit with recording backend failed\n");
+        return 1;
+    }
+
+    if (!_CheckSetters(&mni, icon_a, icon_b) || !_CheckDispatch(&mni)) {
+        return 1;
+    }
+
+    _Bench(&mni, "set tip", BENCH_OP_SET_TIP, iterations, icon_a, icon_b);
+    _Bench(&mni, "set icon", BENCH_OP_SET_ICON, iterations, icon_a, icon_b);
+    _Bench(&mni, "update scope", BENCH_OP_UPDATE_SCOPE, iterations, icon_a, icon_b);
+    _Bench(&mni, "dispatch click", BENCH_OP_DISPATCH_CLICK, iterations, icon_a, icon_b);
+    _Bench(&mni, "dispatch ignored", BENCH_OP_DISPATCH_IGNORED, iterations, icon_a, icon_b);
+
+    if (!_CheckRelease(&mni)) {
+        return 1;
+    }
+
+    printf("recorded shell calls match\n");
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+// Benchmark of UTF-8 tip and balloon conversion, _MniUtf8ToUtf16 against the path it replaced:
+// measuring input with _StringLengthMaxA, converting into stack buffer with MultiByteToWideChar
+// and copying into NOTIFYICONDATAW field. iconv stands in for MultiByteToWideChar.
+//
+// Linux only:
+//   cc -O2 -o mni_utf8_bench tools/mni_utf8_bench.c src/mni_utf8.c
+//   ./mni_utf8_bench [iterations]
+
+#include "../src/mni_utf8.h"
+
+#include <iconv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Sizes of szTip, szInfoTitle and szInfo.
+#define TIP_LENGTH      128
+#define TITLE_LENGTH    64
+#define TEXT_LENGTH     256
+
+typedef struct BenchCase {
+    const char  *name;
+    const char  *text;
+    int         cch;
+} BenchCase;
+
+// ========================================================================== //
+
+#pragma region Baseline
+
+static iconv_t g_iconv;
+
+static int _StringLengthMaxA(const char *str, int max) {
+    int i = 0;
+
+    if (str) {
+        for (i = 0; i < max; i += 1) {
+            if (str[i] == '\0') {
+                break;
+            }
+        }
+    }
+
+    return i;
+}
+
+// ========================================================================== //
+
+static void _StringCopyW(uint16_t *dest, int cch, const uint16_t *src) {
+    int i = 0;
+    for (; i < cch - 1 && src[i]; i += 1) {
+        dest[i] = src[i];
+    }
+    dest[i] = 0;
+}
+
+// ========================================================================== //
+
+// Old _UTF8ToUTF16 followed by copy into the field.
+static void _BaselineConvert(const char *utf8, uint16_t *field, int cch) {
+    uint16_t buffer[TEXT_LENGTH];
+
+    int len = _StringLengthMaxA(utf8, cch * 4);
+
+    char *in = (char *)utf8;
+    size_t in_left = (size_t)len;
+    char *out = (char *)buffer;
+    size_t out_left = (size_t)(cch - 1) * sizeof(uint16_t);
+
+    iconv(g_iconv, NULL, NULL, NULL, NULL);
+    iconv(g_iconv, &in, &in_left, &out, &out_left);
+    buffer[(out - (char *)buffer) / sizeof(uint16_t)] = 0;
+
+    _StringCopyW(field, cch, buffer);
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+#pragma region Bench
+
+static double _Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// ========================================================================== //
+
+static void _Run(const BenchCase *bench, long iterations) {
+    static uint16_t baseline[TEXT_LENGTH];
+    static uint16_t field[TEXT_LENGTH];
+    volatile uint16_t sink = 0;
+
+    _BaselineConvert(bench->text, baseline, bench->cch);
+    int count = _MniUtf8ToUtf16(bench->text, field, bench->cch);
+    if (memcmp(baseline, field, (size_t)(count + 1) * sizeof(uint16_t)) != 0) {
+        printf("%-20s output differs from baseline\n", bench->name);
+    }
+
+    double start = _Now();
+    for (long i = 0; i < iterations; i += 1) {
+        _BaselineConvert(bench->text, baseline, bench->cch);
+        sink ^= baseline[0];
+    }
+    double baseline_time = _Now() - start;
+
+    start = _Now();
+    for (long i = 0; i < iterations; i += 1) {
+        _MniUtf8ToUtf16(bench->text, field, bench->cch);
+        sink ^= field[0];
+    }
+    double time = _Now() - start;
+
+    (void)sink;
+    printf(
+        "%-20s %4d units  baseline %8.1f ns  transcoder %8.1f ns  %5.1fx\n",
+        bench->name,
+        count,
+        baseline_time * 1e9 / (double)iterations,
+        time * 1e9 / (double)iterations,
+        baseline_time / time
+    );
+}
+
+#pragma endregion
+
+// ========================================================================== //
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: mni_utf8_bench [iterations]\n");
+        return 1;
+    }
+
+    g_iconv = iconv_open("UTF-16LE", "UTF-8");
+    if (g_iconv == (iconv_t)-1) {
+        fprintf(stderr, "iconv doesn't support UTF-8 to UTF-16LE\n");
+        return 1;
+    }
+
+    static const BenchCase cases[] = {
+        {
+            .name = "ascii tip",
+            .text = "Sync complete - 1,024 files up to date, last checked at 14:32",
+            .cch = TIP_LENGTH,
+        },
+        {
+            .name = "ascii text cut",
+            .text = "Your download of the latest release has finished and is ready to install. "
+                    "Restart the application to apply the update, unsaved documents are kept "
+                    "and reopened after restart. Release notes are available from the help menu, "
+                    "along with the list of changes and known issues of this version.",
+            .cch = TEXT_LENGTH,
+        },
+        {
+            .name = "latin text",
+            .text = "Die Synchronisierung wurde abgeschlossen. Alle Dateien sind auf dem neuesten "
+                    "Stand, \xc3\xa4nderungen werden automatisch \xc3\xbc" "bertragen. Gr\xc3\xb6\xc3\x9f" "ere "
+                    "Dateien k\xc3\xb6nnen etwas l\xc3\xa4nger dauern.",
+            .cch = TEXT_LENGTH,
+        },
+        {
+            .name = "cjk text",
+            .text = "\xe5\x90\x8c\xe6\xad\xa5\xe5\xb7\xb2\xe5\xae\x8c\xe6\x88\x90\xe3\x80\x82"
+                    "\xe6\x89\x80\xe6\x9c\x89\xe6\x96\x87\xe4\xbb\xb6\xe9\x83\xbd\xe6\x98\xaf"
+                    "\xe6\x9c\x80\xe6\x96\xb0\xe7\x9a\x84\xef\xbc\x8c\xe6\x9b\xb4\xe6\x94\xb9"
+                    "\xe4\xbc\x9a\xe8\x87\xaa\xe5\x8a\xa8\xe4\xb8\x8a\xe4\xbc\xa0\xe3\x80\x82",
+            .cch = TEXT_LENGTH,
+        },
+        {
+            .name = "emoji title cut",
+            .text = "\xf0\x9f\x8e\x89 New messages \xf0\x9f\x93\xa8\xf0\x9f\x93\xa8\xf0\x9f\x93\xa8 "
+                    "from your team \xf0\x9f\x91\x8b\xf0\x9f\x91\x8b\xf0\x9f\x91\x8b and 12 more "
+                    "conversations \xf0\x9f\x92\xac\xf0\x9f\x92\xac",
+            .cch = TITLE_LENGTH,
+        },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i += 1) {
+        _Run(&cases[i], iterations);
+    }
+
+    iconv_close(g_iconv);
+    return 0;
+}